@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <set>
+
+#include "raylib.h"
+
+#include "BeamTracer.h"
+#include "Room.h"
+
+static Vec2<double> rotate(const Vec2<double> &v, double angle) {
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    return Vec2<double>(v.x * c - v.y * s, v.x * s + v.y * c);
+}
+
+// Отражение точки point относительно прямой, проходящей через a и b
+static Vec2<double> mirror(
+    const Vec2<double> &point, const Vec2<double> &a, const Vec2<double> &b
+) {
+    Vec2<double> d = normalize(b - a);
+    Vec2<double> n(-d.y, d.x);
+    return point - n * (2 * dot(point - a, n));
+}
+
+// Расстояние вдоль луча origin + dir * t до прямой, проходящей через a и b
+static double lineDistance(
+    const Vec2<double> &origin, const Vec2<double> &dir, const Vec2<double> &a,
+    const Vec2<double> &b
+) {
+    return cross(a - origin, b - a) / cross(dir, b - a);
+}
+
+void BeamTracer::update(Room *room) {
+    starts.clear();
+    ends.clear();
+    arcs = false;
+    auto add = [&](Wall *wall) {
+        starts.push_back(Vec2<double>(wall->getStart()->getCoord()));
+        ends.push_back(Vec2<double>(wall->getEnd()->getCoord()));
+        arcs = arcs || dynamic_cast<WallLine *>(wall) == nullptr;
+    };
+
+    // Стены нумеруются так же, как в снимке Tracer: сначала стены комнаты,
+    // затем стены препятствий
+    for (Wall *wall : room->getWalls()) {
+        add(wall);
+    }
+    for (Obstacle *obstacle : room->getObstacles()) {
+        for (Wall *wall : obstacle->getWalls()) {
+            add(wall);
+        }
+    }
+}
+
+BeamTracer::Beam BeamTracer::root(const Vec2<double> &source) const {
+    return Beam{source, -1, source, source, 0};
+}
+
+vector<BeamTracer::Piece> BeamTracer::sweep(const Beam &beam) const {
+    const Vec2<double> &v = beam.source;
+    const double fullTurn = 2 * PI;
+
+    // Углы отсчитываются от направления base. Пучок источника --- весь круг,
+    // пучок изображения --- угол, под которым из него видно окно
+    Vec2<double> base(1, 0);
+    double range = fullTurn;
+    Vec2<double> windowA = beam.a;
+    Vec2<double> windowB = beam.b;
+    double side = 0;
+    if (beam.wall >= 0) {
+        if (cross(windowA - v, windowB - v) < 0) {
+            std::swap(windowA, windowB);
+        }
+        base = normalize(windowA - v);
+        range = std::atan2(
+            cross(windowA - v, windowB - v), dot(windowA - v, windowB - v)
+        );
+        // Знак, с которым комната лежит за окном, если смотреть из
+        // изображения
+        side = cross(windowB - windowA, v - windowA) > 0 ? -1 : 1;
+    }
+    auto angleOf = [&](const Vec2<double> &point) {
+        Vec2<double> d = point - v;
+        double angle = std::atan2(cross(base, d), dot(base, d));
+        return angle < 0 ? angle + fullTurn : angle;
+    };
+
+    // Отрезки стен с промежутками углов, под которыми они видны
+    vector<Span> spans;
+    for (int i = 0; i < (int)starts.size(); ++i) {
+        if (i == beam.wall) {
+            continue;
+        }
+        Vec2<double> p = starts[i];
+        Vec2<double> q = ends[i];
+
+        // Стены между изображением и окном свет не достигает, они отсекаются
+        // прямой окна
+        if (beam.wall >= 0) {
+            double fp = cross(windowB - windowA, p - windowA) * side;
+            double fq = cross(windowB - windowA, q - windowA) * side;
+            if (fp <= 0 && fq <= 0) {
+                continue;
+            }
+            if (fp < 0) {
+                p = p + (q - p) * (fp / (fp - fq));
+            } else if (fq < 0) {
+                q = q + (p - q) * (fq / (fq - fp));
+            }
+
+            // Стены, целиком лежащие по одну сторону от края пучка, не
+            // сортируются: в комнате из сотен стен в узкий пучок попадают
+            // лишь немногие из них
+            if ((cross(windowA - v, p - v) < 0 &&
+                 cross(windowA - v, q - v) < 0) ||
+                (cross(windowB - v, p - v) > 0 &&
+                 cross(windowB - v, q - v) > 0)) {
+                continue;
+            }
+        }
+
+        if (cross(p - v, q - v) < 0) {
+            std::swap(p, q);
+        }
+        if (cross(p - v, q - v) <= 0) {
+            continue; // Стена видна с ребра
+        }
+        double start = angleOf(p);
+        double end = angleOf(q);
+        if (end < start) { // Стена пересекает направление base
+            spans.push_back(Span{i, p, q, start, fullTurn});
+            start = 0;
+        }
+        spans.push_back(Span{i, p, q, start, end});
+    }
+    for (Span &span : spans) {
+        span.end = std::min(span.end, range);
+    }
+    spans.erase(
+        std::remove_if(
+            spans.begin(), spans.end(),
+            [](const Span &span) { return span.start >= span.end; }
+        ),
+        spans.end()
+    );
+
+    vector<double> angles = {0, range};
+    for (const Span &span : spans) {
+        angles.push_back(span.start);
+        angles.push_back(span.end);
+    }
+    std::sort(angles.begin(), angles.end());
+    angles.erase(std::unique(angles.begin(), angles.end()), angles.end());
+
+    vector<int> byStart(spans.size());
+    std::iota(byStart.begin(), byStart.end(), 0);
+    vector<int> byEnd = byStart;
+    std::sort(byStart.begin(), byStart.end(), [&](int i, int j) {
+        return spans[i].start < spans[j].start;
+    });
+    std::sort(byEnd.begin(), byEnd.end(), [&](int i, int j) {
+        return spans[i].end < spans[j].end;
+    });
+
+    // Активные отрезки упорядочены по расстоянию вдоль направления dir.
+    // Стены не пересекаются, поэтому порядок отрезков, видимых на всем
+    // промежутке между соседними событиями, не зависит от выбора dir внутри
+    // него, и направление можно менять, не перестраивая множество
+    Vec2<double> dir;
+    auto closer = [&](int i, int j) {
+        double di = lineDistance(v, dir, spans[i].a, spans[i].b);
+        double dj = lineDistance(v, dir, spans[j].a, spans[j].b);
+        return di != dj ? di < dj : i < j;
+    };
+    std::set<int, decltype(closer)> active(closer);
+    vector<std::set<int, decltype(closer)>::iterator> handles(spans.size());
+
+    vector<Piece> pieces;
+    size_t nextStart = 0;
+    size_t nextEnd = 0;
+    for (size_t i = 0; i + 1 < angles.size(); ++i) {
+        double from = angles[i];
+        double to = angles[i + 1];
+        if (from >= range) {
+            break;
+        }
+
+        while (nextEnd < byEnd.size() && spans[byEnd[nextEnd]].end <= from) {
+            active.erase(handles[byEnd[nextEnd++]]);
+        }
+        dir = rotate(base, (from + to) / 2);
+        while (nextStart < byStart.size() &&
+               spans[byStart[nextStart]].start <= from) {
+            int k = byStart[nextStart++];
+            handles[k] = active.insert(k).first;
+        }
+        if (active.empty()) {
+            continue;
+        }
+
+        const Span &span = spans[*active.begin()];
+        Vec2<double> d0 = rotate(base, from);
+        Vec2<double> d1 = rotate(base, to);
+        Vec2<double> p0 = v + d0 * lineDistance(v, d0, span.a, span.b);
+        Vec2<double> p1 = v + d1 * lineDistance(v, d1, span.a, span.b);
+        Vec2<double> w0 = v;
+        Vec2<double> w1 = v;
+        if (beam.wall >= 0) {
+            w0 = v + d0 * lineDistance(v, d0, windowA, windowB);
+            w1 = v + d1 * lineDistance(v, d1, windowA, windowB);
+        }
+
+        // Соседние участки одной стены объединяются в один
+        if (!pieces.empty() && pieces.back().wall == span.wall &&
+            length(pieces.back().end - p0) < 1e-9) {
+            pieces.back().end = p1;
+            pieces.back().windowEnd = w1;
+        } else {
+            pieces.push_back(Piece{span.wall, p0, p1, w0, w1});
+        }
+    }
+    return pieces;
+}
+
+BeamTracer::Beam
+BeamTracer::reflect(const Beam &beam, const Piece &piece) const {
+    return Beam{
+        mirror(beam.source, starts[piece.wall], ends[piece.wall]), piece.wall,
+        piece.start, piece.end, beam.order + 1
+    };
+}
+
+vector<Vec2<double>>
+BeamTracer::region(const Piece &piece, const Beam &beam) const {
+    if (beam.wall < 0) {
+        return {beam.source, piece.start, piece.end};
+    }
+    return {piece.windowStart, piece.start, piece.end, piece.windowEnd};
+}
+
+bool BeamTracer::contains(
+    const Piece &piece, const Beam &beam, const Vec2<double> &point
+) const {
+    // Участок виден из изображения под углом меньше развернутого, поэтому
+    // точка лежит в области, если она между краями пучка, перед стеной и за
+    // окном
+    const Vec2<double> &v = beam.source;
+    if (cross(piece.start - v, point - v) < 0 ||
+        cross(piece.end - v, point - v) > 0) {
+        return false;
+    }
+
+    Vec2<double> wall = piece.end - piece.start;
+    if (cross(wall, point - piece.start) * cross(wall, v - piece.start) < 0) {
+        return false;
+    }
+
+    if (beam.wall < 0) {
+        return true;
+    }
+    Vec2<double> window = piece.windowEnd - piece.windowStart;
+    return cross(window, point - piece.windowStart) *
+               cross(window, v - piece.windowStart) <=
+           0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+#include "Geometry.h"
+
+using std::vector;
+
+class Room;
+
+// Трассировка пучков в комнате из прямых стен. Пучок --- изображение
+// источника в стенах и окно (участок стены), через которое от изображения
+// проходит свет или звук. Участки стен, видимые из изображения в пределах
+// окна, находятся угловым заметанием за O(n log n), и каждый такой участок
+// становится окном пучка следующего порядка. Так строится дерево пучков, в
+// котором каждое изображение заведомо видно через свое окно.
+//
+// Снимок хранит концы стен комнаты и препятствий и, как и Tracer, может
+// использоваться из нескольких потоков одновременно. Дуги заменяются хордами
+class BeamTracer {
+public:
+    struct Beam {
+        Vec2<double> source; // Изображение источника
+        int wall;            // Стена, в которой отражено изображение (-1 у
+                             // самого источника, у него нет окна)
+        Vec2<double> a;      // Концы окна на этой стене
+        Vec2<double> b;
+        int order;           // Число отражений
+    };
+
+    // Участок стены, видимый из изображения источника в пределах пучка
+    struct Piece {
+        int wall;
+        Vec2<double> start;       // Концы участка в порядке обхода против
+        Vec2<double> end;         // часовой стрелки вокруг изображения
+        Vec2<double> windowStart; // Соответствующие точки окна (у пучка
+        Vec2<double> windowEnd;   // без окна --- само изображение)
+    };
+
+    BeamTracer() {}
+
+    BeamTracer(Room *room) { update(room); }
+
+    void update(Room *room); // Обновление снимка стен комнаты
+
+    size_t wallsCount() const { return starts.size(); }
+
+    bool hasArcs() const { return arcs; }
+
+    const Vec2<double> &getStart(int wall) const { return starts[wall]; }
+
+    const Vec2<double> &getEnd(int wall) const { return ends[wall]; }
+
+    Beam root(const Vec2<double> &source) const; // Пучок самого источника
+
+    // Участки стен, видимые в пределах пучка, в порядке обхода
+    vector<Piece> sweep(const Beam &beam) const;
+
+    // Пучок, отраженный от участка piece
+    Beam reflect(const Beam &beam, const Piece &piece) const;
+
+    // Область, освещенная через участок piece: треугольник от изображения
+    // или четырехугольник от окна. Выпуклый многоугольник
+    vector<Vec2<double>> region(const Piece &piece, const Beam &beam) const;
+
+    // Лежит ли точка в области, освещенной через участок piece
+    bool contains(
+        const Piece &piece, const Beam &beam, const Vec2<double> &point
+    ) const;
+
+private:
+    // Отрезок стены, видимый на промежутке углов [start, end] (углы
+    // отсчитываются от начального направления пучка против часовой стрелки)
+    struct Span {
+        int wall;
+        Vec2<double> a;
+        Vec2<double> b;
+        double start;
+        double end;
+    };
+
+    vector<Vec2<double>> starts; // Начала стен
+    vector<Vec2<double>> ends;   // Концы стен
+    bool arcs = false;           // Есть ли в комнате кривые стены
+};
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Caustic.h"
+#include "Tracer.h"
+
+Caustic::Sample Caustic::trace(
+    const Tracer<float> &tracer, const Vec2<float> &origin, int fromWall,
+    const Vec2<float> &normal, float angle
+) {
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    // Поворот нормали на angle - PI / 2 и производная по углу --- тот же
+    // вектор, повернутый еще на прямой угол
+    float c = std::cos(angle - PI / 2);
+    float s = std::sin(angle - PI / 2);
+    Vec2<float> dir(normal.x * c - normal.y * s, normal.x * s + normal.y * c);
+    Tracer<float>::Differential differential;
+    differential.dir = Vec2<float>(-dir.y, dir.x);
+
+    Sample sample;
+    sample.angle = angle;
+    Vec2<float> start = origin;
+    int wall = fromWall;
+    float energy = 1;
+    pathPoints.push_back(start.toVector2());
+
+    Tracer<float>::Hit hit;
+    for (int bounce = 0; bounce <= maximumBounces; ++bounce) {
+        bool found = tracer.trace(start, dir, wall, hit);
+        float length = found ? hit.distance : infinity;
+
+        // Смещение точки start + dir * t при изменении угла
+        // differential.origin + differential.dir * t перпендикулярно лучу
+        // в точке огибающей. У первого отрезка все лучи выходят из одной
+        // точки, и огибающей нет
+        Leg leg = {bounce == 0 ? -1 : wall, dir, start, false, energy};
+        float t =
+            -cross(differential.origin, dir) / cross(differential.dir, dir);
+        if (bounce > 0 && t > 0 && t < length) {
+            leg.focus = start + dir * t;
+            leg.real = true;
+        }
+        sample.legs.push_back(leg);
+
+        if (!found) {
+            Vec2<float> end = start + dir * Tracer<float>::unboundedLength;
+            pathPoints.push_back(end.toVector2());
+            break;
+        }
+        pathPoints.push_back(hit.point.toVector2());
+        if (hit.aim || tracer.isDiffuse(hit.wall)) {
+            break;
+        }
+
+        // Лучи каустики не ветвятся, светоделитель для них --- зеркало, а
+        // после диффузной стены каустики нет
+        differential = tracer.reflectDifferential(hit, dir, differential);
+        energy *= tracer.getReflectance(hit.wall);
+        dir = tracer.reflect(hit, dir);
+        start = hit.point;
+        wall = hit.wall;
+    }
+    pathStarts.push_back(pathPoints.size());
+    return sample;
+}
+
+bool Caustic::needsSplit(const Sample &a, const Sample &b) {
+    // Пока стены совпадают, точки огибающих должны быть ближе tolerance.
+    // Там, где огибающая есть только у одного из лучей или стены
+    // различаются, ищется граница кривой
+    size_t legs = std::max(a.legs.size(), b.legs.size());
+    bool same = true;
+    for (size_t j = 1; j < legs; ++j) {
+        const Leg *legA = j < a.legs.size() ? &a.legs[j] : nullptr;
+        const Leg *legB = j < b.legs.size() ? &b.legs[j] : nullptr;
+        same = same && legA && legB && legA->wall == legB->wall;
+        bool realA = legA && legA->real;
+        bool realB = legB && legB->real;
+        if (same && realA && realB) {
+            if (length(legA->focus - legB->focus) > tolerance) {
+                return true;
+            }
+        } else if (realA || realB) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Caustic::build(
+    const Tracer<float> &tracer, const Vector2 &origin, int fromWall,
+    const Vector2 &normal, float fromAngle, float toAngle
+) {
+    clear();
+    pathStarts.push_back(0);
+
+    vector<Sample> samples;
+    samples.reserve(maximumSamples);
+    for (int i = 0; i < initialSamples; ++i) {
+        float angle =
+            fromAngle + (toAngle - fromAngle) * i / (initialSamples - 1);
+        samples.push_back(trace(tracer, origin, fromWall, normal, angle));
+    }
+
+    // Промежутки делятся в ширину, чтобы при исчерпании лучей сетка
+    // оставалась равномерно сгущенной по всем кривым
+    std::deque<std::pair<int, int>> intervals;
+    for (int i = 0; i + 1 < initialSamples; ++i) {
+        intervals.push_back({i, i + 1});
+    }
+    while (!intervals.empty() && (int)samples.size() < maximumSamples) {
+        int a = intervals.front().first;
+        int b = intervals.front().second;
+        intervals.pop_front();
+        if (std::fabs(samples[b].angle - samples[a].angle) < minimalStep ||
+            !needsSplit(samples[a], samples[b])) {
+            continue;
+        }
+        float angle = (samples[a].angle + samples[b].angle) / 2;
+        samples.push_back(trace(tracer, origin, fromWall, normal, angle));
+        int middle = samples.size() - 1;
+        intervals.push_back({a, middle});
+        intervals.push_back({middle, b});
+    }
+    samplesCount = samples.size();
+
+    // Сетка идет по возрастанию или убыванию угла вместе с fromAngle и
+    // toAngle
+    bool ascending = fromAngle <= toAngle;
+    std::sort(
+        samples.begin(), samples.end(),
+        [ascending](const Sample &a, const Sample &b) {
+            return ascending ? a.angle < b.angle : a.angle > b.angle;
+        }
+    );
+    connect(samples);
+}
+
+void Caustic::connect(const vector<Sample> &samples) {
+    // Смещение точки огибающей вдоль луча, меньше которого оно считается
+    // ошибкой округления
+    const float stall = tolerance * 1e-3f;
+
+    for (int bounces = 1; bounces <= maximumBounces; ++bounces) {
+        size_t j = bounces;
+        Curve curve = {{}, bounces, 0};
+        float previousShift = 0;
+
+        auto finishCurve = [&]() {
+            if (curve.points.size() > 1) {
+                curves.push_back(curve);
+            }
+            curve.points.clear();
+            previousShift = 0;
+        };
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            const Sample &sample = samples[i];
+            if (j >= sample.legs.size() || !sample.legs[j].real) {
+                finishCurve();
+                continue;
+            }
+            const Leg &leg = sample.legs[j];
+
+            if (!curve.points.empty()) {
+                const Sample &previous = samples[i - 1];
+                bool same = true;
+                for (size_t k = 1; k <= j && same; ++k) {
+                    same = previous.legs[k].wall == sample.legs[k].wall;
+                }
+                // Точки, между которыми шаг угла уже наименьший, а
+                // расстояние все еще больше tolerance, лежат по разные
+                // стороны разрыва
+                float gap = std::fabs(sample.angle - previous.angle);
+                Vec2<float> step = leg.focus - previous.legs[j].focus;
+                if (!same ||
+                    (gap < 2 * minimalStep && length(step) > tolerance)) {
+                    finishCurve();
+                } else {
+                    // Точка огибающей движется вдоль луча. В фокусе она
+                    // останавливается и поворачивает обратно
+                    float shift = dot(step, previous.legs[j].dir);
+                    if (std::fabs(shift) > stall) {
+                        if (previousShift * shift < 0) {
+                            foci.push_back({curve.points.back(), bounces});
+                        }
+                        previousShift = shift;
+                    }
+                }
+            }
+            if (curve.points.empty()) {
+                curve.energy = leg.energy;
+            }
+            curve.points.push_back(leg.focus.toVector2());
+        }
+        finishCurve();
+    }
+}
+
+void Caustic::clear() {
+    curves.clear();
+    foci.clear();
+    pathPoints.clear();
+    pathStarts.clear();
+    samplesCount = 0;
+}
+
+bool Caustic::crosses(const vector<Tracer<float>::Box> &boxes) const {
+    for (size_t k = 0; k + 1 < pathStarts.size(); ++k) {
+        for (int i = pathStarts[k]; i + 1 < pathStarts[k + 1]; ++i) {
+            Vec2<float> start(pathPoints[i]);
+            Vec2<float> offset = Vec2<float>(pathPoints[i + 1]) - start;
+            float size = length(offset);
+            if (size > 0 && Tracer<float>::crosses(
+                                start, offset * (1 / size), size, boxes
+                            )) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Caustic::draw() {
+    for (const Curve &curve : curves) {
+        Color color = Fade(RED, 0.3f + 0.7f * curve.energy);
+        for (size_t i = 0; i + 1 < curve.points.size(); ++i) {
+            DrawLineEx(curve.points[i], curve.points[i + 1], 2, color);
+        }
+    }
+    for (const Focus &focus : foci) {
+        DrawCircleV(focus.point, 5, MAROON);
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include "raylib.h"
+
+#include "Geometry.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Каустики семейства лучей, выходящих из одной точки под углами от fromAngle
+// до toAngle. Каждый луч несет производные начала и направления по углу
+// (Tracer::Differential), которые переносятся через отражения. По ним точка
+// огибающей на каждом отрезке пути находится аналитически: отраженные лучи с
+// близкими углами пересекаются в точке, где смещение луча поперек
+// направления равно нулю.
+//
+// Углы выбираются адаптивно: промежуток делится пополам, пока точки
+// огибающей соседних лучей с одинаковой последовательностью стен дальше
+// tolerance друг от друга, или пока не найдена граница, где огибающая
+// обрывается. Поэтому лучей нужно на порядки меньше, чем для оценки
+// плотности. Соседние точки с одинаковой последовательностью стен
+// соединяются в кривые, а фокусы --- точки возврата кривых, в которых точка
+// огибающей меняет направление движения вдоль луча
+class Caustic {
+public:
+    static const int maximumBounces = 4; // Наибольшее число отражений
+    static const int maximumSamples = 4096; // Наибольшее число лучей
+
+    // Кривая каустики после bounces отражений
+    struct Curve {
+        vector<Vector2> points;
+        int bounces;
+        float energy; // Доля энергии лучей, образующих кривую
+    };
+
+    // Фокус --- точка возврата каустики
+    struct Focus {
+        Vector2 point;
+        int bounces;
+    };
+
+private:
+    // Отрезок пути луча между отражениями
+    struct Leg {
+        int wall;          // Стена, от которой отразился луч (-1 у первого)
+        Vec2<float> dir;   // Направление
+        Vec2<float> focus; // Точка огибающей на прямой отрезка
+        bool real;         // Лежит ли точка огибающей на самом отрезке
+        float energy;      // Доля энергии луча на отрезке
+    };
+
+    // Луч семейства
+    struct Sample {
+        float angle;
+        vector<Leg> legs;
+    };
+
+    static const int initialSamples = 129; // Лучи начальной равномерной сетки
+    static constexpr float tolerance = 2;  // Наибольшее расстояние между
+                                           // соседними точками кривой
+    static constexpr float minimalStep = 1e-4f; // Наименьший шаг угла
+
+    vector<Curve> curves;
+    vector<Focus> foci;
+    size_t samplesCount = 0;
+
+    // Пути лучей для проверки, затронуло ли изменение комнаты каустику:
+    // точки пути луча k --- от pathStarts[k] до pathStarts[k + 1]
+    vector<Vector2> pathPoints;
+    vector<int> pathStarts;
+
+    // Трассировка луча семейства под углом angle к стене с нормалью normal
+    Sample trace(
+        const Tracer<float> &tracer, const Vec2<float> &origin, int fromWall,
+        const Vec2<float> &normal, float angle
+    );
+
+    // Нужно ли добавить луч между соседними лучами a и b
+    static bool needsSplit(const Sample &a, const Sample &b);
+
+    // Соединение точек огибающих соседних лучей в кривые и поиск фокусов
+    void connect(const vector<Sample> &samples);
+
+public:
+    // Построение каустик лучей из точки origin на стене fromWall снимка
+    // tracer. Луч под углом angle к стене имеет направление нормали normal,
+    // повернутой на angle - PI / 2, как у веера лучей
+    void build(
+        const Tracer<float> &tracer, const Vector2 &origin, int fromWall,
+        const Vector2 &normal, float fromAngle, float toAngle
+    );
+
+    void clear();
+
+    const vector<Curve> &getCurves() const { return curves; }
+
+    const vector<Focus> &getFoci() const { return foci; }
+
+    size_t getSamplesCount() const { return samplesCount; }
+
+    // Проходит ли путь одного из лучей через прямоугольники boxes
+    bool crosses(const vector<Tracer<float>::Box> &boxes) const;
+
+    void draw();
+};
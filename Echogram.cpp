@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Echogram.h"
+#include "Parallel.h"
+#include "Ray.h"
+#include "Room.h"
+
+const char *Echogram::NoAim::what() const noexcept {
+    return "Для эхограммы нужна цель (приемник)";
+}
+
+const char *Echogram::HasArcs::what() const noexcept {
+    return "Эхограмма строится только для комнат из прямых стен";
+}
+
+// Расстояние от точки до отрезка [a, b]
+static double segmentDistance(
+    const Vec2<double> &point, const Vec2<double> &a, const Vec2<double> &b
+) {
+    Vec2<double> ab = b - a;
+    double t = dot(point - a, ab) / dot(ab, ab);
+    t = std::clamp(t, 0.0, 1.0);
+    return length(point - (a + ab * t));
+}
+
+void Echogram::compute(
+    Room *room, Vector2 source, int orders, double duration, double reflection
+) {
+    if (!room->aim) {
+        throw NoAim();
+    }
+    beams.update(room);
+    if (beams.hasArcs()) {
+        throw HasArcs();
+    }
+
+    Vec2<double> receiver(room->aim->getCenter());
+    double maxLength = duration * speedOfSound / metersPerPixel;
+
+    // Приходы через участки пучка и пучки следующего порядка. Путь через
+    // окно не короче расстояния от изображения до окна, а отражение это
+    // расстояние сохраняет, поэтому дальние окна не продолжаются
+    auto expand = [&](const BeamTracer::Beam &beam,
+                      vector<BeamTracer::Beam> &children,
+                      vector<Arrival> &found) {
+        for (const BeamTracer::Piece &piece : beams.sweep(beam)) {
+            if (beams.contains(piece, beam, receiver)) {
+                double distance = length(receiver - beam.source);
+                if (distance <= maxLength) {
+                    double meters = std::max(distance, 1.0) * metersPerPixel;
+                    found.push_back(Arrival{
+                        meters / speedOfSound,
+                        std::pow(reflection, beam.order) / meters, beam.order,
+                        beam.source
+                    });
+                }
+            }
+            if (beam.order < orders &&
+                length(piece.end - piece.start) > minimalWindow &&
+                segmentDistance(beam.source, piece.start, piece.end) <=
+                    maxLength) {
+                children.push_back(beams.reflect(beam, piece));
+            }
+        }
+    };
+
+    // Первые порядки строятся в ширину, пока пучков не хватит на все потоки
+    int threadsCount = hardwareThreads();
+    size_t frontierSize = 64 * (size_t)threadsCount;
+    vector<BeamTracer::Beam> frontier = {beams.root(Vec2<double>(source))};
+    arrivals.clear();
+    beamsCount = 0;
+    while (!frontier.empty() && frontier.size() < frontierSize) {
+        vector<BeamTracer::Beam> next;
+        for (const BeamTracer::Beam &beam : frontier) {
+            expand(beam, next, arrivals);
+        }
+        beamsCount += frontier.size();
+        frontier.swap(next);
+    }
+
+    // Поддеревья оставшихся пучков обходятся в глубину, каждый поток
+    // собирает приходы отдельно
+    std::atomic<size_t> nextBeam(0);
+    vector<vector<Arrival>> found(threadsCount);
+    vector<long> counts(threadsCount, 0);
+    vector<std::thread> threads;
+    for (int k = 0; k < threadsCount; ++k) {
+        threads.emplace_back([&, k]() {
+            vector<BeamTracer::Beam> stack;
+            for (size_t i = nextBeam++; i < frontier.size(); i = nextBeam++) {
+                stack.push_back(frontier[i]);
+                while (!stack.empty()) {
+                    BeamTracer::Beam beam = stack.back();
+                    stack.pop_back();
+                    expand(beam, stack, found[k]);
+                    ++counts[k];
+                }
+            }
+        });
+    }
+    for (int k = 0; k < threadsCount; ++k) {
+        threads[k].join();
+        arrivals.insert(arrivals.end(), found[k].begin(), found[k].end());
+        beamsCount += counts[k];
+    }
+
+    // Приемник на границе соседних участков попадает в оба, и путь от
+    // одного изображения учитывается дважды. Разные пути одной длины в
+    // симметричных комнатах при этом сохраняются
+    std::sort(
+        arrivals.begin(), arrivals.end(),
+        [](const Arrival &a, const Arrival &b) {
+            if (a.time != b.time) {
+                return a.time < b.time;
+            }
+            if (a.order != b.order) {
+                return a.order < b.order;
+            }
+            return a.image.x != b.image.x ? a.image.x < b.image.x
+                                          : a.image.y < b.image.y;
+        }
+    );
+    arrivals.erase(
+        std::unique(
+            arrivals.begin(), arrivals.end(),
+            [](const Arrival &a, const Arrival &b) {
+                return a.order == b.order &&
+                       length(a.image - b.image) <= 1e-6;
+            }
+        ),
+        arrivals.end()
+    );
+}
+
+void Echogram::exportCsv(const char *path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Не удалось сохранить эхограмму");
+    }
+    file << "time_s,amplitude,order\n";
+    file.precision(9);
+    for (const Arrival &arrival : arrivals) {
+        file << arrival.time << ',' << arrival.amplitude << ','
+             << arrival.order << '\n';
+    }
+    if (file.fail()) {
+        throw std::runtime_error("Не удалось сохранить эхограмму");
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "raylib.h"
+
+#include "BeamTracer.h"
+#include "Room.h"
+
+using std::vector;
+
+// Эхограмма методом мнимых источников. Комната рассматривается как план
+// помещения, стены --- как звукоотражающие перегородки. Изображения источника
+// в стенах перебираются по дереву пучков (BeamTracer), поэтому изображение
+// учитывается, только если его видно через освещенный участок стены, а
+// ветви без видимых стен отсекаются сразу. Для каждого пути от источника до
+// центра цели запоминаются время прихода и амплитуда.
+//
+// Дерево строится в ширину, пока число пучков не станет достаточным для
+// распределения по потокам, затем потоки по очереди берут пучки и обходят их
+// поддеревья в глубину. Пучки, окна которых дальше, чем звук проходит за
+// заданное время, не продолжаются
+class Echogram {
+public:
+    // Приход звука по одному пути
+    struct Arrival {
+        double time;        // Время прихода, с
+        double amplitude;   // Амплитуда относительно источника в 1 м от него
+        int order;          // Число отражений
+        Vec2<double> image; // Изображение источника, от которого идет путь
+    };
+
+    class NoAim: public std::exception { // Исключение, выбрасывается,
+                                         // если в комнате нет цели
+    public:
+        const char *what() const noexcept;
+    };
+
+    class HasArcs: public std::exception { // Исключение, выбрасывается,
+                                           // если в комнате есть дуги
+    public:
+        const char *what() const noexcept;
+    };
+
+    static constexpr double speedOfSound = 343;    // Скорость звука, м/с
+    static constexpr double metersPerPixel = 0.01; // Масштаб плана
+
+private:
+    // Окна короче этой длины не порождают пучков следующего порядка
+    static constexpr double minimalWindow = 1e-6;
+
+    BeamTracer beams;         // Снимок стен комнаты
+    vector<Arrival> arrivals; // Приходы в порядке времени
+    long beamsCount = 0;      // Число рассмотренных пучков
+
+public:
+    Echogram() {}
+
+    // Рассчитать эхограмму для источника source и приемника в центре цели.
+    // Учитываются пути не более чем из orders отражений, приходящие не позже
+    // duration секунд. Амплитуда убывает обратно пропорционально длине пути
+    // и умножается на reflection при каждом отражении
+    void compute(
+        Room *room, Vector2 source, int orders = 20, double duration = 0.5,
+        double reflection = 0.9
+    );
+
+    const vector<Arrival> &getArrivals() { return arrivals; }
+
+    long getBeams() { return beamsCount; }
+
+    void exportCsv(const char *path); // Сохранение эхограммы в CSV
+};
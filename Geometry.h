@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+
+// Двумерный вектор с произвольным скалярным типом. Интерактивная трассировка
+// использует float, длительные расчеты --- double или long double
+template <typename T> struct Vec2 {
+    T x;
+    T y;
+
+    Vec2(): x(0), y(0) {}
+
+    Vec2(T x, T y): x(x), y(y) {}
+
+    Vec2(const Vector2 &v): x(v.x), y(v.y) {}
+
+    Vector2 toVector2() const { return Vector2{(float)x, (float)y}; }
+
+    Vec2 operator+(const Vec2 &v) const { return Vec2(x + v.x, y + v.y); }
+
+    Vec2 operator-(const Vec2 &v) const { return Vec2(x - v.x, y - v.y); }
+
+    Vec2 operator*(T s) const { return Vec2(x * s, y * s); }
+
+    Vec2 operator-() const { return Vec2(-x, -y); }
+};
+
+template <typename T> T dot(const Vec2<T> &a, const Vec2<T> &b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+template <typename T> T cross(const Vec2<T> &a, const Vec2<T> &b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+template <typename T> T length(const Vec2<T> &v) {
+    return std::sqrt(dot(v, v));
+}
+
+template <typename T> Vec2<T> normalize(const Vec2<T> &v) {
+    T len = length(v);
+    return len > 0 ? v * (1 / len) : v;
+}
+
+// Расстояние вдоль луча origin + dir * t (dir единичный) до отрезка [a, b].
+// Если пересечения при t > 0 нет, возвращает бесконечность
+template <typename T>
+T lineIntersection(
+    const Vec2<T> &origin, const Vec2<T> &dir, const Vec2<T> &a,
+    const Vec2<T> &b
+) {
+    Vec2<T> wallVec = b - a;
+    T denominator = cross(dir, wallVec);
+
+    if (std::fabs(denominator) <=
+        std::numeric_limits<T>::epsilon() * length(wallVec)) {
+        return std::numeric_limits<T>::infinity();
+    }
+
+    Vec2<T> w = a - origin;
+    T t = cross(w, wallVec) / denominator;
+    T u = cross(w, dir) / denominator;
+
+    if (t > 0 && u >= 0 && u <= 1) {
+        return t;
+    }
+
+    return std::numeric_limits<T>::infinity();
+}
+
+// Корни пересечения луча origin + dir * t (dir единичный) с окружностью в
+// порядке возрастания. Возвращает false, если пересечения нет
+template <typename T>
+bool circleIntersection(
+    const Vec2<T> &origin, const Vec2<T> &dir, const Vec2<T> &center, T radius,
+    T &t1, T &t2
+) {
+    Vec2<T> f = origin - center;
+
+    T b = dot(f, dir);
+    T c = dot(f, f) - radius * radius;
+    T D = b * b - c;
+
+    if (D < 0) {
+        return false;
+    }
+
+    D = std::sqrt(D);
+    t1 = -b - D;
+    t2 = -b + D;
+    return true;
+}
+
+// Покомпонентно обратный вектор направления для boxDistance. Нулевые
+// компоненты (в том числе -0) заменяются положительной бесконечностью
+template <typename T> Vec2<T> inverseDirection(const Vec2<T> &dir) {
+    const T infinity = std::numeric_limits<T>::infinity();
+    return Vec2<T>(
+        dir.x == 0 ? infinity : 1 / dir.x, dir.y == 0 ? infinity : 1 / dir.y
+    );
+}
+
+// Расстояние вдоль луча origin + dir * t до входа в прямоугольник
+// [low, high] (0, если начало луча внутри него) по обратному вектору
+// направления inverse. Если луч не входит в прямоугольник при
+// t <= maxDistance, возвращает бесконечность
+template <typename T>
+T boxDistance(
+    const Vec2<T> &origin, const Vec2<T> &inverse, const Vec2<T> &low,
+    const Vec2<T> &high, T maxDistance
+) {
+    T enter = 0;
+    T leave = maxDistance;
+    for (int k = 0; k < 2; ++k) {
+        T o = k == 0 ? origin.x : origin.y;
+        T d = k == 0 ? inverse.x : inverse.y;
+        T t1 = ((k == 0 ? low.x : low.y) - o) * d;
+        T t2 = ((k == 0 ? high.x : high.y) - o) * d;
+        if (t1 > t2) {
+            std::swap(t1, t2);
+        }
+        // Луч вдоль оси, начинающийся на стороне прямоугольника, дает
+        // неопределенность 0 * бесконечность, которая промежуток не сужает
+        if (t1 > enter) {
+            enter = t1;
+        }
+        if (t2 < leave) {
+            leave = t2;
+        }
+    }
+    return enter <= leave ? enter : std::numeric_limits<T>::infinity();
+}
+
+// Отражение направления dir относительно нормали normal
+template <typename T>
+Vec2<T> reflect(const Vec2<T> &dir, const Vec2<T> &normal) {
+    return normalize(dir - normal * (2 * dot(dir, normal)));
+}
+
+// Лежит ли направление diff (смещение точки от центра дуги) внутри дуги с
+// серединой в направлении middle (единичный вектор) и косинусом половины
+// угловой длины cosHalfSpan. Проверка не требует тригонометрии и корней
+template <typename T>
+bool arcContains(const Vec2<T> &diff, const Vec2<T> &middle, T cosHalfSpan) {
+    T projection = dot(diff, middle);
+    T threshold = cosHalfSpan * cosHalfSpan * dot(diff, diff);
+
+    if (cosHalfSpan >= 0) {
+        return projection >= 0 && projection * projection >= threshold;
+    }
+    return projection >= 0 || projection * projection <= threshold;
+}
+
+// Параметр t в диапазоне [0, 1] для направления diff внутри дуги с серединой
+// middle и угловой длиной span в радианах
+template <typename T>
+T arcParameter(const Vec2<T> &diff, const Vec2<T> &middle, T span) {
+    T angle = std::atan2(cross(middle, diff), dot(middle, diff));
+    T t = T(0.5) + angle / span;
+    return std::fmax(T(0), std::fmin(T(1), t));
+}
+
+// Пересекаются ли отрезки [a, b] и [c, d] во внутренних точках
+template <typename T>
+bool segmentsCross(
+    const Vec2<T> &a, const Vec2<T> &b, const Vec2<T> &c, const Vec2<T> &d
+) {
+    T d1 = cross(b - a, c - a);
+    T d2 = cross(b - a, d - a);
+    T d3 = cross(d - c, a - c);
+    T d4 = cross(d - c, b - c);
+    return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+           ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+// Лежит ли точка p внутри или на границе треугольника abc, перечисленного
+// против часовой стрелки
+template <typename T>
+bool isInTriangle(
+    const Vec2<T> &p, const Vec2<T> &a, const Vec2<T> &b, const Vec2<T> &c
+) {
+    return cross(b - a, p - a) >= 0 && cross(c - b, p - b) >= 0 &&
+           cross(a - c, p - c) >= 0;
+}
+
+// Корни пересечения луча origin + dir * t (dir единичный) с эллипсом с
+// центром center, полуосью a вдоль единичного вектора axis и полуосью b
+// поперек него, в порядке возрастания. В системе координат, где эллипс
+// становится единичной окружностью, уравнение остается квадратным
+template <typename T>
+bool ellipseIntersection(
+    const Vec2<T> &origin, const Vec2<T> &dir, const Vec2<T> &center,
+    const Vec2<T> &axis, T a, T b, T &t1, T &t2
+) {
+    Vec2<T> f = origin - center;
+    Vec2<T> perp(-axis.y, axis.x);
+    Vec2<T> o(dot(f, axis) / a, dot(f, perp) / b);
+    Vec2<T> d(dot(dir, axis) / a, dot(dir, perp) / b);
+
+    T A = dot(d, d);
+    T B = dot(o, d);
+    T C = dot(o, o) - 1;
+    T D = B * B - A * C;
+
+    if (D < 0) {
+        return false;
+    }
+
+    D = std::sqrt(D);
+    t1 = (-B - D) / A;
+    t2 = (-B + D) / A;
+    return true;
+}
+
+// Точка кривой Безье степени degree (2 или 3) с контрольными точками p
+template <typename T>
+Vec2<T> bezierPoint(const Vec2<T> *p, int degree, T t) {
+    T s = 1 - t;
+    if (degree == 2) {
+        return p[0] * (s * s) + p[1] * (2 * s * t) + p[2] * (t * t);
+    }
+    return p[0] * (s * s * s) + p[1] * (3 * s * s * t) +
+           p[2] * (3 * s * t * t) + p[3] * (t * t * t);
+}
+
+// Производная кривой Безье по параметру
+template <typename T>
+Vec2<T> bezierTangent(const Vec2<T> *p, int degree, T t) {
+    T s = 1 - t;
+    if (degree == 2) {
+        return (p[1] - p[0]) * (2 * s) + (p[2] - p[1]) * (2 * t);
+    }
+    return (p[1] - p[0]) * (3 * s * s) + (p[2] - p[1]) * (6 * s * t) +
+           (p[3] - p[2]) * (3 * t * t);
+}
+
+// Вторая производная кривой Безье по параметру
+template <typename T>
+Vec2<T> bezierSecond(const Vec2<T> *p, int degree, T t) {
+    if (degree == 2) {
+        return (p[2] - p[1] * 2 + p[0]) * 2;
+    }
+    return (p[2] - p[1] * 2 + p[0]) * (6 * (1 - t)) +
+           (p[3] - p[2] * 2 + p[1]) * (6 * t);
+}
+
+// Контрольные точки q части кривой при параметре от t0 до t1: кривая
+// делится алгоритмом де Кастельжо в t1, и левая часть --- в t0 / t1
+template <typename T>
+void bezierPart(const Vec2<T> *p, int degree, T t0, T t1, Vec2<T> *q) {
+    Vec2<T> r[4];
+    for (int i = 0; i <= degree; ++i) {
+        r[i] = p[i];
+    }
+    for (int k = 1; k <= degree; ++k) {
+        for (int i = degree; i >= k; --i) {
+            r[i] = r[i - 1] + (r[i] - r[i - 1]) * t1;
+        }
+    }
+    T u = t1 > 0 ? t0 / t1 : 0;
+    for (int k = 1; k <= degree; ++k) {
+        for (int i = 0; i <= degree - k; ++i) {
+            r[i] = r[i] + (r[i + 1] - r[i]) * u;
+        }
+    }
+    for (int i = 0; i <= degree; ++i) {
+        q[i] = r[i];
+    }
+}
+
+// Ближайшее пересечение луча origin + dir * s (dir единичный) с кривой Безье
+// дальше minDistance, для которого accept(t, point) возвращает true, методом
+// отсечения Безье. Расстояния контрольных точек части кривой до прямой луча
+// образуют явную кривую Безье, и ее выпуклая оболочка сужает промежуток
+// параметра, на котором может лежать корень. Если промежуток сужается
+// меньше чем на 20%, часть делится пополам. Узкий промежуток уточняется
+// методом Ньютона. Части, лежащие целиком по одну сторону от прямой, позади
+// начала луча или дальше найденного пересечения, отбрасываются сразу.
+// Возвращает бесконечность, если пересечения нет
+template <typename T, typename Accept>
+T bezierClip(
+    const Vec2<T> *p, int degree, const Vec2<T> &origin, const Vec2<T> &dir,
+    T minDistance, Accept accept, T &parameter
+) {
+    const T infinity = std::numeric_limits<T>::infinity();
+    const T tolerance = std::sqrt(std::numeric_limits<T>::epsilon());
+    const int maximumParts = 32; // Глубина стека частей
+    const int maximumSteps = 256;
+    const int maximumNewton = 8;
+
+    struct Part {
+        T t0;
+        T t1;
+    };
+    Part stack[maximumParts];
+    int top = 0;
+    stack[top++] = Part{0, 1};
+
+    T best = infinity;
+    for (int step = 0; top > 0 && step < maximumSteps; ++step) {
+        Part part = stack[--top];
+        Vec2<T> q[4];
+        if (part.t0 == 0 && part.t1 == 1) {
+            for (int i = 0; i <= degree; ++i) {
+                q[i] = p[i];
+            }
+        } else {
+            bezierPart(p, degree, part.t0, part.t1, q);
+        }
+
+        T d[4];
+        T nearest = infinity;
+        T farthest = -infinity;
+        bool below = false;
+        bool above = false;
+        int changes = 0; // Число смен знака расстояний
+        for (int i = 0; i <= degree; ++i) {
+            Vec2<T> w = q[i] - origin;
+            d[i] = cross(dir, w);
+            changes += i > 0 && (d[i] < 0) != (d[i - 1] < 0);
+            below = below || d[i] <= 0;
+            above = above || d[i] >= 0;
+            T s = dot(w, dir);
+            nearest = std::min(nearest, s);
+            farthest = std::max(farthest, s);
+        }
+        if (!below || !above || farthest <= minDistance || nearest >= best) {
+            continue;
+        }
+
+        // Пересечение выпуклой оболочки точек (i / degree, d[i]) с осью ---
+        // промежуток между крайними пересечениями ребер между парами точек
+        T low = 1;
+        T high = 0;
+        for (int i = 0; i <= degree; ++i) {
+            if (d[i] == 0) {
+                low = std::min(low, T(i) / degree);
+                high = std::max(high, T(i) / degree);
+            }
+            for (int j = i + 1; j <= degree; ++j) {
+                if ((d[i] < 0) != (d[j] < 0) && d[i] != d[j]) {
+                    T x = (i + (j - i) * d[i] / (d[i] - d[j])) / degree;
+                    low = std::min(low, x);
+                    high = std::max(high, x);
+                }
+            }
+        }
+        if (low > high) {
+            continue;
+        }
+
+        // Промежуток немного расширяется, чтобы корень у его края не терялся
+        // из-за ошибки округления расстояний
+        low = std::max(T(0), low - T(1e-3));
+        high = std::min(T(1), high + T(1e-3));
+
+        T width = part.t1 - part.t0;
+        T a = part.t0 + width * low;
+        T b = part.t0 + width * high;
+
+        // Если расстояния контрольных точек меняют знак один раз, корень на
+        // промежутке единственный, и он уточняется методом Ньютона по
+        // расстоянию точки кривой до прямой луча. Если итерации выходят из
+        // промежутка, отсечение продолжается. Узкий промежуток уточняется
+        // в любом случае
+        bool converged = b - a <= tolerance;
+        if (converged || changes == 1) {
+            T t = (a + b) / 2;
+            for (int k = 0; k < maximumNewton; ++k) {
+                T f = cross(dir, bezierPoint(p, degree, t) - origin);
+                T df = cross(dir, bezierTangent(p, degree, t));
+                if (df == 0) {
+                    break;
+                }
+                T next = t - f / df;
+                if (!converged && (next < a || next > b)) {
+                    break;
+                }
+                next = std::max(T(0), std::min(T(1), next));
+                bool done = std::abs(next - t) <= tolerance;
+                t = next;
+                if (done) {
+                    converged = true;
+                    break;
+                }
+            }
+            if (converged) {
+                Vec2<T> point = bezierPoint(p, degree, t);
+                T s = dot(point - origin, dir);
+                if (s > minDistance && s < best && accept(t, point)) {
+                    best = s;
+                    parameter = t;
+                }
+                continue;
+            }
+        }
+
+        if (top + 2 > maximumParts) {
+            continue;
+        }
+        if (high - low > T(0.8)) {
+            T middle = (a + b) / 2;
+            stack[top++] = Part{middle, b};
+            stack[top++] = Part{a, middle};
+        } else {
+            stack[top++] = Part{a, b};
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "raylib.h"
+
+#include "Heatmap.h"
+#include "Parallel.h"
+#include "Ray.h"
+#include "Room.h"
+#include "Sampling.h"
+#include "Tracer.h"
+
+const char *Heatmap::NoRayStart::what() const noexcept {
+    return "Для расчета карты освещенности нужен луч";
+}
+
+static Vec2<double> rotate(const Vec2<double> &v, double angle) {
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    return Vec2<double>(v.x * c - v.y * s, v.x * s + v.y * c);
+}
+
+Heatmap::Heatmap(int width, int height) {
+    Heatmap::width = width;
+    Heatmap::height = height;
+    bounds = Rectangle{0, 0, 0, 0};
+
+    // Логарифмическая шкала, чтобы были видны и слабо освещенные области.
+    // Цвета берутся из таблицы, чтобы не считать логарифм для каждой ячейки
+    const float contrast = 1000.0f;
+    palette.resize(1 << 16);
+    for (size_t i = 0; i < palette.size(); ++i) {
+        float v = std::log1p(contrast * i / (palette.size() - 1)) /
+                  std::log1p(contrast);
+        palette[i] = Color{
+            (unsigned char)(255 * std::min(1.0f, 2 * v)),
+            (unsigned char)(255 * std::max(0.0f, 2 * v - 1)), 0,
+            (unsigned char)(200 * v)
+        };
+    }
+}
+
+void Heatmap::start(Room *room, long bounces, bool fan, int depth) {
+    if (!room->rayStart) {
+        throw NoRayStart();
+    }
+
+    clear();
+    Heatmap::room = room;
+    Heatmap::fan = fan;
+    Heatmap::depth = depth;
+    targetBounces = bounces;
+    restart();
+}
+
+void Heatmap::restart() {
+    roomVersion = room->getVersion();
+
+    // Сетка покрывает габаритный прямоугольник стен
+    Vector2 low = room->getWalls()[0]->getStart()->getCoord();
+    Vector2 high = low;
+    for (Wall *wall : room->getWalls()) {
+        for (int i = 0; i <= 32; ++i) {
+            Vector2 point = wall->getPointByT(i / 32.0f);
+            low = Vector2{std::min(low.x, point.x), std::min(low.y, point.y)};
+            high =
+                Vector2{std::max(high.x, point.x), std::max(high.y, point.y)};
+        }
+    }
+    bounds = Rectangle{
+        low.x - 1, low.y - 1, high.x - low.x + 2, high.y - low.y + 2
+    };
+
+    tracer.update(room);
+    RayStart *rayStart = room->rayStart;
+    rayOrigin = Vec2<double>(rayStart->getStart());
+    rayNormal = Vec2<double>(rayStart->getDirection(PI / 2));
+    rayWall = tracer.indexOf(rayStart->getWall());
+    rayAngle = rayStart->getAngle();
+
+    origin = rayOrigin;
+    dir = rotate(rayNormal, rayAngle - PI / 2);
+    fromWall = rayWall;
+    energy = 1;
+
+    nextRay = 0;
+    totalBounces = 0;
+    finished = false;
+
+    // Одна траектория последовательна по своей природе, поэтому без веера
+    // расчет идет в одном потоке
+    int threadsCount = fan ? hardwareThreads() : 1;
+    grids.resize(threadsCount);
+    for (vector<float> &grid : grids) {
+        grid.assign((size_t)width * height, 0.0f);
+    }
+    density.assign((size_t)width * height, 0.0f);
+    refreshRow = 0;
+    displayMax = 0;
+    passMax = 0;
+    refresh();
+}
+
+void Heatmap::step(double budget) {
+    if (!room) {
+        return;
+    }
+
+    if (room->getVersion() != roomVersion) {
+        if (!room->rayStart) {
+            clear();
+            return;
+        }
+        restart();
+    }
+
+    if (finished) {
+        return;
+    }
+
+    // Обновление полосы изображения входит в бюджет порции
+    double deadline = now() + budget;
+    int rows = std::min(refreshRows, height - refreshRow);
+    mergeRows(refreshRow, rows);
+    updatePixels(refreshRow, rows);
+    refreshRow += rows;
+    if (refreshRow >= height) {
+        refreshRow = 0;
+        displayMax = passMax;
+        passMax = 0;
+    }
+
+    totalBounces += fan ? traceFan(deadline) : traceTrajectory(deadline);
+    finished = finished || totalBounces >= targetBounces;
+    if (finished) {
+        refresh();
+    }
+}
+
+void Heatmap::compute(Room *room, long bounces, bool fan, int depth) {
+    start(room, bounces, fan, depth);
+    while (!finished) {
+        step(std::numeric_limits<double>::infinity());
+    }
+}
+
+long Heatmap::traceFan(double deadline) {
+    long rays = std::max(1L, targetBounces / depth);
+    vector<long> counts(grids.size(), 0);
+
+    // Потоки берут лучи по очереди, пока не истечет время порции. Начатый
+    // луч прослеживается до конца. Углы берутся из последовательности ван дер
+    // Корпута, поэтому уже первые порции равномерно покрывают весь веер.
+    // Лучи независимы и идут одним проходом
+    nextRay = runPasses(nextRay, rays, rays, deadline, [&](long i, int k) {
+        Vec2<double> o = rayOrigin;
+        Vec2<double> d = rotate(rayNormal, PI * radicalInverse(i + 1) - PI / 2);
+        int from = rayWall;
+        double e = 1;
+        Tracer<double>::Hit hit;
+        long count = 0;
+
+        for (int step = 0; step < depth; ++step) {
+            if (!tracer.trace(o, d, from, hit)) {
+                break;
+            }
+            accumulate(grids[k], o, hit.point, e);
+            ++count;
+            if (hit.aim) {
+                break;
+            }
+            // Случайные решения на светоделителе, диффузной стене и в
+            // рулетке зависят только от номеров луча и отражения, поэтому
+            // карта не зависит от числа потоков
+            uint32_t h = hashBits(hashBits((uint32_t)i) + step);
+            if (!tracer.scatter(
+                    hit, d, toUnit(h), toUnit(hashBits(h + 1)), e
+                ) ||
+                !russianRoulette(e, rouletteThreshold, toUnit(hashBits(h)))) {
+                break;
+            }
+            o = hit.point;
+            from = hit.wall;
+        }
+        counts[k] += count;
+    });
+
+    long total = 0;
+    for (long count : counts) {
+        total += count;
+    }
+    finished = nextRay >= rays;
+    return total;
+}
+
+long Heatmap::traceTrajectory(double deadline) {
+    long count = 0;
+    Tracer<double>::Hit hit;
+
+    while (totalBounces + count < targetBounces) {
+        if (count % 256 == 0 && now() >= deadline) {
+            break;
+        }
+        if (!tracer.trace(origin, dir, fromWall, hit)) {
+            finished = true;
+            break;
+        }
+        accumulate(grids[0], origin, hit.point, energy);
+        ++count;
+        if (hit.aim) {
+            finished = true;
+            break;
+        }
+        uint32_t h = hashBits((uint32_t)(totalBounces + count));
+        if (!tracer.scatter(
+                hit, dir, toUnit(h), toUnit(hashBits(h)), energy
+            ) ||
+            energy < minimalEnergy) {
+            finished = true;
+            break;
+        }
+        origin = hit.point;
+        fromWall = hit.wall;
+    }
+
+    return count;
+}
+
+float Heatmap::getProgress() {
+    if (finished) {
+        return 1;
+    }
+    if (fan) {
+        return (float)nextRay / std::max(1L, targetBounces / depth);
+    }
+    return (float)totalBounces / targetBounces;
+}
+
+void Heatmap::mergeRows(int first, int count) {
+    size_t begin = (size_t)first * width;
+    size_t end = (size_t)(first + count) * width;
+    for (size_t i = begin; i < end; ++i) {
+        float sum = 0;
+        for (const vector<float> &grid : grids) {
+            sum += grid[i];
+        }
+        density[i] = sum;
+        passMax = std::max(passMax, sum);
+    }
+}
+
+void Heatmap::refresh() {
+    passMax = 0;
+    mergeRows(0, height);
+    displayMax = passMax;
+    passMax = 0;
+    refreshRow = 0;
+    updatePixels(0, height);
+}
+
+void Heatmap::accumulate(
+    vector<float> &grid, const Vec2<double> &a, const Vec2<double> &b,
+    double weight
+) const {
+    double scaleX = width / bounds.width;
+    double scaleY = height / bounds.height;
+    double ax = (a.x - bounds.x) * scaleX;
+    double ay = (a.y - bounds.y) * scaleY;
+    double bx = (b.x - bounds.x) * scaleX;
+    double by = (b.y - bounds.y) * scaleY;
+
+    // Отрезок обходится по столбцам вдоль оси, по которой он длиннее. Так как
+    // наклон по второй оси не больше единицы, в каждом столбце он проходит
+    // не более чем через две ячейки
+    bool isHorizontal = std::fabs(bx - ax) >= std::fabs(by - ay);
+    double p0 = isHorizontal ? ax : ay;
+    double q0 = isHorizontal ? ay : ax;
+    double p1 = isHorizontal ? bx : by;
+    double q1 = isHorizontal ? by : bx;
+    if (p1 < p0) {
+        std::swap(p0, p1);
+        std::swap(q0, q1);
+    }
+    if (p1 == p0) {
+        return;
+    }
+
+    int columns = isHorizontal ? width : height;
+    int rows = isHorizontal ? height : width;
+
+    size_t columnStride = isHorizontal ? 1 : width;
+    size_t rowStride = isHorizontal ? width : 1;
+
+    double slope = (q1 - q0) / (p1 - p0);
+    double inverseSlope = slope != 0 ? 1 / slope : 0;
+    double lengthPerColumn = weight * length(b - a) / (p1 - p0);
+
+    int first = std::clamp((int)std::floor(p0), 0, columns - 1);
+    int last = std::clamp((int)std::floor(p1), 0, columns - 1);
+    double qStart = q0;
+    double pStart = p0;
+    for (int column = first; column <= last; ++column) {
+        double pEnd = column == last ? p1 : column + 1;
+        double qEnd = q0 + (pEnd - p0) * slope;
+        int rowStart = std::clamp((int)qStart, 0, rows - 1);
+        int rowEnd = std::clamp((int)qEnd, 0, rows - 1);
+        float *cell = &grid[column * columnStride];
+
+        if (rowStart == rowEnd) {
+            cell[rowStart * rowStride] += (pEnd - pStart) * lengthPerColumn;
+        } else {
+            // Отрезок пересекает границу строк внутри столбца
+            double pBorder =
+                p0 + (std::max(rowStart, rowEnd) - q0) * inverseSlope;
+            pBorder = std::clamp(pBorder, pStart, pEnd);
+            cell[rowStart * rowStride] +=
+                (pBorder - pStart) * lengthPerColumn;
+            cell[rowEnd * rowStride] += (pEnd - pBorder) * lengthPerColumn;
+        }
+
+        pStart = pEnd;
+        qStart = qEnd;
+    }
+}
+
+void Heatmap::updatePixels(int first, int count) {
+    // До конца первого прохода нормировка идет по уже пройденным строкам
+    float maxValue = std::max(displayMax, passMax);
+    float scale = maxValue > 0 ? (palette.size() - 1) / maxValue : 0;
+
+    pixels.resize(density.size());
+    size_t begin = (size_t)first * width;
+    size_t end = (size_t)(first + count) * width;
+    for (size_t i = begin; i < end; ++i) {
+        pixels[i] = palette[std::min(
+            (size_t)(density[i] * scale), palette.size() - 1
+        )];
+    }
+
+    if (!hasTexture) {
+        Image image = {
+            pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+        };
+        texture = LoadTextureFromImage(image);
+        hasTexture = true;
+    } else if (count > 0) {
+        UpdateTextureRec(
+            texture, Rectangle{0, (float)first, (float)width, (float)count},
+            &pixels[begin]
+        );
+    }
+}
+
+void Heatmap::clear() {
+    room = nullptr;
+    totalBounces = 0;
+    finished = false;
+    density.clear();
+    grids.clear();
+    pixels.clear();
+    if (hasTexture) {
+        UnloadTexture(texture);
+        hasTexture = false;
+    }
+}
+
+void Heatmap::draw() {
+    if (!hasTexture) {
+        return;
+    }
+    DrawTexturePro(
+        texture, Rectangle{0, 0, (float)width, (float)height}, bounds,
+        Vector2{0, 0}, 0, WHITE
+    );
+}
+
+void Heatmap::exportImage(const char *path) {
+    if (!isReady()) {
+        throw std::runtime_error("Карта освещенности не рассчитана");
+    }
+    refresh();
+
+    Image image = {
+        pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    if (!ExportImage(image, path)) {
+        throw std::runtime_error("Не удалось сохранить карту освещенности");
+    }
+}
+
+Heatmap::~Heatmap() {
+    clear();
+}
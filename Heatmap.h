@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+
+#include "raylib.h"
+
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Карта освещенности комнаты. Лучи выпускаются из начала луча комнаты, и в
+// каждой ячейке сетки накапливается суммарная длина прошедших через нее
+// отрезков, умноженная на энергию луча. Энергия уменьшается при отражении от
+// стен с долей отражения меньше единицы, ослабевшие лучи веера обрываются
+// русской рулеткой. Расчет распределяется по потокам, у каждого потока своя
+// сетка, сетки складываются при обновлении изображения.
+//
+// Расчет идет порциями: step() трассирует лучи в течение заданного времени,
+// поэтому карту можно уточнять по кадрам, не останавливая редактор. Если
+// комната, цель или луч изменились, расчет начинается заново
+class Heatmap {
+private:
+    int width;  // Число ячеек по горизонтали
+    int height; // Число ячеек по вертикали
+
+    Rectangle bounds;            // Область комнаты, покрываемая сеткой
+    vector<float> density;       // Накопленная длина лучей в ячейках
+    vector<vector<float>> grids; // Сетки потоков
+
+    Room *room = nullptr;      // Комната, для которой идет расчет
+    unsigned long roomVersion; // Версия комнаты на момент начала расчета
+    Tracer<double> tracer;     // Снимок геометрии комнаты
+    Vec2<double> rayOrigin;    // Начало луча
+    Vec2<double> rayNormal;    // Направление луча под прямым углом к стене
+    int rayWall;               // Индекс стены начала луча
+    double rayAngle;           // Угол луча к стене
+
+    bool fan;              // Веер лучей или одна траектория
+    int depth;             // Число отражений одного луча веера
+    long targetBounces;    // Требуемое число отражений
+    long nextRay = 0;      // Номер следующего луча веера
+    long totalBounces = 0; // Число отражений, учтенных в карте
+    bool finished = false; // Расчет завершен
+
+    // Энергия, ниже которой луч веера проходит через русскую рулетку
+    static constexpr double rouletteThreshold = 0.1;
+    // Энергия, при которой одна траектория считается погасшей
+    static constexpr double minimalEnergy = 1e-6;
+
+    // Состояние одной траектории, которая продолжается между порциями
+    Vec2<double> origin;
+    Vec2<double> dir;
+    int fromWall;
+    double energy;
+
+    // Изображение обновляется полосами по refreshRows строк за порцию,
+    // нормировка берется по максимуму предыдущего полного прохода
+    static constexpr int refreshRows = 64;
+    int refreshRow = 0;   // Первая строка следующей полосы
+    float displayMax = 0; // Максимум, по которому строится изображение
+    float passMax = 0;    // Максимум текущего прохода
+
+    vector<Color> palette; // Таблица цветов логарифмической шкалы
+    vector<Color> pixels;  // Изображение карты
+    Texture2D texture;
+    bool hasTexture = false;
+
+    void restart(); // Начало расчета по текущему состоянию комнаты
+
+    long traceFan(double deadline);        // Порция лучей веера
+    long traceTrajectory(double deadline); // Порция одной траектории
+
+    void accumulate( // Добавление отрезка [a, b] с весом weight в сетку grid
+        vector<float> &grid, const Vec2<double> &a, const Vec2<double> &b,
+        double weight
+    ) const;
+
+    void mergeRows(int first, int count); // Сложение сеток потоков
+    void updatePixels(int first, int count);
+
+    void refresh(); // Полное обновление изображения
+
+public:
+    class NoRayStart: public std::exception { // Исключение, выбрасывается,
+                                              // если в комнате нет луча
+    public:
+        const char *what() const noexcept;
+    };
+
+    Heatmap(int width = 1024, int height = 1024);
+
+    // Начать расчет карты по bounces отражениям. Если fan == true, лучи
+    // выпускаются веером по всем углам от стены, каждый на depth отражений,
+    // иначе рассчитывается одна траектория под углом начала луча
+    void start(Room *room, long bounces, bool fan = true, int depth = 100);
+
+    void step(double budget); // Продолжить расчет на budget миллисекунд
+
+    void compute( // Рассчитать карту целиком
+        Room *room, long bounces, bool fan = true, int depth = 100
+    );
+
+    bool isActive() { return room != nullptr; }
+
+    bool isReady() { return totalBounces > 0; }
+
+    bool isDone() { return finished; }
+
+    long getBounces() { return totalBounces; }
+
+    float getProgress(); // Доля выполненных отражений
+
+    void clear();
+
+    void draw();
+
+    void exportImage(const char *path); // Сохранение карты в PNG
+
+    ~Heatmap();
+};
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "raylib.h"
+
+#include "HitEstimator.h"
+#include "Parallel.h"
+#include "Ray.h"
+#include "Sampling.h"
+
+using std::vector;
+
+const char *HitEstimator::NoAim::what() const noexcept {
+    return "Для оценки попадания нужна цель";
+}
+
+const char *HitEstimator::NoRayStart::what() const noexcept {
+    return "Для оценки попадания нужен луч";
+}
+
+HitEstimator::HitEstimator(Room *room) {
+    HitEstimator::room = room;
+    tracer.update(room);
+}
+
+HitEstimator::Result HitEstimator::estimate(
+    Sampling sampling, long samples, int replicates, int depth, unsigned seed,
+    bool roulette
+) {
+    if (!room->aim) {
+        throw NoAim();
+    }
+    if (!room->rayStart) {
+        throw NoRayStart();
+    }
+
+    Wall *wall = room->rayStart->getWall();
+    int wallIndex = tracer.indexOf(wall);
+    float normalSign = room->rayStart->isInverted() ? -1.0f : 1.0f;
+    int target = room->getAimIndex();
+
+    // Концы стены исключаются: из угла луч запустить нельзя
+    const double margin = 1e-4;
+
+    vector<double> estimates(replicates, 0);
+    vector<long> bounces(replicates, 0);
+    auto runReplicate = [&](int r) {
+        std::mt19937 random(seed + r);
+        std::uniform_real_distribution<double> uniform(0, 1);
+
+        // Случайное скремблирование последовательности: для Халтона ---
+        // сдвиг по модулю 1, для Соболя --- перемешивание Оуэна
+        double shiftT = uniform(random);
+        double shiftAngle = uniform(random);
+        uint32_t seedT = random();
+        uint32_t seedAngle = random();
+
+        double received = 0;
+        long count = 0;
+        for (long i = 0; i < samples; ++i) {
+            double u, v;
+            switch (sampling) {
+            case SAMPLING_RANDOM: {
+                u = uniform(random);
+                v = uniform(random);
+                break;
+            }
+            case SAMPLING_HALTON: {
+                u = std::fmod(radicalInverse(i + 1, 2) + shiftT, 1.0);
+                v = std::fmod(radicalInverse(i + 1, 3) + shiftAngle, 1.0);
+                break;
+            }
+            case SAMPLING_SOBOL:
+            default: {
+                u = toUnit(owenScramble(sobol(i, 0), seedT));
+                v = toUnit(owenScramble(sobol(i, 1), seedAngle));
+                break;
+            }
+            }
+
+            float t = margin + u * (1 - 2 * margin);
+            double angle = (1 + 178 * v) * DEG2RAD;
+
+            Vector2 point = wall->getPointByT(t);
+            Vector2 normal = wall->getNormal(point);
+            Vec2<double> n(normal.x * normalSign, normal.y * normalSign);
+            double c = std::cos(angle - PI / 2);
+            double s = std::sin(angle - PI / 2);
+            Vec2<double> dir(n.x * c - n.y * s, n.x * s + n.y * c);
+            Vec2<double> origin(point);
+            int fromWall = wallIndex;
+            double energy = 1;
+            Tracer<double>::Hit hit;
+
+            for (int step = 0; step <= depth; ++step) {
+                if (!tracer.trace(origin, dir, fromWall, hit)) {
+                    break;
+                }
+                ++count;
+                // Остальные цели поглощают луч, как и в дереве лучей
+                if (hit.aim) {
+                    if (hit.target == target) {
+                        received += energy;
+                    }
+                    break;
+                }
+                double choice = uniform(random);
+                double spread = uniform(random);
+                if (!tracer.scatter(hit, dir, choice, spread, energy)) {
+                    break;
+                }
+                if (roulette && !russianRoulette(
+                                    energy, rouletteThreshold, uniform(random)
+                                )) {
+                    break;
+                }
+                origin = hit.point;
+                fromWall = hit.wall;
+            }
+        }
+        estimates[r] = received / samples;
+        bounces[r] = count;
+    };
+
+    // Серии независимы и распределяются по потокам
+    int threadsCount = std::min(replicates, hardwareThreads());
+    vector<std::thread> threads;
+    for (int k = 0; k < threadsCount; ++k) {
+        threads.emplace_back([&, k]() {
+            for (int r = k; r < replicates; r += threadsCount) {
+                runReplicate(r);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    double mean = 0;
+    for (double estimate : estimates) {
+        mean += estimate;
+    }
+    mean /= replicates;
+
+    double variance = 0;
+    for (double estimate : estimates) {
+        variance += (estimate - mean) * (estimate - mean);
+    }
+    variance /= std::max(1, replicates - 1);
+
+    Result result;
+    result.energy = mean;
+    result.halfWidth =
+        studentQuantile(replicates - 1) * std::sqrt(variance / replicates);
+    result.traces = samples * replicates;
+    result.bounces = 0;
+    for (long count : bounces) {
+        result.bounces += count;
+    }
+    return result;
+}
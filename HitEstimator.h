@@ -0,0 +1,58 @@
+#pragma once
+
+#include <exception>
+
+#include "Room.h"
+#include "Tracer.h"
+
+// Оценка доли энергии луча, доходящей до цели, при запуске со стены начала
+// луча из случайной точки t и под случайным углом. При идеальных зеркалах это
+// вероятность попадания. Точки (t, угол) берутся из случайной, Халтона или
+// Соболя последовательности. Квазислучайные последовательности сдвигаются
+// случайно (скремблируются) в каждой из независимых серий, по разбросу серий
+// строится доверительный интервал.
+//
+// Энергия луча умножается на долю отражения каждой стены. Ослабевший луч
+// обрывается русской рулеткой, поэтому время не тратится на пути с
+// пренебрежимо малым вкладом, а оценка остается несмещенной
+class HitEstimator {
+private:
+    // Энергия, ниже которой луч проходит через русскую рулетку
+    static constexpr double rouletteThreshold = 0.1;
+
+    Room *room;
+    Tracer<double> tracer; // Снимок геометрии комнаты
+
+public:
+    enum Sampling { SAMPLING_RANDOM, SAMPLING_HALTON, SAMPLING_SOBOL };
+
+    struct Result {
+        double energy;    // Оценка доли энергии, доходящей до цели
+        double halfWidth; // Полуширина 95% доверительного интервала
+        long traces;      // Число прослеженных лучей
+        long bounces;     // Число найденных столкновений
+    };
+
+    class NoAim: public std::exception { // Исключение, выбрасывается,
+                                         // если в комнате нет цели
+    public:
+        const char *what() const noexcept;
+    };
+
+    class NoRayStart: public std::exception { // Исключение, выбрасывается,
+                                              // если в комнате нет луча
+    public:
+        const char *what() const noexcept;
+    };
+
+    HitEstimator(Room *room);
+
+    // Оценка по replicates сериям из samples лучей, каждый луч
+    // прослеживается не более чем на depth отражений. Без roulette лучи
+    // обрываются только по числу отражений
+    Result estimate(
+        Sampling sampling, long samples, int replicates = 16,
+        int depth = Room::maximumRayDepth, unsigned seed = 1,
+        bool roulette = true
+    );
+};
@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "BeamTracer.h"
+#include "Illumination.h"
+#include "Parallel.h"
+#include "Room.h"
+#include "Tracer.h"
+
+const char *Illumination::NotClosed::what() const noexcept {
+    return "Для расчета освещения комната должна быть замкнута";
+}
+
+const char *Illumination::OutsideRoom::what() const noexcept {
+    return "Источник света должен быть внутри комнаты";
+}
+
+Illumination::Illumination(int width, int height) {
+    Illumination::width = width;
+    Illumination::height = height;
+    bounds = Rectangle{0, 0, 0, 0};
+}
+
+void Illumination::start(Room *room, Vector2 source, int orders) {
+    clear();
+    Illumination::room = room;
+    Illumination::source = source;
+    Illumination::orders = orders;
+    try {
+        compute();
+    } catch (...) {
+        clear();
+        throw;
+    }
+}
+
+bool Illumination::update() {
+    if (!room || room->getShapeVersion() == roomShape) {
+        return false;
+    }
+    try {
+        compute();
+    } catch (...) {
+        clear();
+        throw;
+    }
+    return true;
+}
+
+void Illumination::compute() {
+    roomShape = room->getShapeVersion();
+    if (!room->isClosed()) {
+        throw NotClosed();
+    }
+
+    beams.update(room);
+    exact = !beams.hasArcs();
+
+    // Контур комнаты и контуры замкнутых препятствий, кривые стены
+    // заменяются ломаными. Незамкнутые препятствия площади не ограничивают
+    contours.clear();
+    auto addContour = [&](vector<Wall *> &walls) {
+        vector<Vec2<double>> contour;
+        for (Wall *wall : walls) {
+            Vector2 start = wall->getStart()->getCoord();
+            bool round = dynamic_cast<WallLine *>(wall) == nullptr;
+            int count = round ? 32 : 1;
+            bool reversed = Vector2Distance(wall->getPointByT(0), start) >
+                            Vector2Distance(wall->getPointByT(1), start);
+            for (int i = 0; i < count; ++i) {
+                float t = (float)i / count;
+                contour.push_back(
+                    Vec2<double>(wall->getPointByT(reversed ? 1 - t : t))
+                );
+            }
+        }
+        contours.push_back(contour);
+    };
+    addContour(room->getWalls());
+    for (Obstacle *obstacle : room->getObstacles()) {
+        if (obstacle->isClosed()) {
+            addContour(obstacle->getWalls());
+        }
+    }
+    if (!isInside(Vec2<double>(source))) {
+        throw OutsideRoom();
+    }
+
+    // Сетка покрывает габаритный прямоугольник контура комнаты, препятствия
+    // лежат внутри него
+    const vector<Vec2<double>> &outline = contours[0];
+    Vec2<double> low = outline[0];
+    Vec2<double> high = outline[0];
+    for (const Vec2<double> &point : outline) {
+        low = Vec2<double>(std::min(low.x, point.x), std::min(low.y, point.y));
+        high =
+            Vec2<double>(std::max(high.x, point.x), std::max(high.y, point.y));
+    }
+    bounds = Rectangle{
+        (float)low.x - 1, (float)low.y - 1, (float)(high.x - low.x) + 2,
+        (float)(high.y - low.y) + 2
+    };
+
+    // Ячейки внутри комнаты отмечаются построчно по точкам пересечения
+    // строки со всеми контурами: между парами точек лежат участки комнаты
+    // вне препятствий
+    cells.assign((size_t)width * height, outside);
+    vector<double> crossings;
+    for (int y = 0; y < height; ++y) {
+        double rowY = bounds.y + (y + 0.5) * bounds.height / height;
+        crossings.clear();
+        for (const vector<Vec2<double>> &contour : contours) {
+            for (size_t i = 0; i < contour.size(); ++i) {
+                const Vec2<double> &a = contour[i];
+                const Vec2<double> &b = contour[(i + 1) % contour.size()];
+                if ((a.y > rowY) != (b.y > rowY)) {
+                    crossings.push_back(
+                        a.x + (rowY - a.y) * (b.x - a.x) / (b.y - a.y)
+                    );
+                }
+            }
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            int first = std::ceil(
+                (crossings[i] - bounds.x) * width / bounds.width - 0.5
+            );
+            int last = std::floor(
+                (crossings[i + 1] - bounds.x) * width / bounds.width - 0.5
+            );
+            for (int x = std::max(first, 0); x <= std::min(last, width - 1);
+                 ++x) {
+                cells[(size_t)y * width + x] = dark;
+            }
+        }
+    }
+
+    regions.clear();
+    if (exact) {
+        traceBeams();
+    } else {
+        traceSampled();
+    }
+    findDark();
+    textureStale = true;
+}
+
+void Illumination::traceBeams() {
+    // Пучки обходятся в порядке возрастания числа отражений: пучки
+    // следующего порядка добавляются в конец очереди
+    vector<BeamTracer::Beam> queue = {beams.root(Vec2<double>(source))};
+    for (size_t i = 0; i < queue.size(); ++i) {
+        BeamTracer::Beam beam = queue[i];
+        for (const BeamTracer::Piece &piece : beams.sweep(beam)) {
+            Region region = {beam.order, beams.region(piece, beam)};
+            markRegion(region);
+            regions.push_back(region);
+
+            if (beam.order < orders && queue.size() < maximumBeams &&
+                length(piece.end - piece.start) > minimalWindow) {
+                queue.push_back(beams.reflect(beam, piece));
+            }
+        }
+    }
+}
+
+void Illumination::traceSampled() {
+    // Цели не задерживают свет, как и у точного построения по пучкам
+    Tracer<double> tracer(room);
+    tracer.ignoreAim();
+    Vec2<double> origin(source);
+
+    // Каждый поток отмечает лучи веера в своей сетке, затем сетки
+    // объединяются по наименьшему порядку
+    int threadsCount = hardwareThreads();
+    vector<vector<unsigned char>> grids(
+        threadsCount, vector<unsigned char>(cells.size(), dark)
+    );
+    double scaleX = width / bounds.width;
+    double scaleY = height / bounds.height;
+    double step =
+        0.75 * std::min(bounds.width / width, bounds.height / height);
+
+    auto mark = [&](vector<unsigned char> &grid, const Vec2<double> &a,
+                    const Vec2<double> &b, unsigned char order) {
+        int count = (int)(length(b - a) / step) + 1;
+        for (int j = 0; j <= count; ++j) {
+            Vec2<double> p = a + (b - a) * ((double)j / count);
+            int x = std::clamp((int)((p.x - bounds.x) * scaleX), 0, width - 1);
+            int y = std::clamp((int)((p.y - bounds.y) * scaleY), 0, height - 1);
+            unsigned char &cell = grid[(size_t)y * width + x];
+            cell = std::min(cell, order);
+        }
+    };
+
+    vector<std::thread> threads;
+    for (int k = 0; k < threadsCount; ++k) {
+        threads.emplace_back([&, k]() {
+            Tracer<double>::Hit hit;
+            for (int i = k; i < sampledRays; i += threadsCount) {
+                Vec2<double> o = origin;
+                Vec2<double> d(
+                    std::cos(2 * PI * (i + 0.5) / sampledRays),
+                    std::sin(2 * PI * (i + 0.5) / sampledRays)
+                );
+                int from = -1;
+                for (int order = 0; order <= orders; ++order) {
+                    if (!tracer.trace(o, d, from, hit)) {
+                        break;
+                    }
+                    mark(grids[k], o, hit.point, order);
+                    d = tracer.reflect(hit, d);
+                    o = hit.point;
+                    from = hit.wall;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < cells.size(); ++i) {
+        if (cells[i] == outside) {
+            continue;
+        }
+        for (const vector<unsigned char> &grid : grids) {
+            cells[i] = std::min(cells[i], grid[i]);
+        }
+    }
+}
+
+bool Illumination::isInside(const Vec2<double> &point) const {
+    // Правило четности по всем контурам: точка внутри препятствия лежит
+    // внутри двух контуров
+    bool inside = false;
+    for (const vector<Vec2<double>> &contour : contours) {
+        for (size_t i = 0; i < contour.size(); ++i) {
+            const Vec2<double> &a = contour[i];
+            const Vec2<double> &b = contour[(i + 1) % contour.size()];
+            if ((a.y > point.y) != (b.y > point.y) &&
+                point.x < a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+void Illumination::markRegion(const Region &region) {
+    const vector<Vec2<double>> &polygon = region.polygon;
+    double scaleX = width / bounds.width;
+    double scaleY = height / bounds.height;
+
+    Vec2<double> low = polygon[0];
+    Vec2<double> high = polygon[0];
+    for (const Vec2<double> &point : polygon) {
+        low = Vec2<double>(std::min(low.x, point.x), std::min(low.y, point.y));
+        high =
+            Vec2<double>(std::max(high.x, point.x), std::max(high.y, point.y));
+    }
+    int firstX = std::max(0, (int)((low.x - bounds.x) * scaleX));
+    int lastX = std::min(width - 1, (int)((high.x - bounds.x) * scaleX));
+    int firstY = std::max(0, (int)((low.y - bounds.y) * scaleY));
+    int lastY = std::min(height - 1, (int)((high.y - bounds.y) * scaleY));
+
+    // Центр ячейки лежит в выпуклом многоугольнике, если он по одну сторону
+    // от всех ребер. Вырожденные ребра пропускаются
+    for (int y = firstY; y <= lastY; ++y) {
+        for (int x = firstX; x <= lastX; ++x) {
+            unsigned char &cell = cells[(size_t)y * width + x];
+            if (cell == outside || cell <= region.order) {
+                continue;
+            }
+            Vec2<double> center(
+                bounds.x + (x + 0.5) / scaleX, bounds.y + (y + 0.5) / scaleY
+            );
+            bool hasPositive = false;
+            bool hasNegative = false;
+            for (size_t i = 0; i < polygon.size(); ++i) {
+                const Vec2<double> &a = polygon[i];
+                const Vec2<double> &b = polygon[(i + 1) % polygon.size()];
+                double c = cross(b - a, center - a);
+                hasPositive = hasPositive || c > 1e-9;
+                hasNegative = hasNegative || c < -1e-9;
+            }
+            if (!(hasPositive && hasNegative)) {
+                cell = region.order;
+            }
+        }
+    }
+}
+
+void Illumination::findDark() {
+    // Связные области меньше minimalCells ячеек считаются погрешностью
+    // растеризации на границах освещенных областей
+    const int minimalCells = 4;
+
+    long inside = 0;
+    long darkCells = 0;
+    darkRegions = 0;
+    vector<bool> visited(cells.size(), false);
+    vector<size_t> stack;
+    for (size_t i = 0; i < cells.size(); ++i) {
+        if (cells[i] == outside) {
+            continue;
+        }
+        ++inside;
+        if (cells[i] != dark || visited[i]) {
+            continue;
+        }
+
+        long size = 0;
+        stack.push_back(i);
+        visited[i] = true;
+        while (!stack.empty()) {
+            size_t j = stack.back();
+            stack.pop_back();
+            ++size;
+            int x = j % width;
+            int y = j / width;
+            size_t neighbours[4] = {
+                x > 0 ? j - 1 : j, x + 1 < width ? j + 1 : j,
+                y > 0 ? j - width : j, y + 1 < height ? j + width : j
+            };
+            for (size_t n : neighbours) {
+                if (!visited[n] && cells[n] == dark) {
+                    visited[n] = true;
+                    stack.push_back(n);
+                }
+            }
+        }
+        darkCells += size;
+        if (size >= minimalCells) {
+            ++darkRegions;
+        }
+    }
+    darkFraction = inside > 0 ? (float)darkCells / inside : 0;
+}
+
+void Illumination::updateTexture() {
+    // Точные области рисуются многоугольниками, поэтому в текстуре остаются
+    // только темные ячейки. Ячейки, освещенные веером, окрашиваются по
+    // порядку отражения
+    vector<Color> pixels(cells.size(), Color{0, 0, 0, 0});
+    for (size_t i = 0; i < cells.size(); ++i) {
+        if (cells[i] == dark) {
+            pixels[i] = Color{30, 30, 70, 150};
+        } else if (cells[i] != outside && !exact) {
+            pixels[i] = Color{
+                255, 220, 80, (unsigned char)(120 / (cells[i] + 1))
+            };
+        }
+    }
+
+    if (hasTexture) {
+        UnloadTexture(texture);
+    }
+    textureStale = false;
+    Image image = {
+        pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    texture = LoadTextureFromImage(image);
+    hasTexture = true;
+}
+
+void Illumination::clear() {
+    room = nullptr;
+    regions.clear();
+    cells.clear();
+    textureStale = false;
+    if (hasTexture) {
+        UnloadTexture(texture);
+        hasTexture = false;
+    }
+}
+
+void Illumination::draw() {
+    if (!room) {
+        return;
+    }
+
+    // Текстура загружается при отрисовке, так что расчет не требует
+    // графического контекста
+    if (textureStale) {
+        updateTexture();
+    }
+    if (hasTexture) {
+        DrawTexturePro(
+            texture, Rectangle{0, 0, (float)width, (float)height}, bounds,
+            Vector2{0, 0}, 0, WHITE
+        );
+    }
+
+    // Области рисуются веером треугольников. Вершины перечисляются против
+    // часовой стрелки на экране, иначе raylib отбрасывает треугольник
+    for (const Region &region : regions) {
+        Color color = {255, 220, 80, (unsigned char)(120 / (region.order + 1))};
+        const vector<Vec2<double>> &polygon = region.polygon;
+        for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+            Vector2 a = polygon[0].toVector2();
+            Vector2 b = polygon[i].toVector2();
+            Vector2 c = polygon[i + 1].toVector2();
+            if ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) > 0) {
+                std::swap(b, c);
+            }
+            DrawTriangle(a, b, c, color);
+        }
+    }
+
+    DrawCircleV(source, 8, GOLD);
+    DrawCircleLinesV(source, 8, ORANGE);
+}
+
+Illumination::~Illumination() {
+    clear();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "raylib.h"
+
+#include "BeamTracer.h"
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Освещение комнаты точечным источником, помещенным внутрь нее. Если все
+// стены прямые, освещенные после k отражений области строятся точно по
+// дереву пучков (BeamTracer): многоугольник видимости источника, затем
+// области за каждым освещенным участком стены, видимые из зеркального
+// изображения источника, и так далее до заданного числа отражений. Если в
+// комнате есть дуги, освещенные области оцениваются веером лучей.
+//
+// Части комнаты, не освещенные ни одним порядком, отмечаются на сетке: по ней
+// рисуются темные области и считаются их число и доля площади комнаты.
+// Внутренность замкнутых препятствий в площадь комнаты не входит
+class Illumination {
+public:
+    // Освещенная область: выпуклый многоугольник
+    struct Region {
+        int order; // Число отражений
+        vector<Vec2<double>> polygon;
+    };
+
+    class NotClosed: public std::exception { // Исключение, выбрасывается,
+                                             // если комната не замкнута
+    public:
+        const char *what() const noexcept;
+    };
+
+    class OutsideRoom: public std::exception { // Исключение, выбрасывается,
+                                               // если источник вне комнаты
+                                               // или внутри препятствия
+    public:
+        const char *what() const noexcept;
+    };
+
+private:
+    int width;  // Число ячеек сетки по горизонтали
+    int height; // Число ячеек сетки по вертикали
+
+    // Окна короче этой длины не порождают пучков следующего порядка
+    static constexpr double minimalWindow = 1e-3;
+    // Ограничение на число пучков, которое растет с порядком экспоненциально
+    static const int maximumBeams = 200000;
+    // Число лучей веера в комнатах с дугами
+    static const int sampledRays = 1 << 13;
+
+    Room *room = nullptr;    // Освещаемая комната
+    unsigned long roomShape; // Версия стен на момент расчета
+    Vector2 source;          // Положение источника
+    int orders;              // Наибольшее число отражений
+    bool exact;              // Построены ли области точно
+
+    BeamTracer beams; // Снимок стен для построения пучков
+    // Контур комнаты, дуги --- ломаными, и контуры замкнутых препятствий
+    vector<vector<Vec2<double>>> contours;
+
+    vector<Region> regions;
+
+    Rectangle bounds;            // Область комнаты, покрываемая сеткой
+    vector<unsigned char> cells; // Наименьший порядок освещения ячейки
+    float darkFraction;          // Доля площади комнаты в тени
+    int darkRegions;             // Число связных темных областей
+
+    Texture2D texture;
+    bool hasTexture = false;
+    bool textureStale = false; // Сетка изменилась после загрузки текстуры
+
+    void compute(); // Расчет по текущему состоянию комнаты
+
+    void traceBeams();   // Точное построение областей для прямых стен
+    void traceSampled(); // Оценка освещенных ячеек веером лучей
+
+    // Внутри ли комнаты и вне замкнутых препятствий
+    bool isInside(const Vec2<double> &point) const;
+
+    void markRegion(const Region &region); // Отметка ячеек области
+    void findDark();                       // Поиск темных областей
+    void updateTexture(); // Загрузка сетки в текстуру, вызывается в draw
+
+public:
+    static constexpr unsigned char dark = 255;    // Неосвещенная ячейка
+    static constexpr unsigned char outside = 254; // Ячейка вне комнаты
+
+    Illumination(int width = 512, int height = 512);
+
+    // Поместить источник в точку source и построить освещенные области для
+    // числа отражений от 0 до orders
+    void start(Room *room, Vector2 source, int orders = 3);
+
+    // Перестроить области, если комната изменилась. Возвращает true, если
+    // области были перестроены
+    bool update();
+
+    bool isActive() { return room != nullptr; }
+
+    bool isExact() { return exact; }
+
+    Vector2 getSource() { return source; }
+
+    const vector<Region> &getRegions() { return regions; }
+
+    unsigned char getCell(int x, int y) { return cells[(size_t)y * width + x]; }
+
+    float getDarkFraction() { return darkFraction; }
+
+    int getDarkRegions() { return darkRegions; }
+
+    void clear();
+
+    void draw();
+
+    ~Illumination();
+};
@@ -0,0 +1,108 @@
+#include "Itineraries.h"
+
+void Itineraries::reset(long launches) {
+    nodes.assign(1, Node{-1, -1, -1, 0, 0, 0});
+    leaves.assign(launches, -1);
+}
+
+int Itineraries::childOf(int node, int wall) {
+    int previous = -1;
+    for (int child = nodes[node].child; child >= 0;
+         child = nodes[child].sibling) {
+        if (nodes[child].wall == wall) {
+            // Найденное продолжение переносится в начало списка: соседние
+            // запуски порции обычно идут по одному маршруту
+            if (previous >= 0) {
+                nodes[previous].sibling = nodes[child].sibling;
+                nodes[child].sibling = nodes[node].child;
+                nodes[node].child = child;
+            }
+            return child;
+        }
+        previous = child;
+    }
+
+    nodes.push_back(Node{node, -1, nodes[node].child, 0, 0, (uint16_t)wall});
+    nodes[node].child = nodes.size() - 1;
+    return nodes.size() - 1;
+}
+
+void Itineraries::insert(Batch &batch) {
+    std::lock_guard<std::mutex> lock(treeMutex);
+    size_t offset = 0;
+    for (size_t i = 0; i < batch.launches.size(); ++i) {
+        int node = root;
+        ++nodes[root].launches;
+        for (int k = 0; k < batch.lengths[i]; ++k) {
+            node = childOf(node, batch.walls[offset + k]);
+            ++nodes[node].launches;
+        }
+        offset += batch.lengths[i];
+        ++nodes[node].ends;
+        leaves[batch.launches[i]] = node;
+    }
+
+    batch.walls.clear();
+    batch.lengths.clear();
+    batch.launches.clear();
+}
+
+vector<int> Itineraries::getChildren(int node) const {
+    vector<int> children;
+    for (int child = nodes[node].child; child >= 0;
+         child = nodes[child].sibling) {
+        children.push_back(child);
+    }
+    return children;
+}
+
+int Itineraries::find(const vector<int> &prefix) const {
+    int node = root;
+    for (int wall : prefix) {
+        int child = nodes[node].child;
+        while (child >= 0 && nodes[child].wall != wall) {
+            child = nodes[child].sibling;
+        }
+        if (child < 0) {
+            return -1;
+        }
+        node = child;
+    }
+    return node;
+}
+
+vector<int> Itineraries::getItinerary(long launch) const {
+    vector<int> walls;
+    for (int node = leaves[launch]; node > root; node = nodes[node].parent) {
+        walls.push_back(nodes[node].wall);
+    }
+    return vector<int>(walls.rbegin(), walls.rend());
+}
+
+vector<long> Itineraries::select(const vector<int> &prefix) const {
+    vector<long> launches;
+    int start = find(prefix);
+    if (start < 0) {
+        return launches;
+    }
+
+    // Отметка поддерева префикса обходом в глубину, затем отбор запусков,
+    // полный маршрут которых лежит в поддереве
+    vector<char> inside(nodes.size(), 0);
+    vector<int> stack = {start};
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        inside[node] = 1;
+        for (int child = nodes[node].child; child >= 0;
+             child = nodes[child].sibling) {
+            stack.push_back(child);
+        }
+    }
+    for (size_t launch = 0; launch < leaves.size(); ++launch) {
+        if (leaves[launch] >= 0 && inside[leaves[launch]]) {
+            launches.push_back(launch);
+        }
+    }
+    return launches;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+using std::vector;
+
+// Маршруты лучей перебора --- последовательности индексов стен, от которых
+// луч отражался, --- в префиксном дереве. Узел дерева соответствует префиксу
+// маршрута (корень --- пустому) и хранит одну стену, поэтому память растет с
+// числом разных префиксов, а не с числом лучей. Для каждого запуска хранится
+// только узел его полного маршрута.
+//
+// Поток перебора записывает маршруты своей порции в Batch (16-битная стена на
+// отражение) и добавляет их в общее дерево сразу всей порцией под мьютексом.
+// Запросы к дереву не должны идти одновременно с добавлением
+class Itineraries {
+public:
+    static const int maximumWalls = 65536; // Наибольшее число стен
+
+    static const int root = 0; // Узел пустого маршрута
+
+    // Узел дерева: префикс маршрута
+    struct Node {
+        int parent;    // Префикс без последней стены (-1 у корня)
+        int child;     // Первое продолжение префикса (или -1)
+        int sibling;   // Следующее продолжение того же родителя (или -1)
+        int launches;  // Число запусков, маршрут которых начинается с префикса
+        int ends;      // Число запусков, маршрут которых равен префиксу
+        uint16_t wall; // Последняя стена префикса
+    };
+
+    // Маршруты порции одного потока до добавления в дерево
+    class Batch {
+    private:
+        vector<uint16_t> walls; // Стены всех маршрутов подряд
+        vector<int> lengths;    // Длины маршрутов
+        vector<long> launches;  // Номера запусков
+
+        friend class Itineraries;
+
+    public:
+        void begin(long launch) { // Начало маршрута запуска launch
+            launches.push_back(launch);
+            lengths.push_back(0);
+        }
+
+        void add(int wall) { // Отражение от стены wall
+            walls.push_back(wall);
+            ++lengths.back();
+        }
+    };
+
+private:
+    vector<Node> nodes;
+    vector<int> leaves; // Узел полного маршрута запуска (-1, если его нет)
+    std::mutex treeMutex;
+
+    int childOf(int node, int wall); // Продолжение префикса (создается)
+
+public:
+    Itineraries() { reset(0); }
+
+    void reset(long launches); // Пустое дерево для launches запусков
+
+    // Добавление маршрутов порции в дерево (порция очищается). Порции разных
+    // потоков можно добавлять одновременно
+    void insert(Batch &batch);
+
+    size_t size() const { return nodes.size(); } // Число узлов
+
+    const Node &getNode(int node) const { return nodes[node]; }
+
+    vector<int> getChildren(int node) const; // Продолжения префикса
+
+    // Узел маршрута, начинающегося со стен prefix (или -1, если такого нет)
+    int find(const vector<int> &prefix) const;
+
+    bool isTraced(long launch) const {
+        return launch >= 0 && launch < (long)leaves.size() &&
+               leaves[launch] >= 0;
+    }
+
+    int getLeaf(long launch) const { return leaves[launch]; }
+
+    vector<int> getItinerary(long launch) const; // Стены маршрута запуска
+
+    // Запуски, маршрут которых начинается со стен prefix, по возрастанию
+    vector<long> select(const vector<int> &prefix) const;
+
+    void clear() { reset(0); }
+};
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Lyapunov.h"
+#include "Parallel.h"
+#include "Room.h"
+#include "Sampling.h"
+#include "Tracer.h"
+
+const char *Lyapunov::NotClosed::what() const noexcept {
+    return "Для показателя Ляпунова комната должна быть замкнута";
+}
+
+void Lyapunov::start(Room *room, long bounces, int trajectories) {
+    if (!room->isClosed()) {
+        throw NotClosed();
+    }
+
+    clear();
+    Lyapunov::room = room;
+    Lyapunov::trajectories.resize(std::max(2, trajectories));
+    targetBounces = bounces;
+    restart();
+}
+
+void Lyapunov::restart() {
+    roomShape = room->getShapeVersion();
+    tracer.update(room);
+    tracer.ignoreAim();
+
+    // Длины стен контура, у кривых --- по вписанной ломаной, и габарит
+    vector<Wall *> &walls = room->getWalls();
+    vector<double> offsets(walls.size() + 1, 0);
+    Vector2 low = walls[0]->getStart()->getCoord();
+    Vector2 high = low;
+    for (size_t i = 0; i < walls.size(); ++i) {
+        bool round = dynamic_cast<WallLine *>(walls[i]) == nullptr;
+        int count = round ? 32 : 1;
+        double length = 0;
+        for (int k = 0; k < count; ++k) {
+            Vector2 a = walls[i]->getPointByT((float)k / count);
+            Vector2 b = walls[i]->getPointByT((float)(k + 1) / count);
+            length += Vector2Distance(a, b);
+            low = Vector2{std::min(low.x, b.x), std::min(low.y, b.y)};
+            high = Vector2{std::max(high.x, b.x), std::max(high.y, b.y)};
+        }
+        offsets[i + 1] = offsets[i] + length;
+    }
+    scale = Vector2Distance(low, high);
+
+    // Концы стен и касательные направления исключаются: из угла траекторию
+    // запустить нельзя, а вдоль стены она никуда не придет
+    const double margin = 1e-4;
+    const uint32_t seedPosition = hashBits(1);
+    const uint32_t seedAngle = hashBits(2);
+
+    for (size_t i = 0; i < trajectories.size(); ++i) {
+        Trajectory &trajectory = trajectories[i];
+        trajectory.bounces = 0;
+        trajectory.length = 0;
+        trajectory.growth = 0;
+        trajectory.lost = false;
+
+        double u = toUnit(owenScramble(sobol(i, 0), seedPosition));
+        double v = toUnit(owenScramble(sobol(i, 1), seedAngle));
+        double position = u * offsets.back();
+        size_t index = std::upper_bound(
+                           offsets.begin() + 1, offsets.end() - 1, position
+                       ) -
+                       offsets.begin() - 1;
+        Wall *wall = walls[index];
+        double t = (position - offsets[index]) /
+                   std::max(1e-9, offsets[index + 1] - offsets[index]);
+        t = std::clamp(t, margin, 1 - margin);
+
+        // Синус угла к нормали, направленной внутрь комнаты. Луч, выпущенный
+        // наружу замкнутой комнаты, ни во что не попадает
+        Vector2 point = wall->getPointByT(t);
+        Vector2 normal = wall->getNormal(point);
+        double sine = (2 * v - 1) * (1 - margin);
+        double cosine = std::sqrt(1 - sine * sine);
+        int fromWall = tracer.indexOf(wall);
+        Vec2<double> origin(point);
+        Tracer<double>::Hit hit;
+        Vec2<double> n;
+        for (double sign : {1.0, -1.0}) {
+            n = normalize(Vec2<double>(normal.x * sign, normal.y * sign));
+            trajectory.dir = Vec2<double>(
+                n.x * cosine - n.y * sine, n.x * sine + n.y * cosine
+            );
+            if (tracer.trace(origin, trajectory.dir, fromWall, hit)) {
+                break;
+            }
+        }
+        trajectory.origin = origin;
+        trajectory.fromWall = fromWall;
+
+        // Смещение вдоль стены и поворот луча
+        trajectory.tangent.origin = Vec2<double>(-n.y, n.x);
+        trajectory.tangent.dir =
+            Vec2<double>(-trajectory.dir.y, trajectory.dir.x) * (1 / scale);
+        double size = norm(trajectory);
+        trajectory.tangent.origin = trajectory.tangent.origin * (1 / size);
+        trajectory.tangent.dir = trajectory.tangent.dir * (1 / size);
+    }
+
+    // Задача k продолжает траекторию k % count на chunkBounces отражений,
+    // поэтому траектории продвигаются вровень и оценка в любой момент
+    // усредняет траектории одинаковой длины
+    long count = trajectories.size();
+    perTrajectory = std::max(1L, targetBounces / count);
+    tasksCount = count * ((perTrajectory + chunkBounces - 1) / chunkBounces);
+    nextTask = 0;
+    totalBounces = 0;
+    finished = false;
+    history.clear();
+    nextCheckpoint = trajectories.size() * 1024;
+}
+
+double Lyapunov::norm(const Trajectory &trajectory) const {
+    // Сдвиг начала вдоль луча переводит траекторию саму в себя и не
+    // учитывается
+    double shift = cross(trajectory.dir, trajectory.tangent.origin);
+    double turn = cross(trajectory.dir, trajectory.tangent.dir) * scale;
+    return std::hypot(shift, turn);
+}
+
+long Lyapunov::advance(Trajectory &trajectory, long count) const {
+    Tracer<double>::Hit hit;
+    long done = 0;
+    for (; done < count; ++done) {
+        if (!tracer.trace(
+                trajectory.origin, trajectory.dir, trajectory.fromWall, hit
+            )) {
+            trajectory.lost = true;
+            break;
+        }
+        trajectory.tangent =
+            tracer.reflectDifferential(hit, trajectory.dir, trajectory.tangent);
+        trajectory.dir = tracer.reflect(hit, trajectory.dir);
+        trajectory.origin = hit.point;
+        trajectory.fromWall = hit.wall;
+        trajectory.length += hit.distance;
+        ++trajectory.bounces;
+
+        if (trajectory.bounces % renormalizationPeriod == 0) {
+            // Вектор, выродившийся при попадании в угол или по касательной,
+            // дальше не переносится
+            double size = norm(trajectory);
+            if (!(size > 0 && size < std::numeric_limits<double>::max())) {
+                trajectory.lost = true;
+                ++done;
+                break;
+            }
+            trajectory.growth += std::log(size);
+            trajectory.tangent.origin = trajectory.tangent.origin * (1 / size);
+            trajectory.tangent.dir = trajectory.tangent.dir * (1 / size);
+        }
+    }
+    return done;
+}
+
+void Lyapunov::step(double budget) {
+    if (!room) {
+        return;
+    }
+
+    if (room->getShapeVersion() != roomShape) {
+        if (!room->isClosed()) {
+            clear();
+            return;
+        }
+        restart();
+    }
+
+    if (finished) {
+        return;
+    }
+
+    // Задачи одного прохода продолжают разные траектории
+    long count = trajectories.size();
+    std::atomic<long> bounces(0);
+    nextTask = runPasses(
+        nextTask, tasksCount, count, now() + budget, [&](long i, int) {
+            Trajectory &trajectory = trajectories[i % count];
+            long left = perTrajectory - trajectory.bounces;
+            if (!trajectory.lost && left > 0) {
+                bounces += advance(trajectory, std::min(chunkBounces, left));
+            }
+        }
+    );
+
+    totalBounces += bounces;
+    finished = nextTask >= tasksCount;
+
+    if (totalBounces >= nextCheckpoint || finished) {
+        Result result = getResult();
+        history.push_back({totalBounces, result.exponent, result.halfWidth});
+        while (nextCheckpoint <= totalBounces) {
+            nextCheckpoint *= 2;
+        }
+    }
+}
+
+void Lyapunov::compute(Room *room, long bounces, int trajectories) {
+    start(room, bounces, trajectories);
+    while (!finished) {
+        step(std::numeric_limits<double>::infinity());
+    }
+}
+
+float Lyapunov::getProgress() {
+    if (finished) {
+        return 1;
+    }
+    return (float)nextTask / tasksCount;
+}
+
+Lyapunov::Result Lyapunov::getResult() const {
+    Result result = {0, 0, 0, totalBounces, 0, 0};
+    vector<double> exponents;
+    for (const Trajectory &trajectory : trajectories) {
+        if (trajectory.lost) {
+            ++result.lost;
+            continue;
+        }
+        if (trajectory.bounces == 0) {
+            continue;
+        }
+        double growth = trajectory.growth + std::log(norm(trajectory));
+        exponents.push_back(growth / trajectory.bounces);
+        result.lengthExponent += growth / trajectory.length;
+    }
+
+    int count = exponents.size();
+    result.trajectories = count;
+    if (count == 0) {
+        return result;
+    }
+    for (double exponent : exponents) {
+        result.exponent += exponent;
+    }
+    result.exponent /= count;
+    result.lengthExponent /= count;
+
+    double variance = 0;
+    for (double exponent : exponents) {
+        variance += (exponent - result.exponent) * (exponent - result.exponent);
+    }
+    variance /= std::max(1, count - 1);
+    result.halfWidth =
+        studentQuantile(count - 1) * std::sqrt(variance / count);
+    return result;
+}
+
+void Lyapunov::clear() {
+    room = nullptr;
+    trajectories.clear();
+    history.clear();
+    nextTask = 0;
+    totalBounces = 0;
+    finished = false;
+}
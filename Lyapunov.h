@@ -0,0 +1,116 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Старший показатель Ляпунова бильярда --- средняя скорость, с которой
+// экспоненциально расходятся близкие траектории. Вместе с траекторией по
+// отражениям переносится касательный вектор: производные начала и направления
+// луча (Tracer::Differential), которые Tracer::reflectDifferential переносит
+// точно для стен всех видов. Каждые renormalizationPeriod отражений вектор
+// нормируется, а логарифм его длины накапливается, поэтому он не
+// переполняется и за сотни миллионов отражений.
+//
+// Начальные условия берутся из последовательности Соболя равномерно по длине
+// контура и синусу угла к нормали (по инвариантной мере бильярда).
+// Траектории независимы и распределяются по потокам проходами (runPasses),
+// поэтому одну траекторию не продолжают два потока сразу. Все стены
+// считаются зеркалами, цели лучей не задерживают. Оценка --- среднее по
+// траекториям, доверительный интервал строится по их разбросу. При каждом
+// удвоении числа отражений оценка сохраняется в истории, по которой видно,
+// сошлась ли она. Расчет идет порциями, как у карты освещенности, и
+// начинается заново, если изменились стены
+class Lyapunov {
+public:
+    struct Result {
+        double exponent;       // Показатель на одно отражение
+        double halfWidth;      // Полуширина 95% доверительного интервала
+        double lengthExponent; // Показатель на единицу длины пути
+        long bounces;          // Число отражений всех траекторий
+        int trajectories;      // Число траекторий в оценке
+        int lost;              // Число потерянных траекторий
+    };
+
+    // Оценка после bounces отражений
+    struct Checkpoint {
+        long bounces;
+        double exponent;
+        double halfWidth;
+    };
+
+    class NotClosed: public std::exception { // Исключение, выбрасывается,
+                                             // если комната не замкнута
+    public:
+        const char *what() const noexcept;
+    };
+
+private:
+    // Траектория, которая продолжается между порциями
+    struct Trajectory {
+        Vec2<double> origin;
+        Vec2<double> dir;
+        int fromWall;
+        Tracer<double>::Differential tangent; // Касательный вектор
+        long bounces;
+        double length; // Длина пройденного пути
+        double growth; // Сумма логарифмов длин вектора при нормировках
+        bool lost;     // Покинула комнату или потеряла вектор
+    };
+
+    static const int renormalizationPeriod = 8; // Отражений между
+                                                // нормировками вектора
+    static constexpr long chunkBounces = 4096; // Отражений траектории за задачу
+
+    Room *room = nullptr;    // Комната, для которой идет расчет
+    unsigned long roomShape; // Версия стен на момент начала расчета
+    Tracer<double> tracer;   // Снимок геометрии комнаты без целей
+    double scale;            // Размер комнаты, уравнивающий в длине вектора
+                             // смещение и поворот луча
+
+    vector<Trajectory> trajectories;
+    long targetBounces;    // Требуемое число отражений всех траекторий
+    long perTrajectory;    // Требуемое число отражений одной траектории
+    long tasksCount;       // Число задач по chunkBounces отражений
+    long nextTask = 0;     // Номер следующей задачи
+    long totalBounces = 0; // Число отражений всех траекторий
+    bool finished = false;
+
+    vector<Checkpoint> history;
+    long nextCheckpoint; // Число отражений для следующей записи в истории
+
+    void restart(); // Начало расчета по текущему состоянию комнаты
+
+    // Длина касательного вектора: смещение поперек луча и поворот,
+    // умноженный на scale
+    double norm(const Trajectory &trajectory) const;
+
+    // Продолжение траектории на count отражений. Возвращает число отражений
+    long advance(Trajectory &trajectory, long count) const;
+
+public:
+    // Начать расчет по bounces отражениям, поровну между trajectories
+    // траекториями
+    void start(Room *room, long bounces, int trajectories = 64);
+
+    void step(double budget); // Продолжить расчет на budget миллисекунд
+
+    void compute(Room *room, long bounces, int trajectories = 64);
+
+    bool isActive() { return room != nullptr; }
+
+    bool isDone() { return finished; }
+
+    float getProgress(); // Доля выполненных отражений
+
+    Result getResult() const; // Текущая оценка
+
+    const vector<Checkpoint> &getHistory() { return history; }
+
+    void clear();
+};
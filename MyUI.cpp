@@ -4,6 +4,7 @@
 #include "raygui.h"
 #include "raylib.h"
 
+#include "HitEstimator.h"
 #include "MyUI.h"
 #include "Room.h"
 
@@ -168,31 +169,88 @@ void MyUI::saveFile(Room *room) {
     );
 }
 
+void MyUI::saveHeatmap(Heatmap *heatmap) {
+    fs::path filePath = fileDialog.filePath();
+
+    if (filePath.extension() != ".png") {
+        filePath.replace_extension(".png");
+    }
+
+    if (!fs::exists(filePath.parent_path())) {
+        throw runtime_error(
+            "Некоррректное имя файла: " + filePath.filename().string()
+        );
+    }
+
+    heatmap->exportImage(filePath.string().c_str());
+
+    showHint((
+        string("Карта освещенности сохранена в файл ") +
+              filePath.filename().string()
+        ).c_str()
+    );
+}
+
+void MyUI::saveEchogram(Echogram *echogram) {
+    fs::path filePath = fileDialog.filePath();
+
+    if (filePath.extension() != ".csv") {
+        filePath.replace_extension(".csv");
+    }
+
+    if (!fs::exists(filePath.parent_path())) {
+        throw runtime_error(
+            "Некоррректное имя файла: " + filePath.filename().string()
+        );
+    }
+
+    echogram->exportCsv(filePath.string().c_str());
+
+    showHint((
+        "Эхограмма (" + std::to_string(echogram->getArrivals().size()) +
+        " путей) сохранена в файл " + filePath.filename().string()
+        ).c_str()
+    );
+}
+
 void MyUI::showHint(const char *message) {
     currentHint = message;
     hintTimer = 0;
     hintActive = true;
 }
 
-void MyUI::showPanel(Wall *wall, RayStart *rayStart) {
+void MyUI::showPanel(Wall *wall, RayStart *rayStart, RayFan *fan) {
     MyUI::wall = wall;
     MyUI::rayStart = rayStart;
+    MyUI::fan = fan;
 }
 
-void MyUI::drawPanel() {
+void MyUI::drawPanel(
+    ReachMap *reachMap, PeriodicOrbits *orbits, PhaseSpace *phaseSpace
+) {
     Rectangle label = Rectangle{panel.x + 10, panel.y + 50, panel.width, 50};
 
     if (wall) {
         Rectangle typeButton = {panel.x + 20, panel.y + 40, 260, 30};
         WallRound *wallRound = dynamic_cast<WallRound *>(wall);
+        WallEllipse *wallEllipse = dynamic_cast<WallEllipse *>(wall);
+        WallBezier *wallBezier = dynamic_cast<WallBezier *>(wall);
 
         GuiPanel(panel, "Свойства зеркала");
-        if (wallRound) {
-            // Кнопка типа стены
-            if (GuiButton(typeButton, "Тип: сферическое")) {
-                wall = wall->room->changeWallType(wall);
-            }
 
+        // Кнопка типа стены (перебирает типы по кругу)
+        const char *typeName = wallRound     ? "Тип: сферическое"
+                               : wallEllipse ? "Тип: эллиптическое"
+                               : wallBezier  ? "Тип: Безье"
+                                             : "Тип: плоское";
+        if (GuiButton(typeButton, typeName)) {
+            wall = wall->room->changeWallType(wall);
+            wallRound = nullptr;
+            wallEllipse = nullptr;
+            wallBezier = nullptr;
+        }
+
+        if (wallRound) {
             // Кнопка измеения выпуклости
             Rectangle orientButton = {panel.x + 20, panel.y + 140, 260, 30};
             if (GuiButton(orientButton, "Изменить выпуклость")) {
@@ -210,11 +268,77 @@ void MyUI::drawPanel() {
             if (sliderValue != newSliderValue) {
                 wallRound->setRadiusCoef(newSliderValue);
             }
-        } else {
-            if (GuiButton(typeButton, "Тип: плоское")) {
-                wall = wall->room->changeWallType(wall);
+        } else if (wallEllipse) {
+            Rectangle orientButton = {panel.x + 20, panel.y + 140, 260, 30};
+            if (GuiButton(orientButton, "Изменить выпуклость")) {
+                wallEllipse->toggleOrient();
+            }
+
+            // Ползунок отношения полуосей
+            float aspect = wallEllipse->getAspect();
+            float newAspect = aspect;
+            Rectangle slider = {panel.x + 100, panel.y + 90, 135, 25};
+            GuiSliderBar(
+                slider, "Сжатие", TextFormat("%.2f", aspect), &newAspect,
+                0.1f, 2
+            );
+            if (aspect != newAspect) {
+                wallEllipse->setAspect(newAspect);
+            }
+        } else if (wallBezier) {
+            // Ползунки высоты внутренних контрольных точек над хордой
+            for (int i = 0; i < wallBezier->getDegree() - 1; ++i) {
+                float height = wallBezier->getHeight(i);
+                float newHeight = height;
+                Rectangle slider = {
+                    panel.x + 100, panel.y + 85 + 30 * i, 135, 25
+                };
+                GuiSliderBar(
+                    slider, i == 0 ? "Изгиб 1" : "Изгиб 2",
+                    TextFormat("%.2f", height), &newHeight, -1, 1
+                );
+                if (height != newHeight) {
+                    wallBezier->setHeight(i, newHeight);
+                }
+            }
+
+            // Кнопка степени кривой
+            Rectangle degreeButton = {panel.x + 20, panel.y + 150, 260, 30};
+            if (GuiButton(
+                    degreeButton, wallBezier->getDegree() == 2
+                                      ? "Степень: квадратичная"
+                                      : "Степень: кубическая"
+                )) {
+                wallBezier->setDegree(5 - wallBezier->getDegree());
             }
         }
+
+        // Поверхность стены (кнопка перебирает виды по кругу) и доля
+        // отраженного света
+        static const char *surfaceNames[] = {
+            "Поверхность: зеркальная", "Поверхность: диффузная",
+            "Поверхность: светоделитель"
+        };
+        Rectangle surfaceButton = {panel.x + 20, panel.y + 190, 260, 30};
+        if (GuiButton(surfaceButton, surfaceNames[wall->getSurface()])) {
+            Wall::Surface next = (Wall::Surface)((wall->getSurface() + 1) % 3);
+            wall->setSurface(next);
+            // Светоделитель, отражающий весь свет, ничего не пропускает,
+            // поэтому по умолчанию он делит свет поровну
+            if (next == Wall::SURFACE_SPLITTER && wall->getReflectance() == 1) {
+                wall->setReflectance(0.5f);
+            }
+        }
+        float reflectance = wall->getReflectance();
+        float newReflectance = reflectance;
+        Rectangle reflectanceSlider = {panel.x + 100, panel.y + 240, 135, 25};
+        GuiSliderBar(
+            reflectanceSlider, "Отражение",
+            TextFormat("%.0f%%", reflectance * 100), &newReflectance, 0, 1
+        );
+        if (reflectance != newReflectance) {
+            wall->setReflectance(newReflectance);
+        }
     } else if (rayStart) {
         GuiPanel(panel, "Свойства луча");
         // Ползунок угла
@@ -236,6 +360,270 @@ void MyUI::drawPanel() {
         if (GuiButton(directButton, "Изменить направление")) {
             rayStart->inverseDirection();
         }
+
+        // Кнопка оценки доли энергии, доходящей до цели
+        Rectangle estimateButton = {panel.x + 20, panel.y + 150, 260, 30};
+        if (GuiButton(estimateButton, "Энергия в цели")) {
+            try {
+                HitEstimator estimator(rayStart->getWall()->room);
+                HitEstimator::Result result =
+                    estimator.estimate(HitEstimator::SAMPLING_SOBOL, 4096);
+                showHint(TextFormat(
+                    "В цель: %.2f%% ± %.2f%% энергии (%ld лучей)",
+                    100 * result.energy, 100 * result.halfWidth,
+                    result.traces
+                ));
+            } catch (std::exception &e) {
+                showHint(e.what());
+            }
+        }
+
+        // Карта достижимости цели: по горизонтали положение начала луча на
+        // стене, по вертикали угол. Клик по карте переносит туда луч
+        Room *room = rayStart->getWall()->room;
+        Rectangle mapLabel = {panel.x + 20, panel.y + 190, 260, 30};
+        Rectangle mapArea = {panel.x + 20, panel.y + 220, 260, 260};
+        if (!room->aim) {
+            GuiLabel(mapLabel, "Добавьте цель для карты");
+        } else {
+            if (!reachMap->isActive()) {
+                reachMap->start(room);
+            }
+            // Над картой --- маршрут луча ячейки под курсором: первые стены
+            // и число лучей карты с точно таким же маршрутом
+            const Itineraries &itineraries = reachMap->getItineraries();
+            long launch = reachMap->pickLaunch(mapArea, GetMousePosition());
+            if (itineraries.isTraced(launch)) {
+                vector<int> walls = itineraries.getItinerary(launch);
+                string pathText = "Стены:";
+                for (size_t i = 0; i < walls.size() && i < 6; ++i) {
+                    pathText += TextFormat(" %d", walls[i] + 1);
+                }
+                if (walls.size() > 6) {
+                    pathText += "...";
+                }
+                int leaf = itineraries.getLeaf(launch);
+                pathText += TextFormat(
+                    " (лучей: %d)", itineraries.getNode(leaf).ends
+                );
+                GuiLabel(mapLabel, pathText.c_str());
+            } else {
+                GuiLabel(
+                    mapLabel, reachMap->isDone()
+                                  ? "Карта достижимости"
+                                  : TextFormat(
+                                        "Карта достижимости: %.0f%%",
+                                        reachMap->getProgress() * 100
+                                    )
+                );
+            }
+            reachMap->draw(mapArea);
+
+            float t, angle;
+            if (!GuiIsLocked() && IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+                reachMap->pick(mapArea, GetMousePosition(), t, angle)) {
+                try {
+                    rayStart->setT(t);
+                    rayStart->setAngle(angle);
+                    room->defaultRayAngle = angle;
+                } catch (std::exception &e) {
+                    showHint(e.what());
+                }
+            }
+        }
+
+        // Доли энергии этого луча, дошедшие до каждой из целей
+        int aimsCount = room->getAims().size();
+        if (aimsCount > 0) {
+            string energyText = "Попадания в цели:";
+            for (int i = 0; i < aimsCount && i < 6; ++i) {
+                float energy = rayStart->getTree().getAimEnergy(i);
+                energyText += TextFormat("\n%d: %.1f%%", i + 1, 100 * energy);
+            }
+            Rectangle energyLabel = {panel.x + 20, panel.y + 535, 260, 120};
+            GuiLabel(energyLabel, energyText.c_str());
+        }
+
+        // Кнопка удаления луча
+        Rectangle removeButton = {panel.x + 20, panel.y + 495, 260, 30};
+        if (GuiButton(removeButton, "Удалить луч")) {
+            room->removeRay(rayStart);
+            rayStart = nullptr;
+        }
+    } else if (fan) {
+        GuiPanel(panel, "Свойства веера");
+        // Ползунки границ веера
+        float fromValue = fan->getFromAngle() * RAD2DEG;
+        float toValue = fan->getToAngle() * RAD2DEG;
+        float newFromValue = fromValue;
+        float newToValue = toValue;
+        Rectangle fromSlider = {panel.x + 70, panel.y + 50, 165, 25};
+        GuiSliderBar(
+            fromSlider, "От", TextFormat("%.0f°", fromValue), &newFromValue,
+            1.01f, 179
+        );
+        Rectangle toSlider = {panel.x + 70, panel.y + 90, 165, 25};
+        GuiSliderBar(
+            toSlider, "До", TextFormat("%.0f°", toValue), &newToValue, 1.01f,
+            179
+        );
+        if (fromValue != newFromValue || toValue != newToValue) {
+            fan->setAngles(newFromValue * DEG2RAD, newToValue * DEG2RAD);
+        }
+
+        // Ползунок числа лучей или, при адаптивном выборе углов, допустимого
+        // расстояния между соседними лучами
+        Rectangle countSlider = {panel.x + 100, panel.y + 130, 135, 25};
+        if (fan->isAdaptive()) {
+            float tolerance = fan->getTolerance();
+            float newTolerance = tolerance;
+            int raysCount = fan->getAngles().size();
+            GuiSliderBar(
+                countSlider, "Точность",
+                TextFormat("%.1f (%d)", tolerance, raysCount), &newTolerance,
+                RayFan::minimalTolerance, RayFan::maximumTolerance
+            );
+            if (tolerance != newTolerance) {
+                fan->setTolerance(newTolerance);
+            }
+        } else {
+            float countValue = fan->getCount();
+            float newCountValue = countValue;
+            GuiSliderBar(
+                countSlider, "Лучей", TextFormat("%d", fan->getCount()),
+                &newCountValue, 1, RayFan::maximumCount
+            );
+            if ((int)newCountValue != fan->getCount()) {
+                fan->setCount((int)newCountValue);
+            }
+        }
+
+        // Кнопка выбора углов: равномерно или по расхождению лучей
+        Rectangle adaptiveButton = {panel.x + 20, panel.y + 170, 260, 30};
+        if (GuiButton(
+                adaptiveButton, fan->isAdaptive() ? "Шаг: адаптивный"
+                                                  : "Шаг: равномерный"
+            )) {
+            fan->setAdaptive(!fan->isAdaptive());
+        }
+
+        // Кнопка изменения направления
+        Rectangle directButton = {panel.x + 20, panel.y + 210, 260, 30};
+        if (GuiButton(directButton, "Изменить направление")) {
+            fan->inverseDirection();
+        }
+
+        // Кнопка каустик и список найденных фокусов
+        Rectangle causticButton = {panel.x + 20, panel.y + 250, 260, 30};
+        if (GuiButton(
+                causticButton,
+                fan->isCausticShown() ? "Скрыть каустики" : "Каустики"
+            )) {
+            fan->setCausticShown(!fan->isCausticShown());
+        }
+        if (fan->isCausticShown()) {
+            const vector<Caustic::Focus> &foci = fan->getCaustic().getFoci();
+            string fociText = TextFormat("Фокусов: %d", (int)foci.size());
+            for (size_t i = 0; i < foci.size() && i < 6; ++i) {
+                fociText += TextFormat(
+                    "\n(%.0f, %.0f), отражений: %d", foci[i].point.x,
+                    foci[i].point.y, foci[i].bounces
+                );
+            }
+            Rectangle fociLabel = {panel.x + 20, panel.y + 340, 260, 150};
+            GuiLabel(fociLabel, fociText.c_str());
+        }
+
+        // Кнопка удаления веера
+        Rectangle removeButton = {panel.x + 20, panel.y + 290, 260, 30};
+        if (GuiButton(removeButton, "Удалить веер")) {
+            fan->getWall()->room->removeFan(fan);
+            fan = nullptr;
+        }
+    } else if (mode == UI_NORMAL && phaseSpace->isActive()) {
+        GuiPanel(panel, "Фазовое пространство");
+
+        Rectangle countLabel = {panel.x + 20, panel.y + 40, 260, 30};
+        GuiLabel(
+            countLabel, phaseSpace->isDone()
+                            ? TextFormat(
+                                  "Отражений: %ld", phaseSpace->getBounces()
+                              )
+                            : TextFormat(
+                                  "Отражений: %ld (%.0f%%)",
+                                  phaseSpace->getBounces(),
+                                  phaseSpace->getProgress() * 100
+                              )
+        );
+
+        // Плотность отражений: по горизонтали положение на границе (тонкие
+        // линии --- стыки стен), по вертикали синус угла к нормали
+        Rectangle area = {panel.x + 20, panel.y + 80, 260, 260};
+        phaseSpace->draw(area);
+        GuiLabel(
+            Rectangle{panel.x + 20, panel.y + 350, 260, 75},
+            "По горизонтали: положение на \nгранице, по вертикали: синус "
+            "\nугла к нормали"
+        );
+    } else if (mode == UI_NORMAL && orbits->isActive()) {
+        GuiPanel(panel, "Периодические орбиты");
+
+        // Ползунок периода (0 --- показать орбиты всех периодов)
+        Rectangle periodSlider = {panel.x + 70, panel.y + 50, 165, 25};
+        float period = orbits->getShownPeriod();
+        float newPeriod = period;
+        GuiSliderBar(
+            periodSlider, "Период",
+            period == 0 ? "все" : TextFormat("%.0f", period), &newPeriod, 0,
+            PeriodicOrbits::maximumPeriod
+        );
+        if ((int)newPeriod != (int)period) {
+            orbits->setShownPeriod((int)newPeriod);
+            orbitsScroll = 0;
+        }
+
+        Rectangle countLabel = {panel.x + 20, panel.y + 90, 260, 30};
+        GuiLabel(
+            countLabel, orbits->isDone()
+                            ? TextFormat(
+                                  "Найдено орбит: %d", orbits->getOrbitsCount()
+                              )
+                            : TextFormat(
+                                  "Поиск: %.0f%%, найдено %d",
+                                  orbits->getProgress() * 100,
+                                  orbits->getOrbitsCount()
+                              )
+        );
+
+        // Список орбит периода. Выбранная орбита выделяется на поле
+        Rectangle orbitsList = {panel.x + 20, panel.y + 130, 260, 360};
+        if (orbits->getShownPeriod() == 0) {
+            GuiLabel(
+                Rectangle{panel.x + 20, panel.y + 130, 260, 50},
+                "Выберите период, чтобы \nувидеть список орбит"
+            );
+        } else {
+            const vector<PeriodicOrbits::Orbit> &list =
+                orbits->getOrbits(orbits->getShownPeriod());
+            string text;
+            for (size_t i = 0; i < list.size(); ++i) {
+                const char *stability =
+                    list[i].stability == PeriodicOrbits::STABILITY_STABLE
+                        ? "устойчивая"
+                    : list[i].stability == PeriodicOrbits::STABILITY_NEUTRAL
+                        ? "нейтральная"
+                        : "неустойчивая";
+                text += TextFormat(
+                    "%s%d: %s, след %.3g", i == 0 ? "" : ";", (int)i + 1,
+                    stability, list[i].trace
+                );
+            }
+            int active = orbits->getSelected();
+            GuiListView(orbitsList, text.c_str(), &orbitsScroll, &active);
+            if (active != orbits->getSelected()) {
+                orbits->setSelected(active);
+            }
+        }
     } else {
         GuiPanel(panel, "");
         if (mode == UI_NORMAL) {
@@ -259,6 +647,20 @@ void MyUI::drawPanel() {
             );
         } else if (mode == UI_ADD_RAY) {
             GuiLabel(label, "Кликните на зеркало, чтобы \nотложить луч света");
+        } else if (mode == UI_ADD_AIM) {
+            GuiLabel(
+                label, "Кликните на пустое место, \nчтобы добавить цель, или "
+                       "\nна цель, чтобы удалить ее"
+            );
+        } else if (mode == UI_ADD_FAN) {
+            GuiLabel(
+                label, "Кликните на зеркало, чтобы \nпоставить веер лучей"
+            );
+        } else if (mode == UI_ADD_LIGHT) {
+            GuiLabel(
+                label, "Кликните внутри комнаты, \nчтобы поместить источник "
+                       "\nсвета"
+            );
         }
     }
 }
@@ -269,6 +671,7 @@ void MyUI::setMode(UIMode newMode) {
         mode = UI_IMPORT;
         wall = nullptr;
         rayStart = nullptr;
+        fan = nullptr;
         SetMouseCursor(MOUSE_CURSOR_DEFAULT);
         fileDialog.show(FileDialog::FILE_DIALOG_OPEN);
         break;
@@ -323,12 +726,62 @@ void MyUI::setMode(UIMode newMode) {
         mode = UI_CLEAR;
         wall = nullptr;
         rayStart = nullptr;
+        fan = nullptr;
+        break;
+    }
+    case UI_HEATMAP: {
+        mode = UI_HEATMAP;
+        break;
+    }
+    case UI_EXPORT_HEATMAP: {
+        mode = UI_EXPORT_HEATMAP;
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        fileDialog.show(FileDialog::FILE_DIALOG_SAVE);
+        break;
+    }
+    case UI_ADD_LIGHT: {
+        mode = UI_ADD_LIGHT;
+        SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
+        break;
+    }
+    case UI_CLEAR_LIGHT: {
+        mode = UI_CLEAR_LIGHT;
+        break;
+    }
+    case UI_EXPORT_ECHOGRAM: {
+        mode = UI_EXPORT_ECHOGRAM;
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        fileDialog.show(FileDialog::FILE_DIALOG_SAVE);
+        break;
+    }
+    case UI_RADIOSITY: {
+        mode = UI_RADIOSITY;
+        break;
+    }
+    case UI_ADD_FAN: {
+        mode = UI_ADD_FAN;
+        SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
+        break;
+    }
+    case UI_LYAPUNOV: {
+        mode = UI_LYAPUNOV;
+        break;
+    }
+    case UI_ORBITS: {
+        mode = UI_ORBITS;
+        break;
+    }
+    case UI_PHASE_SPACE: {
+        mode = UI_PHASE_SPACE;
         break;
     }
     }
 }
 
-void MyUI::handleButtons(bool isClosed) {
+void MyUI::handleButtons(
+    bool isClosed, bool hasHeatmap, bool hasLight, bool hasRadiosity,
+    bool hasLyapunov, bool hasOrbits, bool hasPhaseSpace
+) {
     if (importButton.draw()) {
         setMode(UI_IMPORT);
     }
@@ -365,6 +818,10 @@ void MyUI::handleButtons(bool isClosed) {
         setMode(UI_ADD_RAY);
     }
 
+    if (addFanButton.draw(getMode() == UI_ADD_FAN)) {
+        setMode(UI_ADD_FAN);
+    }
+
     if (addAimButton.draw(getMode() == UI_ADD_AIM)) {
         setMode(UI_ADD_AIM);
     }
@@ -372,6 +829,70 @@ void MyUI::handleButtons(bool isClosed) {
     if (clearButton.draw()) {
         setMode(UI_CLEAR);
     }
+
+    if (heatmapButton.draw(hasHeatmap)) {
+        setMode(UI_HEATMAP);
+    }
+
+    if (exportHeatmapButton.draw()) {
+        if (hasHeatmap) {
+            setMode(UI_EXPORT_HEATMAP);
+        } else {
+            showHint("Карта освещенности не рассчитана");
+        }
+    }
+
+    // Повторное нажатие убирает источник света
+    if (addLightButton.draw(getMode() == UI_ADD_LIGHT || hasLight)) {
+        if (hasLight) {
+            setMode(UI_CLEAR_LIGHT);
+        } else if (!isClosed) {
+            showHint("Комната не замкнута");
+        } else {
+            setMode(UI_ADD_LIGHT);
+        }
+    }
+
+    // Эхограмма строится от источника света как от источника звука
+    if (echogramButton.draw()) {
+        if (hasLight) {
+            setMode(UI_EXPORT_ECHOGRAM);
+        } else {
+            showHint("Сначала поставьте источник");
+        }
+    }
+
+    // Освещенность диффузных стен (повторное нажатие скрывает ее)
+    if (radiosityButton.draw(hasRadiosity)) {
+        if (hasLight || hasRadiosity) {
+            setMode(UI_RADIOSITY);
+        } else {
+            showHint("Сначала поставьте источник");
+        }
+    }
+
+    // Показатель Ляпунова траекторий (повторное нажатие останавливает расчет)
+    if (lyapunovButton.draw(hasLyapunov)) {
+        if (hasLyapunov || isClosed) {
+            setMode(UI_LYAPUNOV);
+        } else {
+            showHint("Комната не замкнута");
+        }
+    }
+
+    // Периодические орбиты (повторное нажатие скрывает их)
+    if (orbitsButton.draw(hasOrbits)) {
+        setMode(UI_ORBITS);
+    }
+
+    // Фазовое пространство (повторное нажатие скрывает его)
+    if (phaseSpaceButton.draw(hasPhaseSpace)) {
+        if (hasPhaseSpace || isClosed) {
+            setMode(UI_PHASE_SPACE);
+        } else {
+            showHint("Комната не замкнута");
+        }
+    }
 }
 
 void MyUI::updateSize() {
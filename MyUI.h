@@ -4,7 +4,12 @@
 
 #include "raylib.h"
 
+#include "Echogram.h"
 #include "FileDialog.h"
+#include "Heatmap.h"
+#include "PeriodicOrbits.h"
+#include "PhaseSpace.h"
+#include "ReachMap.h"
 #include "Room.h"
 
 class Button {
@@ -36,6 +41,8 @@ private:
     Rectangle panel = Rectangle{canvas.width, 0, rightPanelWidth, screen.y};
     Wall *wall = nullptr;
     RayStart *rayStart = nullptr;
+    RayFan *fan = nullptr;
+    int orbitsScroll = 0; // Прокрутка списка периодических орбит
 
     Vector2 hintPosition;
     Rectangle hintBar;
@@ -48,6 +55,15 @@ private:
     Button addRayButton = {Rectangle{210, 5, 30, 30}, "#145#"};
     Button addAimButton = {Rectangle{260, 5, 30, 30}, "#64#"};
     Button clearButton = {Rectangle{310, 5, 30, 30}, "#24#"};
+    Button heatmapButton = {Rectangle{360, 5, 30, 30}, "#197#"};
+    Button exportHeatmapButton = {Rectangle{395, 5, 30, 30}, "#12#"};
+    Button addLightButton = {Rectangle{445, 5, 30, 30}, "#157#"};
+    Button echogramButton = {Rectangle{480, 5, 30, 30}, "#124#"};
+    Button radiosityButton = {Rectangle{515, 5, 30, 30}, "#94#"};
+    Button addFanButton = {Rectangle{565, 5, 30, 30}, "#146#"};
+    Button lyapunovButton = {Rectangle{615, 5, 30, 30}, "#147#"};
+    Button orbitsButton = {Rectangle{650, 5, 30, 30}, "#61#"};
+    Button phaseSpaceButton = {Rectangle{685, 5, 30, 30}, "#101#"};
 
 public:
     enum UIMode {
@@ -61,7 +77,17 @@ public:
         UI_EDIT_RAY,
         UI_IMPORT,
         UI_EXPORT,
-        UI_CLEAR
+        UI_CLEAR,
+        UI_HEATMAP,
+        UI_EXPORT_HEATMAP,
+        UI_ADD_LIGHT,
+        UI_CLEAR_LIGHT,
+        UI_EXPORT_ECHOGRAM,
+        UI_RADIOSITY,
+        UI_ADD_FAN,
+        UI_LYAPUNOV,
+        UI_ORBITS,
+        UI_PHASE_SPACE
     };
 
     MyUI(const char *fontPath, const char *iconsPath);
@@ -79,11 +105,18 @@ public:
 
     void saveFile(Room *room);
     Room *openFIle(Room *room);
+    void saveHeatmap(Heatmap *heatmap);
+    void saveEchogram(Echogram *echogram);
 
     void showHint(const char *message);
-    void showPanel(Wall *wall, RayStart *rayStart);
-    void drawPanel();
-    void handleButtons(bool isClosed);
+    void showPanel(Wall *wall, RayStart *rayStart, RayFan *fan = nullptr);
+    void drawPanel(
+        ReachMap *reachMap, PeriodicOrbits *orbits, PhaseSpace *phaseSpace
+    );
+    void handleButtons(
+        bool isClosed, bool hasHeatmap, bool hasLight, bool hasRadiosity,
+        bool hasLyapunov, bool hasOrbits, bool hasPhaseSpace
+    );
 
 private:
     MyUI::UIMode mode = UI_NORMAL;
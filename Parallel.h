@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+// Выполнение пронумерованных задач в нескольких потоках порциями по времени
+// для расчетов, которые продолжают траектории между кадрами
+
+// Текущее время в миллисекундах
+inline double now() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+// Число потоков расчета
+inline int hardwareThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Выполнение задач с номерами из [next, end) до момента deadline. Задачи i и
+// i + period продолжают одну траекторию, поэтому они идут проходами по
+// period задач, и следующий проход начинается, только когда завершены все
+// задачи предыдущего: одну траекторию не продолжают два потока сразу.
+// Внутри прохода потоки берут задачи по очереди из общего счетчика и
+// вызывают run(task, thread), где thread --- номер потока меньше
+// hardwareThreads(). Независимые задачи идут одним проходом: period равен
+// end. Возвращает номер первой невыполненной задачи
+template <typename Run>
+long runPasses(long next, long end, long period, double deadline, Run run) {
+    while (next < end && now() < deadline) {
+        long passEnd = std::min(end, (next / period + 1) * period);
+        int threadsCount = std::min<long>(hardwareThreads(), passEnd - next);
+        std::atomic<long> counter(next);
+        vector<std::thread> threads;
+        for (int k = 0; k < threadsCount; ++k) {
+            threads.emplace_back([&, k]() {
+                while (now() < deadline) {
+                    long task = counter++;
+                    if (task >= passEnd) {
+                        break;
+                    }
+                    run(task, k);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        next = std::min(counter.load(), passEnd);
+    }
+    return next;
+}
@@ -0,0 +1,672 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Parallel.h"
+#include "PeriodicOrbits.h"
+#include "Room.h"
+#include "Tracer.h"
+
+const char *PeriodicOrbits::NoWalls::what() const noexcept {
+    return "Для поиска орбит нужны стены";
+}
+
+// Вектор, повернутый на прямой угол против часовой стрелки
+static Vec2<double> perp(const Vec2<double> &v) {
+    return Vec2<double>(-v.y, v.x);
+}
+
+// Направление под углом angle к стене на сторону нормали normal
+static Vec2<double> turn(const Vec2<double> &normal, double angle) {
+    double c = std::cos(angle - PI / 2);
+    double s = std::sin(angle - PI / 2);
+    return Vec2<double>(
+        normal.x * c - normal.y * s, normal.x * s + normal.y * c
+    );
+}
+
+// Положение точки вдоль стены для выбора первой точки обхода: у прямых стен
+// это параметр t, у дуг --- близкая к нему проекция на хорду
+static double alongWall(Wall *wall, const Vec2<double> &point) {
+    Vec2<double> a(wall->getStart()->getCoord());
+    Vec2<double> b(wall->getEnd()->getCoord());
+    return dot(point - a, b - a) / std::max(1e-9, dot(b - a, b - a));
+}
+
+void PeriodicOrbits::start(Room *room) {
+    if (room->getWalls().empty()) {
+        throw NoWalls();
+    }
+
+    clear();
+    PeriodicOrbits::room = room;
+    restart();
+}
+
+void PeriodicOrbits::restart() {
+    roomShape = room->getShapeVersion();
+    tracer.update(room);
+    tracer.ignoreAim();
+
+    vector<Wall *> walls;
+    for (size_t i = 0; i < tracer.wallsCount(); ++i) {
+        walls.push_back(tracer.getWall(i));
+    }
+    Vector2 low = walls[0]->getStart()->getCoord();
+    Vector2 high = low;
+    for (Wall *wall : walls) {
+        for (int k = 0; k <= 8; ++k) {
+            Vector2 point = wall->getPointByT((float)k / 8);
+            low = Vector2{std::min(low.x, point.x), std::min(low.y, point.y)};
+            high =
+                Vector2{std::max(high.x, point.x), std::max(high.y, point.y)};
+        }
+    }
+    scale = std::max(1.0f, Vector2Distance(low, high));
+
+    sweepTasks = (long)walls.size() * 2 * sweepColumns;
+    candidates.clear();
+    seeds.clear();
+    found.clear();
+    results.clear();
+    orbits.assign(maximumPeriod + 1, {});
+    selected = -1;
+    nextTask = 0;
+    finished = false;
+}
+
+bool PeriodicOrbits::evaluate(const State &state, Frame &frame) const {
+    // Концы стен исключаются: в угле нормаль не определена
+    const double margin = 1e-6;
+    const double h = 1e-3;
+    if (!(state.t > margin && state.t < 1 - margin && state.angle > margin &&
+          state.angle < PI - margin)) {
+        return false;
+    }
+
+    // Производные по t --- конечными разностями, у концов стены односторонними
+    Wall *wall = tracer.getWall(state.wall);
+    double low = std::max(0.0, state.t - h);
+    double high = std::min(1.0, state.t + h);
+    Vector2 point = wall->getPointByT(state.t);
+    Vector2 before = wall->getPointByT(low);
+    Vector2 after = wall->getPointByT(high);
+    Vec2<double> derivative =
+        (Vec2<double>(after) - Vec2<double>(before)) * (1 / (high - low));
+    frame.point = Vec2<double>(point);
+    frame.speed = length(derivative);
+    if (!(frame.speed > 0)) {
+        return false;
+    }
+    frame.tangent = derivative * (1 / frame.speed);
+
+    auto normal = [&](const Vector2 &at) {
+        Vector2 n = wall->getNormal(at);
+        return normalize(Vec2<double>(n.x * state.side, n.y * state.side));
+    };
+    frame.dir = turn(normal(point), state.angle);
+    Vec2<double> dirBefore = turn(normal(before), state.angle);
+    Vec2<double> dirAfter = turn(normal(after), state.angle);
+    frame.dirShift =
+        (dirAfter - dirBefore) * (1 / ((high - low) * frame.speed));
+    return true;
+}
+
+void PeriodicOrbits::keep(const Seed &seed, vector<Seed> &best) {
+    // Затравки с одной последовательностью стен обычно ведут к одной орбите
+    // или к одному семейству нейтральных орбит, которое иначе вытеснило бы
+    // остальные
+    auto same = std::find_if(best.begin(), best.end(), [&](const Seed &other) {
+        return other.itinerary == seed.itinerary;
+    });
+    if (same != best.end()) {
+        if (!less(seed, *same)) {
+            return;
+        }
+        best.erase(same);
+    } else if ((int)best.size() == seedsPerPeriod) {
+        if (!less(seed, best.back())) {
+            return;
+        }
+        best.pop_back();
+    }
+    best.insert(std::upper_bound(best.begin(), best.end(), seed, less), seed);
+}
+
+bool PeriodicOrbits::less(const Seed &a, const Seed &b) {
+    // При равной близости порядок не должен зависеть от распределения задач
+    // по потокам
+    if (a.closeness != b.closeness) {
+        return a.closeness < b.closeness;
+    }
+    if (a.launch.wall != b.launch.wall) {
+        return a.launch.wall < b.launch.wall;
+    }
+    if (a.launch.side != b.launch.side) {
+        return a.launch.side < b.launch.side;
+    }
+    if (a.launch.t != b.launch.t) {
+        return a.launch.t < b.launch.t;
+    }
+    return a.launch.angle < b.launch.angle;
+}
+
+void PeriodicOrbits::sweepColumn(
+    long task, vector<vector<Seed>> &best
+) const {
+    int wallIndex = task / (2 * sweepColumns);
+    double side = (task / sweepColumns) % 2 == 0 ? 1 : -1;
+    double t = (task % sweepColumns + 0.5) / sweepColumns;
+    Wall *wall = tracer.getWall(wallIndex);
+
+    Tracer<double>::Hit hit;
+    for (int row = 0; row < sweepRows; ++row) {
+        State launch = {wallIndex, side, t, PI * (row + 0.5) / sweepRows};
+        Frame frame;
+        if (!evaluate(launch, frame)) {
+            continue;
+        }
+
+        // Запуск --- первая точка обхода: стены с меньшим индексом и точки
+        // раньше по той же стене на пути не встречаются. Тогда орбита
+        // находится один раз, а не из каждой своей точки
+        double key = wallIndex + alongWall(wall, frame.point);
+        double smallest = key;
+
+        Vec2<double> origin = frame.point;
+        Vec2<double> dir = frame.dir;
+        int fromWall = wallIndex;
+        unsigned itinerary = wallIndex;
+        for (int bounces = 1; bounces <= maximumPeriod; ++bounces) {
+            if (!tracer.trace(origin, dir, fromWall, hit)) {
+                break;
+            }
+            dir = tracer.reflect(hit, dir);
+            origin = hit.point;
+            fromWall = hit.wall;
+            itinerary = itinerary * 31 + hit.wall + 1;
+            if (hit.wall < wallIndex) {
+                break;
+            }
+
+            if (hit.wall == wallIndex && smallest >= key - 0.01) {
+                double closeness =
+                    length(hit.point - frame.point) / scale +
+                    std::fabs(std::atan2(
+                        cross(frame.dir, dir), dot(frame.dir, dir)
+                    ));
+                if (closeness < seedTolerance) {
+                    Seed seed = {bounces, closeness, itinerary, launch};
+                    keep(seed, best[bounces]);
+                }
+            }
+            smallest = std::min(
+                smallest,
+                hit.wall + alongWall(tracer.getWall(hit.wall), hit.point)
+            );
+        }
+    }
+}
+
+double PeriodicOrbits::residuals(
+    const vector<State> &states, vector<double> &residual,
+    vector<double> *jacobian, vector<Frame> &frames
+) const {
+    const double infinity = std::numeric_limits<double>::infinity();
+    int period = states.size();
+    int size = 2 * period;
+    for (int i = 0; i < period; ++i) {
+        if (!evaluate(states[i], frames[i])) {
+            return infinity;
+        }
+    }
+    if (jacobian) {
+        jacobian->assign(size * size, 0);
+    }
+
+    double sum = 0;
+    Tracer<double>::Hit hit;
+    for (int i = 0; i < period; ++i) {
+        int j = (i + 1) % period;
+        const Frame &from = frames[i];
+        const Frame &to = frames[j];
+        if (!tracer.trace(from.point, from.dir, states[i].wall, hit) ||
+            hit.wall != states[j].wall) {
+            return infinity;
+        }
+
+        // Расхождение точки попадания с точкой следующего состояния вдоль
+        // стены и угол между отраженным лучом и его направлением
+        Vec2<double> reflected = tracer.reflect(hit, from.dir);
+        residual[2 * i] = dot(hit.point - to.point, to.tangent);
+        residual[2 * i + 1] =
+            std::atan2(cross(to.dir, reflected), dot(to.dir, reflected));
+        sum += residual[2 * i] * residual[2 * i] +
+               residual[2 * i + 1] * residual[2 * i + 1] * scale * scale;
+
+        if (!jacobian) {
+            continue;
+        }
+        // Сдвиг точки вдоль стены и поворот луча на угол к стене
+        Tracer<double>::Differential shift = {from.tangent, from.dirShift};
+        Tracer<double>::Differential rotation = {
+            Vec2<double>(), perp(from.dir)
+        };
+        shift = tracer.reflectDifferential(hit, from.dir, shift);
+        rotation = tracer.reflectDifferential(hit, from.dir, rotation);
+
+        // У периода 1 состояния i и j совпадают, и производные складываются
+        double *row = jacobian->data() + 2 * i * size;
+        row[2 * i] += dot(shift.origin, to.tangent);
+        row[2 * i + 1] += dot(rotation.origin, to.tangent);
+        row[2 * j] -= 1;
+        row += size;
+        row[2 * i] += cross(to.dir, shift.dir);
+        row[2 * i + 1] += cross(to.dir, rotation.dir);
+        row[2 * j] += cross(to.dirShift, reflected);
+        row[2 * j + 1] += cross(perp(to.dir), reflected);
+    }
+    return sum;
+}
+
+// Решение системы matrix * x = right методом Гаусса с выбором ведущего
+// элемента. Столбцы без ведущего элемента (вырожденная матрица у семейств
+// орбит) дают нулевые неизвестные
+static vector<double> solve(vector<double> matrix, vector<double> right) {
+    int size = right.size();
+    double largest = 0;
+    for (double value : matrix) {
+        largest = std::max(largest, std::fabs(value));
+    }
+    double threshold = largest * 1e-10;
+
+    vector<int> pivotColumn;
+    int row = 0;
+    for (int column = 0; column < size && row < size; ++column) {
+        int pivot = row;
+        for (int r = row + 1; r < size; ++r) {
+            if (std::fabs(matrix[r * size + column]) >
+                std::fabs(matrix[pivot * size + column])) {
+                pivot = r;
+            }
+        }
+        if (std::fabs(matrix[pivot * size + column]) <= threshold) {
+            continue;
+        }
+        if (pivot != row) {
+            std::swap_ranges(
+                matrix.begin() + pivot * size,
+                matrix.begin() + (pivot + 1) * size,
+                matrix.begin() + row * size
+            );
+            std::swap(right[pivot], right[row]);
+        }
+        for (int r = row + 1; r < size; ++r) {
+            double factor =
+                matrix[r * size + column] / matrix[row * size + column];
+            if (factor == 0) {
+                continue;
+            }
+            for (int c = column; c < size; ++c) {
+                matrix[r * size + c] -= factor * matrix[row * size + c];
+            }
+            right[r] -= factor * right[row];
+        }
+        pivotColumn.push_back(column);
+        ++row;
+    }
+
+    vector<double> x(size, 0);
+    for (int k = row - 1; k >= 0; --k) {
+        int column = pivotColumn[k];
+        double value = right[k];
+        for (int c = column + 1; c < size; ++c) {
+            value -= matrix[k * size + c] * x[c];
+        }
+        x[column] = value / matrix[k * size + column];
+    }
+    return x;
+}
+
+bool PeriodicOrbits::refine(const Seed &seed, Orbit &orbit) const {
+    int period = seed.period;
+    int size = 2 * period;
+
+    // Начальные состояния --- точки отражений луча затравки
+    vector<State> states = {seed.launch};
+    vector<Frame> frames(period);
+    if (!evaluate(seed.launch, frames[0])) {
+        return false;
+    }
+    Vec2<double> origin = frames[0].point;
+    Vec2<double> dir = frames[0].dir;
+    int fromWall = seed.launch.wall;
+    Tracer<double>::Hit hit;
+    for (int i = 1; i < period; ++i) {
+        if (!tracer.trace(origin, dir, fromWall, hit)) {
+            return false;
+        }
+        dir = tracer.reflect(hit, dir);
+        origin = hit.point;
+        fromWall = hit.wall;
+
+        Wall *wall = tracer.getWall(hit.wall);
+        float t = wall->getTByPoint(hit.point.toVector2(), 1);
+        if (t < 0) {
+            return false;
+        }
+        Vector2 n = wall->getNormal(wall->getPointByT(t));
+        Vec2<double> normal = normalize(Vec2<double>(n));
+        double side = dot(dir, normal) >= 0 ? 1 : -1;
+        normal = normal * side;
+        double angle =
+            PI / 2 + std::atan2(cross(normal, dir), dot(normal, dir));
+        states.push_back({hit.wall, side, t, angle});
+    }
+
+    vector<double> residual(size);
+    vector<double> jacobian;
+    double merit = residuals(states, residual, &jacobian, frames);
+    bool converged = false;
+    for (int iteration = 0; iteration < maximumIterations; ++iteration) {
+        if (!(merit < std::numeric_limits<double>::infinity())) {
+            return false;
+        }
+        converged = true;
+        for (int i = 0; i < period && converged; ++i) {
+            converged = std::fabs(residual[2 * i]) < positionTolerance &&
+                        std::fabs(residual[2 * i + 1]) < angleTolerance;
+        }
+        if (converged) {
+            break;
+        }
+
+        vector<double> right(size);
+        for (int k = 0; k < size; ++k) {
+            right[k] = -residual[k];
+        }
+        vector<double> step = solve(jacobian, right);
+        vector<double> speeds(period);
+        for (int i = 0; i < period; ++i) {
+            speeds[i] = frames[i].speed;
+        }
+
+        // Шаг уменьшается вдвое, пока невязки не уменьшатся
+        vector<State> trial(period);
+        vector<double> trialResidual(size);
+        vector<Frame> trialFrames(period);
+        double factor = 1;
+        double trialMerit = std::numeric_limits<double>::infinity();
+        for (int halving = 0; halving < 10; ++halving, factor /= 2) {
+            for (int i = 0; i < period; ++i) {
+                trial[i] = states[i];
+                trial[i].t += factor * step[2 * i] / speeds[i];
+                trial[i].angle += factor * step[2 * i + 1];
+            }
+            trialMerit = residuals(trial, trialResidual, nullptr, trialFrames);
+            if (trialMerit < merit) {
+                break;
+            }
+        }
+        if (!(trialMerit < merit)) {
+            return false;
+        }
+        states = trial;
+        merit = residuals(states, residual, &jacobian, frames);
+    }
+    if (!converged) {
+        return false;
+    }
+
+    // Орбита, которая за period отражений обходит меньший цикл несколько
+    // раз, найдена в своем периоде
+    for (int divisor = 1; divisor < period; ++divisor) {
+        if (period % divisor != 0) {
+            continue;
+        }
+        bool repeats = true;
+        for (int i = 0; i < period && repeats; ++i) {
+            int k = (i + divisor) % period;
+            repeats = states[i].wall == states[k].wall &&
+                      length(frames[i].point - frames[k].point) <
+                          mergeTolerance;
+        }
+        if (repeats) {
+            return false;
+        }
+    }
+
+    // Матрица монодромии --- произведение производных отображения
+    // отражения по сдвигу точки вдоль стены и повороту луча
+    double monodromy[2][2] = {{1, 0}, {0, 1}};
+    orbit.points.clear();
+    orbit.walls.clear();
+    for (int i = 0; i < period; ++i) {
+        int j = (i + 1) % period;
+        const Frame &from = frames[i];
+        const Frame &to = frames[j];
+        if (!tracer.trace(from.point, from.dir, states[i].wall, hit)) {
+            return false;
+        }
+        Tracer<double>::Differential shift = {from.tangent, Vec2<double>()};
+        Tracer<double>::Differential rotation = {
+            Vec2<double>(), perp(from.dir)
+        };
+        shift = tracer.reflectDifferential(hit, from.dir, shift);
+        rotation = tracer.reflectDifferential(hit, from.dir, rotation);
+        double segment[2][2] = {
+            {dot(shift.origin, to.tangent), dot(rotation.origin, to.tangent)},
+            {cross(to.dir, shift.dir), cross(to.dir, rotation.dir)}
+        };
+        double product[2][2];
+        for (int r = 0; r < 2; ++r) {
+            for (int c = 0; c < 2; ++c) {
+                product[r][c] = segment[r][0] * monodromy[0][c] +
+                                segment[r][1] * monodromy[1][c];
+            }
+        }
+        std::copy(&product[0][0], &product[0][0] + 4, &monodromy[0][0]);
+
+        orbit.points.push_back(from.point);
+        orbit.walls.push_back(states[i].wall);
+    }
+    orbit.trace = monodromy[0][0] + monodromy[1][1];
+    double margin = 1e-6 * std::max(1.0, std::fabs(orbit.trace));
+    if (std::fabs(orbit.trace) < 2 - margin) {
+        orbit.stability = STABILITY_STABLE;
+    } else if (std::fabs(orbit.trace) <= 2 + margin) {
+        orbit.stability = STABILITY_NEUTRAL;
+    } else {
+        orbit.stability = STABILITY_UNSTABLE;
+    }
+    return true;
+}
+
+// Совпадают ли последовательности стен с точностью до сдвига и обращения
+static bool sameCycle(const vector<int> &a, const vector<int> &b) {
+    int period = a.size();
+    for (int shift = 0; shift < period; ++shift) {
+        bool forward = true;
+        bool backward = true;
+        for (int i = 0; i < period && (forward || backward); ++i) {
+            forward = forward && a[i] == b[(i + shift) % period];
+            backward = backward && a[i] == b[(shift - i + period) % period];
+        }
+        if (forward || backward) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PeriodicOrbits::merge(const Orbit &orbit) {
+    for (const Orbit &other : orbits[orbit.points.size()]) {
+        if (orbit.stability == STABILITY_NEUTRAL &&
+            other.stability == STABILITY_NEUTRAL &&
+            sameCycle(orbit.walls, other.walls)) {
+            return;
+        }
+        bool same = true;
+        for (const Vec2<double> &point : orbit.points) {
+            bool near = false;
+            for (const Vec2<double> &otherPoint : other.points) {
+                near = near || length(point - otherPoint) < mergeTolerance;
+            }
+            same = same && near;
+        }
+        if (same) {
+            return;
+        }
+    }
+    orbits[orbit.points.size()].push_back(orbit);
+}
+
+void PeriodicOrbits::step(double budget) {
+    if (!room) {
+        return;
+    }
+
+    if (room->getShapeVersion() != roomShape) {
+        if (room->getWalls().empty()) {
+            clear();
+            return;
+        }
+        restart();
+    }
+
+    if (finished) {
+        return;
+    }
+
+    int threadsCount = hardwareThreads();
+    if ((int)candidates.size() < threadsCount) {
+        candidates.resize(
+            threadsCount, vector<vector<Seed>>(maximumPeriod + 1)
+        );
+    }
+    long tasksCount = sweepTasks + seeds.size();
+    long first = nextTask;
+
+    // Задачи перебора и затравок не смешиваются: затравки выбираются, когда
+    // перебор закончен. Задачи независимы и идут одним проходом
+    long last = nextTask < sweepTasks ? sweepTasks : tasksCount;
+    nextTask = runPasses(
+        nextTask, last, last, now() + budget, [&](long i, int k) {
+            if (i < sweepTasks) {
+                sweepColumn(i, candidates[k]);
+                return;
+            }
+            long index = i - sweepTasks;
+            Orbit orbit;
+            found[index] = refine(seeds[index], orbit);
+            if (found[index]) {
+                results[index] = orbit;
+            }
+        }
+    );
+
+    // Орбиты добавляются в порядке затравок, поэтому результат не зависит
+    // от числа потоков
+    for (long i = std::max(first, sweepTasks); i < nextTask; ++i) {
+        long index = i - sweepTasks;
+        if (found[index]) {
+            merge(results[index]);
+            results[index] = Orbit();
+        }
+    }
+
+    if (nextTask == sweepTasks && seeds.empty()) {
+        // Лучшие затравки всех потоков для каждого периода
+        for (int period = 1; period <= maximumPeriod; ++period) {
+            vector<Seed> all;
+            for (vector<vector<Seed>> &best : candidates) {
+                for (const Seed &seed : best[period]) {
+                    keep(seed, all);
+                }
+            }
+            seeds.insert(seeds.end(), all.begin(), all.end());
+        }
+        candidates.clear();
+        found.assign(seeds.size(), false);
+        results.assign(seeds.size(), Orbit());
+    }
+    finished = nextTask >= sweepTasks + (long)seeds.size();
+}
+
+void PeriodicOrbits::compute(Room *room) {
+    start(room);
+    while (!finished) {
+        step(std::numeric_limits<double>::infinity());
+    }
+}
+
+float PeriodicOrbits::getProgress() {
+    if (finished) {
+        return 1;
+    }
+    // Перебор и уточнение затравок считаются половинами расчета
+    if (nextTask < sweepTasks) {
+        return 0.5f * nextTask / sweepTasks;
+    }
+    return 0.5f +
+           0.5f * (nextTask - sweepTasks) / std::max<size_t>(1, seeds.size());
+}
+
+int PeriodicOrbits::getOrbitsCount() {
+    int count = 0;
+    for (const vector<Orbit> &list : orbits) {
+        count += list.size();
+    }
+    return count;
+}
+
+void PeriodicOrbits::setShownPeriod(int period) {
+    if (period != shownPeriod) {
+        shownPeriod = std::clamp(period, 0, maximumPeriod);
+        selected = -1;
+    }
+}
+
+void PeriodicOrbits::clear() {
+    room = nullptr;
+    candidates.clear();
+    seeds.clear();
+    found.clear();
+    results.clear();
+    orbits.clear();
+    selected = -1;
+    nextTask = 0;
+    finished = false;
+}
+
+void PeriodicOrbits::draw() {
+    if (!room) {
+        return;
+    }
+    for (int period = 1; period < (int)orbits.size(); ++period) {
+        if (shownPeriod != 0 && period != shownPeriod) {
+            continue;
+        }
+        for (int k = 0; k < (int)orbits[period].size(); ++k) {
+            const Orbit &orbit = orbits[period][k];
+            Color color = orbit.stability == STABILITY_STABLE ? DARKGREEN
+                          : orbit.stability == STABILITY_NEUTRAL ? DARKBLUE
+                                                                 : ORANGE;
+            bool highlighted = shownPeriod != 0 && k == selected;
+            float thickness = highlighted ? 3 : 1;
+            if (!highlighted) {
+                color = Fade(color, selected < 0 ? 0.6f : 0.2f);
+            }
+            for (int i = 0; i < period; ++i) {
+                DrawLineEx(
+                    orbit.points[i].toVector2(),
+                    orbit.points[(i + 1) % period].toVector2(), thickness,
+                    color
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "raylib.h"
+
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Периодические пути света: состояния после отражения (точка стены и угол
+// луча к ней), в которые луч возвращается через period отражений. Все стены
+// считаются зеркалами.
+//
+// Сначала потоки грубо перебирают запуски со всех стен (с обеих сторон) по
+// сетке параметра t и угла и прослеживают каждый на maximumPeriod отражений.
+// Если луч вернулся на стену запуска близко к точке и направлению запуска,
+// запуск становится затравкой для периода, равного числу отражений. Для
+// каждого периода берутся seedsPerPeriod лучших затравок с разными
+// последовательностями стен.
+//
+// Затравка уточняется методом Ньютона по отображению отражения с
+// многократной стрельбой: неизвестные --- параметры t и углы всех period
+// состояний, а невязки --- расхождения точки и направления каждого отрезка
+// со следующим состоянием. Производные по углу и по положению точки на стене
+// переносятся по отрезку Tracer::reflectDifferential, а точки и нормали
+// состояний берутся из Wall::getPointByT и Wall::getNormal. Каждый отрезок
+// содержит одно отражение, поэтому система обусловлена хорошо и для
+// неустойчивых орбит с большим периодом, где одиночная стрельба теряет
+// точность за десятки отражений.
+//
+// Найденные орбиты без повторов и кратных обходов хранятся по периодам.
+// Устойчивость определяется следом матрицы монодромии --- произведения
+// матриц отражений вдоль орбиты. У нейтральных орбит (след 2) есть семейства
+// соседних орбит, и семейство с той же последовательностью стен хранится
+// одной орбитой. Расчет идет порциями и начинается заново при изменении стен
+class PeriodicOrbits {
+public:
+    static constexpr int maximumPeriod = 50;
+
+    enum Stability { STABILITY_STABLE, STABILITY_NEUTRAL, STABILITY_UNSTABLE };
+
+    // Периодическая орбита: точки отражений в порядке обхода
+    struct Orbit {
+        vector<Vec2<double>> points;
+        vector<int> walls; // Индексы стен в снимке
+        double trace;      // След матрицы монодромии
+        Stability stability;
+    };
+
+    class NoWalls: public std::exception { // Исключение, выбрасывается,
+                                           // если в комнате нет стен
+    public:
+        const char *what() const noexcept;
+    };
+
+private:
+    // Состояние после отражения: луч выходит из точки стены с параметром t
+    // под углом angle к стене на сторону нормали, умноженной на side
+    struct State {
+        int wall;
+        double side;
+        double t;
+        double angle;
+    };
+
+    // Точка состояния с производными по длине стены
+    struct Frame {
+        Vec2<double> point;
+        Vec2<double> tangent;  // Единичная касательная стены
+        double speed;          // Длина производной точки по t
+        Vec2<double> dir;      // Направление луча
+        Vec2<double> dirShift; // Производная направления по длине стены
+    };
+
+    // Запуск грубого перебора, вернувшийся близко к себе через period
+    // отражений
+    struct Seed {
+        int period;
+        double closeness;    // Расхождение точки, деленное на scale, и угла
+        unsigned itinerary;  // Свертка последовательности стен
+        State launch;
+    };
+
+    static const int sweepColumns = 64; // Значений t на стене
+    static const int sweepRows = 128;   // Значений угла
+    static const int seedsPerPeriod = 32;
+    static constexpr double seedTolerance = 0.2; // Наибольшее расхождение
+                                                 // затравки
+
+    static const int maximumIterations = 30;
+    static constexpr double positionTolerance = 1e-3; // Невязки точки и
+    static constexpr double angleTolerance = 1e-6;    // направления
+    static constexpr double mergeTolerance = 0.5; // Расстояние между точками
+                                                  // совпадающих орбит
+
+    Room *room = nullptr;    // Комната, для которой идет расчет
+    unsigned long roomShape; // Версия стен на момент начала расчета
+    Tracer<double> tracer;   // Снимок геометрии комнаты
+    double scale;            // Диагональ габарита стен
+
+    // Грубый перебор: задача --- столбец t одной стороны одной стены.
+    // У каждого потока свои лучшие затравки по периодам
+    long sweepTasks;
+    vector<vector<vector<Seed>>> candidates;
+
+    vector<Seed> seeds; // Затравки по возрастанию периода
+    vector<char> found; // Сошелся ли метод Ньютона для затравки
+    vector<Orbit> results;
+
+    long nextTask = 0; // Номер следующей задачи: сначала перебора, затем
+                       // затравок
+    bool finished = false;
+
+    vector<vector<Orbit>> orbits; // Найденные орбиты по периодам
+    int shownPeriod = 0;          // Период показываемых орбит (0 --- все)
+    int selected = -1;            // Выделенная орбита показываемого периода
+
+    void restart(); // Начало расчета по текущему состоянию комнаты
+
+    void sweepColumn(long task, vector<vector<Seed>> &best) const;
+
+    // Добавление затравки к лучшим затравкам периода: по одной на
+    // последовательность стен, не больше seedsPerPeriod
+    static void keep(const Seed &seed, vector<Seed> &best);
+
+    static bool less(const Seed &a, const Seed &b); // Лучше ли затравка a
+
+    // Точка и направление состояния. Возвращает false, если состояние вне
+    // стены
+    bool evaluate(const State &state, Frame &frame) const;
+
+    // Метод Ньютона из затравки. Возвращает false, если он не сошелся
+    bool refine(const Seed &seed, Orbit &orbit) const;
+
+    // Невязки отрезков и матрица производных. Возвращает сумму квадратов
+    // невязок или бесконечность, если луч попал не на ту стену
+    double residuals(
+        const vector<State> &states, vector<double> &residual,
+        vector<double> *jacobian, vector<Frame> &frames
+    ) const;
+
+    // Добавление орбиты, если ее еще нет среди найденных
+    void merge(const Orbit &orbit);
+
+public:
+    void start(Room *room);
+
+    void step(double budget); // Продолжить расчет на budget миллисекунд
+
+    void compute(Room *room);
+
+    bool isActive() { return room != nullptr; }
+
+    bool isDone() { return finished; }
+
+    float getProgress();
+
+    // Орбиты периода period (от 1 до maximumPeriod)
+    const vector<Orbit> &getOrbits(int period) { return orbits[period]; }
+
+    int getOrbitsCount(); // Число найденных орбит всех периодов
+
+    int getShownPeriod() { return shownPeriod; }
+
+    void setShownPeriod(int period);
+
+    int getSelected() { return selected; }
+
+    void setSelected(int index) { selected = index; }
+
+    void clear();
+
+    // Отрисовка орбит показываемого периода с выделенной орбитой
+    void draw();
+};
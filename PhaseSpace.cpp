@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Parallel.h"
+#include "PhaseSpace.h"
+#include "Room.h"
+#include "Sampling.h"
+#include "Tracer.h"
+
+const char *PhaseSpace::NotClosed::what() const noexcept {
+    return "Для фазового пространства комната должна быть замкнута";
+}
+
+PhaseSpace::PhaseSpace() {
+    // Логарифмическая шкала, как у карты освещенности: от белого фона к
+    // темно-синему
+    const float contrast = 1000.0f;
+    palette.resize(1 << 16);
+    for (size_t i = 0; i < palette.size(); ++i) {
+        float v = std::log1p(contrast * i / (palette.size() - 1)) /
+                  std::log1p(contrast);
+        palette[i] = Color{
+            (unsigned char)(255 * (1 - v)),
+            (unsigned char)(255 * (1 - 0.8f * v)),
+            (unsigned char)(255 * (1 - 0.4f * v)), 255
+        };
+    }
+}
+
+void PhaseSpace::start(Room *room, long bounces, int trajectories) {
+    if (!room->isClosed()) {
+        throw NotClosed();
+    }
+
+    clear();
+    PhaseSpace::room = room;
+    PhaseSpace::trajectories.resize(std::max(1, trajectories));
+    targetBounces = bounces;
+    restart();
+}
+
+void PhaseSpace::restart() {
+    roomShape = room->getShapeVersion();
+    tracer.update(room);
+    tracer.ignoreAim();
+
+    // Длина дуги по вписанным ломаным: у прямых стен один отрезок
+    pieceStarts.clear();
+    arcLengths.clear();
+    pieceDirs.clear();
+    double length = 0;
+    for (size_t i = 0; i < tracer.wallsCount(); ++i) {
+        Wall *wall = tracer.getWall(i);
+        bool line = dynamic_cast<WallLine *>(wall) != nullptr;
+        int count = line ? 1 : curvePieces;
+        pieceStarts.push_back(arcLengths.size());
+        Vec2<double> previous(wall->getPointByT(0));
+        arcLengths.push_back(length);
+        for (int k = 1; k <= count; ++k) {
+            Vec2<double> point(wall->getPointByT((float)k / count));
+            double piece = ::length(point - previous);
+            pieceDirs.push_back(
+                piece > 0 ? (point - previous) * (1 / piece) : Vec2<double>()
+            );
+            length += piece;
+            arcLengths.push_back(length);
+            previous = point;
+        }
+    }
+    pieceStarts.push_back(arcLengths.size());
+    perimeter = std::max(1e-9, length);
+
+    // Начальные условия --- равномерно по длине контура и синусу угла к
+    // нормали. Концы стен и касательные направления исключаются
+    const double margin = 1e-4;
+    const uint32_t seedPosition = hashBits(1);
+    const uint32_t seedAngle = hashBits(2);
+    size_t outline = room->getWalls().size();
+    double outlineLength = arcLengths[pieceStarts[outline] - 1];
+    for (size_t i = 0; i < trajectories.size(); ++i) {
+        Trajectory &trajectory = trajectories[i];
+        trajectory.bounces = 0;
+        trajectory.lost = false;
+
+        double u = toUnit(owenScramble(sobol(i, 0), seedPosition));
+        double v = toUnit(owenScramble(sobol(i, 1), seedAngle));
+        double position = u * outlineLength;
+        size_t index = 0;
+        while (index + 1 < outline &&
+               arcLengths[pieceStarts[index + 1]] <= position) {
+            ++index;
+        }
+        double first = arcLengths[pieceStarts[index]];
+        double last = arcLengths[pieceStarts[index + 1] - 1];
+        double t = (position - first) / std::max(1e-9, last - first);
+        t = std::clamp(t, margin, 1 - margin);
+
+        // Луч, выпущенный наружу замкнутой комнаты, ни во что не попадает
+        Wall *wall = tracer.getWall(index);
+        Vector2 point = wall->getPointByT(t);
+        Vector2 normal = wall->getNormal(point);
+        double sine = (2 * v - 1) * (1 - margin);
+        double cosine = std::sqrt(1 - sine * sine);
+        Vec2<double> origin(point);
+        Tracer<double>::Hit hit;
+        for (double sign : {1.0, -1.0}) {
+            Vec2<double> n =
+                normalize(Vec2<double>(normal.x * sign, normal.y * sign));
+            trajectory.dir = Vec2<double>(
+                n.x * cosine - n.y * sine, n.x * sine + n.y * cosine
+            );
+            if (tracer.trace(origin, trajectory.dir, index, hit)) {
+                break;
+            }
+        }
+        trajectory.origin = origin;
+        trajectory.fromWall = index;
+    }
+
+    long count = trajectories.size();
+    perTrajectory = std::max(1L, targetBounces / count);
+    tasksCount = count * ((perTrajectory + chunkBounces - 1) / chunkBounces);
+    nextTask = 0;
+    totalBounces = 0;
+    finished = false;
+
+    density.assign((size_t)width * height, 0);
+    for (vector<uint16_t> &histogram : histograms) {
+        std::fill(histogram.begin(), histogram.end(), 0);
+    }
+    updatePixels();
+}
+
+int PhaseSpace::cellOf(
+    const Tracer<double>::Hit &hit, const Vec2<double> &dir
+) const {
+    // Параметр точки считается по снимку в double: у дуг и эллипсов --- по
+    // углу от центра, без поиска ближайшей точки
+    int first = pieceStarts[hit.wall];
+    int count = pieceStarts[hit.wall + 1] - first - 1;
+    double t = tracer.getParameter(hit.wall, hit.point, hit.parameter);
+    int piece = std::min(count - 1, (int)(t * count));
+    double fraction = t * count - piece;
+    double s = arcLengths[first + piece] * (1 - fraction) +
+               arcLengths[first + piece + 1] * fraction;
+
+    // Синус угла к нормали --- проекция на касательную в сторону роста
+    // длины дуги
+    Vec2<double> normal = tracer.getNormal(hit.wall, hit.point, hit.parameter);
+    Vec2<double> tangent(-normal.y, normal.x);
+    if (dot(tangent, pieceDirs[first - hit.wall + piece]) < 0) {
+        tangent = -tangent;
+    }
+    double sine = dot(dir, tangent);
+
+    int column = std::clamp((int)(s / perimeter * width), 0, width - 1);
+    int row = std::clamp((int)((1 - sine) / 2 * height), 0, height - 1);
+    return row * width + column;
+}
+
+long PhaseSpace::advance(
+    Trajectory &trajectory, long count, vector<uint16_t> &histogram
+) const {
+    Tracer<double>::Hit hit;
+    long done = 0;
+    for (; done < count; ++done) {
+        if (!tracer.trace(
+                trajectory.origin, trajectory.dir, trajectory.fromWall, hit
+            )) {
+            trajectory.lost = true;
+            break;
+        }
+        trajectory.dir = tracer.reflect(hit, trajectory.dir);
+        trajectory.origin = hit.point;
+        trajectory.fromWall = hit.wall;
+        ++trajectory.bounces;
+        ++histogram[cellOf(hit, trajectory.dir)];
+    }
+    return done;
+}
+
+void PhaseSpace::flush(vector<uint16_t> &histogram) {
+    std::lock_guard<std::mutex> lock(densityMutex);
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        density[i] += histogram[i];
+    }
+    std::fill(histogram.begin(), histogram.end(), 0);
+}
+
+void PhaseSpace::step(double budget) {
+    if (!room) {
+        return;
+    }
+
+    if (room->getShapeVersion() != roomShape) {
+        if (!room->isClosed()) {
+            clear();
+            return;
+        }
+        restart();
+    }
+
+    if (finished) {
+        return;
+    }
+
+    int threadsCount = hardwareThreads();
+    if ((int)histograms.size() < threadsCount) {
+        histograms.resize(threadsCount, vector<uint16_t>(density.size(), 0));
+    }
+
+    // Счетчик ячейки не больше числа отражений с последнего переноса,
+    // поэтому перенос перед каждой задачей, которая могла бы превысить
+    // предел, исключает переполнение. Задачи одного прохода продолжают разные
+    // траектории
+    const long limit = std::numeric_limits<uint16_t>::max();
+    long count = trajectories.size();
+    vector<long> pending(threadsCount, 0);
+    std::atomic<long> bounces(0);
+    nextTask = runPasses(
+        nextTask, tasksCount, count, now() + budget, [&](long i, int k) {
+            Trajectory &trajectory = trajectories[i % count];
+            long left = perTrajectory - trajectory.bounces;
+            if (trajectory.lost || left <= 0) {
+                return;
+            }
+            long chunk = std::min(chunkBounces, left);
+            if (pending[k] + chunk > limit) {
+                flush(histograms[k]);
+                pending[k] = 0;
+            }
+            long done = advance(trajectory, chunk, histograms[k]);
+            pending[k] += done;
+            bounces += done;
+        }
+    );
+
+    for (vector<uint16_t> &histogram : histograms) {
+        flush(histogram);
+    }
+    totalBounces += bounces;
+    finished = nextTask >= tasksCount;
+    updatePixels();
+}
+
+void PhaseSpace::compute(Room *room, long bounces, int trajectories) {
+    start(room, bounces, trajectories);
+    while (!finished) {
+        step(std::numeric_limits<double>::infinity());
+    }
+}
+
+float PhaseSpace::getProgress() {
+    if (finished) {
+        return 1;
+    }
+    return (float)nextTask / tasksCount;
+}
+
+void PhaseSpace::updatePixels() {
+    uint64_t maxValue = 0;
+    for (uint64_t value : density) {
+        maxValue = std::max(maxValue, value);
+    }
+    double scale = maxValue > 0 ? (double)(palette.size() - 1) / maxValue : 0;
+
+    pixels.resize(density.size());
+    for (size_t i = 0; i < density.size(); ++i) {
+        pixels[i] = palette[std::min(
+            (size_t)(density[i] * scale), palette.size() - 1
+        )];
+    }
+
+    if (!hasTexture) {
+        Image image = {
+            pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+        };
+        texture = LoadTextureFromImage(image);
+        hasTexture = true;
+    } else {
+        UpdateTexture(texture, pixels.data());
+    }
+}
+
+void PhaseSpace::clear() {
+    room = nullptr;
+    trajectories.clear();
+    histograms.clear();
+    density.clear();
+    pixels.clear();
+    nextTask = 0;
+    totalBounces = 0;
+    finished = false;
+    if (hasTexture) {
+        UnloadTexture(texture);
+        hasTexture = false;
+    }
+}
+
+void PhaseSpace::draw(Rectangle area) {
+    DrawRectangleRec(area, RAYWHITE);
+    if (hasTexture) {
+        DrawTexturePro(
+            texture, Rectangle{0, 0, (float)width, (float)height}, area,
+            Vector2{0, 0}, 0, WHITE
+        );
+    }
+
+    // Границы стен и нулевой угол (луч по нормали)
+    for (size_t i = 1; i + 1 < pieceStarts.size(); ++i) {
+        float x = area.x + arcLengths[pieceStarts[i]] / perimeter * area.width;
+        DrawLineV(
+            {x, area.y}, {x, area.y + area.height}, Fade(GRAY, 0.5f)
+        );
+    }
+    float middle = area.y + area.height / 2;
+    DrawLineV(
+        {area.x, middle}, {area.x + area.width, middle}, Fade(GRAY, 0.5f)
+    );
+    DrawRectangleLinesEx(area, 1, GRAY);
+}
+
+PhaseSpace::~PhaseSpace() {
+    clear();
+}
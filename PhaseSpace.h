@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+#include "raylib.h"
+
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Фазовое пространство бильярда в координатах Биркгофа: по горизонтали ---
+// длина дуги границы от начала первой стены (стены контура, за ними стены
+// препятствий), по вертикали --- синус угла отраженного луча к нормали (со
+// знаком, положительный --- в сторону роста длины дуги). Каждое отражение
+// траекторий добавляется в ячейку гистограммы, и из нее строится изображение
+// плотности с логарифмической шкалой.
+//
+// Траектории начинаются на контуре по инвариантной мере бильярда
+// (последовательность Соболя, как у показателя Ляпунова) и продолжаются
+// порциями. У каждого потока своя гистограмма из 16-битных счетчиков: поток
+// переносит ее в общую гистограмму, прежде чем счетчик может переполниться,
+// поэтому на 10^9 отражений память не растет. Все стены считаются
+// зеркалами, цели лучей не задерживают. Расчет начинается заново, если
+// изменились стены
+class PhaseSpace {
+public:
+    static const int width = 256;  // Ячеек по длине дуги
+    static const int height = 256; // Ячеек по синусу угла
+
+    class NotClosed: public std::exception { // Исключение, выбрасывается,
+                                             // если комната не замкнута
+    public:
+        const char *what() const noexcept;
+    };
+
+private:
+    // Траектория, которая продолжается между порциями
+    struct Trajectory {
+        Vec2<double> origin;
+        Vec2<double> dir;
+        int fromWall;
+        long bounces;
+        bool lost; // Покинула комнату через стык стен
+    };
+
+    static constexpr long chunkBounces = 4096; // Отражений траектории за задачу
+    static const int curvePieces = 32;         // Отрезков ломаной кривой стены
+
+    Room *room = nullptr;    // Комната, для которой идет расчет
+    unsigned long roomShape; // Версия стен на момент начала расчета
+    Tracer<double> tracer;   // Снимок геометрии комнаты без целей
+
+    // Ломаные стен: начала ломаных в pieceStarts, для каждой вершины длина
+    // дуги от начала границы в arcLengths, для каждого отрезка направление
+    // в pieceDirs
+    vector<int> pieceStarts;
+    vector<double> arcLengths;
+    vector<Vec2<double>> pieceDirs;
+    double perimeter; // Длина всей границы
+
+    vector<Trajectory> trajectories;
+    long targetBounces;    // Требуемое число отражений всех траекторий
+    long perTrajectory;    // Требуемое число отражений одной траектории
+    long tasksCount;       // Число задач по chunkBounces отражений
+    long nextTask = 0;     // Номер следующей задачи
+    long totalBounces = 0; // Число отражений, учтенных в гистограмме
+    bool finished = false;
+
+    vector<uint64_t> density;             // Общая гистограмма
+    vector<vector<uint16_t>> histograms;  // Гистограммы потоков
+    std::mutex densityMutex;              // Защита общей гистограммы
+
+    vector<Color> palette; // Таблица цветов логарифмической шкалы
+    vector<Color> pixels;
+    Texture2D texture;
+    bool hasTexture = false;
+
+    void restart(); // Начало расчета по текущему состоянию комнаты
+
+    // Продолжение траектории на count отражений с добавлением их в
+    // histogram. Возвращает число отражений
+    long advance(
+        Trajectory &trajectory, long count, vector<uint16_t> &histogram
+    ) const;
+
+    // Ячейка гистограммы для отражения в точке hit с направлением dir
+    int cellOf(const Tracer<double>::Hit &hit, const Vec2<double> &dir) const;
+
+    // Перенос гистограммы потока в общую (она обнуляется)
+    void flush(vector<uint16_t> &histogram);
+
+    void updatePixels(); // Перенос гистограммы в изображение
+
+public:
+    PhaseSpace();
+
+    // Начать расчет по bounces отражениям, поровну между trajectories
+    // траекториями
+    void start(Room *room, long bounces, int trajectories = 256);
+
+    void step(double budget); // Продолжить расчет на budget миллисекунд
+
+    void compute(Room *room, long bounces, int trajectories = 256);
+
+    bool isActive() { return room != nullptr; }
+
+    bool isDone() { return finished; }
+
+    long getBounces() { return totalBounces; }
+
+    float getProgress(); // Доля выполненных отражений
+
+    // Число отражений в ячейке: column --- по длине дуги, row --- по синусу
+    // угла сверху вниз от 1 до -1
+    uint64_t getDensity(int column, int row) const {
+        return density[(size_t)row * width + column];
+    }
+
+    void clear();
+
+    // Отрисовка изображения в области area с границами стен
+    void draw(Rectangle area);
+
+    ~PhaseSpace();
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+// Пул объектов одного типа. Память выделяется блоками по blockSize объектов,
+// блоки не перемещаются, поэтому указатели на объекты остаются верными до
+// очистки. Объекты не освобождаются по одному: clear() сбрасывает пул целиком,
+// а блоки сохраняются и используются повторно без обращения к куче
+template <typename T, size_t blockSize = 4096> class Pool {
+private:
+    vector<T *> blocks;
+    size_t count = 0; // Число выданных объектов
+
+public:
+    Pool() {}
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    T *allocate() { // Новый объект в конце пула
+        if (count == blocks.size() * blockSize) {
+            blocks.push_back(new T[blockSize]);
+        }
+        T *object = &blocks[count / blockSize][count % blockSize];
+        ++count;
+        return object;
+    }
+
+    // Объекты нумеруются в порядке выдачи
+    T &operator[](size_t index) {
+        return blocks[index / blockSize][index % blockSize];
+    }
+
+    const T &operator[](size_t index) const {
+        return blocks[index / blockSize][index % blockSize];
+    }
+
+    size_t size() const { return count; }
+
+    size_t capacity() const { return blocks.size() * blockSize; }
+
+    void clear() { count = 0; }
+
+    ~Pool() {
+        for (T *block : blocks) {
+            delete[] block;
+        }
+    }
+};
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "Parallel.h"
+#include "Radiosity.h"
+#include "Room.h"
+
+// Допустимое расхождение точки попадания луча с целевой точкой на стене
+static const double visibilityTolerance = 0.05;
+
+const char *Radiosity::NotClosed::what() const noexcept {
+    return "Для расчета излучательности комната должна быть замкнута";
+}
+
+const char *Radiosity::OutsideRoom::what() const noexcept {
+    return "Источник света должен быть внутри комнаты";
+}
+
+Radiosity::Radiosity(double patchLength) {
+    Radiosity::patchLength = patchLength;
+}
+
+void Radiosity::start(Room *room, Vector2 source) {
+    clear();
+    Radiosity::room = room;
+    Radiosity::source = source;
+    try {
+        compute();
+    } catch (...) {
+        clear();
+        throw;
+    }
+}
+
+bool Radiosity::update() {
+    if (!room || room->getShapeVersion() == roomShape) {
+        return false;
+    }
+    try {
+        compute();
+    } catch (...) {
+        clear();
+        throw;
+    }
+    return true;
+}
+
+void Radiosity::compute() {
+    roomShape = room->getShapeVersion();
+    if (!room->isClosed()) {
+        throw NotClosed();
+    }
+
+    makePatches();
+    Vec2<double> light(source);
+    if (!isInside(light)) {
+        throw OutsideRoom();
+    }
+
+    // Прямой свет: доля потока источника, попадающая в угол, под которым
+    // виден патч, деленная на длину патча
+    for (Patch &patch : patches) {
+        patch.emitted = 0;
+        if (dot(light - patch.a, patch.normal) <= 0) {
+            continue;
+        }
+        Vec2<double> a = patch.a - light;
+        Vec2<double> b = patch.b - light;
+        double angle = std::fabs(std::atan2(cross(a, b), dot(a, b)));
+        int visible = isVisible(light, -1, patch.samples[0], patch.wall) +
+                      isVisible(light, -1, patch.samples[1], patch.wall);
+        patch.emitted = angle / (2 * PI) * visible / 2 / patch.length;
+    }
+
+    computeFactors();
+    solve();
+    gatherAim();
+}
+
+void Radiosity::makePatches() {
+    tracer.update(room);
+    tracer.ignoreAim();
+    beams.update(room);
+
+    // Контуры: стены комнаты, затем стены каждого препятствия. Стены
+    // незамкнутого препятствия видны с обеих сторон и получают патчи на
+    // каждую сторону
+    struct Contour {
+        vector<Wall *> walls;
+        bool twoSided;
+    };
+    vector<Contour> contours = {{room->getWalls(), false}};
+    for (Obstacle *obstacle : room->getObstacles()) {
+        contours.push_back({obstacle->getWalls(), !obstacle->isClosed()});
+    }
+
+    // Длины стен, у кривых --- по вписанной ломаной
+    auto wallLength = [](Wall *wall) {
+        bool round = dynamic_cast<WallLine *>(wall) == nullptr;
+        int count = round ? 64 : 1;
+        double sum = 0;
+        for (int k = 0; k < count; ++k) {
+            sum += Vector2Distance(
+                wall->getPointByT((float)k / count),
+                wall->getPointByT((float)(k + 1) / count)
+            );
+        }
+        return sum;
+    };
+    double total = 0;
+    int sides = 0;
+    for (const Contour &contour : contours) {
+        for (Wall *wall : contour.walls) {
+            total += wallLength(wall) * (contour.twoSided ? 2 : 1);
+            sides += contour.twoSided ? 2 : 1;
+        }
+    }
+    // Округление вверх добавляет не больше одного патча на сторону стены
+    double step =
+        std::max(patchLength, total / std::max(1, maximumPatches - sides));
+
+    // Патчи перечисляются в порядке обхода контура, поэтому у дуг, параметр
+    // которых идет от конца к началу, он разворачивается
+    patches.clear();
+    double side = 1;
+    for (size_t c = 0; c < contours.size(); ++c) {
+        const Contour &contour = contours[c];
+        size_t first = patches.size();
+        for (Wall *wall : contour.walls) {
+            Vector2 start = wall->getStart()->getCoord();
+            bool reversed = Vector2Distance(wall->getPointByT(0), start) >
+                            Vector2Distance(wall->getPointByT(1), start);
+            auto at = [&](double t) {
+                return Vec2<double>(wall->getPointByT(reversed ? 1 - t : t));
+            };
+
+            int count =
+                std::max(1, (int)std::ceil(wallLength(wall) / step - 1e-9));
+            for (int k = 0; k < count; ++k) {
+                double t0 = (double)k / count;
+                double t1 = (double)(k + 1) / count;
+                Patch patch;
+                patch.wall = tracer.indexOf(wall);
+                patch.a = at(t0);
+                patch.b = at(t1);
+                patch.samples[0] = at(t0 + (t1 - t0) / 4);
+                patch.samples[1] = at(t1 - (t1 - t0) / 4);
+                patch.length = length(patch.b - patch.a);
+                patch.reflectance =
+                    wall->isDiffuse() ? wall->getReflectance() : 0;
+                patch.emitted = patch.irradiance = patch.radiosity = 0;
+                patches.push_back(patch);
+            }
+        }
+        size_t last = patches.size();
+
+        // Обратная сторона --- те же патчи с переставленными концами
+        if (contour.twoSided) {
+            for (size_t i = first; i < last; ++i) {
+                Patch patch = patches[i];
+                std::swap(patch.a, patch.b);
+                std::swap(patch.samples[0], patch.samples[1]);
+                patches.push_back(patch);
+            }
+        }
+
+        // Формула перекрещенных нитей требует, чтобы комната лежала по одну
+        // сторону от всех патчей, поэтому замкнутое препятствие обходится
+        // навстречу стенам комнаты. У незамкнутого препятствия стороны и
+        // так обходятся навстречу друг другу
+        double area = 0;
+        for (size_t i = first; i < last; ++i) {
+            area += cross(patches[i].a, patches[i].b);
+        }
+        if (c == 0) {
+            side = area > 0 ? 1 : -1;
+        } else if (!contour.twoSided && (area > 0) == (side > 0)) {
+            for (size_t i = first; i < last; ++i) {
+                std::swap(patches[i].a, patches[i].b);
+                std::swap(patches[i].samples[0], patches[i].samples[1]);
+            }
+        }
+    }
+
+    // Нормали направлены в комнату: слева от обхода, если площадь контура
+    // комнаты положительна, и справа иначе
+    for (Patch &patch : patches) {
+        Vec2<double> d = patch.b - patch.a;
+        patch.normal = normalize(Vec2<double>(-d.y, d.x)) * side;
+    }
+}
+
+// Форм-факторы патча i с патчами j > i без учета препятствий в row[j]:
+// разность сумм перекрещенных и неперекрещенных нитей, умноженная на scale.
+// Патч целиком позади другого не виден. Координаты лежат в coordinates
+// массивами концов и нормалей по n чисел (ax, ay, bx, by, nx, ny), а
+// условия умножаются вместо ветвления, поэтому цикл векторизуется
+static void unoccludedRow(
+    const double *coordinates, size_t n, size_t i, double scale, double *row
+) {
+    const double *ax = coordinates, *ay = ax + n, *bx = ay + n, *by = bx + n;
+    const double *nx = by + n, *ny = nx + n;
+    double pax = ax[i], pay = ay[i], pbx = bx[i], pby = by[i];
+    double pnx = nx[i], pny = ny[i];
+
+    for (size_t j = i + 1; j < n; ++j) {
+        double crossed =
+            std::sqrt(
+                (ax[j] - pax) * (ax[j] - pax) +
+                (ay[j] - pay) * (ay[j] - pay)
+            ) +
+            std::sqrt(
+                (bx[j] - pbx) * (bx[j] - pbx) +
+                (by[j] - pby) * (by[j] - pby)
+            );
+        double uncrossed =
+            std::sqrt(
+                (bx[j] - pax) * (bx[j] - pax) +
+                (by[j] - pay) * (by[j] - pay)
+            ) +
+            std::sqrt(
+                (ax[j] - pbx) * (ax[j] - pbx) +
+                (ay[j] - pby) * (ay[j] - pby)
+            );
+        double front = std::max(
+            (ax[j] - pax) * pnx + (ay[j] - pay) * pny,
+            (bx[j] - pax) * pnx + (by[j] - pay) * pny
+        );
+        double back = std::max(
+            (pax - ax[j]) * nx[j] + (pay - ay[j]) * ny[j],
+            (pbx - ax[j]) * nx[j] + (pby - ay[j]) * ny[j]
+        );
+        double factor = (crossed - uncrossed) * scale;
+        double facing = (front > 1e-9 ? 1.0 : 0.0) * (back > 1e-9 ? 1.0 : 0.0);
+        row[j] = std::max(factor, 0.0) * facing;
+    }
+}
+
+void Radiosity::computeFactors() {
+    size_t n = patches.size();
+    factors.assign(n * n, 0.0f);
+
+    // Координаты патчей отдельными массивами по n чисел
+    vector<double> coordinates(6 * n);
+    for (size_t i = 0; i < n; ++i) {
+        coordinates[i] = patches[i].a.x;
+        coordinates[n + i] = patches[i].a.y;
+        coordinates[2 * n + i] = patches[i].b.x;
+        coordinates[3 * n + i] = patches[i].b.y;
+        coordinates[4 * n + i] = patches[i].normal.x;
+        coordinates[5 * n + i] = patches[i].normal.y;
+    }
+
+    // Поток считает строку i для патчей j > i и по взаимности площадей
+    // заполняет F_ji. Ячейки разных строк не пересекаются
+    std::atomic<size_t> nextRow(0);
+    bool swept = !beams.hasArcs();
+    auto work = [&]() {
+        vector<double> row(n);
+        Visible visible[2];
+        for (size_t i = nextRow++; i < n; i = nextRow++) {
+            const Patch &from = patches[i];
+
+            unoccludedRow(
+                &coordinates[0], n, i, 1 / (2 * from.length), &row[0]
+            );
+
+            // Точки патча сдвигаются внутрь комнаты на тысячную долю
+            // пикселя, иначе его стена попадает в заметание вырожденной
+            if (swept) {
+                for (int k = 0; k < 2; ++k) {
+                    see(from.samples[k] + from.normal * 1e-3, visible[k]);
+                }
+            }
+
+            // Доля видимых пар точек двух патчей
+            for (size_t j = i + 1; j < n; ++j) {
+                if (row[j] == 0) {
+                    continue;
+                }
+                const Patch &to = patches[j];
+                int seen = 0;
+                for (int k = 0; k < 2; ++k) {
+                    for (const Vec2<double> &q : to.samples) {
+                        seen += swept ? isSeen(visible[k], to.wall, q)
+                                      : isVisible(
+                                            from.samples[k], from.wall, q,
+                                            to.wall
+                                        );
+                    }
+                }
+                if (seen > 0) {
+                    double factor = row[j] * seen / 4;
+                    factors[i * n + j] = factor;
+                    factors[j * n + i] = factor * from.length / to.length;
+                }
+            }
+        }
+    };
+
+    int threadsCount = hardwareThreads();
+    vector<std::thread> threads;
+    for (int k = 0; k < threadsCount; ++k) {
+        threads.emplace_back(work);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void Radiosity::solve() {
+    size_t n = patches.size();
+
+    // Излучают только диффузные патчи, остальные лишь принимают свет
+    vector<size_t> diffuse;
+    for (size_t i = 0; i < n; ++i) {
+        Patch &patch = patches[i];
+        patch.radiosity = patch.reflectance * patch.emitted;
+        if (patch.reflectance > 0) {
+            diffuse.push_back(i);
+        }
+    }
+
+    // B_i = rho_i (E_i + sum F_ij B_j), новые значения сразу используются
+    for (iterations = 0; iterations < maximumIterations;) {
+        ++iterations;
+        double change = 0;
+        double largest = 0;
+        for (size_t i : diffuse) {
+            const float *row = &factors[i * n];
+            double gathered = 0;
+            for (size_t j : diffuse) {
+                gathered += row[j] * patches[j].radiosity;
+            }
+            Patch &patch = patches[i];
+            double value = patch.reflectance * (patch.emitted + gathered);
+            change = std::max(change, std::fabs(value - patch.radiosity));
+            largest = std::max(largest, value);
+            patch.radiosity = value;
+        }
+        if (change <= tolerance * largest) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const float *row = &factors[i * n];
+        double gathered = 0;
+        for (size_t j : diffuse) {
+            gathered += row[j] * patches[j].radiosity;
+        }
+        patches[i].irradiance = patches[i].emitted + gathered;
+    }
+}
+
+void Radiosity::gatherAim() {
+    aimDirect = aimTotal = 0;
+    if (!room->aim) {
+        return;
+    }
+
+    // Освещенность точки: прямой свет убывает обратно пропорционально
+    // расстоянию, яркость диффузного патча равна половине его
+    // излучательности и умножается на угол, под которым он виден
+    Vec2<double> center(room->aim->getCenter());
+    Vec2<double> light(source);
+    Vec2<double> dir = center - light;
+    double distance = length(dir);
+    Tracer<double>::Hit hit;
+    if (distance > 0 &&
+        (!tracer.trace(light, dir * (1 / distance), -1, hit) ||
+         hit.distance >= distance)) {
+        aimDirect = 1 / (2 * PI * distance);
+    }
+
+    aimTotal = aimDirect;
+    for (const Patch &patch : patches) {
+        if (patch.radiosity <= 0 ||
+            dot(center - patch.a, patch.normal) <= 0) {
+            continue;
+        }
+        Vec2<double> a = patch.a - center;
+        Vec2<double> b = patch.b - center;
+        double angle = std::fabs(std::atan2(cross(a, b), dot(a, b)));
+        int visible = isVisible(center, -1, patch.samples[0], patch.wall) +
+                      isVisible(center, -1, patch.samples[1], patch.wall);
+        aimTotal += patch.radiosity / 2 * angle * visible / 2;
+    }
+}
+
+bool Radiosity::isInside(const Vec2<double> &point) const {
+    // Подсчет пересечений по всем патчам: внутренность замкнутого
+    // препятствия лежит внутри двух контуров и считается внешней, а две
+    // стороны незамкнутого препятствия пересекаются дважды и не влияют
+    bool inside = false;
+    for (const Patch &patch : patches) {
+        const Vec2<double> &a = patch.a;
+        const Vec2<double> &b = patch.b;
+        if ((a.y > point.y) != (b.y > point.y) &&
+            point.x < a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+bool Radiosity::isVisible(
+    const Vec2<double> &p, int fromWall, const Vec2<double> &q, int toWall
+) const {
+    Vec2<double> dir = q - p;
+    double distance = length(dir);
+    if (distance <= visibilityTolerance) {
+        return false;
+    }
+    Tracer<double>::Hit hit;
+    if (!tracer.trace(p, dir * (1 / distance), fromWall, hit)) {
+        return false;
+    }
+    return hit.wall == toWall &&
+           std::fabs(hit.distance - distance) <= visibilityTolerance;
+}
+
+void Radiosity::see(const Vec2<double> &point, Visible &visible) const {
+    vector<BeamTracer::Piece> pieces = beams.sweep(beams.root(point));
+    int walls = beams.wallsCount();
+
+    // Участки раскладываются по стенам подсчетом
+    visible.first.assign(walls + 1, 0);
+    for (const BeamTracer::Piece &piece : pieces) {
+        ++visible.first[piece.wall + 1];
+    }
+    for (int w = 0; w < walls; ++w) {
+        visible.first[w + 1] += visible.first[w];
+    }
+    visible.from.resize(pieces.size());
+    visible.to.resize(pieces.size());
+    vector<int> next(visible.first.begin(), visible.first.end() - 1);
+    for (const BeamTracer::Piece &piece : pieces) {
+        Vec2<double> start = beams.getStart(piece.wall);
+        Vec2<double> d = beams.getEnd(piece.wall) - start;
+        double u0 = dot(piece.start - start, d) / dot(d, d);
+        double u1 = dot(piece.end - start, d) / dot(d, d);
+        int k = next[piece.wall]++;
+        visible.from[k] = std::min(u0, u1);
+        visible.to[k] = std::max(u0, u1);
+    }
+}
+
+bool Radiosity::isSeen(
+    const Visible &visible, int wall, const Vec2<double> &point
+) const {
+    Vec2<double> start = beams.getStart(wall);
+    Vec2<double> d = beams.getEnd(wall) - start;
+    double u = dot(point - start, d) / dot(d, d);
+    for (int k = visible.first[wall]; k < visible.first[wall + 1]; ++k) {
+        if (u >= visible.from[k] - 1e-9 && u <= visible.to[k] + 1e-9) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Radiosity::clear() {
+    room = nullptr;
+    patches.clear();
+    vector<float>().swap(factors);
+    iterations = 0;
+    aimDirect = aimTotal = 0;
+}
+
+void Radiosity::draw() {
+    if (!room) {
+        return;
+    }
+
+    double maxValue = aimTotal;
+    for (const Patch &patch : patches) {
+        maxValue = std::max(maxValue, patch.irradiance);
+    }
+
+    // Логарифмическая шкала на три порядка вниз от наибольшего значения
+    auto color = [&](double value) {
+        float v = 0;
+        if (value > 0 && maxValue > 0) {
+            v = Clamp(1 + std::log10(value / maxValue) / 3, 0, 1);
+        }
+        return Color{
+            (unsigned char)(255 * std::min(1.0f, 2 * v)),
+            (unsigned char)(255 * std::max(0.0f, 2 * v - 1)), 0, 255
+        };
+    };
+
+    // Патч рисуется со стороны своей нормали, поэтому две стороны
+    // препятствия видны по отдельности
+    for (const Patch &patch : patches) {
+        Vec2<double> shift = patch.normal * 2;
+        DrawLineEx(
+            (patch.a + shift).toVector2(), (patch.b + shift).toVector2(), 4,
+            color(patch.irradiance)
+        );
+    }
+
+    if (room->aim) {
+        DrawCircleV(
+            room->aim->getCenter(), room->aim->getRadius() / 2,
+            color(aimTotal)
+        );
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "raylib.h"
+
+#include "BeamTracer.h"
+#include "Geometry.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Излучательность (radiosity) в плоской комнате с диффузными стенами. Стены
+// делятся на участки (патчи), между каждой парой патчей считается плоский
+// форм-фактор по правилу перекрещенных нитей с учетом видимости между
+// точками патчей. Источник света точечный. Диффузные стены рассеивают
+// долю reflectance падающего света, зеркальные стены и светоделители в этой
+// модели свет только принимают. Излучательность патчей находится итерациями
+// Гаусса-Зейделя.
+//
+// Форм-факторы считаются в нескольких потоках построчно. Строка сначала
+// заполняется без учета препятствий циклом без ветвлений по массивам
+// координат патчей, и пары, не обращенные друг к другу, отбрасываются до
+// проверки видимости. GCC векторизует этот цикл при -O3 (сборка Release)
+// с -fno-math-errno, которые задает CMakeLists.txt. В комнате из прямых
+// стен для точек патча строятся многоугольники видимости (BeamTracer), и
+// видимость точек других патчей проверяется по ним без трассировки. С дугами
+// видимость проверяется лучами
+class Radiosity {
+public:
+    // Участок стены
+    struct Patch {
+        int wall;                // Индекс стены в снимке
+        Vec2<double> a;          // Концы участка (у дуги --- хорда) в
+        Vec2<double> b;          // порядке обхода комнаты
+        Vec2<double> normal;     // Нормаль внутрь комнаты
+        Vec2<double> samples[2]; // Точки на стене для проверки видимости
+        double length;
+        float reflectance; // Доля рассеянного света (0 у зеркальных стен)
+        double emitted;    // Освещенность прямым светом источника
+        double irradiance; // Полная освещенность
+        double radiosity;  // Рассеиваемый поток на единицу длины
+    };
+
+    class NotClosed: public std::exception { // Исключение, выбрасывается,
+                                             // если комната не замкнута
+    public:
+        const char *what() const noexcept;
+    };
+
+    class OutsideRoom: public std::exception { // Исключение, выбрасывается,
+                                               // если источник вне комнаты
+    public:
+        const char *what() const noexcept;
+    };
+
+private:
+    static const int maximumPatches = 4096;   // Ограничение размера матрицы
+    static const int maximumIterations = 500; // Ограничение итераций
+    static constexpr double tolerance = 1e-6; // Относительная точность
+
+    double patchLength; // Наибольшая длина патча
+
+    Room *room = nullptr;    // Освещаемая комната
+    unsigned long roomShape; // Версия стен на момент расчета
+    Vector2 source;          // Положение источника (мощность 1)
+    Tracer<double> tracer;   // Снимок геометрии для проверки видимости
+    BeamTracer beams;        // Снимок для многоугольников видимости
+
+    vector<Patch> patches;
+    vector<float> factors; // Форм-факторы, factors[i * n + j] = F_ij
+    int iterations;        // Число итераций последнего решения
+
+    double aimDirect; // Освещенность центра цели прямым светом
+    double aimTotal;  // Полная освещенность центра цели
+
+    // Участки стен, видимые из точки: промежутки параметра вдоль стены,
+    // промежутки стены w занимают индексы от first[w] до first[w + 1]
+    struct Visible {
+        vector<int> first;
+        vector<double> from;
+        vector<double> to;
+    };
+
+    void compute(); // Расчет по текущему состоянию комнаты
+
+    void makePatches();    // Разбиение стен на патчи
+    void computeFactors(); // Форм-факторы всех пар патчей
+    void solve();          // Итерации Гаусса-Зейделя
+    void gatherAim();      // Освещенность центра цели
+
+    bool isInside(const Vec2<double> &point) const; // Внутри ли комнаты
+
+    // Видна ли точка q на стене toWall из точки p на стене fromWall
+    // (fromWall равно -1, если p не лежит на стене)
+    bool isVisible(
+        const Vec2<double> &p, int fromWall, const Vec2<double> &q, int toWall
+    ) const;
+
+    void see( // Построение участков стен, видимых из точки point
+        const Vec2<double> &point, Visible &visible
+    ) const;
+
+    // Попадает ли точка point на стене wall в видимые участки
+    bool isSeen(
+        const Visible &visible, int wall, const Vec2<double> &point
+    ) const;
+
+public:
+    Radiosity(double patchLength = 8);
+
+    // Поместить источник в точку source и рассчитать освещенность стен
+    void start(Room *room, Vector2 source);
+
+    // Пересчитать, если стены комнаты изменились. Возвращает true, если
+    // расчет был выполнен заново
+    bool update();
+
+    bool isActive() { return room != nullptr; }
+
+    const vector<Patch> &getPatches() { return patches; }
+
+    int getIterations() { return iterations; }
+
+    double getAimDirect() { return aimDirect; }
+
+    double getAimTotal() { return aimTotal; }
+
+    void clear();
+
+    void draw(); // Отрисовка освещенности вдоль стен и в центре цели
+};
@@ -1,167 +1,156 @@
+#include <algorithm>
 #include <cfloat>
 #include <climits>
+#include <limits>
 #include <math.h>
 
 #include "nlohmann/json_fwd.hpp"
 #include "raylib.h"
 #include "raymath.h"
 
+#include "Geometry.h"
 #include "Ray.h"
 
-RaySegment::RaySegment(const Vector2 &start, const Vector2 &end, int depth):
-    start(start),
-    end(end),
-    hasHit(false),
-    hitWall(nullptr),
-    next(nullptr),
-    depth(depth) {}
-
-RaySegment::~RaySegment() {
-    if (next) {
-        delete next;
-    }
-}
+// Доля энергии, ниже которой луч веера не продолжается (как у ветвей дерева
+// луча)
+static const float fanMinimalEnergy = 1e-3f;
 
-void RaySegment::draw() const {
-    DrawLineEx(start, hasHit ? hitPoint : end, 4.0f, ORANGE);
-    if (next) {
-        next->draw();
-    }
+// Проходит ли отрезок start + direction * t, 0 <= t <= length, через один из
+// прямоугольников boxes
+static bool crossesBoxes(
+    const Vector2 &start, const Vector2 &direction, float length,
+    const vector<Tracer<float>::Box> &boxes
+) {
+    return Tracer<float>::crosses(
+        Vec2<float>(start), Vec2<float>(direction), length, boxes
+    );
 }
 
-Vector2 RaySegment::intersectionWithWallLine(WallLine *wall) {
-    Vector2 wallStart = wall->getStart()->getCoord();
-    Vector2 wallEnd = wall->getEnd()->getCoord();
-
-    float denominator = (start.x - end.x) * (wallStart.y - wallEnd.y) -
-                        (start.y - end.y) * (wallStart.x - wallEnd.x);
+RayTree::RayTree(long budget, float minimalEnergy):
+    budget(budget),
+    minimalEnergy(minimalEnergy) {}
 
-    if (fabsf(denominator) < 0.0001f) {
-        return Vector2{NAN, NAN};
+RayTree::Node *RayTree::add(
+    const Vector2 &start, const Vector2 &direction, int fromWall, int depth,
+    float energy
+) {
+    if (energy < minimalEnergy) {
+        return nullptr;
     }
-
-    float t = ((start.x - wallStart.x) * (wallStart.y - wallEnd.y) -
-               (start.y - wallStart.y) * (wallStart.x - wallEnd.x)) /
-              denominator;
-    float u = -((start.x - end.x) * (start.y - wallStart.y) -
-                (start.y - end.y) * (start.x - wallStart.x)) /
-              denominator;
-
-    if (t >= 0.0f && t <= 1.0f && u >= 0.0f && u <= 1.0f) {
-        return Vector2{
-            start.x + t * (end.x - start.x), start.y + t * (end.y - start.y)
-        };
+    if ((long)nodes.size() >= budget) {
+        truncated = true;
+        return nullptr;
     }
 
-    return Vector2{NAN, NAN};
+    Node *node = nodes.allocate();
+    *node = Node{};
+    node->start = start;
+    node->direction = Vector2Normalize(direction);
+    node->fromWall = fromWall;
+    node->hitWall = -1;
+    node->hitAim = -1;
+    node->depth = depth;
+    node->energy = energy;
+    return node;
 }
 
-Vector2 RaySegment::intersectionWithWallRound(WallRound *wall) {
-    Vector2 center = wall->getCenter();
-    float radius = wall->getRadius();
-
-    Vector2 d = Vector2Subtract(end, start);
-    Vector2 f = Vector2Subtract(start, center);
-
-    float a = Vector2DotProduct(d, d);
-    float b = 2 * Vector2DotProduct(f, d);
-    float c = Vector2DotProduct(f, f) - radius * radius;
-
-    float D = b * b - 4 * a * c;
-
-    if (D < 0) {
-        return Vector2{NAN, NAN};
-    }
-
-    D = sqrtf(D);
-    float t1 = (-b - D) / (2 * a);
-    float t2 = (-b + D) / (2 * a);
+void RayTree::build(
+    Room *room, const Vector2 &start, const Vector2 &direction, int fromWall,
+    int depth
+) {
+    nodes.clear();
+    truncated = false;
+    add(start, direction, fromWall, 1, 1);
+
+    const Tracer<float> &tracer = room->getTracer();
+    Tracer<float>::Hit hit;
+
+    // Дети добавляются в конец пула, поэтому узлы обходятся по уровням
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        Node &node = nodes[i];
+        if (node.escaped ||
+            !tracer.trace(node.start, node.direction, node.fromWall, hit)) {
+            continue;
+        }
 
-    Vector2 closestIntersection = {NAN, NAN};
-    float minT = FLT_MAX;
+        node.hasHit = true;
+        node.hitPoint = hit.point.toVector2();
+        node.hitWall = hit.wall;
+        node.hitAim = hit.target;
 
-    for (float t : {t1, t2}) {
-        if (t >= 0.0001f && t <= 1.0f && t < minT) {
-            Vector2 point = Vector2{start.x + t * d.x, start.y + t * d.y};
+        if (hit.aim || node.depth > depth) {
+            continue; // Попали в область цели или исчерпали отражения
+        }
+        if (tracer.isDiffuse(hit.wall)) {
+            continue; // Диффузная стена рассеивает свет во все стороны, и
+                      // отдельный луч дальше не продолжается
+        }
 
-            if (wall->isPointOnArc(point, 0.1f)) {
-                closestIntersection = point;
-                minT = t;
+        float reflectance = tracer.getReflectance(hit.wall);
+        float transmittance = tracer.getTransmittance(hit.wall);
+        Vector2 reflected = tracer.reflect(hit, node.direction).toVector2();
+        node.reflected = add(
+            node.hitPoint, reflected, hit.wall, node.depth + 1,
+            node.energy * reflectance
+        );
+        if (transmittance > 0) {
+            // Прошедшая ветвь продолжает направление луча. Сквозь стену
+            // замкнутой комнаты она выходит наружу и дальше не прослеживается,
+            // сквозь препятствие --- остается в комнате
+            node.transmitted = add(
+                node.hitPoint, node.direction, hit.wall, node.depth + 1,
+                node.energy * transmittance
+            );
+            if (node.transmitted) {
+                node.transmitted->escaped = tracer.isBoundary(hit.wall);
             }
         }
     }
-
-    return closestIntersection;
 }
 
-void RaySegment::updateParameters(Room *room) {
-    Vector2 closestHit = {NAN, NAN};
-    float minDist = FLT_MAX;
-    Wall *closestWall = nullptr;
-    bool hitAimArea = false;
-
-    if (room->aim) {
-        Vector2 aimIntersection;
-        if (room->isRayInAim(start, end, aimIntersection)) {
-            float dist = Vector2Distance(start, aimIntersection);
-            if (dist > 0.1f && dist < minDist) {
-                minDist = dist;
-                closestHit = aimIntersection;
-                hitAimArea = true; // Помечаем, что попали в область цели
-            }
+float RayTree::getAimEnergy(int aim) const {
+    // Луч, попавший в цель, в ней заканчивается, поэтому энергия ветвей
+    // не учитывается дважды
+    float energy = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].hitAim == aim) {
+            energy += nodes[i].energy;
         }
     }
+    return energy;
+}
 
-    for (Wall *wall : room->getWalls()) {
-        if (!hitAimArea || Vector2Distance(start, closestHit) > 0) {
-            Vector2 intersection = {NAN, NAN};
-
-            WallLine *wallLine = dynamic_cast<WallLine *>(wall);
-            WallRound *wallRound = dynamic_cast<WallRound *>(wall);
-
-            if (wallLine) {
-                intersection = intersectionWithWallLine(wallLine);
-            } else if (wallRound) {
-                intersection = intersectionWithWallRound(wallRound);
-            }
-
-            if (!isnan(intersection.x) && !isnan(intersection.y)) {
-                float dist = Vector2Distance(start, intersection);
-                if (dist > 0.5f && dist < minDist) {
-                    minDist = dist;
-                    closestHit = intersection;
-                    closestWall = wall;
-                    hitAimArea = false;
-                }
-            }
+bool RayTree::crosses(const vector<Tracer<float>::Box> &boxes) const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Node &node = nodes[i];
+        if (node.escaped) {
+            continue; // Вышедшая из комнаты ветвь не прослеживалась
         }
-    }
-
-    if (!isnan(closestHit.x) && !isnan(closestHit.y)) {
-        hasHit = true;
-        hitPoint = closestHit;
-        hitWall = closestWall;
-
-        if (hitAimArea) {
-            return;
+        float length = node.hasHit ? Vector2Distance(node.start, node.hitPoint)
+                                   : infinity;
+        if (crossesBoxes(node.start, node.direction, length, boxes)) {
+            return true;
         }
+    }
+    return false;
+}
 
-        if (hitWall && depth <= hitWall->room->maximumRayDepth) {
-            Vector2 normal = hitWall->getNormal(hitPoint);
-            Vector2 incident =
-                Vector2Normalize(Vector2Subtract(hitPoint, start));
-
-            float dotProduct = Vector2DotProduct(incident, normal);
-            Vector2 reflected =
-                Vector2Subtract(incident, Vector2Scale(normal, 2 * dotProduct));
-
-            Vector2 nextEnd =
-                Vector2Add(hitPoint, Vector2Scale(reflected, 10000.0f));
-            next = new RaySegment(hitPoint, nextEnd, depth + 1);
-            next->updateParameters(room);
-        }
-    } else {
-        hasHit = false;
+void RayTree::draw() const {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Node &node = nodes[i];
+        Vector2 end = node.hasHit ? node.hitPoint
+                                  : Vector2Add(
+                                        node.start,
+                                        Vector2Scale(
+                                            node.direction,
+                                            Tracer<float>::unboundedLength
+                                        )
+                                    );
+        // Ослабленный отражениями луч рисуется прозрачнее
+        DrawLineEx(
+            node.start, end, 4.0f, Fade(ORANGE, 0.2f + 0.8f * node.energy)
+        );
     }
 }
 
@@ -202,9 +191,16 @@ void RayStart::setAngle(float angle) {
     updateRaySegments();
 }
 
+void RayStart::setT(float t) {
+    if (t <= 0 || t >= 1) {
+        throw CantStartInCorner();
+    }
+    RayStart::t = t;
+    updateParams();
+}
+
 void RayStart::setWall(Wall *wall) {
     RayStart::wall = wall;
-    updateParams();
 }
 
 void RayStart::inverseT() {
@@ -217,23 +213,33 @@ void RayStart::inverseDirection() {
     updateRaySegments();
 }
 
-void RayStart::updateRaySegments() {
-    if (ray) {
-        delete ray;
-    }
+Vector2 RayStart::getDirection(float angle) {
     Vector2 normal = wall->getNormal(start);
     if (inverted) {
         normal = Vector2Scale(normal, -1.0f);
     }
-    Vector2 rayDir = Vector2Rotate(normal, angle - PI / 2);
-    Vector2 rayEnd = Vector2Add(start, Vector2Scale(rayDir, 10000.0f));
-    ray = new RaySegment(start, rayEnd, 1);
-    ray->updateParameters(wall->room);
+    return Vector2Rotate(normal, angle - PI / 2);
+}
+
+void RayStart::updateRaySegments() {
+    wall->room->markChanged();
+    tree.build(
+        wall->room, start, getDirection(angle),
+        wall->room->getTracer().indexOf(wall), Room::maximumRayDepth
+    );
 }
 
 void RayStart::updateParams() {
+    wall->room->markChanged();
+    retrace();
+}
+
+void RayStart::retrace() {
     start = wall->getPointByT(t);
-    updateRaySegments();
+    tree.build(
+        wall->room, start, getDirection(angle),
+        wall->room->getTracer().indexOf(wall), Room::maximumRayDepth
+    );
 }
 
 json RayStart::toJson() {
@@ -246,52 +252,354 @@ json RayStart::toJson() {
 
 void RayStart::draw() {
     DrawCircleV(start, 10, ORANGE);
-    ray->draw();
+    tree.draw();
 }
 
-RayStart::~RayStart() {
-    delete ray;
+const char *RayFan::InvalidCount::what() const noexcept {
+    return "Число лучей веера может быть от 1 до 10000";
 }
 
-AimArea::AimArea(const Vector2 &center, float radius):
-    center(center),
-    radius(radius) {}
+const char *RayFan::InvalidTolerance::what() const noexcept {
+    return "Точность веера может быть от 0.5 до 100 пикселей";
+}
 
-void AimArea::setCenter(const Vector2 &center) {
-    this->center = center;
+RayFan::RayFan(
+    const Vector2 &point, Wall *wall, float fromAngle, float toAngle,
+    int count, bool inverted
+):
+    start(point),
+    wall(wall),
+    t(wall->getTByPoint(point)),
+    inverted(inverted) {
+    if (start == wall->getStart()->getCoord() ||
+        start == wall->getEnd()->getCoord()) {
+        throw RayStart::CantStartInCorner();
+    }
+    if (count < 1 || count > maximumCount) {
+        throw InvalidCount();
+    }
+    RayFan::count = count;
+    setAngles(fromAngle, toAngle);
 }
 
-bool AimArea::intersectsWithRay(
-    const Vector2 &rayStart, const Vector2 &rayEnd, Vector2 &intersectionPoint
+Vector2 RayFan::getDirection(float angle) {
+    Vector2 normal = wall->getNormal(start);
+    if (inverted) {
+        normal = Vector2Scale(normal, -1.0f);
+    }
+    return Vector2Rotate(normal, angle - PI / 2);
+}
+
+void RayFan::setAngles(float fromAngle, float toAngle) {
+    for (float angle : {fromAngle, toAngle}) {
+        if (angle * RAD2DEG < 1 || angle * RAD2DEG > 179) {
+            throw RayStart::InvalidAngle();
+        }
+    }
+    RayFan::fromAngle = fromAngle;
+    RayFan::toAngle = toAngle;
+    wall->room->markChanged();
+    retrace();
+}
+
+void RayFan::setCount(int count) {
+    if (count < 1 || count > maximumCount) {
+        throw InvalidCount();
+    }
+    RayFan::count = count;
+    updateParams();
+}
+
+void RayFan::setT(float t) {
+    if (t <= 0 || t >= 1) {
+        throw RayStart::CantStartInCorner();
+    }
+    RayFan::t = t;
+    updateParams();
+}
+
+void RayFan::setWall(Wall *wall) {
+    RayFan::wall = wall;
+}
+
+void RayFan::inverseT() {
+    t = 1 - t;
+    updateParams();
+}
+
+void RayFan::inverseDirection() {
+    inverted = !inverted;
+    updateParams();
+}
+
+void RayFan::setAdaptive(bool adaptive) {
+    RayFan::adaptive = adaptive;
+    updateParams();
+}
+
+void RayFan::setTolerance(float tolerance) {
+    if (tolerance < minimalTolerance || tolerance > maximumTolerance) {
+        throw InvalidTolerance();
+    }
+    RayFan::tolerance = tolerance;
+    updateParams();
+}
+
+void RayFan::setCausticShown(bool shown) {
+    causticShown = shown;
+    caustic.clear();
+    updateParams();
+}
+
+void RayFan::updateParams() {
+    wall->room->markChanged();
+    retrace();
+}
+
+float RayFan::spread(
+    const Tracer<float> &tracer, int startWall, float angle
 ) {
-    Vector2 d = Vector2Subtract(rayEnd, rayStart);
-    Vector2 f = Vector2Subtract(rayStart, center);
+    // Производные начала и направления луча по углу переносятся через
+    // отражения. Расстояние между точками столкновения соседних лучей ---
+    // производная точки столкновения, умноженная на шаг угла. Луч, ушедший
+    // из комнаты, не учитывается: на бесконечности расхождение ничем не
+    // ограничено
+    Vec2<float> origin(start);
+    Vec2<float> dir(getDirection(angle));
+    Tracer<float>::Differential differential;
+    differential.dir = Vec2<float>(-dir.y, dir.x);
+    int fromWall = startWall;
+    float energy = 1;
+
+    float rate = 0;
+    Tracer<float>::Hit hit;
+    for (int depth = 0; depth <= Room::maximumRayDepth; ++depth) {
+        if (!tracer.trace(origin, dir, fromWall, hit)) {
+            break;
+        }
+        if (hit.aim) {
+            // Цель не сдвигает точку вдоль луча
+            Vec2<float> end =
+                differential.origin + differential.dir * hit.distance;
+            return std::fmax(rate, length(end));
+        }
+        differential = tracer.reflectDifferential(hit, dir, differential);
+        rate = std::fmax(rate, length(differential.origin));
 
-    float a = Vector2DotProduct(d, d);
-    float b = 2 * Vector2DotProduct(f, d);
-    float c = Vector2DotProduct(f, f) - radius * radius;
+        energy *= tracer.getReflectance(hit.wall);
+        if (depth == Room::maximumRayDepth || energy < fanMinimalEnergy ||
+            tracer.isDiffuse(hit.wall)) {
+            break;
+        }
+        dir = tracer.reflect(hit, dir);
+        origin = hit.point;
+        fromWall = hit.wall;
+    }
+    return rate;
+}
 
-    float discriminant = b * b - 4 * a * c;
+void RayFan::chooseAngles(const Tracer<float> &tracer, int startWall) {
+    angles.clear();
+    if (!adaptive) {
+        for (int i = 0; i < count; ++i) {
+            angles.push_back(
+                count == 1 ? (fromAngle + toAngle) / 2
+                           : fromAngle + (toAngle - fromAngle) * i / (count - 1)
+            );
+        }
+        return;
+    }
 
-    if (discriminant < 0) {
-        return false;
+    // Шаг угла выбирается по скорости расхождения лучей в начале шага. Если
+    // в конце шага лучи расходятся вдвое быстрее допустимого, шаг
+    // сокращается по скорости в конце. Разрывы, где соседние лучи попадают
+    // на разные стены, производные не описывают
+    float span = std::fabs(toAngle - fromAngle);
+    float direction = toAngle >= fromAngle ? 1 : -1;
+    float minimalStep = span / (maximumCount - 1);
+    float maximalStep = span / 16;
+
+    float angle = fromAngle;
+    float rate = spread(tracer, startWall, angle);
+    float passed = 0;
+    angles.push_back(angle);
+    while (passed < span && (int)angles.size() < maximumCount) {
+        float step = tolerance / std::fmax(rate, tolerance / maximalStep);
+        step = std::fmax(minimalStep, std::fmin(step, span - passed));
+        float nextRate = spread(tracer, startWall, angle + direction * step);
+        if (nextRate * step > 2 * tolerance && step > minimalStep) {
+            step = std::fmax(minimalStep, tolerance / nextRate);
+            nextRate = spread(tracer, startWall, angle + direction * step);
+        }
+        passed += step;
+        angle = passed >= span ? toAngle : fromAngle + direction * passed;
+        rate = nextRate;
+        angles.push_back(angle);
     }
+}
 
-    discriminant = sqrtf(discriminant);
-    float t1 = (-b - discriminant) / (2 * a);
-    float t2 = (-b + discriminant) / (2 * a);
+void RayFan::retrace() {
+    typedef Tracer<float>::Packet Packet;
+    const int packetSize = Tracer<float>::packetSize;
 
-    float t = FLT_MAX;
+    // Луч, ожидающий трассировки
+    struct Active {
+        Vec2<float> origin;
+        Vec2<float> dir;
+        int fromWall;
+        float energy;
+    };
 
-    if (t1 >= 0 && t1 <= 1 && t1 < t) {
-        t = t1;
+    start = wall->getPointByT(t);
+    segments.clear();
+    const Tracer<float> &tracer = wall->room->getTracer();
+
+    int startWall = tracer.indexOf(wall);
+    chooseAngles(tracer, startWall);
+
+    vector<Active> active;
+    vector<Active> next;
+    active.reserve(angles.size());
+    for (float angle : angles) {
+        active.push_back(
+            {Vec2<float>(start), Vec2<float>(getDirection(angle)), startWall, 1}
+        );
     }
-    if (t2 >= 0 && t2 <= 1 && t2 < t) {
-        t = t2;
+
+    Packet packet;
+    Tracer<float>::Hit hits[packetSize];
+    bool found[packetSize];
+    for (int depth = 0; depth <= Room::maximumRayDepth && !active.empty();
+         ++depth) {
+        // Лучи, отразившиеся от одной стены, идут подряд в порядке веера
+        std::stable_sort(
+            active.begin(), active.end(),
+            [](const Active &a, const Active &b) {
+                return a.fromWall < b.fromWall;
+            }
+        );
+
+        next.clear();
+        for (size_t first = 0; first < active.size();) {
+            packet.count = 0;
+            while (first + packet.count < active.size() &&
+                   packet.count < packetSize &&
+                   active[first + packet.count].fromWall ==
+                       active[first].fromWall) {
+                const Active &ray = active[first + packet.count];
+                packet.origin[packet.count] = ray.origin;
+                packet.dir[packet.count] = ray.dir;
+                packet.fromWall[packet.count] = ray.fromWall;
+                ++packet.count;
+            }
+            tracer.tracePacket(packet, hits, found);
+
+            for (int k = 0; k < packet.count; ++k) {
+                const Active &ray = active[first + k];
+                if (!found[k]) {
+                    Vec2<float> end =
+                        ray.origin + ray.dir * Tracer<float>::unboundedLength;
+                    segments.push_back(
+                        {ray.origin.toVector2(), end.toVector2(), ray.energy,
+                         false}
+                    );
+                    continue;
+                }
+                const Tracer<float>::Hit &hit = hits[k];
+                segments.push_back(
+                    {ray.origin.toVector2(), hit.point.toVector2(), ray.energy,
+                     true}
+                );
+                // Веер, как и дерево лучей, на диффузной стене обрывается
+                if (hit.aim || depth == Room::maximumRayDepth ||
+                    tracer.isDiffuse(hit.wall)) {
+                    continue;
+                }
+                float energy = ray.energy * tracer.getReflectance(hit.wall);
+                if (energy >= fanMinimalEnergy) {
+                    next.push_back(
+                        {hit.point, tracer.reflect(hit, ray.dir), hit.wall,
+                         energy}
+                    );
+                }
+            }
+            first += packet.count;
+        }
+        active.swap(next);
     }
 
-    if (t < FLT_MAX) {
-        intersectionPoint = Vector2{rayStart.x + t * d.x, rayStart.y + t * d.y};
+    if (causticShown) {
+        caustic.build(
+            tracer, start, startWall, getDirection(PI / 2), fromAngle, toAngle
+        );
+    }
+}
+
+bool RayFan::crosses(const vector<Tracer<float>::Box> &boxes) const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    for (const Segment &segment : segments) {
+        Vector2 offset = Vector2Subtract(segment.end, segment.start);
+        float length = segment.hasHit ? Vector2Length(offset) : infinity;
+        if (crossesBoxes(
+                segment.start, Vector2Normalize(offset), length, boxes
+            )) {
+            return true;
+        }
+    }
+    return causticShown && caustic.crosses(boxes);
+}
+
+json RayFan::toJson() {
+    return {
+        {"fromAngle", fromAngle},
+        {"toAngle", toAngle},
+        {"count", count},
+        {"start", {{"x", start.x}, {"y", start.y}}},
+        {"inverted", inverted},
+        {"caustic", causticShown},
+        {"adaptive", adaptive},
+        {"tolerance", tolerance}
+    };
+}
+
+void RayFan::draw() {
+    // Лучи густого веера перекрываются, поэтому рисуются тем прозрачнее, чем
+    // их больше
+    float alpha = std::fmax(0.05f, std::fmin(1.0f, 32.0f / angles.size()));
+    for (const Segment &segment : segments) {
+        DrawLineV(
+            segment.start, segment.end,
+            Fade(ORANGE, alpha * (0.2f + 0.8f * segment.energy))
+        );
+    }
+    caustic.draw();
+    DrawCircleV(start, 10, ORANGE);
+}
+
+AimArea::AimArea(const Vector2 &center, float radius):
+    center(center),
+    radius(radius) {}
+
+void AimArea::setCenter(const Vector2 &center) {
+    this->center = center;
+}
+
+bool AimArea::intersectsWithRay(
+    const Vector2 &origin, const Vector2 &direction, float &distance
+) {
+    float t1, t2;
+    if (!circleIntersection<float>(
+            origin, Vector2Normalize(direction), center, radius, t1, t2
+        )) {
+        return false;
+    }
+
+    if (t1 >= 0) {
+        distance = t1;
+        return true;
+    }
+    if (t2 >= 0) {
+        distance = t2;
         return true;
     }
 
@@ -3,7 +3,10 @@
 #include "nlohmann/json_fwd.hpp"
 #include "raylib.h"
 
+#include "Caustic.h"
+#include "Pool.h"
 #include "Room.h"
+#include "Tracer.h"
 
 using nlohmann::json;
 
@@ -12,26 +15,68 @@ class WallLine;
 class WallRound;
 class Room;
 
-// Класс сегмента луча
-class RaySegment {
+// Дерево луча. Луч, попавший на светоделитель, разделяется на отраженную и
+// прошедшую ветви, поэтому сегменты образуют дерево. Дерево строится в
+// ширину: узлы выдаются пулом в порядке уровней, и очередью обхода служит сам
+// пул. Ветви, энергия которых меньше minimalEnergy, не продолжаются, а когда
+// число узлов достигает бюджета, отбрасываются самые глубокие уровни. Пул
+// сохраняет память между перестроениями, поэтому при движении луча узлы не
+// выделяются в куче по одному
+class RayTree {
+public:
+    // Сегмент луча
+    struct Node {
+        Vector2 start;     // Точка начала
+        Vector2 direction; // Единичный вектор направления (луч задается
+                           // параметрически: start + direction * t, t > 0)
+        int fromWall;      // Индекс стены, от которой отразился луч (или -1)
+        bool hasHit;       // Было ли столкновение со стеной
+        bool escaped;      // Прошел ли луч сквозь стену замкнутой комнаты
+        Vector2 hitPoint;  // Точка столкновения (если есть)
+        int hitWall;       // Индекс стены, с которой произошло столкновение
+        int hitAim;        // Индекс цели, в которую попал сегмент (или -1)
+        int depth;         // Число переотражений
+        float energy;      // Доля энергии луча на этом сегменте
+        Node *reflected;   // Отраженная ветвь (или nullptr)
+        Node *transmitted; // Прошедшая сквозь светоделитель ветвь (или nullptr)
+    };
+
 private:
-    Vector2 start; // Точка начала
-    Vector2 end;   // Точка конца (большие координаты чтобы гарантированно найти
-                   // пересечение)
-    bool hasHit;   // Было ли столкновение со стеной
-    Vector2 hitPoint; // Точка столкновения (если есть)
-    Wall *hitWall;    // Стена, с которой произошло столкновение
-    RaySegment *next; // Следующий сегмент луча
-    int depth;        // Число переторажений
-
-    Vector2 intersectionWithWallLine(WallLine *wall);
-    Vector2 intersectionWithWallRound(WallRound *wall);
+    Pool<Node> nodes;       // Узлы в порядке обхода в ширину
+    long budget;            // Наибольшее число узлов
+    float minimalEnergy;    // Энергия, ниже которой ветви не продолжаются
+    bool truncated = false; // Были ли ветви отброшены из-за бюджета
+
+    Node *add( // Новый узел или nullptr, если он выходит за ограничения
+        const Vector2 &start, const Vector2 &direction, int fromWall,
+        int depth, float energy
+    );
 
 public:
-    RaySegment(const Vector2 &start, const Vector2 &end, int depth = 1);
-    void updateParameters(Room *room);
+    RayTree(long budget = 1 << 20, float minimalEnergy = 1e-3f);
+
+    // Построение дерева луча из start в направлении direction, ветви
+    // прослеживаются не более чем на depth отражений
+    void build(
+        Room *room, const Vector2 &start, const Vector2 &direction,
+        int fromWall, int depth
+    );
+
+    const Node *getRoot() const { return nodes.size() ? &nodes[0] : nullptr; }
+
+    size_t size() const { return nodes.size(); }
+
+    bool isTruncated() const { return truncated; }
+
+    // Доля энергии луча, попавшая в цель с индексом aim
+    float getAimEnergy(int aim) const;
+
+    // Проходит ли какой-либо сегмент через один из прямоугольников boxes
+    bool crosses(const vector<Tracer<float>::Box> &boxes) const;
+
+    void clear() { nodes.clear(); }
+
     void draw() const;
-    ~RaySegment();
 };
 
 // Класс вершины луча
@@ -40,7 +85,7 @@ class RayStart {
     float angle; // Угол относительно родительской стены (от 1 до 179 градусов )
     Wall *wall;  // Родительская стена
     float t;
-    RaySegment *ray = nullptr;
+    RayTree tree; // Сегменты луча
     bool inverted;
 
 public:
@@ -69,18 +114,149 @@ public:
 
     Wall *getWall() { return wall; }
 
+    float getT() { return t; }
+
+    bool isInverted() { return inverted; }
+
+    const RayTree &getTree() { return tree; }
+
+    Vector2 getDirection(float angle); // Направление луча под углом angle
+
     void setAngle(float angle);
-    void setWall(Wall *wall);
+    void setT(float t); // Перемещение начала луча по стене
+    void setWall(Wall *wall); // Перенос на другую стену (сегменты
+                              // перестраиваются при обновлении комнаты)
     void inverseT();
     void inverseDirection();
     void updateRaySegments();
     void updateParams();
 
+    // Перестроение сегментов луча по текущему снимку комнаты без отметки ее
+    // изменения. Лучи разных начал можно перестраивать в нескольких потоках
+    void retrace();
+
     json toJson(); // Экспорт в json
 
     void draw();
+};
+
+// Веер лучей: count лучей из одной точки стены под углами к ней от fromAngle
+// до toAngle. Соседние лучи веера идут почти параллельно, поэтому
+// прослеживаются пакетами (Tracer::tracePacket). После каждого отражения лучи
+// упорядочиваются по стене, от которой отразились, и пакет составляется из
+// соседних лучей одной стены: пакет, лучи которого попали на разные стены,
+// распадается на несколько. Лучи веера не ветвятся, светоделитель для них ---
+// зеркало с долей отражения reflectance
+class RayFan {
+public:
+    // Отрезок пути одного из лучей
+    struct Segment {
+        Vector2 start;
+        Vector2 end;
+        float energy; // Доля энергии луча на отрезке
+        bool hasHit;  // Закончился ли отрезок на стене или в цели (иначе он
+                      // уходит в бесконечность, и end --- точка для рисования)
+    };
+
+    static const int maximumCount = 10000; // Наибольшее число лучей
+    static constexpr float minimalTolerance = 0.5f; // Пределы точности
+    static constexpr float maximumTolerance = 100;  // адаптивного выбора
+
+private:
+    Vector2 start;   // Точка начала лучей
+    Wall *wall;      // Родительская стена
+    float t;         // Параметр точки начала на стене
+    float fromAngle; // Углы крайних лучей относительно стены (от 1 до 179
+    float toAngle;   // градусов)
+    int count;       // Число лучей при равномерном выборе углов
+    bool inverted;
+    bool adaptive = false;     // Выбираются ли углы лучей адаптивно
+    float tolerance = 5;       // Допустимое расстояние между соседними лучами
+    vector<float> angles;      // Углы лучей при последнем перестроении
+    vector<Segment> segments;  // Отрезки всех лучей
+    Caustic caustic;           // Каустики семейства лучей веера
+    bool causticShown = false; // Строятся ли каустики при перестроении
+
+    // Наибольшая скорость, с которой расходятся соседние лучи (в пикселях на
+    // радиан), вдоль пути луча под углом angle
+    float spread(const Tracer<float> &tracer, int startWall, float angle);
+
+    // Выбор углов лучей: равномерно или адаптивно, с шагом, при котором
+    // соседние лучи расходятся не больше чем на tolerance
+    void chooseAngles(const Tracer<float> &tracer, int startWall);
+
+public:
+    RayFan(
+        const Vector2 &point, Wall *wall, float fromAngle, float toAngle,
+        int count, bool inverted = false
+    );
+
+    class InvalidCount: public std::exception { // Исключение, выбрасывается,
+                                                // когда число лучей не от 1
+                                                // до maximumCount
+    public:
+        const char *what() const noexcept;
+    };
+
+    class InvalidTolerance: public std::exception { // Исключение,
+                                                    // выбрасывается, когда
+                                                    // точность вне пределов
+    public:
+        const char *what() const noexcept;
+    };
+
+    Vector2 getStart() { return start; }
+
+    Wall *getWall() { return wall; }
+
+    float getT() { return t; }
+
+    float getFromAngle() { return fromAngle; }
+
+    float getToAngle() { return toAngle; }
+
+    int getCount() { return count; }
+
+    bool isInverted() { return inverted; }
+
+    bool isAdaptive() { return adaptive; }
 
-    ~RayStart();
+    float getTolerance() { return tolerance; }
+
+    const vector<float> &getAngles() { return angles; }
+
+    const vector<Segment> &getSegments() { return segments; }
+
+    const Caustic &getCaustic() { return caustic; }
+
+    bool isCausticShown() { return causticShown; }
+
+    void setCausticShown(bool shown); // Включение и выключение каустик
+
+    Vector2 getDirection(float angle); // Направление луча под углом angle
+
+    void setAngles(float fromAngle, float toAngle);
+    void setCount(int count);
+    void setAdaptive(bool adaptive);
+    void setTolerance(float tolerance);
+    void setT(float t); // Перемещение начала веера по стене
+    void setWall(Wall *wall); // Перенос на другую стену (лучи
+                              // перестраиваются при обновлении комнаты)
+    void inverseT();
+    void inverseDirection();
+    void updateParams();
+
+    // Перестроение лучей по текущему снимку комнаты без отметки ее
+    // изменения, как у RayStart::retrace
+    void retrace();
+
+    // Проходит ли какой-либо отрезок лучей веера или каустик через один из
+    // прямоугольников boxes
+    bool crosses(const vector<Tracer<float>::Box> &boxes) const;
+
+    json toJson(); // Экспорт в json
+
+    void draw();
 };
 
 // Класс области цели (круг)
@@ -98,9 +274,8 @@ public:
 
     void setCenter(const Vector2 &center);
 
-    bool intersectsWithRay(
-        const Vector2 &rayStart, const Vector2 &rayEnd,
-        Vector2 &intersectionPoint
+    bool intersectsWithRay( // Пересечение с лучом origin + direction * t
+        const Vector2 &origin, const Vector2 &direction, float &distance
     );
 
     bool containsPoint(
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+
+#include "Parallel.h"
+#include "Ray.h"
+#include "ReachMap.h"
+#include "Room.h"
+#include "Sampling.h"
+#include "Tracer.h"
+
+const char *ReachMap::NoRayStart::what() const noexcept {
+    return "Для карты достижимости нужен луч";
+}
+
+// Чередование битов координат плитки (код Мортона)
+static uint32_t interleave(uint32_t x, uint32_t y) {
+    uint32_t code = 0;
+    for (int bit = 0; bit < 16; ++bit) {
+        code |= ((x >> bit) & 1) << (2 * bit);
+        code |= ((y >> bit) & 1) << (2 * bit + 1);
+    }
+    return code;
+}
+
+ReachMap::ReachMap(int width, int height) {
+    ReachMap::width = width;
+    ReachMap::height = height;
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+
+    // Плитки обходятся по возрастанию обратной записи кода Мортона: так
+    // первые плитки равномерно покрывают карту, а следующие заполняют
+    // промежутки между ними
+    tiles.resize(tilesX * tilesY);
+    vector<uint32_t> keys(tiles.size());
+    for (int y = 0; y < tilesY; ++y) {
+        for (int x = 0; x < tilesX; ++x) {
+            tiles[y * tilesX + x] = y * tilesX + x;
+            keys[y * tilesX + x] = reverseBits(interleave(x, y));
+        }
+    }
+    std::sort(tiles.begin(), tiles.end(), [&](int a, int b) {
+        return keys[a] < keys[b];
+    });
+}
+
+void ReachMap::start(Room *room, int depth) {
+    if (!room->rayStart) {
+        throw NoRayStart();
+    }
+
+    clear();
+    ReachMap::room = room;
+    ReachMap::depth = depth;
+    restart();
+}
+
+void ReachMap::restart() {
+    roomShape = room->getShapeVersion();
+    wall = room->rayStart->getWall();
+    inverted = room->rayStart->isInverted();
+    tracer.update(room);
+    wallIndex = tracer.indexOf(wall);
+    target = room->getAimIndex();
+
+    // Точки и нормали считаются заранее, чтобы потоки не обращались к
+    // виртуальным методам стены
+    float sign = inverted ? -1.0f : 1.0f;
+    origins.resize(width);
+    normals.resize(width);
+    for (int column = 0; column < width; ++column) {
+        Vector2 point = wall->getPointByT(getT(column));
+        Vector2 normal = wall->getNormal(point);
+        origins[column] = Vec2<double>(point);
+        normals[column] = Vec2<double>(normal.x * sign, normal.y * sign);
+    }
+
+    // Цвета от желтого (без отражений) к синему (depth отражений)
+    palette.resize(depth + 2);
+    for (int i = 0; i <= depth; ++i) {
+        float hue = 60 + 180.0f * i / std::max(1, depth);
+        palette[i] = ColorFromHSV(hue, 0.8f, 1);
+    }
+    palette[depth + 1] = DARKGRAY;
+
+    reach.assign((size_t)width * height, miss);
+    indexed = tracer.wallsCount() <= Itineraries::maximumWalls;
+    itineraries.reset(indexed ? (long)width * height : 0);
+    nextTile = 0;
+    finished = false;
+
+    if (hasTexture) {
+        UnloadTexture(texture);
+    }
+    vector<Color> pixels((size_t)width * height, Color{0, 0, 0, 0});
+    Image image = {
+        pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    texture = LoadTextureFromImage(image);
+    hasTexture = true;
+}
+
+void ReachMap::step(double budget) {
+    if (!room) {
+        return;
+    }
+
+    RayStart *rayStart = room->rayStart;
+    if (!rayStart) {
+        clear();
+        return;
+    }
+    if (room->getShapeVersion() != roomShape ||
+        rayStart->getWall() != wall || rayStart->isInverted() != inverted) {
+        restart();
+    }
+
+    if (finished) {
+        return;
+    }
+
+    long tilesCount = tiles.size();
+    long first = nextTile;
+
+    // Потоки берут плитки по очереди, пока не истечет время порции. Начатая
+    // плитка рассчитывается до конца. Плитки независимы и идут одним
+    // проходом
+    nextTile = runPasses(
+        nextTile, tilesCount, tilesCount, now() + budget,
+        [&](long i, int) { traceTile(tiles[i]); }
+    );
+    for (long i = first; i < nextTile; ++i) {
+        updateTile(tiles[i]);
+    }
+    finished = nextTile >= tilesCount;
+}
+
+void ReachMap::compute(Room *room, int depth) {
+    start(room, depth);
+    while (!finished) {
+        step(std::numeric_limits<double>::infinity());
+    }
+}
+
+void ReachMap::traceTile(int tile) {
+    int columnStart = tile % tilesX * tileSize;
+    int rowStart = tile / tilesX * tileSize;
+    int columnEnd = std::min(columnStart + tileSize, width);
+    int rowEnd = std::min(rowStart + tileSize, height);
+    Tracer<double>::Hit hit;
+    Itineraries::Batch batch;
+
+    for (int row = rowStart; row < rowEnd; ++row) {
+        double angle = getAngle(row) - PI / 2;
+        double c = std::cos(angle);
+        double s = std::sin(angle);
+
+        for (int column = columnStart; column < columnEnd; ++column) {
+            const Vec2<double> &n = normals[column];
+            Vec2<double> origin = origins[column];
+            Vec2<double> dir(n.x * c - n.y * s, n.x * s + n.y * c);
+            int fromWall = wallIndex;
+            unsigned char result = miss;
+            long launch = getLaunch(column, row);
+            if (indexed) {
+                batch.begin(launch);
+            }
+
+            for (int bounce = 0; bounce <= depth; ++bounce) {
+                if (!tracer.trace(origin, dir, fromWall, hit)) {
+                    break;
+                }
+                // Попадание в другую цель считается промахом
+                if (hit.aim) {
+                    if (hit.target == target) {
+                        result = bounce;
+                    }
+                    break;
+                }
+                if (indexed) {
+                    batch.add(hit.wall);
+                }
+                // Светоделитель и диффузная стена выбирают продолжение по
+                // хешу номеров запуска и отражения, поэтому карта не зависит
+                // от порядка обхода плиток. Энергия на карту не влияет
+                uint32_t h = hashBits(hashBits((uint32_t)launch) + bounce);
+                double energy = 1;
+                if (!tracer.scatter(
+                        hit, dir, toUnit(h), toUnit(hashBits(h + 1)), energy
+                    )) {
+                    break;
+                }
+                origin = hit.point;
+                fromWall = hit.wall;
+            }
+            reach[(size_t)row * width + column] = result;
+        }
+    }
+
+    if (indexed) {
+        itineraries.insert(batch);
+    }
+}
+
+void ReachMap::updateTile(int tile) {
+    int columnStart = tile % tilesX * tileSize;
+    int rowStart = tile / tilesX * tileSize;
+    int columns = std::min(tileSize, width - columnStart);
+    int rows = std::min(tileSize, height - rowStart);
+
+    Color pixels[tileSize * tileSize];
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            unsigned char value =
+                reach[(size_t)(rowStart + row) * width + columnStart + column];
+            pixels[row * columns + column] =
+                palette[value == miss ? depth + 1 : value];
+        }
+    }
+    UpdateTextureRec(
+        texture,
+        Rectangle{
+            (float)columnStart, (float)rowStart, (float)columns, (float)rows
+        },
+        pixels
+    );
+}
+
+float ReachMap::getProgress() {
+    return (float)nextTile / tiles.size();
+}
+
+bool ReachMap::pick(Rectangle area, Vector2 point, float &t, float &angle) {
+    if (!CheckCollisionPointRec(point, area)) {
+        return false;
+    }
+    int column = (point.x - area.x) / area.width * width;
+    int row = (point.y - area.y) / area.height * height;
+    t = getT(std::clamp(column, 0, width - 1));
+    angle = getAngle(std::clamp(row, 0, height - 1));
+    return true;
+}
+
+long ReachMap::pickLaunch(Rectangle area, Vector2 point) {
+    if (!CheckCollisionPointRec(point, area)) {
+        return -1;
+    }
+    int column = (point.x - area.x) / area.width * width;
+    int row = (point.y - area.y) / area.height * height;
+    return getLaunch(
+        std::clamp(column, 0, width - 1), std::clamp(row, 0, height - 1)
+    );
+}
+
+void ReachMap::clear() {
+    room = nullptr;
+    finished = false;
+    nextTile = 0;
+    reach.clear();
+    itineraries.clear();
+    if (hasTexture) {
+        UnloadTexture(texture);
+        hasTexture = false;
+    }
+}
+
+void ReachMap::draw(Rectangle area) {
+    DrawRectangleRec(area, LIGHTGRAY);
+    if (!hasTexture) {
+        return;
+    }
+    DrawTexturePro(
+        texture, Rectangle{0, 0, (float)width, (float)height}, area,
+        Vector2{0, 0}, 0, WHITE
+    );
+
+    // Отметка текущего луча
+    RayStart *rayStart = room ? room->rayStart : nullptr;
+    if (rayStart && rayStart->getWall() == wall) {
+        float x = area.x + rayStart->getT() * area.width;
+        float y = area.y +
+                  (179 - rayStart->getAngle() * RAD2DEG) / 178 * area.height;
+        DrawLineV({x, area.y}, {x, area.y + area.height}, BLACK);
+        DrawLineV({area.x, y}, {area.x + area.width, y}, BLACK);
+        DrawCircleV({x, y}, 3, BLACK);
+    }
+    DrawRectangleLinesEx(area, 1, GRAY);
+}
+
+ReachMap::~ReachMap() {
+    clear();
+}
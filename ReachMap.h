@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+
+#include "raylib.h"
+
+#include "Geometry.h"
+#include "Itineraries.h"
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+// Карта достижимости цели. По горизонтали откладывается параметр t точки
+// начала луча на стене, по вертикали --- угол запуска от 1 до 179 градусов
+// (сверху вниз по убыванию). В каждой ячейке хранится число отражений, после
+// которого луч попадает в цель, или промах.
+//
+// Маршруты лучей (последовательности стен до цели или промаха) собираются в
+// префиксное дерево, по которому можно найти, например, все запуски,
+// отразившиеся сначала от одной стены, а затем от другой.
+//
+// Карта делится на плитки, которые потоки берут по очереди. Расчет идет
+// порциями, как у карты освещенности, и начинается заново, если изменились
+// стены, цель, стена начала луча или его направление. Положение и угол луча
+// на карту не влияют, поэтому при их изменении она сохраняется
+class ReachMap {
+private:
+    int width;  // Число значений t
+    int height; // Число значений угла
+    int depth;  // Наибольшее число отражений
+
+    vector<unsigned char> reach; // Число отражений до цели для ячеек
+    Itineraries itineraries;     // Маршруты лучей ячеек
+    bool indexed = false;        // Собираются ли маршруты (стен в снимке не
+                                 // больше Itineraries::maximumWalls)
+
+    static constexpr int tileSize = 16;
+    int tilesX;        // Число плиток по горизонтали
+    int tilesY;        // Число плиток по вертикали
+    vector<int> tiles; // Порядок обхода плиток
+    long nextTile = 0; // Номер следующей плитки в порядке обхода
+    bool finished = false;
+
+    Room *room = nullptr;    // Комната, для которой идет расчет
+    unsigned long roomShape; // Версия стен и цели на момент начала расчета
+    Wall *wall;              // Стена начала луча
+    bool inverted;           // Направлен ли луч по обратной нормали
+    Tracer<double> tracer;   // Снимок геометрии комнаты
+    int wallIndex;           // Индекс стены начала луча в снимке
+    int target;              // Индекс выбранной цели в снимке (или -1)
+
+    // Точки стены и нормали внутрь комнаты для каждого значения t
+    vector<Vec2<double>> origins;
+    vector<Vec2<double>> normals;
+
+    vector<Color> palette; // Цвета по числу отражений, последний --- промах
+    Texture2D texture;
+    bool hasTexture = false;
+
+    void restart(); // Начало расчета по текущему состоянию комнаты
+
+    void traceTile(int tile);  // Расчет ячеек одной плитки
+    void updateTile(int tile); // Перенос плитки в текстуру
+
+public:
+    static constexpr unsigned char miss = 255; // Значение ячейки-промаха
+
+    class NoRayStart: public std::exception { // Исключение, выбрасывается,
+                                              // если в комнате нет луча
+    public:
+        const char *what() const noexcept;
+    };
+
+    ReachMap(int width = 1024, int height = 1024);
+
+    // Начать расчет карты для луча комнаты, лучи прослеживаются не более чем
+    // на depth отражений
+    void start(Room *room, int depth = Room::maximumRayDepth);
+
+    void step(double budget); // Продолжить расчет на budget миллисекунд
+
+    void compute(Room *room, int depth = Room::maximumRayDepth);
+
+    bool isActive() { return room != nullptr; }
+
+    bool isDone() { return finished; }
+
+    float getProgress(); // Доля рассчитанных плиток
+
+    // Число отражений до цели (miss при промахе) для параметров ячейки
+    unsigned char getReach(int column, int row) {
+        return reach[(size_t)row * width + column];
+    }
+
+    // Маршруты лучей. Запуск ячейки --- row * width + column
+    const Itineraries &getItineraries() { return itineraries; }
+
+    long getLaunch(int column, int row) { return (long)row * width + column; }
+
+    float getT(int column) { return (column + 0.5f) / width; }
+
+    float getAngle(int row) { // Угол в радианах
+        return (179 - 178 * (row + 0.5f) / height) * DEG2RAD;
+    }
+
+    // Параметры луча (t, угол в радианах) в точке point карты, нарисованной
+    // в прямоугольнике area. Возвращает false, если точка вне карты
+    bool pick(Rectangle area, Vector2 point, float &t, float &angle);
+
+    // Запуск ячейки в точке point карты, нарисованной в прямоугольнике area
+    // (или -1, если точка вне карты)
+    long pickLaunch(Rectangle area, Vector2 point);
+
+    void clear();
+
+    // Отрисовка карты в прямоугольнике area с отметкой текущего луча
+    void draw(Rectangle area);
+
+    ~ReachMap();
+};
@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <atomic>
 #include <cfloat>
 #include <climits>
 #include <math.h>
+#include <thread>
 
 #include "nlohmann/json_fwd.hpp"
 #include "raylib.h"
 #include "raymath.h"
 
+#include "Geometry.h"
+#include "Parallel.h"
 #include "Ray.h"
 #include "Room.h"
 
@@ -74,14 +79,52 @@ Wall::~Wall() {
     end->clear(this);
 }
 
+const char *Wall::InvalidReflectance::what() const noexcept {
+    return "Доля отраженного света должна быть от 0 до 1";
+}
+
+// Цвет стены по виду поверхности
+static Color surfaceColor(Wall::Surface surface) {
+    switch (surface) {
+    case Wall::SURFACE_DIFFUSE:
+        return DARKGRAY;
+    case Wall::SURFACE_SPLITTER:
+        return SKYBLUE;
+    default:
+        return BROWN;
+    }
+}
+
+void Wall::setSurface(Surface surface) {
+    Wall::surface = surface;
+    room->update();
+}
+
+void Wall::setReflectance(float reflectance) {
+    if (reflectance < 0 || reflectance > 1) {
+        throw InvalidReflectance();
+    }
+    Wall::reflectance = reflectance;
+    room->update();
+}
+
+void Wall::copySurface(Wall *wall) {
+    surface = wall->surface;
+    reflectance = wall->reflectance;
+}
+
 json WallLine::toJson() {
-    json j = {{"type", "line"}};
+    json j = {
+        {"type", "line"}, {"surface", surface}, {"reflectance", reflectance}
+    };
 
     return j;
 }
 
 void WallLine::draw() {
-    DrawLineEx(start->getCoord(), end->getCoord(), 4, BROWN);
+    DrawLineEx(
+        start->getCoord(), end->getCoord(), 4, surfaceColor(surface)
+    );
 }
 
 const char *WallRound::InvalidRadiusCoef::what() const noexcept {
@@ -108,9 +151,7 @@ void WallRound::updateParams() {
     }
 
     updateAngles();
-    if (room->rayStart) {
-        room->rayStart->updateParams();
-    }
+    room->update();
 }
 
 void WallRound::updateAngles() {
@@ -129,6 +170,13 @@ void WallRound::updateAngles() {
     if (startAngle > endAngle) {
         std::swap(startAngle, endAngle);
     }
+
+    // Направления кэшируются, чтобы проверки принадлежности точки дуге
+    // обходились без тригонометрии
+    span = (endAngle - startAngle) * DEG2RAD;
+    float middleAngle = (startAngle + endAngle) / 2 * DEG2RAD;
+    middleDir = Vector2{cosf(middleAngle), sinf(middleAngle)};
+    cosHalfSpan = cosf(span / 2);
 }
 
 WallRound::WallRound(
@@ -147,9 +195,17 @@ WallRound::WallRound(
 
 void WallRound::toggleOrient() {
     orient = !orient;
-    if (room->rayStart && room->rayStart->getWall() == this) {
-        room->rayStart->inverseT();
-        room->rayStart->inverseDirection();
+    for (RayStart *ray : room->getRays()) {
+        if (ray->getWall() == this) {
+            ray->inverseT();
+            ray->inverseDirection();
+        }
+    }
+    for (RayFan *fan : room->getFans()) {
+        if (fan->getWall() == this) {
+            fan->inverseT();
+            fan->inverseDirection();
+        }
     }
     updateParams();
 }
@@ -164,14 +220,19 @@ void WallRound::setRadiusCoef(float radiusCoef) {
 
 json WallRound::toJson() {
     json j = {
-        {"type", "round"}, {"radiusCoef", radiusCoef}, {"orient", orient}
+        {"type", "round"},       {"radiusCoef", radiusCoef},
+        {"orient", orient},      {"surface", surface},
+        {"reflectance", reflectance}
     };
 
     return j;
 }
 
 void WallRound::draw() {
-    DrawRing(center, radius - 2, radius + 2, startAngle, endAngle, 36, BROWN);
+    DrawRing(
+        center, radius - 2, radius + 2, startAngle, endAngle, 36,
+        surfaceColor(surface)
+    );
 }
 
 float Wall::distanceToWall(const Vector2 &point) {
@@ -234,62 +295,25 @@ Vector2 WallLine::getPointByT(float t) {
 }
 
 Vector2 WallRound::closestPoint(const Vector2 &point) {
-    float distanceToCenter = Vector2Distance(point, center);
     Vector2 diff = Vector2Subtract(point, center);
-    float pointAngle = atan2f(diff.y, diff.x) * RAD2DEG;
-    if (pointAngle < 0) {
-        pointAngle += 360.0f;
-    }
-
-    float normalizedStart = fmodf(startAngle, 360.0f);
-    float normalizedEnd = fmodf(endAngle, 360.0f);
-    if (normalizedStart < 0) {
-        normalizedStart += 360.0f;
-    }
-    if (normalizedEnd < 0) {
-        normalizedEnd += 360.0f;
-    }
 
-    bool isWithinArc = false;
-    if (normalizedEnd >= normalizedStart) {
-        isWithinArc =
-            (pointAngle >= normalizedStart && pointAngle <= normalizedEnd);
-    } else {
-        isWithinArc =
-            (pointAngle >= normalizedStart || pointAngle <= normalizedEnd);
-    }
-
-    if (isWithinArc) {
+    if (arcContains<float>(diff, middleDir, cosHalfSpan)) {
+        float distanceToCenter = Vector2Length(diff);
         if (distanceToCenter > 0) {
-            float scale = radius / distanceToCenter;
-            return Vector2{
-                center.x + diff.x * scale, center.y + diff.y * scale
-            };
-        } else {
-            float angleRad = normalizedStart * DEG2RAD;
-            return Vector2{
-                center.x + radius * cosf(angleRad),
-                center.y + radius * sinf(angleRad)
-            };
+            return Vector2Add(
+                center, Vector2Scale(diff, radius / distanceToCenter)
+            );
         }
-    } else {
-        float startRad = startAngle * DEG2RAD;
-        float endRad = endAngle * DEG2RAD;
-
-        Vector2 startPoint = {
-            center.x + radius * cosf(startRad),
-            center.y + radius * sinf(startRad)
-        };
+        return Vector2Add(center, Vector2Scale(middleDir, radius));
+    }
 
-        Vector2 endPoint = {
-            center.x + radius * cosf(endRad), center.y + radius * sinf(endRad)
-        };
+    Vector2 startPoint = start->getCoord();
+    Vector2 endPoint = end->getCoord();
 
-        float distToStart = Vector2Distance(point, startPoint);
-        float distToEnd = Vector2Distance(point, endPoint);
+    float distToStart = Vector2DistanceSqr(point, startPoint);
+    float distToEnd = Vector2DistanceSqr(point, endPoint);
 
-        return (distToStart < distToEnd) ? startPoint : endPoint;
-    }
+    return (distToStart < distToEnd) ? startPoint : endPoint;
 }
 
 Vector2 WallLine::getNormal(const Vector2 &point) {
@@ -303,148 +327,544 @@ Vector2 WallRound::getNormal(const Vector2 &point) {
     return Vector2Normalize(toCenter);
 }
 
-float normalizeAngle(float angle) {
-    float normalized = fmodf(angle, 360.0f);
-    if (normalized < 0) {
-        normalized += 360.0f;
+Vector2 WallRound::getPointByT(float t) {
+    t = fmaxf(0.0f, fminf(1.0f, t));
+    Vector2 direction = Vector2Rotate(middleDir, (t - 0.5f) * span);
+
+    return Vector2Add(center, Vector2Scale(direction, radius));
+}
+
+float WallRound::getTByDirection(const Vector2 &diff) {
+    if (!arcContains<float>(diff, middleDir, cosHalfSpan)) {
+        return -1.0f;
+    }
+    return arcParameter<float>(diff, middleDir, span);
+}
+
+float WallRound::getTByPoint(const Vector2 &point, float precision) {
+    Vector2 diff = Vector2Subtract(point, center);
+    float distanceToCenter = Vector2Length(diff);
+
+    if (fabsf(distanceToCenter - radius) > precision) {
+        return -1.0f;
     }
-    return normalized;
+
+    return getTByDirection(diff);
 }
 
-bool WallRound::crossesZeroDeg() {
-    float normStart = normalizeAngle(startAngle);
-    float normEnd = normalizeAngle(endAngle);
-    return normEnd < normStart;
+bool WallRound::isAngleInArc(float angleDeg, float precision) {
+    float angleRad = angleDeg * DEG2RAD;
+    float t = getTByDirection(Vector2{cosf(angleRad), sinf(angleRad)});
+    return t >= -precision && t <= 1.0f + precision;
 }
 
-float WallRound::getAngularLength() {
-    float normStart = normalizeAngle(startAngle);
-    float normEnd = normalizeAngle(endAngle);
+bool WallRound::isPointOnArc(const Vector2 &point, float precision) {
+    Vector2 diff = Vector2Subtract(point, center);
+    float distanceSq = Vector2LengthSqr(diff);
 
-    if (normEnd >= normStart) {
-        return normEnd - normStart;
-    } else {
-        return (360.0f - normStart) + normEnd;
+    float minRadius = fmaxf(0.0f, radius - precision);
+    float maxRadius = radius + precision;
+    if (distanceSq < minRadius * minRadius ||
+        distanceSq > maxRadius * maxRadius) {
+        return false;
     }
+
+    return arcContains<float>(diff, middleDir, cosHalfSpan);
 }
 
-float WallRound::getAngleByT(float t) {
-    t = fmaxf(0.0f, fminf(1.0f, t));
+Vector2 WallRound::getCenter() {
+    return center;
+}
 
-    float normStart = normalizeAngle(startAngle);
-    float span = getAngularLength();
+float WallRound::getRadius() {
+    return radius;
+}
 
-    float angle = normStart + t * span;
+float WallRound::getStartAngle() {
+    return startAngle;
+}
 
-    if (angle >= 360.0f) {
-        angle -= 360.0f;
+float WallRound::getEndAngle() {
+    return endAngle;
+}
+
+// Параметр ближайшей к point точки кривой curve(t), t из [0, 1]: перебор по
+// равномерной сетке и уточнение тернарным поиском около лучшего узла
+template <typename Curve>
+static float closestParameter(Curve curve, const Vector2 &point) {
+    const int samples = 64;
+    auto distance = [&](float t) {
+        return Vector2DistanceSqr(curve(t), point);
+    };
+
+    int best = 0;
+    float bestDistance = FLT_MAX;
+    for (int i = 0; i <= samples; ++i) {
+        float d = distance((float)i / samples);
+        if (d < bestDistance) {
+            bestDistance = d;
+            best = i;
+        }
     }
 
-    return angle;
+    float low = fmaxf(0.0f, (best - 1.0f) / samples);
+    float high = fminf(1.0f, (best + 1.0f) / samples);
+    for (int i = 0; i < 30; ++i) {
+        float a = low + (high - low) / 3;
+        float b = high - (high - low) / 3;
+        if (distance(a) < distance(b)) {
+            high = b;
+        } else {
+            low = a;
+        }
+    }
+    return (low + high) / 2;
 }
 
-Vector2 WallRound::getPointByT(float t) {
-    float angleDeg = getAngleByT(t);
-    float angleRad = angleDeg * DEG2RAD;
+const char *WallEllipse::InvalidAspect::what() const noexcept {
+    return "Отношение полуосей эллипса должно быть от 0.1 до 2";
+}
 
-    return Vector2{
-        center.x + radius * cosf(angleRad), center.y + radius * sinf(angleRad)
-    };
+WallEllipse::WallEllipse(
+    Point *start, Point *end, Room *room, float aspect, bool orient
+):
+    Wall(start, end, room) {
+    if (aspect < 0.1f || aspect > 2) {
+        throw InvalidAspect();
+    }
+    WallEllipse::aspect = aspect;
+    WallEllipse::orient = orient;
+    updateParams();
 }
 
-float WallRound::getTByAngle(float angleDeg) {
-    float normAngle = normalizeAngle(angleDeg);
-    float normStart = normalizeAngle(startAngle);
-    float span = getAngularLength();
+void WallEllipse::updateParams() {
+    Vector2 chordVec = Vector2Subtract(end->getCoord(), start->getCoord());
+    float chord = Vector2Length(chordVec);
 
-    float t = 0.0f;
+    center = Vector2Lerp(start->getCoord(), end->getCoord(), 0.5f);
+    axis = Vector2Scale(chordVec, 1 / chord);
+    // Сторона выпуклости выбирается так же, как у дуги
+    bulge = orient ? Vector2{-axis.y, axis.x} : Vector2{axis.y, -axis.x};
+    semiAxis = chord / 2;
+    depth = semiAxis * aspect;
 
-    if (!crossesZeroDeg()) {
-        if (normAngle >= normStart && normAngle <= normStart + span) {
-            t = (normAngle - normStart) / span;
-        } else {
-            return -1.0f;
+    room->update();
+}
+
+void WallEllipse::toggleOrient() {
+    orient = !orient;
+    // Нормаль меняет сторону вместе с выпуклостью, поэтому луч со стены
+    // разворачивается, чтобы остаться по ту же сторону от нее
+    for (RayStart *ray : room->getRays()) {
+        if (ray->getWall() == this) {
+            ray->inverseDirection();
         }
-    } else {
-        if (normAngle >= normStart) {
-            t = (normAngle - normStart) / span;
-        } else if (normAngle <= normStart + span - 360.0f) {
-            t = (360.0f - normStart + normAngle) / span;
-        } else {
-            return -1.0f;
+    }
+    for (RayFan *fan : room->getFans()) {
+        if (fan->getWall() == this) {
+            fan->inverseDirection();
         }
     }
+    updateParams();
+}
 
-    return fmaxf(0.0f, fminf(1.0f, t));
+void WallEllipse::setAspect(float aspect) {
+    if (aspect < 0.1f || aspect > 2) {
+        throw InvalidAspect();
+    }
+    WallEllipse::aspect = aspect;
+    updateParams();
 }
 
-float WallRound::getTByPoint(const Vector2 &point, float precision) {
+void WallEllipse::getFoci(Vector2 &first, Vector2 &second) {
+    // Фокусы лежат на большей оси
+    Vector2 major = aspect < 1 ? axis : bulge;
+    float focal = sqrtf(fabsf(semiAxis * semiAxis - depth * depth));
+    first = Vector2Add(center, Vector2Scale(major, -focal));
+    second = Vector2Add(center, Vector2Scale(major, focal));
+}
+
+Vector2 WallEllipse::getPointByT(float t) {
+    t = fmaxf(0.0f, fminf(1.0f, t));
+    float angle = PI * (1 - t);
+    return Vector2Add(
+        center, Vector2Add(
+                    Vector2Scale(axis, semiAxis * cosf(angle)),
+                    Vector2Scale(bulge, depth * sinf(angle))
+                )
+    );
+}
+
+Vector2 WallEllipse::closestPoint(const Vector2 &point) {
+    return getPointByT(closestParameter(
+        [&](float t) { return getPointByT(t); }, point
+    ));
+}
+
+Vector2 WallEllipse::getNormal(const Vector2 &point) {
+    // Нормаль, как у дуги, направлена внутрь эллипса: против градиента
+    // x^2 / a^2 + y^2 / b^2
     Vector2 diff = Vector2Subtract(point, center);
-    float distanceToCenter = Vector2Length(diff);
+    Vector2 gradient = Vector2Add(
+        Vector2Scale(axis, Vector2DotProduct(diff, axis) / semiAxis / semiAxis),
+        Vector2Scale(bulge, Vector2DotProduct(diff, bulge) / depth / depth)
+    );
+    if (Vector2LengthSqr(gradient) == 0) {
+        return Vector2Negate(bulge);
+    }
+    return Vector2Negate(Vector2Normalize(gradient));
+}
 
-    if (fabsf(distanceToCenter - radius) > precision) {
-        return -1.0f;
+float WallEllipse::getTByPoint(const Vector2 &point, float precision) {
+    float t = closestParameter(
+        [&](float t) { return getPointByT(t); }, point
+    );
+    return Vector2Distance(getPointByT(t), point) <= precision ? t : -1.0f;
+}
+
+json WallEllipse::toJson() {
+    json j = {
+        {"type", "ellipse"},     {"aspect", aspect},
+        {"orient", orient},      {"surface", surface},
+        {"reflectance", reflectance}
+    };
+
+    return j;
+}
+
+void WallEllipse::draw() {
+    const int pieces = 48;
+    Color color = surfaceColor(surface);
+    Vector2 previous = getPointByT(0);
+    for (int i = 1; i <= pieces; ++i) {
+        Vector2 next = getPointByT((float)i / pieces);
+        DrawLineEx(previous, next, 4, color);
+        previous = next;
     }
 
-    float pointAngle = atan2f(diff.y, diff.x) * RAD2DEG;
+    Vector2 first, second;
+    getFoci(first, second);
+    DrawCircleV(first, 3, Fade(color, 0.6f));
+    DrawCircleV(second, 3, Fade(color, 0.6f));
+}
 
-    return getTByAngle(pointAngle);
+const char *WallBezier::InvalidDegree::what() const noexcept {
+    return "Степень кривой Безье должна быть 2 или 3";
 }
 
-bool WallRound::isAngleInArc(float angleDeg, float precision) {
-    float t = getTByAngle(angleDeg);
-    return t >= -precision && t <= 1.0f + precision;
+const char *WallBezier::InvalidHeight::what() const noexcept {
+    return "Высота контрольной точки должна быть от -1 до 1";
 }
 
-bool WallRound::isPointOnArc(const Vector2 &point, float precision) {
-    Vector2 diff = Vector2Subtract(point, center);
-    float distanceToCenter = Vector2Length(diff);
+WallBezier::WallBezier(
+    Point *start, Point *end, Room *room, int degree, float firstHeight,
+    float secondHeight
+):
+    Wall(start, end, room) {
+    if (degree != 2 && degree != 3) {
+        throw InvalidDegree();
+    }
+    if (fabsf(firstHeight) > 1 || fabsf(secondHeight) > 1) {
+        throw InvalidHeight();
+    }
+    WallBezier::degree = degree;
+    heights[0] = firstHeight;
+    heights[1] = secondHeight;
+    updateParams();
+}
 
-    if (fabsf(distanceToCenter - radius) > precision) {
-        return false;
+void WallBezier::updateParams() {
+    Vector2 from = start->getCoord();
+    Vector2 to = end->getCoord();
+    Vector2 chordVec = Vector2Subtract(to, from);
+    // Положительная высота выгибает кривую в ту же сторону, что и дугу
+    Vector2 perp = Vector2{chordVec.y, -chordVec.x};
+
+    controls[0] = from;
+    for (int i = 1; i < degree; ++i) {
+        controls[i] = Vector2Add(
+            Vector2Add(from, Vector2Scale(chordVec, (float)i / degree)),
+            Vector2Scale(perp, heights[i - 1])
+        );
     }
+    controls[degree] = to;
 
-    float t = getTByPoint(point, precision);
-    return t >= 0.0f && t <= 1.0f;
+    room->update();
 }
 
-Vector2 WallRound::getCenter() {
-    return center;
+void WallBezier::setDegree(int degree) {
+    if (degree != 2 && degree != 3) {
+        throw InvalidDegree();
+    }
+    WallBezier::degree = degree;
+    updateParams();
 }
 
-float WallRound::getRadius() {
-    return radius;
+void WallBezier::setHeight(int index, float height) {
+    if (fabsf(height) > 1) {
+        throw InvalidHeight();
+    }
+    heights[index] = height;
+    updateParams();
 }
 
-float WallRound::getStartAngle() {
-    return startAngle;
+Vector2 WallBezier::getPointByT(float t) {
+    t = fmaxf(0.0f, fminf(1.0f, t));
+    Vec2<float> p[4];
+    for (int i = 0; i <= degree; ++i) {
+        p[i] = Vec2<float>(controls[i]);
+    }
+    return bezierPoint(p, degree, t).toVector2();
 }
 
-float WallRound::getEndAngle() {
-    return endAngle;
+Vector2 WallBezier::closestPoint(const Vector2 &point) {
+    return getPointByT(closestParameter(
+        [&](float t) { return getPointByT(t); }, point
+    ));
+}
+
+Vector2 WallBezier::getNormal(const Vector2 &point) {
+    float t = closestParameter(
+        [&](float t) { return getPointByT(t); }, point
+    );
+    Vec2<float> p[4];
+    for (int i = 0; i <= degree; ++i) {
+        p[i] = Vec2<float>(controls[i]);
+    }
+    Vector2 tangent = bezierTangent(p, degree, t).toVector2();
+    if (Vector2LengthSqr(tangent) == 0) {
+        tangent = Vector2Subtract(controls[degree], controls[0]);
+    }
+    // Нормаль, как у прямой стены, слева от направления обхода
+    return Vector2Normalize(Vector2{-tangent.y, tangent.x});
+}
+
+float WallBezier::getTByPoint(const Vector2 &point, float precision) {
+    float t = closestParameter(
+        [&](float t) { return getPointByT(t); }, point
+    );
+    return Vector2Distance(getPointByT(t), point) <= precision ? t : -1.0f;
+}
+
+json WallBezier::toJson() {
+    json j = {
+        {"type", "bezier"},
+        {"degree", degree},
+        {"heights", {heights[0], heights[1]}},
+        {"surface", surface},
+        {"reflectance", reflectance}
+    };
+
+    return j;
+}
+
+void WallBezier::draw() {
+    Color color = surfaceColor(surface);
+    if (degree == 2) {
+        DrawSplineSegmentBezierQuadratic(
+            controls[0], controls[1], controls[2], 4, color
+        );
+    } else {
+        DrawSplineSegmentBezierCubic(
+            controls[0], controls[1], controls[2], controls[3], 4, color
+        );
+    }
+}
+
+// Стена по описанию из json между точками start и end (nullptr, если тип
+// стены неизвестен)
+static Wall *wallFromJson(const json &j, Point *start, Point *end, Room *room) {
+    if (j.at("type") == "line") {
+        return new WallLine(start, end, room);
+    } else if (j.at("type") == "round") {
+        return new WallRound(
+            start, end, room, j.at("radiusCoef").get<float>(), j.at("orient")
+        );
+    } else if (j.at("type") == "ellipse") {
+        return new WallEllipse(
+            start, end, room, j.at("aspect").get<float>(), j.at("orient")
+        );
+    } else if (j.at("type") == "bezier") {
+        const auto &heights = j.at("heights");
+        return new WallBezier(
+            start, end, room, j.at("degree").get<int>(),
+            heights.at(0).get<float>(), heights.at(1).get<float>()
+        );
+    }
+    return nullptr;
+}
+
+// Свойства поверхности стены из json. Они необязательны в файлах старого
+// формата, в которых поверхность задавалась флагом рассеивания
+static void surfaceFromJson(Wall *wall, const json &j) {
+    if (j.contains("surface")) {
+        wall->setSurface(j.at("surface").get<Wall::Surface>());
+    } else if (j.contains("diffuse")) {
+        wall->setSurface(
+            j.at("diffuse").get<bool>() ? Wall::SURFACE_DIFFUSE
+                                        : Wall::SURFACE_MIRROR
+        );
+    }
+    if (j.contains("reflectance")) {
+        wall->setReflectance(j.at("reflectance").get<float>());
+    }
+}
+
+const char *Obstacle::InvalidShape::what() const noexcept {
+    return "У препятствия должно быть не меньше двух вершин, у замкнутого --- "
+           "не меньше трех";
+}
+
+Obstacle::Obstacle(Room *room, const vector<Vector2> &coords, bool closed):
+    closed(closed) {
+    points.reserve(coords.size());
+    for (const Vector2 &coord : coords) {
+        points.push_back(Point(coord));
+    }
+    checkPoints();
+
+    size_t count = closed ? points.size() : points.size() - 1;
+    for (size_t i = 0; i < count; ++i) {
+        walls.push_back(new WallLine(
+            &points[i], &points[(i + 1) % points.size()], room
+        ));
+    }
+}
+
+Obstacle::Obstacle(Room *room, const json &j) {
+    const auto &points_j = j.at("points");
+    const auto &walls_j = j.at("walls");
+    if (!points_j.is_array() || !walls_j.is_array() ||
+        (walls_j.size() != points_j.size() &&
+         walls_j.size() + 1 != points_j.size())) {
+        throw std::runtime_error("Неверный формат файла");
+    }
+
+    // У замкнутого препятствия стен столько же, сколько вершин
+    closed = walls_j.size() == points_j.size();
+    points.reserve(points_j.size());
+    for (const auto &point : points_j) {
+        points.push_back(Point(point));
+    }
+    checkPoints();
+
+    try {
+        for (size_t i = 0; i < walls_j.size(); ++i) {
+            Wall *wall = wallFromJson(
+                walls_j.at(i), &points[i], &points[(i + 1) % points.size()],
+                room
+            );
+            if (!wall) {
+                throw std::runtime_error("Неверный формат файла");
+            }
+            walls.push_back(wall);
+            surfaceFromJson(wall, walls_j.at(i));
+        }
+    } catch (...) {
+        for (Wall *wall : walls) {
+            delete wall;
+        }
+        throw;
+    }
+}
+
+void Obstacle::checkPoints() {
+    if (points.size() < (closed ? 3u : 2u)) {
+        throw InvalidShape();
+    }
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        if (Vector2Distance(points[i].getCoord(), points[i + 1].getCoord()) <
+            Room::minimalDistance) {
+            throw Room::PointsAreTooClose();
+        }
+    }
+}
+
+json Obstacle::toJson() {
+    json j = {
+        {"points", json::array()},
+        {"walls", json::array()},
+    };
+
+    for (Point &point : points) {
+        j["points"].push_back(point.toJson());
+    }
+
+    for (Wall *wall : walls) {
+        j["walls"].push_back(wall->toJson());
+    }
+    return j;
+}
+
+void Obstacle::draw() {
+    for (Wall *wall : walls) {
+        wall->draw();
+    }
+
+    for (Point &point : points) {
+        point.draw();
+    }
+}
+
+Obstacle::~Obstacle() {
+    for (Wall *wall : walls) {
+        delete wall;
+    }
 }
 
 Wall *Room::closestWall(const Vector2 &point) {
+    const float pickDistance = 15; // Расстояние, на котором стена выбирается
+
     Wall *closeWall = nullptr;
     float minDist = FLT_MAX;
-
-    for (Wall *wall : walls) {
+    auto consider = [&](Wall *wall) {
         float dist = wall->distanceToWall(point);
 
-        if (dist < minDist && dist < 15) {
+        if (dist < minDist && dist < pickDistance) {
             minDist = dist;
             closeWall = wall;
         }
+    };
+
+    for (Wall *wall : walls) {
+        consider(wall);
+    }
+
+    // Из стен препятствий проверяются только те, габарит которых рядом с
+    // точкой
+    vector<int> near;
+    tracer.findNear(Vec2<float>(point), pickDistance, near);
+    for (int i : near) {
+        consider(tracer.getWall(i));
     }
 
     return closeWall;
 }
 
 RayStart *Room::closestRay(const Vector2 &point) {
-    if (rayStart && Vector2Distance(point, rayStart->getStart()) < 20) {
-        return rayStart;
+    RayStart *closest = nullptr;
+    float closestDistance = 20;
+    for (RayStart *ray : rayStarts) {
+        float distance = Vector2Distance(point, ray->getStart());
+        if (distance < closestDistance) {
+            closest = ray;
+            closestDistance = distance;
+        }
     }
-    return nullptr;
+    return closest;
+}
+
+RayFan *Room::closestFan(const Vector2 &point) {
+    RayFan *closest = nullptr;
+    float closestDistance = 20;
+    for (RayFan *fan : fans) {
+        float distance = Vector2Distance(point, fan->getStart());
+        if (distance < closestDistance) {
+            closest = fan;
+            closestDistance = distance;
+        }
+    }
+    return closest;
 }
 
 Room::Room() {
@@ -460,6 +880,8 @@ Room::Room(const json &j) {
 
     points.reserve(maximumPoints + 1);
 
+    // Снимок геометрии строится один раз после загрузки всех стен
+    loading = true;
     if (points_j.size() > 0) {
         points.push_back(Point(points_j.at(0)));
 
@@ -468,33 +890,82 @@ Room::Room(const json &j) {
             const auto &point =
                 (i + 1 < points_j.size()) ? points_j.at(i + 1) : points_j.at(0);
 
+            Wall *added = nullptr;
             if (wall.at("type") == "line") {
-                addWallLine(Point(point).getCoord());
+                added = addWallLine(Point(point).getCoord());
             } else if (wall.at("type") == "round") {
-                addWallRound(
+                added = addWallRound(
                     Point(point).getCoord(), wall.at("radiusCoef").get<float>(),
                     wall.at("orient")
                 );
+            } else if (wall.at("type") == "ellipse" ||
+                       wall.at("type") == "bezier") {
+                added = addWallLine(Point(point).getCoord());
+                added = replaceWall(
+                    added, wallFromJson(
+                               wall, added->getStart(), added->getEnd(), this
+                           )
+                );
             }
+
+            if (added) {
+                surfaceFromJson(added, wall);
+            }
+        }
+    }
+
+    if (j.contains("obstacles")) {
+        for (const auto &obstacle : j.at("obstacles")) {
+            obstacles.push_back(new Obstacle(this, obstacle));
         }
     }
 
-    if (j.contains("aim")) {
-        json aim = j["aim"];
+    // Файлы прежнего формата содержат одну цель и один луч
+    vector<json> aims_j;
+    if (j.contains("aims")) {
+        aims_j = j.at("aims").get<vector<json>>();
+    } else if (j.contains("aim")) {
+        aims_j.push_back(j.at("aim"));
+    }
+    for (const auto &aim : aims_j) {
         addAim(
             {aim.at("center").at("x"), aim.at("center").at("y")},
             aim.at("radius")
         );
     }
-
-    if (j.contains("rayStart")) {
-        json ray = j["rayStart"];
+    loading = false;
+    update();
+
+    vector<json> rays_j;
+    if (j.contains("rayStarts")) {
+        rays_j = j.at("rayStarts").get<vector<json>>();
+    } else if (j.contains("rayStart")) {
+        rays_j.push_back(j.at("rayStart"));
+    }
+    for (const auto &ray : rays_j) {
         addRay(
             Vector2{ray.at("start").at("x"), ray.at("start").at("y")},
             ray.at("inverted")
         );
         rayStart->setAngle(ray.at("angle"));
     }
+
+    if (j.contains("rayFans")) {
+        for (const auto &fan_j : j.at("rayFans")) {
+            RayFan *fan = addFan(
+                Vector2{fan_j.at("start").at("x"), fan_j.at("start").at("y")},
+                fan_j.at("inverted"), fan_j.at("fromAngle"),
+                fan_j.at("toAngle"), fan_j.at("count")
+            );
+            if (fan && fan_j.value("adaptive", false)) {
+                fan->setTolerance(fan_j.value("tolerance", 5.0f));
+                fan->setAdaptive(true);
+            }
+            if (fan && fan_j.value("caustic", false)) {
+                fan->setCausticShown(true);
+            }
+        }
+    }
 }
 
 const char *Room::RoomException::what() const noexcept {
@@ -525,6 +996,41 @@ bool Room::isClosed() {
     return false;
 }
 
+bool Room::isConvex() {
+    if (!isClosed()) {
+        return false;
+    }
+
+    // Все стены прямые, все повороты одного знака, а сумма углов поворота
+    // равна полному обороту (исключает самопересекающиеся звезды)
+    int sign = 0;
+    float totalTurn = 0;
+    size_t n = walls.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (!dynamic_cast<WallLine *>(walls[i])) {
+            return false;
+        }
+
+        Vector2 a = walls[i]->getStart()->getCoord();
+        Vector2 b = walls[i]->getEnd()->getCoord();
+        Vector2 c = walls[(i + 1) % n]->getEnd()->getCoord();
+        Vector2 ab = Vector2Subtract(b, a);
+        Vector2 bc = Vector2Subtract(c, b);
+
+        float turn = ab.x * bc.y - ab.y * bc.x;
+        if (turn != 0) {
+            int turnSign = turn > 0 ? 1 : -1;
+            if (sign != 0 && turnSign != sign) {
+                return false;
+            }
+            sign = turnSign;
+        }
+        totalTurn += atan2f(turn, Vector2DotProduct(ab, bc));
+    }
+
+    return sign != 0 && fabsf(fabsf(totalTurn) - 2 * PI) < 0.01f;
+}
+
 WallLine *Room::addWallLine(const Vector2 &coord) {
     size_t pointsAmount = points.size();
 
@@ -538,9 +1044,7 @@ WallLine *Room::addWallLine(const Vector2 &coord) {
                 WallLine *wall =
                     new WallLine(&points[pointsAmount - 1], &points[0], this);
                 walls.push_back(wall);
-                if (rayStart) {
-                    rayStart->updateParams();
-                }
+                update();
                 return wall;
             } else {
                 throw Room::PointsAreTooClose();
@@ -573,9 +1077,7 @@ WallLine *Room::addWallLine(const Vector2 &coord) {
             &points[pointsAmount - 2], &points[pointsAmount - 1], this
         );
         walls.push_back(wall);
-        if (rayStart) {
-            rayStart->updateParams();
-        }
+        update();
         return wall;
     }
 
@@ -598,9 +1100,7 @@ WallRound *
                     orient
                 );
                 walls.push_back(wall);
-                if (rayStart) {
-                    rayStart->updateParams();
-                }
+                update();
                 return wall;
             } else {
                 throw Room::PointsAreTooClose();
@@ -634,9 +1134,7 @@ WallRound *
             radiusCoef, orient
         );
         walls.push_back(wall);
-        if (rayStart) {
-            rayStart->updateParams();
-        }
+        update();
         return wall;
     }
 
@@ -644,53 +1142,66 @@ WallRound *
 }
 
 Wall *Room::changeWallType(Wall *wall) {
-    bool updateRay = rayStart ? (rayStart->getWall() == wall) : false;
-    RayStart *ray = rayStart ? rayStart : nullptr;
-    if (updateRay) {
-        rayStart = nullptr;
-    }
-
-    size_t index = 0;
-    for (size_t i = 0; i < walls.size(); ++i) {
-        if (wall == walls[i]) {
-            index = i;
-            break;
-        }
-    }
-
     Point *start = wall->getStart();
     Point *end = wall->getEnd();
-    bool isRound = dynamic_cast<WallRound *>(wall) != nullptr;
-
-    Wall *bind = wall;
 
-    if (isRound) {
-        wall = new WallLine(start, end, this);
+    Wall *replacement;
+    if (dynamic_cast<WallLine *>(wall)) {
+        replacement = new WallRound(start, end, this);
+    } else if (dynamic_cast<WallRound *>(wall)) {
+        replacement = new WallEllipse(start, end, this);
+    } else if (dynamic_cast<WallEllipse *>(wall)) {
+        replacement = new WallBezier(start, end, this);
     } else {
-        wall = new WallRound(start, end, this);
+        replacement = new WallLine(start, end, this);
     }
-    delete bind;
-    walls[index] = wall;
+    replacement->copySurface(wall);
 
-    if (updateRay) {
-        rayStart = ray;
-        rayStart->setWall(wall);
+    return replaceWall(wall, replacement);
+}
+
+Wall *Room::replaceWall(Wall *wall, Wall *replacement) {
+    // Набор стен меняется, поэтому при обновлении перестраиваются все лучи
+    for (RayStart *ray : rayStarts) {
+        if (ray->getWall() == wall) {
+            ray->setWall(replacement);
+        }
+    }
+    for (RayFan *fan : fans) {
+        if (fan->getWall() == wall) {
+            fan->setWall(replacement);
+        }
     }
 
-    if (rayStart) {
-        rayStart->updateParams();
+    std::replace(walls.begin(), walls.end(), wall, replacement);
+    for (Obstacle *obstacle : obstacles) {
+        vector<Wall *> &obstacleWalls = obstacle->getWalls();
+        std::replace(
+            obstacleWalls.begin(), obstacleWalls.end(), wall, replacement
+        );
     }
+    delete wall;
+
+    update();
 
-    return wall;
+    return replacement;
+}
+
+Obstacle *Room::addObstacle(const vector<Vector2> &coords, bool closed) {
+    Obstacle *obstacle = new Obstacle(this, coords, closed);
+    obstacles.push_back(obstacle);
+    update();
+    return obstacle;
 }
 
 void Room::movePoint(Point &p, const Vector2 &coord) {
     p.setCoord(coord);
+    update();
 }
 
 void Room::draw() {
-    if (aim) {
-        aim->draw();
+    for (AimArea *target : aims) {
+        target->draw();
     }
 
     for (Wall *wall : walls) {
@@ -701,8 +1212,16 @@ void Room::draw() {
         point.draw();
     }
 
-    if (rayStart) {
-        rayStart->draw();
+    for (Obstacle *obstacle : obstacles) {
+        obstacle->draw();
+    }
+
+    for (RayFan *fan : fans) {
+        fan->draw();
+    }
+
+    for (RayStart *ray : rayStarts) {
+        ray->draw();
     }
 }
 
@@ -712,12 +1231,25 @@ json Room::toJson() {
         {"walls", json::array()},
     };
 
-    if (rayStart) {
-        j["rayStart"] = rayStart->toJson();
+    if (!rayStarts.empty()) {
+        j["rayStarts"] = json::array();
+        for (RayStart *ray : rayStarts) {
+            j["rayStarts"].push_back(ray->toJson());
+        }
     }
 
-    if (aim) {
-        j["aim"] = aim->toJson();
+    if (!fans.empty()) {
+        j["rayFans"] = json::array();
+        for (RayFan *fan : fans) {
+            j["rayFans"].push_back(fan->toJson());
+        }
+    }
+
+    if (!aims.empty()) {
+        j["aims"] = json::array();
+        for (AimArea *target : aims) {
+            j["aims"].push_back(target->toJson());
+        }
     }
 
     for (Point &point : points) {
@@ -727,6 +1259,13 @@ json Room::toJson() {
     for (Wall *wall : walls) {
         j["walls"].push_back(wall->toJson());
     }
+
+    if (!obstacles.empty()) {
+        j["obstacles"] = json::array();
+        for (Obstacle *obstacle : obstacles) {
+            j["obstacles"].push_back(obstacle->toJson());
+        }
+    }
     return j;
 }
 
@@ -734,18 +1273,122 @@ void Room::addRay(const Vector2 &point, bool inverted) {
     Wall *closestWall = Room::closestWall(point);
     if (closestWall) {
         Vector2 closestPoint = closestWall->closestPoint(point);
-        if (rayStart) {
-            delete rayStart;
-        }
-        rayStart =
+        RayStart *ray =
             new RayStart(closestPoint, closestWall, defaultRayAngle, inverted);
+        rayStarts.push_back(ray);
+        rayStart = ray;
     }
 }
 
+void Room::removeRay(RayStart *removed) {
+    rayStarts.erase(
+        std::remove(rayStarts.begin(), rayStarts.end(), removed),
+        rayStarts.end()
+    );
+    if (rayStart == removed) {
+        rayStart = rayStarts.empty() ? nullptr : rayStarts.back();
+    }
+    delete removed;
+    markChanged();
+}
+
+void Room::selectRay(RayStart *selected) {
+    rayStart = selected;
+    markChanged();
+}
+
+RayFan *Room::addFan(
+    const Vector2 &point, bool inverted, float fromAngle, float toAngle,
+    int count
+) {
+    Wall *closestWall = Room::closestWall(point);
+    if (!closestWall) {
+        return nullptr;
+    }
+    Vector2 closestPoint = closestWall->closestPoint(point);
+    RayFan *fan = new RayFan(
+        closestPoint, closestWall, fromAngle, toAngle, count, inverted
+    );
+    fans.push_back(fan);
+    return fan;
+}
+
+void Room::removeFan(RayFan *removed) {
+    fans.erase(std::remove(fans.begin(), fans.end(), removed), fans.end());
+    delete removed;
+    markChanged();
+}
+
 vector<Wall *> &Room::getWalls() {
     return walls;
 }
 
+void Room::update() {
+    if (loading) {
+        return;
+    }
+    markChanged();
+    ++shapeVersion;
+
+    // Прежний снимок сохраняется для сравнения. Если набор стен не
+    // изменился, перестраиваются только лучи, проходящие через измененные
+    // области
+    std::swap(tracer, previous);
+    tracer.update(this);
+    vector<Tracer<float>::Box> changed;
+    bool partial = tracer.difference(previous, changed);
+
+    vector<RayStart *> affected;
+    for (RayStart *ray : rayStarts) {
+        if (!partial || ray->getTree().crosses(changed)) {
+            affected.push_back(ray);
+        }
+    }
+    vector<RayFan *> affectedFans;
+    for (RayFan *fan : fans) {
+        if (!partial || fan->crosses(changed)) {
+            affectedFans.push_back(fan);
+        }
+    }
+    retrace(affected, affectedFans);
+}
+
+void Room::retrace(
+    const vector<RayStart *> &rays, const vector<RayFan *> &fans
+) {
+    // Лучи только читают общий снимок, и каждый строит свое дерево,
+    // поэтому потоки разбирают лучи по одному без блокировок. Вееры самые
+    // долгие, поэтому разбираются первыми
+    size_t total = fans.size() + rays.size();
+    auto retraceOne = [&](size_t i) {
+        if (i < fans.size()) {
+            fans[i]->retrace();
+        } else {
+            rays[i - fans.size()]->retrace();
+        }
+    };
+    size_t threadsCount = std::min<size_t>(hardwareThreads(), total);
+    if (threadsCount <= 1) {
+        for (size_t i = 0; i < total; ++i) {
+            retraceOne(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    vector<std::thread> threads;
+    for (size_t k = 0; k < threadsCount; ++k) {
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < total; i = next++) {
+                retraceOne(i);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
 void Room::clear() {
     for (Wall *wall : walls) {
         if (wall->getStart()) {
@@ -756,12 +1399,29 @@ void Room::clear() {
         }
         delete wall;
     }
+    for (Obstacle *obstacle : obstacles) {
+        delete obstacle;
+    }
+    markChanged();
+    ++shapeVersion;
     walls.clear();
+    obstacles.clear();
     points.clear();
-    delete rayStart;
+    for (RayStart *ray : rayStarts) {
+        delete ray;
+    }
+    rayStarts.clear();
     rayStart = nullptr;
-    delete aim;
+    for (RayFan *fan : fans) {
+        delete fan;
+    }
+    fans.clear();
+    for (AimArea *target : aims) {
+        delete target;
+    }
+    aims.clear();
     aim = nullptr;
+    tracer.update(this);
 }
 
 Room::~Room() {
@@ -769,29 +1429,59 @@ Room::~Room() {
 }
 
 void Room::addAim(const Vector2 &center, float radius) {
-    if (aim) {
-        delete aim;
-    }
     aim = new AimArea(center, radius);
-    if (rayStart) {
-        rayStart->updateParams();
+    aims.push_back(aim);
+    update();
+}
+
+void Room::removeAim(AimArea *removed) {
+    aims.erase(std::remove(aims.begin(), aims.end(), removed), aims.end());
+    if (aim == removed) {
+        aim = aims.empty() ? nullptr : aims.back();
+    }
+    delete removed;
+    update();
+}
+
+void Room::selectAim(AimArea *selected) {
+    aim = selected;
+    markChanged();
+    ++shapeVersion;
+}
+
+int Room::getAimIndex() {
+    auto found = std::find(aims.begin(), aims.end(), aim);
+    return found == aims.end() ? -1 : found - aims.begin();
+}
+
+AimArea *Room::closestAim(const Vector2 &point) {
+    for (AimArea *target : aims) {
+        if (target->containsPoint(point)) {
+            return target;
+        }
     }
+    return nullptr;
 }
 
 void Room::moveAim(const Vector2 &newCenter) {
     if (aim) {
         aim->setCenter(newCenter);
     }
-    if (rayStart) {
-        rayStart->updateParams();
-    }
+    update();
 }
 
 bool Room::isRayInAim(
-    const Vector2 &rayStart, const Vector2 &rayEnd, Vector2 &intersectionPoint
+    const Vector2 &origin, const Vector2 &direction, float &distance
 ) {
-    if (!aim) {
-        return false;
+    // Ближайшая из целей, которые пересекает луч
+    bool found = false;
+    for (AimArea *target : aims) {
+        float aimDistance;
+        if (target->intersectsWithRay(origin, direction, aimDistance) &&
+            (!found || aimDistance < distance)) {
+            distance = aimDistance;
+            found = true;
+        }
     }
-    return aim->intersectsWithRay(rayStart, rayEnd, intersectionPoint);
+    return found;
 }
@@ -8,6 +8,7 @@
 #include "raylib.h"
 
 #include "Ray.h"
+#include "Tracer.h"
 
 using std::vector, nlohmann::json;
 
@@ -15,7 +16,11 @@ class Wall;
 class Room;
 class WallLine;
 class WallRound;
+class WallEllipse;
+class WallBezier;
+class Obstacle;
 class RayStart;
+class RayFan;
 class AimArea;
 
 // Класс точек между зеркальнымы стенами
@@ -47,14 +52,30 @@ public:
 
 // Абстрактный класс зеркальной стены
 class Wall {
+public:
+    // Поверхность стены: зеркальная, рассеивающая или светоделитель, который
+    // отражает долю reflectance света и пропускает остальное
+    enum Surface { SURFACE_MIRROR, SURFACE_DIFFUSE, SURFACE_SPLITTER };
+
 protected:
     Point *start; // Начальная точка
     Point *end;   // Конечная точка
 
+    Surface surface = SURFACE_MIRROR;
+    float reflectance = 1; // Доля отраженного света (зеркально у зеркальной
+                           // стены и светоделителя, рассеянно у диффузной)
+
 public:
     Room *room;
     Wall(Point *start, Point *end, Room *room);
 
+    class InvalidReflectance:
+        public std::exception { // Исключение, выбрасывается, когда доля
+                                // отраженного света не от 0 до 1
+    public:
+        const char *what() const noexcept;
+    };
+
     virtual void updateParams() {} // Обновление параметров стены
 
     virtual void draw() {}
@@ -65,6 +86,20 @@ public:
 
     Point *getEnd() { return end; }
 
+    Surface getSurface() { return surface; }
+
+    bool isDiffuse() { return surface == SURFACE_DIFFUSE; }
+
+    bool isSplitter() { return surface == SURFACE_SPLITTER; }
+
+    void setSurface(Surface surface);
+
+    float getReflectance() { return reflectance; }
+
+    void setReflectance(float reflectance);
+
+    void copySurface(Wall *wall); // Перенос свойств поверхности со стены wall
+
     virtual Vector2 getNormal(const Vector2 &point) = 0;
 
     virtual Vector2 closestPoint // Возвращает ближайшую точку к `point`
@@ -81,9 +116,15 @@ public:
         float t
     ) = 0; // Получить точку на стене по параметру  t в диапазоне [0,1]
 
-    ~Wall();
+    virtual ~Wall();
 };
 
+NLOHMANN_JSON_SERIALIZE_ENUM(
+    Wall::Surface, {{Wall::SURFACE_MIRROR, "mirror"},
+                    {Wall::SURFACE_DIFFUSE, "diffuse"},
+                    {Wall::SURFACE_SPLITTER, "splitter"}}
+)
+
 // Прямая стена
 class WallLine: public Wall {
 public:
@@ -107,6 +148,10 @@ class WallRound: public Wall {
     float startAngle; // Угол начала относительно горизонтальной прямой
     float endAngle;   // Угол конца относительно горизонтальной прямой
 
+    Vector2 middleDir; // Единичный вектор от центра к середине дуги
+    float cosHalfSpan; // Косинус половины угловой длины дуги
+    float span;        // Угловая длина дуги в радианах
+
     float radiusCoef; // Коэфициент для вычисления радиуса (от 0 до 100)
     float chord;      // Длина хорды между двумя точками
     float radius;     // Радиус дуги
@@ -116,15 +161,11 @@ class WallRound: public Wall {
                  // часовой стрелке
 
     void updateParams();
-    void updateAngles(); // Обновление углов
-
-    bool crossesZeroDeg();
-
-    float getAngularLength();
-
-    float getAngleByT(float t);
+    void updateAngles(); // Обновление углов и направлений дуги
 
-    float getTByAngle(float angleDeg);
+    float getTByDirection( // Параметр t по направлению от центра (или -1)
+        const Vector2 &diff
+    );
 
 public:
     WallRound(
@@ -161,34 +202,209 @@ public:
     float getStartAngle();
     float getEndAngle();
 
+    Vector2 getMiddleDirection() { return middleDir; }
+
+    float getCosHalfSpan() { return cosHalfSpan; }
+
+    json toJson();
+
+    void draw();
+};
+
+// Эллиптическая дуга: половина эллипса, одна из осей которого --- хорда между
+// концами стены. Полуось поперек хорды равна половине хорды, умноженной на
+// aspect. Если aspect < 1, фокусы эллипса лежат на хорде, и свет из одного
+// фокуса после отражения собирается в другом
+class WallEllipse: public Wall {
+    float aspect;   // Отношение полуоси поперек хорды к полуоси вдоль нее
+    bool orient;    // Сторона выпуклости, как у дуги
+    Vector2 center; // Центр эллипса (середина хорды)
+    Vector2 axis;   // Единичный вектор вдоль хорды от начала к концу
+    Vector2 bulge;  // Единичный вектор от центра к середине дуги
+    float semiAxis; // Полуось вдоль хорды
+    float depth;    // Полуось поперек хорды
+
+    void updateParams();
+
+public:
+    WallEllipse(
+        Point *start, Point *end, Room *room, float aspect = 0.5f,
+        bool orient = false
+    );
+
+    class InvalidAspect:
+        public std::exception { // Исключение, выбрасывается, когда отношение
+                                // полуосей не от 0.1 до 2
+    public:
+        const char *what() const noexcept;
+    };
+
+    void toggleOrient();
+
+    float getAspect() { return aspect; }
+
+    void setAspect(float aspect);
+
+    Vector2 getCenter() { return center; }
+
+    Vector2 getBulge() { return bulge; }
+
+    float getSemiAxis() { return semiAxis; }
+
+    float getDepth() { return depth; }
+
+    void getFoci(Vector2 &first, Vector2 &second); // Фокусы эллипса
+
+    Vector2 closestPoint(const Vector2 &point);
+
+    Vector2 getNormal(const Vector2 &point);
+
+    Vector2 getPointByT(float t);
+    float getTByPoint(const Vector2 &point, float precision = 0.1f);
+
+    json toJson();
+
+    void draw();
+};
+
+// Кривая Безье второй или третьей степени. Внутренние контрольные точки
+// задаются в системе координат хорды: вдоль хорды в долях ее длины (1/2 у
+// квадратичной кривой, 1/3 и 2/3 у кубической) и поперек нее высотой в долях
+// длины хорды, поэтому при перемещении концов кривая сохраняет форму
+class WallBezier: public Wall {
+    int degree;          // Степень кривой (2 или 3)
+    float heights[2];    // Высоты внутренних контрольных точек (от -1 до 1)
+    Vector2 controls[4]; // Контрольные точки, включая концы
+
+    void updateParams();
+
+public:
+    WallBezier(
+        Point *start, Point *end, Room *room, int degree = 3,
+        float firstHeight = 0.4f, float secondHeight = 0.4f
+    );
+
+    class InvalidDegree: public std::exception { // Исключение, выбрасывается,
+                                                 // когда степень не 2 и не 3
+    public:
+        const char *what() const noexcept;
+    };
+
+    class InvalidHeight:
+        public std::exception { // Исключение, выбрасывается, когда высота
+                                // контрольной точки не от -1 до 1
+    public:
+        const char *what() const noexcept;
+    };
+
+    int getDegree() { return degree; }
+
+    void setDegree(int degree);
+
+    float getHeight(int index) { return heights[index]; }
+
+    void setHeight(int index, float height);
+
+    const Vector2 *getControls() { return controls; }
+
+    Vector2 closestPoint(const Vector2 &point);
+
+    Vector2 getNormal(const Vector2 &point);
+
+    Vector2 getPointByT(float t);
+    float getTByPoint(const Vector2 &point, float precision = 0.1f);
+
     json toJson();
 
     void draw();
 };
 
+// Препятствие внутри комнаты: замкнутый контур (колонна, перегородка) или
+// незамкнутая ломаная, например отдельное зеркало из одной стены. Стены
+// препятствия отражают свет с обеих сторон. Препятствия не должны пересекать
+// стены комнаты и друг друга
+class Obstacle {
+private:
+    vector<Point> points; // Вершины (место выделяется сразу, чтобы указатели
+                          // стен на вершины оставались верными)
+    vector<Wall *> walls; // Стены между соседними вершинами
+    bool closed;          // Соединена ли последняя вершина с первой
+
+    void checkPoints(); // Проверка числа вершин и расстояний между ними
+
+public:
+    // Препятствие из прямых стен с вершинами coords
+    Obstacle(Room *room, const vector<Vector2> &coords, bool closed);
+    Obstacle(Room *room, const json &j); // Конструктор из json
+
+    Obstacle(const Obstacle &) = delete;
+    Obstacle &operator=(const Obstacle &) = delete;
+
+    class InvalidShape: public std::exception { // Исключение, выбрасывается,
+                                                // когда вершин слишком мало
+    public:
+        const char *what() const noexcept;
+    };
+
+    bool isClosed() { return closed; }
+
+    vector<Point> &getPoints() { return points; }
+
+    vector<Wall *> &getWalls() { return walls; }
+
+    json toJson(); // Экспорт в json
+
+    void draw();
+
+    ~Obstacle();
+};
+
 // Комната, представляющая собой многоугольник
 class Room {
 private:
     vector<Point> points; // Вершины многоугольника
     vector<Wall *> walls; // Стены
+    vector<Obstacle *> obstacles; // Препятствия внутри комнаты
+    vector<RayStart *> rayStarts; // Начала лучей
+    vector<AimArea *> aims;       // Цели
+    vector<RayFan *> fans;        // Вееры лучей
+    Tracer<float> tracer; // Снимок геометрии для интерактивной трассировки
+    Tracer<float> previous; // Снимок до последнего обновления
+    unsigned long version = 0; // Счетчик изменений комнаты, цели и луча
+    unsigned long shapeVersion = 0; // Счетчик изменений стен и цели
+    bool loading = false; // Идет загрузка из json, снимок обновляется один
+                          // раз в конце
+
+    // Перестроение сегментов лучей rays и вееров fans в нескольких потоках
+    void retrace(const vector<RayStart *> &rays, const vector<RayFan *> &fans);
 
 public:
-    RayStart *rayStart = nullptr;
+    RayStart *rayStart = nullptr; // Выбранный луч (или nullptr)
     float defaultRayAngle = PI / 2;
 
-    AimArea *aim = nullptr;
+    AimArea *aim = nullptr; // Выбранная цель (или nullptr)
     void addAim(const Vector2 &center, float radius = 20.0f);
-    void moveAim(const Vector2 &newCenter);
+    void moveAim(const Vector2 &newCenter); // Перемещение выбранной цели
+    void removeAim(AimArea *removed);
+    void selectAim(AimArea *selected);
+    int getAimIndex(); // Индекс выбранной цели в getAims() (или -1)
+    AimArea *closestAim(const Vector2 &point); // Цель, содержащая точку
     bool isRayInAim(
-        const Vector2 &rayStart, const Vector2 &rayEnd,
-        Vector2 &intersectionPoint
+        const Vector2 &origin, const Vector2 &direction, float &distance
     );
 
+    const vector<AimArea *> &getAims() { return aims; }
+
+    const vector<RayStart *> &getRays() { return rayStarts; }
+
+    const vector<RayFan *> &getFans() { return fans; }
+
     Room();
     Room(const json &j); // Конструктор из json
 
     Wall *closestWall(const Vector2 &point);
     RayStart *closestRay(const Vector2 &point);
+    RayFan *closestFan(const Vector2 &point);
 
     const int static minimalDistance; // Минимальное расстояние, на котором
                                       // рядом могут находиться точки
@@ -228,6 +444,8 @@ public:
 
     bool isClosed(); // Замкнутая ли комната
 
+    bool isConvex(); // Является ли комната выпуклым многоугольником
+
     WallLine *addWallLine( // Добавить в конец ломаной прямую стену
         const Vector2 &coord
     );
@@ -235,8 +453,20 @@ public:
         const Vector2 &coord, float radiusCoef = 50, bool orient = false
     );
 
+    // Смена типа стены по кругу: прямая, дуга, эллиптическая дуга, кривая
+    // Безье. Свойства поверхности сохраняются
     Wall *changeWallType(Wall *wall);
 
+    // Замена стены wall (комнаты или препятствия) на стену replacement с
+    // теми же концами
+    Wall *replaceWall(Wall *wall, Wall *replacement);
+
+    // Добавить препятствие из прямых стен с вершинами coords, замкнутое, если
+    // closed. Отдельное зеркало --- незамкнутое препятствие из двух вершин
+    Obstacle *addObstacle(const vector<Vector2> &coords, bool closed);
+
+    const vector<Obstacle *> &getObstacles() { return obstacles; }
+
     void movePoint(
         Point &p, const Vector2 &coord
     ); // Переместить точку на заданные координаты
@@ -245,10 +475,34 @@ public:
 
     json toJson(); // Экспорт в json
 
+    // Добавить луч со стены, ближайшей к точке point, и выбрать его
     void addRay(const Vector2 &point, bool inverted = false);
+    void removeRay(RayStart *removed);
+    void selectRay(RayStart *selected);
+
+    // Добавить веер из count лучей со стены, ближайшей к точке point.
+    // Возвращает nullptr, если рядом с точкой нет стены
+    RayFan *addFan(
+        const Vector2 &point, bool inverted = false,
+        float fromAngle = 10 * DEG2RAD, float toAngle = 170 * DEG2RAD,
+        int count = 1000
+    );
+    void removeFan(RayFan *removed);
 
     vector<Wall *> &getWalls(); // Получить доступ к стенам
 
+    const Tracer<float> &getTracer() { return tracer; }
+
+    // Обновление снимка геометрии и перетрассировка лучей, сегменты которых
+    // проходят через измененные стены и цели
+    void update();
+
+    unsigned long getVersion() { return version; }
+
+    void markChanged() { ++version; } // Отметить изменение комнаты
+
+    unsigned long getShapeVersion() { return shapeVersion; }
+
     void clear(); // Очистка комнаты
 
     ~Room();
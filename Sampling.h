@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+// Последовательности с низким расхождением для квазислучайного перебора
+// параметров луча. В отличие от случайных точек они равномерно заполняют
+// область при любом числе взятых членов
+
+// Обратная запись номера i в системе счисления base (последовательность ван
+// дер Корпута, при base = 2, 3 --- координаты последовательности Халтона)
+inline double radicalInverse(uint64_t i, unsigned base = 2) {
+    double result = 0;
+    double digit = 1.0 / base;
+    for (; i; i /= base, digit /= base) {
+        result += digit * (i % base);
+    }
+    return result;
+}
+
+// Координата dimension (0 или 1) i-й точки последовательности Соболя в виде
+// 32-битной двоичной дроби. Первая координата --- двоичная обратная запись
+// номера, вторая строится по примитивному многочлену x + 1
+inline uint32_t sobol(uint32_t i, int dimension) {
+    uint32_t result = 0;
+    uint32_t m = 1; // Направляющие числа m_k = m_{k-1} xor 2 m_{k-1}
+    for (int k = 1; i; ++k, i >>= 1) {
+        uint32_t v = dimension == 0 ? 1u << (32 - k) : m << (32 - k);
+        if (i & 1) {
+            result ^= v;
+        }
+        m ^= m << 1;
+    }
+    return result;
+}
+
+inline double toUnit(uint32_t x) {
+    return x * (1.0 / 4294967296.0);
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Скремблирование Оуэна двоичной дроби x: каждый разряд инвертируется в
+// зависимости от хеша старших разрядов. Перемешанная последовательность
+// Соболя остается равномерной и дает независимые серии для оценки ошибки.
+// Хеш Лэйна --- Карраса в форме Burley, "Practical Hash-based Owen
+// Scrambling" (2020)
+inline uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// Хеш 32-битного числа (lowbias32, Chris Wellons) для воспроизводимых
+// случайных решений в потоках без общего генератора
+inline uint32_t hashBits(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Русская рулетка: путь с энергией ниже порога threshold продолжается с
+// вероятностью energy / threshold и получает энергию threshold, поэтому
+// математическое ожидание вклада пути не меняется. u --- случайное число из
+// [0, 1). Возвращает false, если путь обрывается
+inline bool russianRoulette(double &energy, double threshold, double u) {
+    if (energy >= threshold) {
+        return true;
+    }
+    if (u * threshold >= energy) {
+        return false;
+    }
+    energy = threshold;
+    return true;
+}
+
+// Квантиль уровня 0.975 распределения Стьюдента с freedom степенями свободы
+// для 95% доверительного интервала по разбросу независимых серий
+inline double studentQuantile(int freedom) {
+    static const double quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (freedom < 1) {
+        return 0;
+    }
+    return freedom <= 30 ? quantiles[freedom - 1] : 1.960;
+}
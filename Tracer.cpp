@@ -0,0 +1,1593 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "raylib.h"
+
+#include "Ray.h"
+#include "Room.h"
+#include "Tracer.h"
+
+// Расширение габарита кривой стены до точки point
+template <typename Segment, typename V>
+static void includeBounds(Segment &segment, const V &point) {
+    segment.low = V(
+        std::fmin(segment.low.x, point.x), std::fmin(segment.low.y, point.y)
+    );
+    segment.high = V(
+        std::fmax(segment.high.x, point.x), std::fmax(segment.high.y, point.y)
+    );
+}
+
+template <typename T>
+typename Tracer<T>::Segment Tracer<T>::snapshot(Wall *wall) const {
+    Segment segment{};
+    segment.start = Vec2<T>(wall->getStart()->getCoord());
+    segment.end = Vec2<T>(wall->getEnd()->getCoord());
+    segment.prev = -1;
+    segment.next = -1;
+    segment.triangle = -1;
+    segment.triangleEdge = -1;
+    segment.reflectance = wall->getReflectance();
+    segment.transmittance = wall->isSplitter() ? 1 - segment.reflectance : T(0);
+    segment.diffuse = wall->isDiffuse();
+
+    WallRound *wallRound = dynamic_cast<WallRound *>(wall);
+    WallEllipse *wallEllipse = dynamic_cast<WallEllipse *>(wall);
+    WallBezier *wallBezier = dynamic_cast<WallBezier *>(wall);
+    if (wallRound) {
+        segment.kind = KIND_ARC;
+        segment.radius = wallRound->getRadius();
+
+        // Центр пересчитывается с точностью T, чтобы окружность точно
+        // проходила через концы стены и между ней и соседями не было зазора
+        Vec2<T> chord = segment.end - segment.start;
+        Vec2<T> chordMiddle = (segment.start + segment.end) * T(0.5);
+        Vec2<T> perp = normalize(Vec2<T>(-chord.y, chord.x));
+        T h = std::sqrt(std::fmax(
+            T(0), segment.radius * segment.radius - dot(chord, chord) / 4
+        ));
+        if (dot(Vec2<T>(wallRound->getCenter()) - chordMiddle, perp) < 0) {
+            h = -h;
+        }
+        segment.center = chordMiddle + perp * h;
+
+        // Середина дуги --- биссектриса направлений на концы, сторона
+        // выбирается по середине исходной дуги
+        Vec2<T> fromStart = normalize(segment.start - segment.center);
+        Vec2<T> fromEnd = normalize(segment.end - segment.center);
+        Vec2<T> middle = fromStart + fromEnd;
+        if (dot(middle, middle) <= std::numeric_limits<T>::epsilon()) {
+            middle = Vec2<T>(-fromStart.y, fromStart.x);
+        }
+        middle = normalize(middle);
+        if (dot(middle, Vec2<T>(wallRound->getMiddleDirection())) < 0) {
+            middle = -middle;
+        }
+        segment.middle = middle;
+        segment.cosHalfSpan = dot(fromStart, middle);
+
+        // Габарит дуги: концы и крайние точки окружности по осям,
+        // попадающие на дугу
+        segment.low = segment.high = segment.start;
+        includeBounds(segment, segment.end);
+        for (Vec2<T> axis : {Vec2<T>(1, 0), Vec2<T>(0, 1), Vec2<T>(-1, 0),
+                             Vec2<T>(0, -1)}) {
+            if (arcContains(axis, segment.middle, segment.cosHalfSpan)) {
+                includeBounds(segment, segment.center + axis * segment.radius);
+            }
+        }
+    } else if (wallEllipse) {
+        // Центр и оси пересчитываются по концам с точностью T
+        segment.kind = KIND_ELLIPSE;
+        segment.center = (segment.start + segment.end) * T(0.5);
+        segment.axis = normalize(segment.end - segment.start);
+        segment.radius = length(segment.end - segment.start) / 2;
+        segment.depth = segment.radius * wallEllipse->getAspect();
+        segment.middle = Vec2<T>(-segment.axis.y, segment.axis.x);
+        if (dot(segment.middle, Vec2<T>(wallEllipse->getBulge())) < 0) {
+            segment.middle = -segment.middle;
+        }
+
+        // Габарит половины эллипса лежит в прямоугольнике, построенном на
+        // хорде и стрелке
+        Vec2<T> top = segment.middle * segment.depth;
+        segment.low = segment.high = segment.start;
+        for (const Vec2<T> &v : {segment.end, segment.start + top,
+                                 segment.end + top}) {
+            includeBounds(segment, v);
+        }
+    } else if (wallBezier) {
+        // Кривая лежит в выпуклой оболочке контрольных точек
+        segment.kind = KIND_BEZIER;
+        segment.degree = wallBezier->getDegree();
+        segment.low = segment.high = segment.start;
+        for (int i = 0; i <= segment.degree; ++i) {
+            segment.controls[i] = Vec2<T>(wallBezier->getControls()[i]);
+            includeBounds(segment, segment.controls[i]);
+        }
+
+        // Если замкнутая ломаная контрольных точек выпукла, выпукла и
+        // область между кривой и хордой
+        int count = segment.degree + 1;
+        bool left = false;
+        bool right = false;
+        for (int i = 0; i < count; ++i) {
+            const Vec2<T> &a = segment.controls[i];
+            const Vec2<T> &b = segment.controls[(i + 1) % count];
+            const Vec2<T> &c = segment.controls[(i + 2) % count];
+            T turn = cross(b - a, c - b);
+            left = left || turn > 0;
+            right = right || turn < 0;
+        }
+        segment.convexCap = !(left && right);
+    } else {
+        Vec2<T> wallVec = segment.end - segment.start;
+        segment.kind = KIND_LINE;
+        segment.normal = normalize(Vec2<T>(-wallVec.y, wallVec.x));
+        segment.low = segment.high = segment.start;
+        includeBounds(segment, segment.end);
+    }
+
+    return segment;
+}
+
+template <typename T> void Tracer<T>::update(Room *room) {
+    walls.clear();
+    sources.clear();
+    lineWalls.clear();
+    arcWalls.clear();
+    curveWalls.clear();
+
+    for (Wall *wall : room->getWalls()) {
+        Segment segment = snapshot(wall);
+        switch (segment.kind) {
+        case KIND_LINE:
+            lineWalls.push_back(walls.size());
+            break;
+        case KIND_ARC:
+            arcWalls.push_back(walls.size());
+            break;
+        default:
+            curveWalls.push_back(walls.size());
+            break;
+        }
+        walls.push_back(segment);
+        sources.push_back(wall);
+    }
+    outlineCount = walls.size();
+
+    // Стены препятствий соединены только в пределах своего препятствия
+    for (Obstacle *obstacle : room->getObstacles()) {
+        int first = walls.size();
+        int count = obstacle->getWalls().size();
+        for (int i = 0; i < count; ++i) {
+            Segment segment = snapshot(obstacle->getWalls()[i]);
+            if (i > 0 || obstacle->isClosed()) {
+                segment.prev = first + (i + count - 1) % count;
+            }
+            if (i + 1 < count || obstacle->isClosed()) {
+                segment.next = first + (i + 1) % count;
+            }
+            walls.push_back(segment);
+            sources.push_back(obstacle->getWalls()[i]);
+        }
+    }
+
+    bool lines = !lineWalls.empty();
+    bool arcs = !arcWalls.empty();
+    if (curveWalls.empty()) {
+        findAll = !arcs    ? &Tracer::findGeneral<true, false, false>
+                  : !lines ? &Tracer::findGeneral<false, true, false>
+                           : &Tracer::findGeneral<true, true, false>;
+    } else {
+        findAll = lines && arcs ? &Tracer::findGeneral<true, true, true>
+                  : lines       ? &Tracer::findGeneral<true, false, true>
+                  : arcs        ? &Tracer::findGeneral<false, true, true>
+                                : &Tracer::findGeneral<false, false, true>;
+    }
+
+    const vector<Wall *> &roomWalls = room->getWalls();
+    for (size_t i = 0; i < roomWalls.size(); ++i) {
+        for (size_t j = 0; j < roomWalls.size(); ++j) {
+            if (i == j) {
+                continue;
+            }
+            if (roomWalls[j]->getEnd() == roomWalls[i]->getStart()) {
+                walls[i].prev = j;
+            }
+            if (roomWalls[j]->getStart() == roomWalls[i]->getEnd()) {
+                walls[i].next = j;
+            }
+        }
+    }
+
+    updateSides();
+    convex = room->isConvex();
+    updateMesh();
+    updateNodes();
+
+    aimCenters.clear();
+    aimRadii.clear();
+    for (AimArea *aim : room->getAims()) {
+        aimCenters.push_back(Vec2<T>(aim->getCenter()));
+        aimRadii.push_back(aim->getRadius());
+    }
+}
+
+template <typename T>
+bool Tracer<T>::isSame(const Segment &a, const Segment &b) {
+    auto same = [](const Vec2<T> &u, const Vec2<T> &v) {
+        return u.x == v.x && u.y == v.y;
+    };
+    // Неиспользуемые видом стены поля снимка равны нулю
+    bool equal = a.kind == b.kind && same(a.start, b.start) &&
+                 same(a.end, b.end) && same(a.center, b.center) &&
+                 a.radius == b.radius && same(a.middle, b.middle) &&
+                 a.cosHalfSpan == b.cosHalfSpan && same(a.axis, b.axis) &&
+                 a.depth == b.depth && a.degree == b.degree &&
+                 a.side == b.side && a.prev == b.prev && a.next == b.next &&
+                 a.reflectance == b.reflectance &&
+                 a.transmittance == b.transmittance && a.diffuse == b.diffuse;
+    for (int i = 0; equal && i < 4; ++i) {
+        equal = same(a.controls[i], b.controls[i]);
+    }
+    return equal;
+}
+
+template <typename T>
+bool Tracer<T>::difference(
+    const Tracer &previous, vector<Box> &changed
+) const {
+    changed.clear();
+    if (walls.size() != previous.walls.size() ||
+        outlineCount != previous.outlineCount ||
+        orientation != previous.orientation) {
+        return false;
+    }
+    for (size_t i = 0; i < walls.size(); ++i) {
+        if (sources[i] != previous.sources[i]) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < walls.size(); ++i) {
+        const Segment &now = walls[i];
+        const Segment &before = previous.walls[i];
+        if (!isSame(now, before)) {
+            changed.push_back({before.low, before.high});
+            changed.push_back({now.low, now.high});
+        }
+    }
+
+    // Появившаяся, исчезнувшая или сдвинутая цель задевает лучи, которые
+    // проходят через ее старый или новый круг
+    size_t aims = std::max(aimCenters.size(), previous.aimCenters.size());
+    for (size_t i = 0; i < aims; ++i) {
+        bool before = i < previous.aimCenters.size();
+        bool now = i < aimCenters.size();
+        if (before && now && aimCenters[i].x == previous.aimCenters[i].x &&
+            aimCenters[i].y == previous.aimCenters[i].y &&
+            aimRadii[i] == previous.aimRadii[i]) {
+            continue;
+        }
+        if (before) {
+            Vec2<T> reach(previous.aimRadii[i], previous.aimRadii[i]);
+            const Vec2<T> &center = previous.aimCenters[i];
+            changed.push_back({center - reach, center + reach});
+        }
+        if (now) {
+            Vec2<T> reach(aimRadii[i], aimRadii[i]);
+            changed.push_back({aimCenters[i] - reach, aimCenters[i] + reach});
+        }
+    }
+    return true;
+}
+
+template <typename T> void Tracer<T>::updateSides() {
+    bool closed = outlineCount > 0;
+    T area = 0;
+    for (size_t i = 0; i < outlineCount; ++i) {
+        closed = closed && walls[i].prev >= 0 && walls[i].next >= 0;
+        area += cross(walls[i].start, walls[i].end);
+    }
+
+    orientation = closed ? (area > 0 ? 1 : -1) : 0;
+
+    // Стены препятствий отражают свет с обеих сторон, как стены незамкнутой
+    // комнаты
+    for (size_t i = outlineCount; i < walls.size(); ++i) {
+        walls[i].side = 0;
+        walls[i].outward = false;
+        walls[i].selfHit = walls[i].kind != KIND_LINE;
+    }
+
+    for (size_t i = 0; i < outlineCount; ++i) {
+        Segment &wall = walls[i];
+        Vec2<T> chord = wall.end - wall.start;
+        Vec2<T> inward = Vec2<T>(-chord.y, chord.x) * orientation;
+        wall.outward = false;
+        wall.selfHit = wall.kind != KIND_LINE;
+
+        if (wall.kind == KIND_LINE || wall.kind == KIND_BEZIER) {
+            // Нормаль кривой Безье, как и прямой, лежит слева от касательной.
+            // Кривая лежит снаружи многоугольника хорд, если все контрольные
+            // точки лежат снаружи
+            wall.side = orientation;
+            if (wall.kind == KIND_BEZIER && orientation != 0) {
+                // Выпуклая кривая, выгнутая внутрь комнаты, обращена к
+                // комнате выпуклой стороной, и отразившийся луч уходит от нее
+                bool inside = true;
+                wall.outward = true;
+                for (int i = 1; i < wall.degree; ++i) {
+                    Vec2<T> control = wall.controls[i] - wall.start;
+                    wall.outward = wall.outward && dot(control, inward) <= 0;
+                    inside = inside && dot(control, inward) >= 0;
+                }
+                wall.selfHit = !(wall.convexCap && inside);
+            }
+            continue;
+        }
+
+        // Если дуга (или эллипс) выгнута наружу, комната лежит внутри
+        // окружности и нормаль, направленная к центру, смотрит внутрь комнаты
+        T height = wall.kind == KIND_ARC ? wall.radius : wall.depth;
+        Vec2<T> arcMid = wall.center + wall.middle * height;
+        Vec2<T> bulge = arcMid - (wall.start + wall.end) * T(0.5);
+        T side = dot(bulge, inward) < 0 ? 1 : -1;
+        wall.side = orientation == 0 ? 0 : side;
+        wall.outward = wall.side > 0;
+    }
+}
+
+template <typename T> void Tracer<T>::updateMesh() {
+    meshVertices.clear();
+    triangles.clear();
+    meshCurves.clear();
+    for (Segment &wall : walls) {
+        wall.triangle = -1;
+        wall.triangleEdge = -1;
+    }
+
+    if (orientation == 0) {
+        return;
+    }
+
+    // Обход стен по порядку их соединения, вершина i --- начало стены loop[i]
+    int n = outlineCount;
+    vector<int> loop;
+    for (int i = 0; loop.size() < (size_t)n; i = walls[i].next) {
+        if (i < 0 || (i == 0 && !loop.empty())) {
+            return;
+        }
+        loop.push_back(i);
+        meshVertices.push_back(walls[i].start);
+    }
+    if (walls[loop.back()].next != 0) {
+        meshVertices.clear();
+        return;
+    }
+
+    // Хорды кривых стен не должны пересекать другие стены, иначе
+    // многоугольник не является простым и триангуляция не строится
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            if (segmentsCross(
+                    meshVertices[i], meshVertices[(i + 1) % n],
+                    meshVertices[j], meshVertices[(j + 1) % n]
+                )) {
+                meshVertices.clear();
+                return;
+            }
+        }
+    }
+
+    // Отсечение ушей: вершины обходятся против часовой стрелки, ухо ---
+    // выпуклая вершина, треугольник которой не содержит других вершин
+    vector<int> polygon;
+    for (int i = 0; i < n; ++i) {
+        polygon.push_back(orientation > 0 ? i : n - 1 - i);
+    }
+
+    while (polygon.size() >= 3) {
+        int m = polygon.size();
+        bool clipped = false;
+        for (int k = 0; k < m && !clipped; ++k) {
+            int a = polygon[(k + m - 1) % m];
+            int b = polygon[k];
+            int c = polygon[(k + 1) % m];
+            const Vec2<T> &pa = meshVertices[a];
+            const Vec2<T> &pb = meshVertices[b];
+            const Vec2<T> &pc = meshVertices[c];
+
+            if (m > 3 && cross(pb - pa, pc - pb) <= 0) {
+                continue;
+            }
+
+            bool isEar = true;
+            for (int q : polygon) {
+                if (q != a && q != b && q != c &&
+                    isInTriangle(meshVertices[q], pa, pb, pc)) {
+                    isEar = false;
+                    break;
+                }
+            }
+            if (!isEar) {
+                continue;
+            }
+
+            Triangle triangle{};
+            triangle.vertex[0] = a;
+            triangle.vertex[1] = b;
+            triangle.vertex[2] = c;
+            triangles.push_back(triangle);
+            polygon.erase(polygon.begin() + k);
+            clipped = true;
+        }
+
+        if (!clipped) {
+            meshVertices.clear();
+            triangles.clear();
+            return;
+        }
+        if (m == 3) {
+            break;
+        }
+    }
+
+    // Соседство треугольников и стены на граничных ребрах
+    vector<int> edgeOwner(n * n, -1);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        Triangle &triangle = triangles[i];
+        for (int k = 0; k < 3; ++k) {
+            int a = triangle.vertex[k];
+            int b = triangle.vertex[(k + 1) % 3];
+            triangle.neighbour[k] = -1;
+            triangle.neighbourEdge[k] = -1;
+            triangle.wall[k] = -1;
+
+            if (b == (a + 1) % n) {
+                triangle.wall[k] = loop[a];
+            } else if (a == (b + 1) % n) {
+                triangle.wall[k] = loop[b];
+            }
+            if (triangle.wall[k] >= 0) {
+                walls[triangle.wall[k]].triangle = i;
+                walls[triangle.wall[k]].triangleEdge = k;
+                continue;
+            }
+
+            int other = edgeOwner[b * n + a];
+            if (other >= 0) {
+                int edge = other % 3;
+                triangle.neighbour[k] = other / 3;
+                triangle.neighbourEdge[k] = edge;
+                triangles[other / 3].neighbour[edge] = i;
+                triangles[other / 3].neighbourEdge[edge] = k;
+            } else {
+                edgeOwner[a * n + b] = i * 3 + k;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (walls[i].triangle < 0) {
+            meshVertices.clear();
+            triangles.clear();
+            return;
+        }
+    }
+
+    // Кривая стена, не лежащая снаружи многоугольника хорд, заходит внутрь
+    // него, поэтому она привязывается ко всем треугольникам, которые
+    // пересекает ее габаритный прямоугольник
+    for (Triangle &triangle : triangles) {
+        triangle.curvesBegin = meshCurves.size();
+
+        Vec2<T> low = meshVertices[triangle.vertex[0]];
+        Vec2<T> high = low;
+        for (int k = 1; k < 3; ++k) {
+            const Vec2<T> &v = meshVertices[triangle.vertex[k]];
+            low = Vec2<T>(std::fmin(low.x, v.x), std::fmin(low.y, v.y));
+            high = Vec2<T>(std::fmax(high.x, v.x), std::fmax(high.y, v.y));
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const Segment &wall = walls[i];
+            if (wall.kind == KIND_LINE || wall.outward) {
+                continue;
+            }
+            if (wall.low.x <= high.x && low.x <= wall.high.x &&
+                wall.low.y <= high.y && low.y <= wall.high.y) {
+                meshCurves.push_back(i);
+            }
+        }
+
+        triangle.curvesEnd = meshCurves.size();
+    }
+}
+
+template <typename T> void Tracer<T>::updateNodes() {
+    nodes.clear();
+    nodeWalls.clear();
+    for (size_t i = 0; i < walls.size(); ++i) {
+        nodeWalls.push_back(i);
+    }
+    outlineRoot = outlineCount > scanLimit ? buildNode(0, outlineCount) : -1;
+    obstacleRoot = walls.size() > outlineCount
+                       ? buildNode(outlineCount, walls.size())
+                       : -1;
+}
+
+template <typename T> int Tracer<T>::buildNode(int first, int last) {
+    int index = nodes.size();
+    nodes.push_back(Node{});
+
+    Node node;
+    node.low = walls[nodeWalls[first]].low;
+    node.high = walls[nodeWalls[first]].high;
+    Vec2<T> centerLow = (node.low + node.high) * T(0.5);
+    Vec2<T> centerHigh = centerLow;
+    for (int i = first + 1; i < last; ++i) {
+        const Segment &wall = walls[nodeWalls[i]];
+        Vec2<T> center = (wall.low + wall.high) * T(0.5);
+        node.low = Vec2<T>(
+            std::min(node.low.x, wall.low.x), std::min(node.low.y, wall.low.y)
+        );
+        node.high = Vec2<T>(
+            std::max(node.high.x, wall.high.x),
+            std::max(node.high.y, wall.high.y)
+        );
+        centerLow = Vec2<T>(
+            std::min(centerLow.x, center.x), std::min(centerLow.y, center.y)
+        );
+        centerHigh = Vec2<T>(
+            std::max(centerHigh.x, center.x), std::max(centerHigh.y, center.y)
+        );
+    }
+
+    if (last - first <= (int)leafSize) {
+        node.first = first;
+        node.count = last - first;
+        nodes[index] = node;
+        return index;
+    }
+
+    // Стены делятся пополам по центрам габаритов вдоль более длинной
+    // стороны прямоугольника центров
+    bool alongX = centerHigh.x - centerLow.x >= centerHigh.y - centerLow.y;
+    auto key = [&](int wall) {
+        const Segment &segment = walls[wall];
+        return alongX ? segment.low.x + segment.high.x
+                      : segment.low.y + segment.high.y;
+    };
+    int middle = (first + last) / 2;
+    std::nth_element(
+        nodeWalls.begin() + first, nodeWalls.begin() + middle,
+        nodeWalls.begin() + last,
+        [&](int a, int b) { return key(a) < key(b); }
+    );
+
+    buildNode(first, middle);
+    node.first = buildNode(middle, last);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+template <typename T>
+void Tracer<T>::findNodes(
+    int root, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+    T &minDist, int &closestWall, T &parameter
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    Vec2<T> inverse = inverseDirection(dir);
+
+    // Узлы обходятся в глубину, из двух потомков первым --- тот, в который
+    // луч входит раньше. Узлы дальше найденного пересечения пропускаются
+    struct Entry {
+        int node;
+        T distance;
+    };
+    Entry stack[maximumDepth];
+    int top = 0;
+    T rootDistance = boxDistance(
+        origin, inverse, nodes[root].low, nodes[root].high, minDist
+    );
+    if (rootDistance != infinity) {
+        stack[top++] = Entry{root, rootDistance};
+    }
+
+    while (top > 0) {
+        Entry entry = stack[--top];
+        if (entry.distance >= minDist) {
+            continue;
+        }
+        const Node &node = nodes[entry.node];
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                T t;
+                T dist =
+                    intersection(nodeWalls[i], origin, dir, fromWall, t);
+                if (dist < minDist) {
+                    minDist = dist;
+                    closestWall = nodeWalls[i];
+                    parameter = t;
+                }
+            }
+            continue;
+        }
+
+        int near = entry.node + 1;
+        int far = node.first;
+        T nearDistance = boxDistance(
+            origin, inverse, nodes[near].low, nodes[near].high, minDist
+        );
+        T farDistance = boxDistance(
+            origin, inverse, nodes[far].low, nodes[far].high, minDist
+        );
+        if (farDistance < nearDistance) {
+            std::swap(near, far);
+            std::swap(nearDistance, farDistance);
+        }
+        if (farDistance != infinity) {
+            stack[top++] = Entry{far, farDistance};
+        }
+        if (nearDistance != infinity) {
+            stack[top++] = Entry{near, nearDistance};
+        }
+    }
+}
+
+template <typename T>
+void Tracer<T>::findNear(
+    const Vec2<T> &point, T radius, vector<int> &found
+) const {
+    found.clear();
+    if (obstacleRoot < 0) {
+        return;
+    }
+
+    int stack[maximumDepth];
+    int top = 0;
+    stack[top++] = obstacleRoot;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node &node = nodes[index];
+        if (point.x < node.low.x - radius || point.x > node.high.x + radius ||
+            point.y < node.low.y - radius || point.y > node.high.y + radius) {
+            continue;
+        }
+        if (node.count > 0) {
+            found.insert(
+                found.end(), nodeWalls.begin() + node.first,
+                nodeWalls.begin() + node.first + node.count
+            );
+        } else {
+            stack[top++] = index + 1;
+            stack[top++] = node.first;
+        }
+    }
+}
+
+template <typename T>
+inline Vec2<T> Tracer<T>::normalAt(
+    const Segment &wall, const Vec2<T> &point, T parameter
+) const {
+    if (wall.kind == KIND_LINE) {
+        return wall.normal;
+    }
+    if (wall.kind == KIND_ARC) {
+        return normalize(wall.center - point);
+    }
+    return curveNormal(wall, point, parameter);
+}
+
+template <typename T>
+Vec2<T> Tracer<T>::curveNormal(
+    const Segment &wall, const Vec2<T> &point, T parameter
+) const {
+    if (wall.kind == KIND_BEZIER) {
+        Vec2<T> tangent = bezierTangent(wall.controls, wall.degree, parameter);
+        return normalize(Vec2<T>(-tangent.y, tangent.x));
+    }
+
+    // Внутрь эллипса, против градиента x^2 / a^2 + y^2 / b^2
+    Vec2<T> f = point - wall.center;
+    Vec2<T> gradient =
+        wall.axis * (dot(f, wall.axis) / (wall.radius * wall.radius)) +
+        wall.middle * (dot(f, wall.middle) / (wall.depth * wall.depth));
+    return -normalize(gradient);
+}
+
+template <typename T>
+Vec2<T> Tracer<T>::normalShift(
+    const Segment &wall, const Vec2<T> &point, T parameter,
+    const Vec2<T> &shift
+) const {
+    if (wall.kind == KIND_LINE) {
+        return Vec2<T>(0, 0);
+    }
+    if (wall.kind == KIND_ARC) {
+        // Нормаль (center - point) / radius поворачивается вместе с точкой
+        return shift * (-1 / length(wall.center - point));
+    }
+
+    // Производная нормированного вектора v / |v| --- составляющая v',
+    // перпендикулярная v, деленная на |v|
+    Vec2<T> v, dv;
+    if (wall.kind == KIND_BEZIER) {
+        Vec2<T> tangent = bezierTangent(wall.controls, wall.degree, parameter);
+        Vec2<T> second = bezierSecond(wall.controls, wall.degree, parameter);
+        T dt = dot(shift, tangent) / dot(tangent, tangent);
+        v = Vec2<T>(-tangent.y, tangent.x);
+        dv = Vec2<T>(-second.y, second.x) * dt;
+    } else {
+        Vec2<T> f = point - wall.center;
+        T a2 = wall.radius * wall.radius;
+        T b2 = wall.depth * wall.depth;
+        v = -(wall.axis * (dot(f, wall.axis) / a2) +
+              wall.middle * (dot(f, wall.middle) / b2));
+        dv = -(wall.axis * (dot(shift, wall.axis) / a2) +
+               wall.middle * (dot(shift, wall.middle) / b2));
+    }
+    T size = length(v);
+    Vec2<T> unit = v * (1 / size);
+    return (dv - unit * dot(dv, unit)) * (1 / size);
+}
+
+template <typename T>
+bool Tracer<T>::isApproaching(
+    const Segment &wall, const Vec2<T> &point, const Vec2<T> &dir, T parameter
+) const {
+    if (wall.side == 0) {
+        return true;
+    }
+    return dot(dir, normalAt(wall, point, parameter)) * wall.side < 0;
+}
+
+template <typename T> int Tracer<T>::indexOf(Wall *wall) const {
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i] == wall) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename T>
+bool Tracer<T>::isOnArc(const Segment &wall, const Vec2<T> &point) const {
+    // Дуга немного расширяется за концы, чтобы луч не проходил в зазор между
+    // дугой и соседней стеной из-за ошибки округления
+    const T tolerance = std::numeric_limits<T>::epsilon() * 100;
+
+    return arcContains(
+        point - wall.center, wall.middle, wall.cosHalfSpan - tolerance
+    );
+}
+
+template <typename T>
+bool Tracer<T>::isOnEllipse(const Segment &wall, const Vec2<T> &point) const {
+    // Половина эллипса со стороны стрелки, с тем же допуском, что у дуги
+    const T tolerance = std::numeric_limits<T>::epsilon() * 100;
+    return dot(point - wall.center, wall.middle) >= -tolerance * wall.depth;
+}
+
+template <typename T>
+T Tracer<T>::lineDistance(
+    int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+) const {
+    const Segment &wall = walls[index];
+
+    // Луч, отразившийся от прямой стены, не может снова попасть в нее
+    if (index == fromWall || dot(dir, wall.normal) * wall.side > 0) {
+        return std::numeric_limits<T>::infinity();
+    }
+    return lineIntersection(origin, dir, wall.start, wall.end);
+}
+
+template <typename T>
+T Tracer<T>::arcDistance(
+    int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    const Segment &wall = walls[index];
+
+    T t1, t2;
+    if (!circleIntersection(origin, dir, wall.center, wall.radius, t1, t2)) {
+        return infinity;
+    }
+
+    // Начало луча лежит на окружности стены, от которой он отразился, поэтому
+    // меньший корень соответствует точке отражения. Повторно попасть в эту
+    // стену можно только вторым корнем, если луч уходит внутрь окружности
+    if (index == fromWall) {
+        if (dot(origin - wall.center, dir) >= 0) {
+            return infinity;
+        }
+        Vec2<T> point = origin + dir * t2;
+        return isOnArc(wall, point) && isApproaching(wall, point, dir)
+                   ? t2
+                   : infinity;
+    }
+
+    // Корень, в котором луч подходит к стене снаружи комнаты, возникает только
+    // из-за ошибки округления около углов и пропускается
+    for (T t : {t1, t2}) {
+        Vec2<T> point = origin + dir * t;
+        if (t > 0 && isOnArc(wall, point) && isApproaching(wall, point, dir)) {
+            return t;
+        }
+    }
+
+    return infinity;
+}
+
+template <typename T>
+T Tracer<T>::ellipseDistance(
+    int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    const Segment &wall = walls[index];
+
+    T t1, t2;
+    if (!ellipseIntersection(
+            origin, dir, wall.center, wall.axis, wall.radius, wall.depth, t1,
+            t2
+        )) {
+        return infinity;
+    }
+
+    // Как у дуги: после отражения от этой же стены остается только второй
+    // корень, если луч уходит внутрь эллипса (против градиента)
+    if (index == fromWall) {
+        if (dot(normalAt(wall, origin, 0), dir) <= 0) {
+            return infinity;
+        }
+        Vec2<T> point = origin + dir * t2;
+        return isOnEllipse(wall, point) && isApproaching(wall, point, dir)
+                   ? t2
+                   : infinity;
+    }
+
+    for (T t : {t1, t2}) {
+        Vec2<T> point = origin + dir * t;
+        if (t > 0 && isOnEllipse(wall, point) &&
+            isApproaching(wall, point, dir)) {
+            return t;
+        }
+    }
+
+    return infinity;
+}
+
+template <typename T>
+T Tracer<T>::bezierDistance(
+    int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+    T &parameter
+) const {
+    const Segment &wall = walls[index];
+
+    // Луч, не задевающий габаритный прямоугольник, отбрасывается до отсечения
+    const T infinity = std::numeric_limits<T>::infinity();
+    if (boxDistance(
+            origin, inverseDirection(dir), wall.low, wall.high, infinity
+        ) == infinity) {
+        return infinity;
+    }
+
+    // Точка отражения лежит на самой кривой и отбрасывается по расстоянию.
+    // Прямая пересекает границу выпуклой области между кривой и хордой не
+    // больше двух раз, поэтому луч, ушедший из этой области или выходящий
+    // из нее через хорду, снова в кривую не попадает
+    T minDistance = 0;
+    if (index == fromWall) {
+        if (!wall.selfHit ||
+            (wall.convexCap && wall.outward &&
+             lineIntersection(origin, dir, wall.start, wall.end) !=
+                 infinity)) {
+            return infinity;
+        }
+        minDistance = length(wall.end - wall.start) *
+                      std::sqrt(std::numeric_limits<T>::epsilon());
+    }
+
+    return bezierClip(
+        wall.controls, wall.degree, origin, dir, minDistance,
+        [&](T t, const Vec2<T> &point) {
+            return isApproaching(wall, point, dir, t);
+        },
+        parameter
+    );
+}
+
+template <typename T>
+T Tracer<T>::intersection(
+    int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+    T &parameter
+) const {
+    switch (walls[index].kind) {
+    case KIND_ARC:
+        return arcDistance(index, origin, dir, fromWall);
+    case KIND_ELLIPSE:
+        return ellipseDistance(index, origin, dir, fromWall);
+    case KIND_BEZIER:
+        return bezierDistance(index, origin, dir, fromWall, parameter);
+    default:
+        return lineDistance(index, origin, dir, fromWall);
+    }
+}
+
+template <typename T>
+Vec2<T> Tracer<T>::project(
+    const Segment &wall, const Vec2<T> &point, T parameter
+) const {
+    switch (wall.kind) {
+    case KIND_ARC:
+        return wall.center + normalize(point - wall.center) * wall.radius;
+    case KIND_ELLIPSE: {
+        // Масштабирование к эллипсу вдоль луча из центра
+        Vec2<T> f = point - wall.center;
+        T x = dot(f, wall.axis) / wall.radius;
+        T y = dot(f, wall.middle) / wall.depth;
+        T scale = std::sqrt(x * x + y * y);
+        if (scale == 0) {
+            return point;
+        }
+        return wall.center + f * (1 / scale);
+    }
+    case KIND_BEZIER:
+        return bezierPoint(wall.controls, wall.degree, parameter);
+    default:
+        break;
+    }
+
+    Vec2<T> wallVec = wall.end - wall.start;
+    T lengthSq = dot(wallVec, wallVec);
+    if (lengthSq == 0) {
+        return wall.start;
+    }
+
+    T t = dot(point - wall.start, wallVec) / lengthSq;
+    t = std::fmax(T(0), std::fmin(T(1), t));
+    return wall.start + wallVec * t;
+}
+
+template <typename T>
+template <bool hasLines, bool hasArcs, bool hasCurves>
+void Tracer<T>::findGeneral(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+    int &closestWall, T &parameter
+) const {
+    // Стены каждого вида перебираются отдельно, поэтому в комнате из одних
+    // прямых (или одних дуг) перебор не содержит ветвлений по виду стены.
+    // Эллипсы и кривые Безье встречаются реже и перебираются вместе
+    if (hasLines) {
+        for (int i : lineWalls) {
+            T dist = lineDistance(i, origin, dir, fromWall);
+            if (dist < minDist) {
+                minDist = dist;
+                closestWall = i;
+            }
+        }
+    }
+    if (hasArcs) {
+        for (int i : arcWalls) {
+            T dist = arcDistance(i, origin, dir, fromWall);
+            if (dist < minDist) {
+                minDist = dist;
+                closestWall = i;
+            }
+        }
+    }
+    if (hasCurves) {
+        for (int i : curveWalls) {
+            T t;
+            T dist = intersection(i, origin, dir, fromWall, t);
+            if (dist < minDist) {
+                minDist = dist;
+                closestWall = i;
+                parameter = t;
+            }
+        }
+    }
+}
+
+template <typename T>
+bool Tracer<T>::findConvex(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+    int &closestWall
+) const {
+    // Из точки на стене fromWall вершины выпуклого многоугольника, начиная с
+    // конца этой стены, видны под монотонно меняющимся углом. Поэтому знак
+    // cross(dir, v - origin) меняется ровно один раз, и стена, через которую
+    // выходит луч, находится бинарным поиском по стенам контура
+    int n = outlineCount;
+    auto isLeft = [&](int j) {
+        return cross(dir, walls[(fromWall + j) % n].start - origin) > 0;
+    };
+
+    bool first = isLeft(1);
+    if (isLeft(n) == first) {
+        return false;
+    }
+
+    int low = 1;
+    int high = n;
+    while (high - low > 1) {
+        int mid = (low + high) / 2;
+        if (isLeft(mid) == first) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    int index = (fromWall + low) % n;
+    if (index == fromWall) {
+        return false;
+    }
+
+    T dist =
+        lineIntersection(origin, dir, walls[index].start, walls[index].end);
+    if (dist == std::numeric_limits<T>::infinity()) {
+        return false;
+    }
+
+    minDist = dist;
+    closestWall = index;
+    return true;
+}
+
+template <typename T>
+int Tracer<T>::exitEdge(
+    const Triangle &triangle, const Vec2<T> &origin, const Vec2<T> &dir,
+    int entry, T &distance
+) const {
+    // Луч выходит через ребро, к внешней стороне которого он направлен, и из
+    // таких ребер --- через ближайшее
+    int edge = -1;
+    distance = std::numeric_limits<T>::infinity();
+    for (int k = 0; k < 3; ++k) {
+        if (k == entry) {
+            continue;
+        }
+        const Vec2<T> &a = meshVertices[triangle.vertex[k]];
+        const Vec2<T> &b = meshVertices[triangle.vertex[(k + 1) % 3]];
+        T denominator = cross(dir, b - a);
+        if (denominator <= 0) {
+            continue;
+        }
+        T t = cross(a - origin, b - a) / denominator;
+        if (t < distance) {
+            distance = t;
+            edge = k;
+        }
+    }
+    return edge;
+}
+
+template <typename T>
+bool Tracer<T>::locate(
+    int wall, const Vec2<T> &point, int &triangle, int &entry
+) const {
+    // Точка на вогнутой дуге лежит внутри многоугольника хорд. Треугольник с
+    // ней ищется обходом от середины хорды к точке
+    const Segment &segment = walls[wall];
+    Vec2<T> from = (segment.start + segment.end) * T(0.5);
+    Vec2<T> dir = point - from;
+    T pathLength = length(dir);
+    dir = normalize(dir);
+
+    triangle = segment.triangle;
+    entry = segment.triangleEdge;
+    for (size_t step = 0; step <= triangles.size(); ++step) {
+        T distance;
+        int edge = exitEdge(triangles[triangle], from, dir, entry, distance);
+        if (edge < 0 || distance >= pathLength) {
+            return true;
+        }
+        if (triangles[triangle].neighbour[edge] < 0) {
+            return false;
+        }
+        entry = triangles[triangle].neighbourEdge[edge];
+        triangle = triangles[triangle].neighbour[edge];
+    }
+    return false;
+}
+
+template <typename T>
+bool Tracer<T>::findMesh(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+    int &closestWall, T &parameter
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    const Segment &from = walls[fromWall];
+    int triangle = from.triangle;
+    int entry = from.triangleEdge;
+
+    if (from.kind != KIND_LINE && from.outward) {
+        // Выпуклая кривая лежит снаружи многоугольника хорд. Луч либо снова
+        // попадает в нее, либо входит в многоугольник через хорду
+        T t;
+        T self = intersection(fromWall, origin, dir, fromWall, t);
+        T chord = lineIntersection(origin, dir, from.start, from.end);
+        if (chord >= self) {
+            if (self == infinity) {
+                return false;
+            }
+            minDist = self;
+            closestWall = fromWall;
+            parameter = t;
+            return true;
+        }
+    } else if (from.kind != KIND_LINE &&
+               !locate(fromWall, origin, triangle, entry)) {
+        return false;
+    }
+
+    T curveDist = infinity;
+    int curveWall = -1;
+    T curveParameter = 0;
+    for (size_t step = 0; step <= triangles.size() * 2; ++step) {
+        const Triangle &current = triangles[triangle];
+        T distance;
+        int edge = exitEdge(current, origin, dir, entry, distance);
+        if (edge < 0) {
+            return false;
+        }
+
+        // Вогнутые кривые, которые луч пересекает до выхода из треугольника.
+        // Расстояние до кривой не зависит от треугольника, поэтому ближайшее
+        // пересечение запоминается на весь обход, и кривая, уже найденная в
+        // предыдущих треугольниках, не пересчитывается
+        for (int i = current.curvesBegin; i < current.curvesEnd; ++i) {
+            if (meshCurves[i] == curveWall) {
+                continue;
+            }
+            T t;
+            T dist = intersection(meshCurves[i], origin, dir, fromWall, t);
+            if (dist < curveDist) {
+                curveDist = dist;
+                curveWall = meshCurves[i];
+                curveParameter = t;
+            }
+        }
+        if (curveDist <= distance) {
+            minDist = curveDist;
+            closestWall = curveWall;
+            parameter = curveParameter;
+            return true;
+        }
+
+        if (current.neighbour[edge] >= 0) {
+            entry = current.neighbourEdge[edge];
+            triangle = current.neighbour[edge];
+            continue;
+        }
+
+        // Граничное ребро: прямая стена или хорда кривой. Точное расстояние
+        // считается по самой стене, и если луч ее не пересекает (ошибка
+        // округления около вершин), используется полный перебор
+        int wall = current.wall[edge];
+        T t;
+        T dist = intersection(wall, origin, dir, fromWall, t);
+        if (dist == infinity) {
+            return false;
+        }
+        minDist = dist;
+        closestWall = wall;
+        parameter = t;
+        return true;
+    }
+
+    return false;
+}
+
+template <typename T>
+bool Tracer<T>::trace(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    T minDist = infinity;
+    int closestWall = -1;
+    T parameter = 0;
+
+    // В выпуклой комнате стена ищется за O(log n), в остальных замкнутых
+    // комнатах --- обходом триангуляции, а луч, выходящий не из стены
+    // контура, --- по иерархии габаритов. В маленьких комнатах и при неудаче
+    // (луч проходит точно через вершину) используется полный перебор
+    bool found = false;
+    bool isLarge = outlineCount > scanLimit;
+    bool fromOutline = fromWall >= 0 && fromWall < (int)outlineCount;
+    if (isLarge && fromOutline && convex) {
+        found = findConvex(origin, dir, fromWall, minDist, closestWall);
+    } else if (isLarge && fromOutline && !triangles.empty()) {
+        found =
+            findMesh(origin, dir, fromWall, minDist, closestWall, parameter);
+    } else if (isLarge) {
+        findNodes(
+            outlineRoot, origin, dir, fromWall, minDist, closestWall,
+            parameter
+        );
+        found = true;
+    }
+    if (!found) {
+        (this->*findAll)(
+            origin, dir, fromWall, minDist, closestWall, parameter
+        );
+    }
+
+    // Препятствия ищутся не дальше найденной стены комнаты
+    if (obstacleRoot >= 0) {
+        findNodes(
+            obstacleRoot, origin, dir, fromWall, minDist, closestWall,
+            parameter
+        );
+    }
+
+    return finish(origin, dir, fromWall, minDist, closestWall, parameter, hit);
+}
+
+template <typename T>
+bool Tracer<T>::traceScan(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit
+) const {
+    T minDist = std::numeric_limits<T>::infinity();
+    int closestWall = -1;
+    T parameter = 0;
+    (this->*findAll)(origin, dir, fromWall, minDist, closestWall, parameter);
+
+    // Стены препятствий не входят в списки полного перебора
+    for (size_t i = outlineCount; i < walls.size(); ++i) {
+        T t = 0;
+        T dist = intersection(i, origin, dir, fromWall, t);
+        if (dist < minDist) {
+            minDist = dist;
+            closestWall = i;
+            parameter = t;
+        }
+    }
+
+    return finish(origin, dir, fromWall, minDist, closestWall, parameter, hit);
+}
+
+template <typename T>
+void Tracer<T>::tracePacket(
+    const Packet &packet, Hit hits[], bool found[]
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+
+    // Неиспользуемые лучи повторяют первый и не могут найти стену ближе 0,
+    // поэтому циклы по лучам всегда имеют длину packetSize
+    Lanes lanes;
+    for (int k = 0; k < packetSize; ++k) {
+        int ray = k < packet.count ? k : 0;
+        lanes.originX[k] = packet.origin[ray].x;
+        lanes.originY[k] = packet.origin[ray].y;
+        lanes.dirX[k] = packet.dir[ray].x;
+        lanes.dirY[k] = packet.dir[ray].y;
+        lanes.inverse[k] = inverseDirection(packet.dir[ray]);
+        lanes.fromWall[k] = packet.fromWall[ray];
+        lanes.minDist[k] = k < packet.count ? infinity : 0;
+        lanes.closest[k] = -1;
+        lanes.parameter[k] = 0;
+    }
+
+    // Стены маленькой комнаты перебираются, большой --- ищутся по иерархии.
+    // Быстрые пути trace() для отдельных лучей здесь не используются: обход
+    // иерархии пакетом дешевле, чем обход триангуляции каждым лучом
+    if (outlineRoot >= 0) {
+        packetNodes(outlineRoot, packet, lanes);
+    } else {
+        for (int i : lineWalls) {
+            packetLine(i, lanes);
+        }
+        for (int i : arcWalls) {
+            packetWall(i, packet, lanes);
+        }
+        for (int i : curveWalls) {
+            packetWall(i, packet, lanes);
+        }
+    }
+    if (obstacleRoot >= 0) {
+        packetNodes(obstacleRoot, packet, lanes);
+    }
+
+    for (int k = 0; k < packet.count; ++k) {
+        found[k] = finish(
+            packet.origin[k], packet.dir[k], packet.fromWall[k],
+            lanes.minDist[k], lanes.closest[k], lanes.parameter[k], hits[k]
+        );
+    }
+}
+
+template <typename T>
+void Tracer<T>::packetLine(int index, Lanes &lanes) const {
+    // Те же вычисления, что в lineDistance и lineIntersection, но без
+    // ветвлений, поэтому цикл по лучам векторизуется
+    const Segment &wall = walls[index];
+    Vec2<T> wallVec = wall.end - wall.start;
+    T parallel = std::numeric_limits<T>::epsilon() * length(wallVec);
+
+    for (int k = 0; k < packetSize; ++k) {
+        T denominator = lanes.dirX[k] * wallVec.y - lanes.dirY[k] * wallVec.x;
+        T wx = wall.start.x - lanes.originX[k];
+        T wy = wall.start.y - lanes.originY[k];
+        T t = (wx * wallVec.y - wy * wallVec.x) / denominator;
+        T u = (wx * lanes.dirY[k] - wy * lanes.dirX[k]) / denominator;
+        T facing = (lanes.dirX[k] * wall.normal.x +
+                    lanes.dirY[k] * wall.normal.y) *
+                   wall.side;
+
+        // Условия объединяются побитово, чтобы не порождать переходов
+        bool closer = (index != lanes.fromWall[k]) & (facing <= 0) &
+                      (std::fabs(denominator) > parallel) & (t > 0) &
+                      (u >= 0) & (u <= 1) & (t < lanes.minDist[k]);
+        lanes.minDist[k] = closer ? t : lanes.minDist[k];
+        lanes.closest[k] = closer ? index : lanes.closest[k];
+    }
+}
+
+template <typename T>
+void Tracer<T>::packetWall(
+    int index, const Packet &packet, Lanes &lanes
+) const {
+    for (int k = 0; k < packet.count; ++k) {
+        T t = 0;
+        T dist = intersection(
+            index, packet.origin[k], packet.dir[k], packet.fromWall[k], t
+        );
+        if (dist < lanes.minDist[k]) {
+            lanes.minDist[k] = dist;
+            lanes.closest[k] = index;
+            lanes.parameter[k] = t;
+        }
+    }
+}
+
+template <typename T>
+void Tracer<T>::packetNodes(
+    int root, const Packet &packet, Lanes &lanes
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+
+    // Узел посещается, если в его габарит входит хотя бы один луч пакета
+    // ближе уже найденного им столкновения. Из двух потомков первым
+    // обходится тот, что лежит раньше вдоль первого луча
+    int stack[maximumDepth];
+    int top = 0;
+    stack[top++] = root;
+
+    while (top > 0) {
+        int index = stack[--top];
+        const Node &node = nodes[index];
+
+        bool entered = false;
+        for (int k = 0; k < packet.count && !entered; ++k) {
+            entered = boxDistance(
+                          packet.origin[k], lanes.inverse[k], node.low,
+                          node.high, lanes.minDist[k]
+                      ) != infinity;
+        }
+        if (!entered) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (walls[nodeWalls[i]].kind == KIND_LINE) {
+                    packetLine(nodeWalls[i], lanes);
+                } else {
+                    packetWall(nodeWalls[i], packet, lanes);
+                }
+            }
+            continue;
+        }
+
+        int near = index + 1;
+        int far = node.first;
+        Vec2<T> offset = (nodes[near].low + nodes[near].high) -
+                         (nodes[far].low + nodes[far].high);
+        if (dot(offset, packet.dir[0]) > 0) {
+            std::swap(near, far);
+        }
+        stack[top++] = far;
+        stack[top++] = near;
+    }
+}
+
+template <typename T>
+bool Tracer<T>::finish(
+    const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T minDist,
+    int closestWall, T parameter, Hit &hit
+) const {
+    const T infinity = std::numeric_limits<T>::infinity();
+    bool hitAimArea = false;
+    int target = -1;
+
+    T t1, t2;
+    for (size_t i = 0; i < aimCenters.size(); ++i) {
+        if (!circleIntersection(
+                origin, dir, aimCenters[i], aimRadii[i], t1, t2
+            )) {
+            continue;
+        }
+        T aimDist = t1 >= 0 ? t1 : t2;
+        if (aimDist >= 0 && aimDist <= minDist) {
+            minDist = aimDist;
+            hitAimArea = true;
+            target = i;
+        }
+    }
+
+    // Луч, отразившийся точно в углу, может уйти наружу через соседнюю стену,
+    // не пересекая ее. В этом случае он отражается от соседней стены в углу
+    if (minDist == infinity && fromWall >= 0) {
+        const Segment &from = walls[fromWall];
+        T tolerance = length(from.end - from.start) *
+                      std::sqrt(std::numeric_limits<T>::epsilon());
+
+        if (length(origin - from.start) <= tolerance && from.prev >= 0) {
+            minDist = 0;
+            closestWall = from.prev;
+        } else if (length(origin - from.end) <= tolerance && from.next >= 0) {
+            minDist = 0;
+            closestWall = from.next;
+        }
+
+        // Угол --- ближайший к началу луча конец соседней стены
+        if (closestWall >= 0) {
+            const Segment &corner = walls[closestWall];
+            parameter = length(origin - corner.start) <=
+                                length(origin - corner.end)
+                            ? 0
+                            : 1;
+        }
+    }
+
+    if (minDist == infinity) {
+        return false;
+    }
+
+    hit.aim = hitAimArea;
+    hit.target = target;
+    hit.wall = hitAimArea ? -1 : closestWall;
+    hit.distance = minDist;
+    hit.point = origin + dir * minDist;
+    hit.parameter = parameter;
+
+    // Точка проецируется на стену, чтобы ошибка округления не накапливалась
+    // и луч не выходил за пределы комнаты
+    if (!hitAimArea) {
+        hit.point = project(walls[closestWall], hit.point, parameter);
+    }
+
+    return true;
+}
+
+template <typename T>
+Vec2<T>
+Tracer<T>::getNormal(int wall, const Vec2<T> &point, T parameter) const {
+    return normalAt(walls[wall], point, parameter);
+}
+
+template <typename T>
+T Tracer<T>::getParameter(int wall, const Vec2<T> &point, T parameter) const {
+    const Segment &segment = walls[wall];
+    switch (segment.kind) {
+    case KIND_ARC: {
+        // Дуга симметрична относительно середины, угловая длина --- два
+        // угла между серединой и концом
+        T cosine = std::fmax(T(-1), std::fmin(T(1), segment.cosHalfSpan));
+        T span = 2 * std::acos(cosine);
+        if (span <= 0) {
+            return T(0.5);
+        }
+        return arcParameter(point - segment.center, segment.middle, span);
+    }
+    case KIND_ELLIPSE: {
+        // Точка center + axis a cos(phi) + middle b sin(phi) имеет параметр
+        // 1 - phi / pi. Точка чуть за хордой у начала стены дает phi около
+        // -pi и переносится к нему
+        Vec2<T> f = point - segment.center;
+        T phi = std::atan2(
+            dot(f, segment.middle) / segment.depth,
+            dot(f, segment.axis) / segment.radius
+        );
+        T pi = std::acos(T(-1));
+        if (phi < -pi / 2) {
+            phi += 2 * pi;
+        }
+        return std::fmax(T(0), std::fmin(T(1), 1 - phi / pi));
+    }
+    case KIND_BEZIER:
+        return parameter;
+    default: {
+        Vec2<T> d = segment.end - segment.start;
+        T t = dot(point - segment.start, d) / dot(d, d);
+        return std::fmax(T(0), std::fmin(T(1), t));
+    }
+    }
+}
+
+template <typename T>
+Vec2<T> Tracer<T>::reflect(const Hit &hit, const Vec2<T> &dir) const {
+    return ::reflect(dir, getNormal(hit.wall, hit.point, hit.parameter));
+}
+
+template <typename T>
+typename Tracer<T>::Differential Tracer<T>::reflectDifferential(
+    const Hit &hit, const Vec2<T> &dir, const Differential &differential
+) const {
+    Vec2<T> normal = getNormal(hit.wall, hit.point, hit.parameter);
+
+    // Смещение точки луча на расстоянии до столкновения дополняется
+    // сдвигом вдоль луча, чтобы точка осталась на стене
+    Vec2<T> moved = differential.origin + differential.dir * hit.distance;
+    Vec2<T> point = moved - dir * (dot(moved, normal) / dot(dir, normal));
+    Vec2<T> turn =
+        normalShift(walls[hit.wall], hit.point, hit.parameter, point);
+
+    // Производная reflect(dir, normal) = dir - 2 (dir, normal) normal
+    T along = dot(dir, normal);
+    T alongShift = dot(differential.dir, normal) + dot(dir, turn);
+    Differential reflected;
+    reflected.origin = point;
+    reflected.dir = differential.dir - normal * (2 * alongShift) -
+                    turn * (2 * along);
+    return reflected;
+}
+
+template <typename T>
+bool Tracer<T>::crosses(
+    const Vec2<T> &origin, const Vec2<T> &dir, T length,
+    const vector<Box> &boxes
+) {
+    const T infinity = std::numeric_limits<T>::infinity();
+    const Vec2<T> margin(1, 1);
+
+    Vec2<T> inverse = inverseDirection(dir);
+    for (const Box &box : boxes) {
+        if (boxDistance(
+                origin, inverse, box.low - margin, box.high + margin, length
+            ) < infinity) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+bool Tracer<T>::scatter(
+    const Hit &hit, Vec2<T> &dir, T u, T v, T &energy
+) const {
+    const Segment &wall = walls[hit.wall];
+    if (wall.transmittance > 0 && u >= wall.reflectance) {
+        return !isBoundary(hit.wall);
+    }
+    if (wall.transmittance == 0) {
+        energy *= wall.reflectance;
+    }
+    if (!wall.diffuse) {
+        dir = reflect(hit, dir);
+        return true;
+    }
+
+    // Рассеянный луч уходит в ту сторону стены, с которой пришел падающий.
+    // Плотность направлений пропорциональна косинусу угла к нормали, поэтому
+    // синус угла распределен равномерно
+    Vec2<T> normal = getNormal(hit.wall, hit.point, hit.parameter);
+    if (dot(normal, dir) > 0) {
+        normal = -normal;
+    }
+    T sine = 2 * v - 1;
+    T cosine = std::sqrt(std::max(T(0), 1 - sine * sine));
+    dir = normal * cosine + Vec2<T>(-normal.y, normal.x) * sine;
+    return true;
+}
+
+template class Tracer<float>;
+template class Tracer<double>;
+template class Tracer<long double>;
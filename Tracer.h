@@ -0,0 +1,395 @@
+#pragma once
+
+#include <vector>
+
+#include "Geometry.h"
+
+using std::vector;
+
+class Room;
+class Wall;
+
+// Трассировщик лучей по снимку геометрии комнаты. Снимок хранит стены в виде
+// простых структур, поэтому не зависит от виртуальных вызовов и может
+// использоваться из нескольких потоков одновременно. Инстанцируется для float
+// (интерактивная отрисовка), double и long double (длительные расчеты).
+//
+// Стены контура комнаты идут в снимке первыми, за ними --- стены препятствий.
+// Препятствия ищутся по иерархии габаритных прямоугольников, поэтому тысячи
+// препятствий почти не замедляют трассировку. По такой же иерархии ищутся
+// стены большой комнаты, когда луч выходит не из стены ее контура
+template <typename T> class Tracer {
+public:
+    // Результат поиска столкновения
+    struct Hit {
+        int wall;      // Индекс стены (-1, если луч попал в цель)
+        T distance;    // Расстояние от начала луча
+        Vec2<T> point; // Точка столкновения
+        bool aim;      // Попал ли луч в цель
+        int target;    // Индекс цели (-1, если луч попал в стену)
+        T parameter;   // Параметр точки на кривой Безье
+    };
+
+    // Габаритный прямоугольник
+    struct Box {
+        Vec2<T> low;
+        Vec2<T> high;
+    };
+
+    // Производные луча по параметру семейства лучей (например, по углу
+    // выхода из общего начала)
+    struct Differential {
+        Vec2<T> origin; // Производная начала луча
+        Vec2<T> dir;    // Производная направления
+    };
+
+    Tracer() {}
+
+    Tracer(Room *room) { update(room); }
+
+    void update(Room *room); // Обновление снимка геометрии комнаты
+
+    // Цели не задерживают лучи (в расчетах, где они только принимают свет)
+    void ignoreAim() {
+        aimCenters.clear();
+        aimRadii.clear();
+    }
+
+    size_t aimsCount() const { return aimCenters.size(); }
+
+    // Области, в которых снимок отличается от снимка previous той же
+    // комнаты: габариты измененных стен и целей до и после изменения.
+    // Возвращает false, если изменился набор стен или замкнутость комнаты,
+    // и изменения нельзя ограничить областями
+    bool difference(const Tracer &previous, vector<Box> &changed) const;
+
+    int indexOf(Wall *wall) const; // Индекс стены в снимке (или -1)
+
+    // Стены препятствий, габарит которых ближе radius к точке point
+    void findNear(const Vec2<T> &point, T radius, vector<int> &found) const;
+
+    Wall *getWall(int index) const { return sources[index]; }
+
+    size_t wallsCount() const { return walls.size(); }
+
+    bool isConvex() const { return convex; }
+
+    bool isClosed() const { return orientation != 0; }
+
+    // Лежит ли стена на контуре замкнутой комнаты: луч, прошедший сквозь
+    // нее, покидает комнату. Сквозь препятствия луч проходит внутри комнаты
+    bool isBoundary(int wall) const {
+        return orientation != 0 && wall < (int)outlineCount;
+    }
+
+    bool trace( // Поиск ближайшего столкновения луча origin + dir * t
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit
+    ) const;
+
+    // То же, что trace(), но перебором всех стен, без бинарного поиска,
+    // триангуляции и иерархий габаритов. Эталон для проверки быстрых путей
+    bool traceScan(
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit
+    ) const;
+
+    static const int packetSize = 8; // Наибольшее число лучей в пакете
+
+    // Длина, до которой рисуется путь луча, не встретившего стен
+    static constexpr float unboundedLength = 10000.0f;
+
+    // Пакет соседних лучей с близкими началами и направлениями
+    struct Packet {
+        int count; // Число лучей
+        Vec2<T> origin[packetSize];
+        Vec2<T> dir[packetSize];
+        int fromWall[packetSize];
+    };
+
+    // Поиск столкновений лучей пакета. Лучи вместе перебирают стены и
+    // обходят иерархии габаритов, поэтому стена или узел читается один раз
+    // на пакет, а прямые стены проверяются векторизованным циклом по лучам.
+    // found[k] --- было ли столкновение у луча k. Результат тот же, что у
+    // trace(), кроме выбора стены при попадании точно в вершину
+    void tracePacket(const Packet &packet, Hit hits[], bool found[]) const;
+
+    // Нормаль стены в точке point, у кривой Безье --- в точке с параметром
+    // parameter
+    Vec2<T> getNormal(int wall, const Vec2<T> &point, T parameter = 0) const;
+
+    // Параметр точки point стены в параметризации Wall::getPointByT: у прямой
+    // --- проекция, у дуги и эллипса --- по углу направления от центра, у
+    // кривой Безье --- parameter из Hit
+    T getParameter(int wall, const Vec2<T> &point, T parameter = 0) const;
+
+    T getReflectance(int wall) const { return walls[wall].reflectance; }
+
+    T getTransmittance(int wall) const { return walls[wall].transmittance; }
+
+    bool isDiffuse(int wall) const { return walls[wall].diffuse; }
+
+    Vec2<T> reflect( // Направление луча после отражения в точке hit
+        const Hit &hit, const Vec2<T> &dir
+    ) const;
+
+    // Производные отраженного луча, начинающегося в точке hit, по
+    // производным differential падающего луча с направлением dir. Точка
+    // столкновения смещается вдоль стены, а нормаль поворачивается с
+    // кривизной стены, поэтому перенос точен для стен всех видов
+    Differential reflectDifferential(
+        const Hit &hit, const Vec2<T> &dir, const Differential &differential
+    ) const;
+
+    // Проходит ли отрезок origin + dir * t, 0 <= t <= length (dir
+    // единичный), через один из прямоугольников boxes. Прямоугольники
+    // немного расширяются, чтобы ошибка округления не пропустила отрезок,
+    // идущий вдоль их края или начинающийся на стене
+    static bool crosses(
+        const Vec2<T> &origin, const Vec2<T> &dir, T length,
+        const vector<Box> &boxes
+    );
+
+    // Продолжение пути после столкновения hit со стеной при случайных
+    // числах u, v из [0, 1). Светоделитель отражает луч с вероятностью,
+    // равной доле отражения, и иначе пропускает его, не меняя энергию,
+    // остальные стены отражают луч и умножают энергию на долю отражения.
+    // Зеркальная стена и светоделитель отражают луч зеркально, диффузная
+    // рассеивает его по закону Ламберта: синус угла к нормали равен 2v - 1.
+    // Возвращает false, если луч прошел сквозь стену замкнутой комнаты и
+    // покинул ее
+    bool scatter(const Hit &hit, Vec2<T> &dir, T u, T v, T &energy) const;
+
+private:
+    typedef void (Tracer::*Finder)(
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+        int &closestWall, T &parameter
+    ) const;
+
+    // Вид стены
+    enum Kind { KIND_LINE, KIND_ARC, KIND_ELLIPSE, KIND_BEZIER };
+
+    // Снимок стены
+    struct Segment {
+        Kind kind;
+        Vec2<T> start;       // Начальная точка
+        Vec2<T> end;         // Конечная точка
+        Vec2<T> normal;      // Нормаль прямой стены
+        T side;              // Знак, с которым нормаль направлена внутрь
+                             // комнаты (0, если комната не замкнута)
+        Vec2<T> center;      // Центр дуги или эллипса
+        T radius;            // Радиус дуги или полуось эллипса вдоль хорды
+        Vec2<T> middle;      // Направление от центра к середине дуги
+        T cosHalfSpan;       // Косинус половины угловой длины дуги
+        Vec2<T> axis;        // Единичный вектор вдоль хорды эллипса
+        T depth;             // Полуось эллипса поперек хорды
+        Vec2<T> controls[4]; // Контрольные точки кривой Безье
+        int degree;          // Степень кривой Безье
+        Vec2<T> low;         // Габаритный прямоугольник кривой стены
+        Vec2<T> high;
+        bool outward;        // Лежит ли кривая снаружи многоугольника хорд
+        bool convexCap;      // Ограничивает ли кривая Безье вместе с хордой
+                             // выпуклую область
+        bool selfHit;        // Может ли отразившийся луч снова попасть в
+                             // кривую
+        T reflectance;       // Доля энергии, сохраняемой при отражении
+        T transmittance;     // Доля энергии, проходящей сквозь светоделитель
+        bool diffuse;        // Рассеивает ли стена свет по закону Ламберта
+        int prev;            // Индекс стены, соседней по начальной точке
+        int next;            // Индекс стены, соседней по конечной точке
+        int triangle;        // Треугольник, прилегающий к стене (или -1)
+        int triangleEdge;    // Номер ребра этого треугольника
+    };
+
+    // Треугольник триангуляции внутренности комнаты. Ребро k соединяет
+    // вершины k и k + 1, вершины перечислены против часовой стрелки
+    struct Triangle {
+        int vertex[3];        // Индексы вершин в meshVertices
+        int neighbour[3];     // Соседний треугольник по ребру (или -1)
+        int neighbourEdge[3]; // Номер того же ребра в соседнем треугольнике
+        int wall[3];          // Стена, лежащая на ребре (или -1)
+        int curvesBegin;      // Диапазон кривых стен в meshCurves, которые
+        int curvesEnd;        // могут пересекать треугольник
+    };
+
+    // Узел иерархии габаритов стен. У листа count > 0, и его стены ---
+    // nodeWalls[first] ... nodeWalls[first + count - 1].
+    // У внутреннего узла левый потомок следует сразу за ним, а правый имеет
+    // индекс first
+    struct Node {
+        Vec2<T> low;
+        Vec2<T> high;
+        int first;
+        int count;
+    };
+
+    vector<Segment> walls;
+    vector<Wall *> sources;  // Исходные стены комнаты
+    size_t outlineCount = 0; // Число стен контура комнаты
+
+    // Число стен, до которого полный перебор быстрее поиска по триангуляции
+    // или бинарного поиска
+    static const size_t scanLimit = 8;
+
+    vector<int> lineWalls;  // Индексы прямых стен
+    vector<int> arcWalls;   // Индексы дуг
+    vector<int> curveWalls; // Индексы эллиптических дуг и кривых Безье
+
+    static const size_t leafSize = 2;   // Наибольшее число стен в листе
+    static const int maximumDepth = 64; // Ограничение стека обхода узлов
+
+    // Иерархии габаритов стен контура (только у большой комнаты) и стен
+    // препятствий. Индексы стен хранятся в nodeWalls в порядке листьев:
+    // сначала стены контура, затем препятствий
+    vector<Node> nodes;
+    vector<int> nodeWalls;
+    int outlineRoot = -1;  // Корень иерархии контура (или -1)
+    int obstacleRoot = -1; // Корень иерархии препятствий (или -1)
+
+    // Вариант полного перебора, выбранный по видам стен при обновлении снимка
+    Finder findAll = &Tracer::findGeneral<true, true, true>;
+
+    bool convex = false; // Выпуклый многоугольник из прямых стен
+    T orientation = 0;   // Знак площади комнаты (0, если она не замкнута)
+
+    // Триангуляция многоугольника, в котором кривые стены заменены хордами.
+    // Пустая, если комната не замкнута или триангуляцию построить не удалось
+    vector<Vec2<T>> meshVertices;
+    vector<Triangle> triangles;
+    vector<int> meshCurves;
+
+    vector<Vec2<T>> aimCenters; // Круги целей
+    vector<T> aimRadii;
+
+    Segment snapshot(Wall *wall) const; // Снимок одной стены
+
+    // Совпадают ли снимки стены по форме и свойствам поверхности
+    static bool isSame(const Segment &a, const Segment &b);
+
+    // Расстояние до пересечения луча со стеной и параметр точки пересечения
+    // на кривой Безье
+    T intersection(
+        int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+        T &parameter
+    ) const;
+
+    T lineDistance( // Расстояние до пересечения луча с прямой стеной
+        int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+    ) const;
+
+    T arcDistance( // Расстояние до пересечения луча с дугой
+        int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+    ) const;
+
+    T ellipseDistance( // Расстояние до пересечения с эллиптической дугой
+        int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall
+    ) const;
+
+    T bezierDistance( // Расстояние до пересечения с кривой Безье и параметр
+        int index, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+        T &parameter
+    ) const;
+
+    // Поиск ближайшей стены полным перебором, специализированный по видам
+    // стен, которые есть в комнате
+    template <bool hasLines, bool hasArcs, bool hasCurves>
+    void findGeneral(
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+        int &closestWall, T &parameter
+    ) const;
+
+    // Завершение поиска после перебора стен: проверка целей, отражение луча,
+    // ушедшего точно через угол, и заполнение результата
+    bool finish(
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T minDist,
+        int closestWall, T parameter, Hit &hit
+    ) const;
+
+    // Лучи пакета в виде отдельных массивов координат и лучшие найденные
+    // для них стены
+    struct Lanes {
+        T originX[packetSize];
+        T originY[packetSize];
+        T dirX[packetSize];
+        T dirY[packetSize];
+        Vec2<T> inverse[packetSize]; // Обратные векторы направлений
+        int fromWall[packetSize];
+        T minDist[packetSize];
+        int closest[packetSize];
+        T parameter[packetSize];
+    };
+
+    void packetLine(int index, Lanes &lanes) const; // Прямая стена для пакета
+
+    void packetWall( // Стена любого вида для каждого луча пакета по очереди
+        int index, const Packet &packet, Lanes &lanes
+    ) const;
+
+    void packetNodes( // Обход иерархии габаритов с корнем root пакетом
+        int root, const Packet &packet, Lanes &lanes
+    ) const;
+
+    void findNodes( // Поиск стены обходом иерархии габаритов с корнем root
+        int root, const Vec2<T> &origin, const Vec2<T> &dir, int fromWall,
+        T &minDist, int &closestWall, T &parameter
+    ) const;
+
+    bool findConvex( // Поиск стены бинарным поиском в выпуклой комнате
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+        int &closestWall
+    ) const;
+
+    bool findMesh( // Поиск стены обходом треугольников вдоль луча
+        const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, T &minDist,
+        int &closestWall, T &parameter
+    ) const;
+
+    int exitEdge( // Ребро, через которое луч покидает треугольник
+        const Triangle &triangle, const Vec2<T> &origin, const Vec2<T> &dir,
+        int entry, T &distance
+    ) const;
+
+    bool locate( // Поиск треугольника, содержащего точку на кривой стене
+        int wall, const Vec2<T> &point, int &triangle, int &entry
+    ) const;
+
+    bool isOnArc(const Segment &wall, const Vec2<T> &point) const;
+
+    bool isOnEllipse(const Segment &wall, const Vec2<T> &point) const;
+
+    // Нормаль стены в точке point (у кривой Безье --- с параметром parameter)
+    Vec2<T> normalAt(
+        const Segment &wall, const Vec2<T> &point, T parameter
+    ) const;
+
+    Vec2<T> curveNormal( // Нормаль эллиптической дуги или кривой Безье
+        const Segment &wall, const Vec2<T> &point, T parameter
+    ) const;
+
+    // Производная нормали при смещении точки point вдоль стены на shift
+    Vec2<T> normalShift(
+        const Segment &wall, const Vec2<T> &point, T parameter,
+        const Vec2<T> &shift
+    ) const;
+
+    bool isApproaching( // Подходит ли луч к стене изнутри комнаты
+        const Segment &wall, const Vec2<T> &point, const Vec2<T> &dir,
+        T parameter = 0
+    ) const;
+
+    void updateSides(); // Определение внутренней стороны каждой стены
+
+    void updateMesh(); // Построение триангуляции замкнутой комнаты
+
+    void updateNodes(); // Построение иерархий габаритов
+
+    // Узел для стен nodeWalls[first] ... nodeWalls[last - 1]. Возвращает
+    // его индекс
+    int buildNode(int first, int last);
+
+    Vec2<T> project( // Проекция точки на стену
+        const Segment &wall, const Vec2<T> &point, T parameter
+    ) const;
+};
+
+extern template class Tracer<float>;
+extern template class Tracer<double>;
+extern template class Tracer<long double>;
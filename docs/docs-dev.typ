@@ -73,15 +73,48 @@
         - raylib/
           - ...
         - CMakeLists.txt
+      - tests/
+        - IlluminationCheck.cpp
+        - TracerCheck.cpp
+      - BeamTracer.cpp
+      - BeamTracer.h
+      - Caustic.cpp
+      - Caustic.h
       - CMakeLists.txt
+      - Echogram.cpp
+      - Echogram.h
       - FileDialog.cpp
       - FileDialog.h
+      - Geometry.h
+      - Heatmap.cpp
+      - Heatmap.h
+      - HitEstimator.cpp
+      - HitEstimator.h
+      - Illumination.cpp
+      - Illumination.h
+      - Itineraries.cpp
+      - Itineraries.h
+      - Lyapunov.cpp
+      - Lyapunov.h
       - MyUI.cpp
       - MyUI.h
+      - PeriodicOrbits.cpp
+      - Parallel.h
+      - PeriodicOrbits.h
+      - PhaseSpace.cpp
+      - PhaseSpace.h
+      - Pool.h
+      - Radiosity.cpp
+      - Radiosity.h
       - Ray.cpp
       - Ray.h
+      - ReachMap.cpp
+      - ReachMap.h
       - Room.cpp
       - Room.h
+      - Sampling.h
+      - Tracer.cpp
+      - Tracer.h
       - main.cpp
       - maker.sh
       - winregen.bat
@@ -118,7 +151,7 @@
 
   `apt-get install cmake make gcc-c++ wayland-devel libwayland-client-devel libwayland-cursor-devel libwayland-egl-devel libxkbcommon-devel libX11-devel libXrandr-devel libXinerama-devel libXcursor-devel libXi-devel libgtk+3-devel libGL-devel`
 
-В проекте есть нужные файлы для CMake, и сборка проекта производится стандартными командами для этого сборщика.
+В проекте есть нужные файлы для CMake, и сборка проекта производится стандартными командами для этого сборщика. Если тип сборки не задан, собирается `Release`.
 
 Также для сборки в директорию `build` можно запустить из корня проекта скрипт из файла `maker.sh`:
 
@@ -148,21 +181,37 @@
 #figure(caption: "Образец входного/выходного JSON-файла.")[
   ```json
   {
-    "aim": {
-      "center": { "x": 242.0, "y": 169.0 },
-      "radius": 20.0
-    },
+    "aims": [
+      {
+        "center": { "x": 242.0, "y": 169.0 },
+        "radius": 20.0
+      }
+    ],
     "points": [
       { "x": 173.0, "y": 324.0},
       { "x": 173.0, "y": 176.0},
       {"x": 401.0, "y": 155.0},
       { "x": 416.0,"y": 316.0}
     ],
-    "rayStart": {
-      "angle": 1.57,
-      "inverted": false,
-      "start": { "x": 235.42, "y": 86.68}
-    },
+    "rayFans": [
+      {
+        "adaptive": false,
+        "caustic": false,
+        "count": 1000,
+        "fromAngle": 0.17,
+        "inverted": false,
+        "start": { "x": 173.0, "y": 250.0},
+        "toAngle": 2.97,
+        "tolerance": 5.0
+      }
+    ],
+    "rayStarts": [
+      {
+        "angle": 1.57,
+        "inverted": false,
+        "start": { "x": 235.42, "y": 86.68}
+      }
+    ],
     "walls": [
       { "type": "line" },
       {
@@ -176,20 +225,33 @@
         "type": "round"
       },
       { "type": "line" }
+    ],
+    "obstacles": [
+      {
+        "points": [
+          { "x": 250.0, "y": 230.0 },
+          { "x": 300.0, "y": 260.0 }
+        ],
+        "walls": [ { "type": "line" } ]
+      }
     ]
   }
   ```
 ]
 
-Поля JSON-объекта соответствуют полям класса `Room`. Поля `aim` и `rayStart` не являются обязательными. Обязательными являются поля `points` и `walls`, причем они оба должны являться списками.
+Поля JSON-объекта соответствуют полям класса `Room`. Поля `aims`, `rayStarts`, `rayFans` и `obstacles` не являются обязательными. Обязательными являются поля `points` и `walls`, причем они оба должны являться списками.
 
 Список `points` обозначает массив `points` в классе `Room`.
 
-Список `walls` обозначает массив `walls` в классе `Room`, элементами которого являются объекты класса `Wall`. Причем, если элемент является объектом класса `WallLine`, то он должен содержать единственное поле `type` со значением `line`. Если же элемент является объектом класса `WallRound`, то он должен содержать поля: `type` со значением `round`, `orient` и `radiusCoef` обозначают то же, что в конструкторе класса `WallRound`.
+Список `walls` обозначает массив `walls` в классе `Room`, элементами которого являются объекты класса `Wall`. Причем, если элемент является объектом класса `WallLine`, то он должен содержать единственное поле `type` со значением `line`. Если же элемент является объектом класса `WallRound`, то он должен содержать поля: `type` со значением `round`, `orient` и `radiusCoef` обозначают то же, что в конструкторе класса `WallRound`. Элемент класса `WallEllipse` содержит поля `type` со значением `ellipse`, `aspect` и `orient`, элемент класса `WallBezier` --- поля `type` со значением `bezier`, `degree` и массив из двух высот `heights`; они обозначают то же, что в конструкторах этих классов.
+
+Список `obstacles` обозначает препятствия внутри комнаты (класс `Obstacle`). Каждое препятствие содержит свои списки `points` и `walls` того же вида, что и у комнаты. Если стен столько же, сколько вершин, препятствие замкнуто, и последняя стена соединяет последнюю вершину с первой; если стен на одну меньше, препятствие --- незамкнутая ломаная, например отдельное зеркало из двух вершин и одной стены.
+
+Списки `aims` и `rayStarts` обозначают массивы целей и начал лучей в классе `Room`. Поля их элементов обозначают то же, что и поля в конструкторах классов `AimArea` и `RayStart` соответственно. Файлы прежнего формата с одной целью в поле `aim` и одним лучом в поле `rayStart` также открываются.
 
-Поля объектов `aim` и `rayStart` обозначают то же, что и поля в конструкторах классов `Aim` и `RayStart` соответственно.
+Список `rayFans` обозначает массив вееров лучей. Поля его элементов `start`, `inverted`, `fromAngle`, `toAngle` и `count` обозначают то же, что в конструкторе класса `RayFan`, необязательные поля `adaptive` и `tolerance` --- выбираются ли углы лучей адаптивно и допустимое расстояние между соседними лучами, `caustic` --- показываются ли каустики веера.
 
-При этом, объекты, обозначающие параметры типа `Vector2` или `Point` (поле `center` объекта `aim`, элементы списка `points` и поле `start` объекта `rayStart`) должны иметь поля `x` и `y` численного типа.
+При этом, объекты, обозначающие параметры типа `Vector2` или `Point` (поле `center` целей, элементы списка `points` и поле `start` начал лучей и вееров) должны иметь поля `x` и `y` численного типа.
 
 #bibliography("thesis.bib", style: bytes(read("gost-7-1-2003.csl")))
 
@@ -37,7 +37,11 @@ public:
 *Конструкторы/деструктор*:
 
 - `Wall(Point *start, Point *end, Room *room)` #h(1em) Конструктор стены с началом в `start`, с концом в `end` в комнате `room`.
-- `~Wall()` #h(1em) Удаляет стену из связанных для точек `start` и `end`
+- `virtual ~Wall()` #h(1em) Удаляет стену из связанных для точек `start` и `end`. Виртуальный: стены удаляются через указатель на `Wall`.
+
+*Вложенные типы*:
+
+- `enum Surface { SURFACE_MIRROR, SURFACE_DIFFUSE, SURFACE_SPLITTER }` #h(1em) Вид поверхности: зеркальная, рассеивающая или светоделитель (полупрозрачное зеркало), который отражает долю `reflectance` света и пропускает остальное. В JSON сохраняется строкой `"mirror"`, `"diffuse"` или `"splitter"`. Разделение луча учитывают `RayTree`, `HitEstimator`, `Heatmap` и `ReachMap`, в остальных расчетах светоделитель считается зеркалом. Рассеяние по закону Ламберта учитывают `HitEstimator`, `Heatmap`, `ReachMap` (`Tracer::scatter`) и `Radiosity`. Дерево лучей, веер и каустики на диффузной стене обрываются, а бильярдные расчеты (`Lyapunov`, `PeriodicOrbits`, `PhaseSpace`) и освещение `Illumination` считают все стены зеркалами.
 
 *Поля*:
 
@@ -45,11 +49,17 @@ protected:
 
 - `Point *start` #h(1em) Начальная точка.
 - `Point *end` #h(1em) Конечная точка.
+- `Surface surface` #h(1em) Вид поверхности (по умолчанию зеркальная).
+- `float reflectance` #h(1em) Доля отраженного света: зеркально у зеркальной стены и светоделителя, рассеянно у диффузной (по умолчанию 1).
 
 public:
 
 - `Room *room`
 
+*Вложенные классы*:
+
+- `class InvalidReflectance` #h(1em) Исключение, выбрасывается, если доля отраженного света не от 0 до 1.
+
 *Методы*:
 
 public:
@@ -59,6 +69,10 @@ public:
 - `json toJson()` #h(1em) Возвращает JSON-объект.
 - `Point *getStart()`
 - `Point *getEnd()`
+- `Surface getSurface()`, `void setSurface(Surface surface)` #h(1em) Вид поверхности стены. Изменение обновляет комнату.
+- `bool isDiffuse()`, `bool isSplitter()`
+- `float getReflectance()`, `void setReflectance(float reflectance)` #h(1em) Доля отраженного света.
+- `void copySurface(Wall *wall)` #h(1em) Переносит свойства поверхности со стены `wall` (используется при смене типа стены).
 - `Vector2 getNormal(const Vector2 &point)` #h(1em) Возвращает вектор нормали к стене в точке `point`.
 - `Vector2 closestPoint(const Vector2 &point)` #h(1em) Возвращает ближайшую точку на стене к `point`.
 - `float distanceToWall(const Vector2 &point)` #h(1em) Возвращает расстояние до `point`.
@@ -87,6 +101,9 @@ private:
 
 - `float startAngle` #h(1em) Угол начала относительно горизонтального луча, с вершиной в центре круга, направленного вправо.
 - `float endAngle` #h(1em) Угол конца относительно горизонтального луча, с вершиной в центре круга, направленного вправо.
+- `Vector2 middleDir` #h(1em) Единичный вектор от центра к середине дуги.
+- `float cosHalfSpan` #h(1em) Косинус половины угловой длины дуги.
+- `float span` #h(1em) Угловая длина дуги в радианах.
 - `float radiusCoef` #h(1em) Коэффициент $k in (0, 100)$ для вычисления радиуса.
 - `float chord` #h(1em) Длина хорды между `start` и `end` из конструктора.
 - `float radius` #h(1em) Радиус дуги.
@@ -98,11 +115,8 @@ private:
 
 private:
 
-- `void updateAngles()` #h(1em) Обновление углов.
-- `bool crossesZeroDeg()` #h(1em) Вспомогательная функция, определяющая пересекает ли дуга $0 degree$.
-- `float getAngularLength()` #h(1em) Вспомогательная функция, возвращает угловую ширину дуги.
-- `float getAngleByT(float t)` #h(1em) Возвращает значение угла по параметру $t in [0, 1]$.
-- `float getTByAngle(float angleDeg)` #h(1em) Возвращает значение параметра $t in [0, 1]$ по углу.
+- `void updateAngles()` #h(1em) Обновление углов и кэшированных направлений дуги. Принадлежность точки дуге проверяется скалярным произведением с `middleDir` без тригонометрии.
+- `float getTByDirection(const Vector2 &diff)` #h(1em) Возвращает значение параметра $t in [0, 1]$ по направлению от центра или $-1$, если направление не попадает в дугу.
 
 public:
 
@@ -119,9 +133,116 @@ public:
 - `float getRadius()`
 - `float getStartAngle()`
 - `float getEndAngle()`
+- `Vector2 getMiddleDirection()`
+- `float getCosHalfSpan()`
+
+==== Класс `WallEllipse`
+
+Класс стены-эллиптического зеркала: половина эллипса, отсекаемая хордой между концами стены. Одна полуось эллипса равна половине хорды и лежит на ней, другая направлена поперек хорды. Наследуется публично от `Wall`.
+
+*Вложенные классы*:
+
+- `InvalidAspect: public std::exception` #h(1em) Исключение, выбрасывается, когда отношение полуосей не от 0.1 до 2.
+
+*Конструкторы/деструктор*:
+
+- `WallEllipse(Point *start, Point *end, Room *room, float aspect = 0.5f, bool orient = false)` #h(1em) Конструктор с отношением полуоси поперек хорды к полуоси вдоль хорды `aspect` и флагом выпуклости/вогнутости `orient`.
+
+*Поля*:
+
+private:
+
+- `float aspect` #h(1em) Отношение полуосей.
+- `bool orient` #h(1em) Сторона хорды, в которую выгнута стена (как у `WallRound`).
+- `Vector2 center` #h(1em) Центр эллипса (середина хорды).
+- `Vector2 axis` #h(1em) Единичный вектор вдоль хорды.
+- `Vector2 bulge` #h(1em) Единичный вектор поперек хорды в сторону стены.
+- `float semiAxis` #h(1em) Полуось вдоль хорды.
+- `float depth` #h(1em) Полуось поперек хорды.
+
+*Методы*:
+
+public:
+
+- `void toggleOrient()` #h(1em) Делает противоположным флаг вогнутости/выпуклости.
+- `float getAspect()`
+- `void setAspect(float aspect)`
+- `Vector2 getCenter()`
+- `Vector2 getBulge()`
+- `float getSemiAxis()`
+- `float getDepth()`
+- `void getFoci(Vector2 &first, Vector2 &second)` #h(1em) Фокусы эллипса. Луч из одного фокуса после отражения проходит через другой.
+- `Vector2 closestPoint(const Vector2 &point)`
+- `Vector2 getNormal(const Vector2 &point)` #h(1em) Нормаль против градиента уравнения эллипса.
+- `Vector2 getPointByT(float t)` #h(1em) Точка с эксцентрическим углом $pi (1 - t)$, $t = 0$ --- начало стены.
+- `float getTByPoint(const Vector2 &point, float precision = 0.1f)`
+
+==== Класс `WallBezier`
+
+Класс стены, представляющей собой кривую Безье второй или третьей степени с концами в концах стены. Внутренние контрольные точки задаются в системе координат хорды: вдоль хорды в долях ее длины ($1/2$ у квадратичной кривой, $1/3$ и $2/3$ у кубической) и поперек нее высотой в долях длины хорды, поэтому при перемещении концов кривая сохраняет форму. Наследуется публично от `Wall`.
+
+*Вложенные классы*:
+
+- `InvalidDegree: public std::exception` #h(1em) Исключение, выбрасывается, когда степень не 2 и не 3.
+- `InvalidHeight: public std::exception` #h(1em) Исключение, выбрасывается, когда высота контрольной точки не от -1 до 1.
+
+*Конструкторы/деструктор*:
+
+- `WallBezier(Point *start, Point *end, Room *room, int degree = 3, float firstHeight = 0.4f, float secondHeight = 0.4f)`
+
+*Поля*:
+
+private:
+
+- `int degree` #h(1em) Степень кривой.
+- `float heights[2]` #h(1em) Высоты внутренних контрольных точек (у квадратичной кривой используется первая).
+- `Vector2 controls[4]` #h(1em) Контрольные точки, включая концы.
+
+*Методы*:
+
+public:
+
+- `int getDegree()`
+- `void setDegree(int degree)`
+- `float getHeight(int index)`
+- `void setHeight(int index, float height)`
+- `const Vector2 *getControls()`
+- `Vector2 closestPoint(const Vector2 &point)`
+- `Vector2 getNormal(const Vector2 &point)` #h(1em) Нормаль слева от касательной в ближайшей точке кривой.
+- `Vector2 getPointByT(float t)` #h(1em) Точка кривой с параметром $t$.
+- `float getTByPoint(const Vector2 &point, float precision = 0.1f)` #h(1em) Параметр ближайшей точки кривой (перебор по 64 точкам и тернарный поиск).
 
 *Примечание*: для классов `Point` и `Wall` реализован паттерн "наблюдатель" c целью того, чтобы при перемещении любой точки, изменялись параметры связанных стен (это больше относится к объектам класса `WallRound`).
 
+=== Класс `Obstacle`
+
+Препятствие внутри комнаты: замкнутый контур (колонна, перегородка) или незамкнутая ломаная, например отдельное зеркало из одной стены. Стены препятствия могут быть любого вида и отражают свет с обеих сторон. Препятствия не должны пересекать стены комнаты и друг друга.
+
+*Вложенные классы*:
+
+- `InvalidShape: public std::exception` #h(1em) Исключение, выбрасывается, когда у препятствия меньше двух вершин, а у замкнутого --- меньше трех.
+
+*Конструкторы/деструктор*:
+
+- `Obstacle(Room *room, const vector<Vector2> &coords, bool closed)` #h(1em) Препятствие из прямых стен с вершинами `coords`. Если соседние вершины ближе `Room::minimalDistance`, выбрасывается `Room::PointsAreTooClose`.
+- `Obstacle(Room *room, const json &j)` #h(1em) Конструктор из JSON.
+- `~Obstacle()` #h(1em) Удаляет стены препятствия.
+
+*Поля*:
+
+private:
+
+- `vector<Point> points` #h(1em) Вершины. Место под них выделяется в конструкторе, чтобы указатели стен на вершины оставались верными.
+- `vector<Wall *> walls` #h(1em) Стены между соседними вершинами.
+- `bool closed` #h(1em) Соединена ли последняя вершина с первой.
+
+*Методы*:
+
+- `bool isClosed()`
+- `vector<Point> &getPoints()`, `vector<Wall *> &getWalls()`
+- `json toJson()` #h(1em) Возвращает JSON-объект.
+- `void draw()`
+
 === Класс `Room`
 
 Комната, представляющая собой многоугольник.
@@ -145,12 +266,21 @@ private:
 
 - `vector<Point> points` #h(1em) Вершины многоугольника.
 - `vector<Wall *> walls` #h(1em) Стены, ограничивающие комнату.
+- `vector<Obstacle *> obstacles` #h(1em) Препятствия внутри комнаты.
+- `vector<RayStart *> rayStarts` #h(1em) Начала лучей.
+- `vector<AimArea *> aims` #h(1em) Цели.
+- `vector<RayFan *> fans` #h(1em) Вееры лучей.
+- `Tracer<float> tracer` #h(1em) Снимок геометрии комнаты для интерактивной трассировки луча.
+- `Tracer<float> previous` #h(1em) Снимок до последнего обновления, с которым `update()` сравнивает новый снимок.
+- `unsigned long version` #h(1em) Счетчик изменений комнаты, цели и луча.
+- `unsigned long shapeVersion` #h(1em) Счетчик изменений стен и цели (без изменений луча).
+- `bool loading` #h(1em) Идет загрузка из JSON. Пока флаг установлен, `update()` ничего не делает, и снимок строится один раз после загрузки всех стен и препятствий.
 
 public:
 
-- `RayStart *rayStart` #h(1em) Объект луча, если не установлен~--- `nullptr`.
+- `RayStart *rayStart` #h(1em) Выбранный луч из `rayStarts`, если лучей нет~--- `nullptr`. По выбранному лучу строятся тепловая карта, карта достижимости и оценка попадания в цель.
 - `float defaultRayAngle` #h(1em) Угол по отношению к стене, с которым луч создается по умолчанию.
-- `AimArea *aim` #h(1em) Объект целевой зоны попадания луча, если не установлен --- `nullptr`.
+- `AimArea *aim` #h(1em) Выбранная цель из `aims`, если целей нет --- `nullptr`. Она служит приемником эхограммы и излучательности.
 - `const int static minimalDistance` #h(1em) Минимальное расстояние, на котором могут располагаться две точки.
 - `const int static maximumPoints` #h(1em) Максимальное число точек в комнате.
 - `const int static minimumPoints` #h(1em) Минимальное число точек в комнате.
@@ -158,22 +288,47 @@ public:
 
 *Методы*:
 
+private:
+
+- `void retrace(const vector<RayStart *> &rays, const vector<RayFan *> &fans)` #h(1em) Перестраивает деревья лучей `rays` и вееры `fans` в `std::thread::hardware_concurrency()` потоках. Лучи только читают общий снимок `tracer`, поэтому потоки разбирают их по одному через атомарный счетчик без блокировок. Вееры, как самые долгие, разбираются первыми.
+
 public:
 
-- `void addAim(const Vector2 &center, float radius = 20.0f)` #h(1em) Добавить цель радиусом `radius` и c центром в точке `center`.
-- `void moveAim(const Vector2 &newCenter)` #h(1em) Изменить центр цели.
-- `bool isRayInAim(const Vector2 &rayStart, const Vector2 &rayEnd, Vector2 &intersectionPoint)` #h(1em) Возвращает `true` и изменяет `intersectionPoint`, если луч из `rayStart` до `rayEnd` пересекает цель, иначе --- возвращает `false`.
-- `Wall *closestWall(const Vector2 &point)` #h(1em) Возвращает ближайшую стену к `point`, если она находится в зоне досягаемости мыши.
-- `RayStart *closestRay(const Vector2 &point)` #h(1em) Возвращает луч, если `point` в зоне досягаемости до вершины луча.
+- `void addAim(const Vector2 &center, float radius = 20.0f)` #h(1em) Добавить цель радиусом `radius` и c центром в точке `center` и выбрать ее.
+- `void moveAim(const Vector2 &newCenter)` #h(1em) Изменить центр выбранной цели.
+- `void removeAim(AimArea *removed)` #h(1em) Удалить цель. Если она была выбрана, выбирается последняя из оставшихся.
+- `void selectAim(AimArea *selected)`
+- `int getAimIndex()` #h(1em) Индекс выбранной цели в `getAims()` (он же индекс цели в снимке `Tracer`) или $-1$, если цель не выбрана.
+- `AimArea *closestAim(const Vector2 &point)` #h(1em) Цель, содержащая точку `point`, или `nullptr`.
+- `bool isRayInAim(const Vector2 &origin, const Vector2 &direction, float &distance)` #h(1em) Возвращает `true` и изменяет `distance` на расстояние до ближайшей цели, если луч из `origin` в направлении `direction` пересекает какую-либо цель, иначе --- возвращает `false`.
+- `const vector<AimArea *> &getAims()`
+- `const vector<RayStart *> &getRays()`
+- `const vector<RayFan *> &getFans()`
+- `Wall *closestWall(const Vector2 &point)` #h(1em) Возвращает ближайшую стену комнаты или препятствия к `point`, если она находится в зоне досягаемости мыши. Из стен препятствий проверяются только те, габарит которых находится рядом с точкой (`Tracer::findNear`).
+- `RayStart *closestRay(const Vector2 &point)` #h(1em) Возвращает луч, вершина которого ближе всех к `point` в зоне досягаемости, или `nullptr`.
+- `RayFan *closestFan(const Vector2 &point)` #h(1em) То же для вееров лучей.
 - `bool isClosed()` #h(1em) Замкнутая ли комната.
+- `bool isConvex()` #h(1em) Является ли комната замкнутым выпуклым многоугольником из прямых стен.
 - `WallLine *addWallLine(const Vector2 &coord)` #h(1em) Добавить в конец ломаной прямую стену c началом в предыдущей добавленной точке и концом в `point`. Если это первая точка, то добавляется только `point`.
 - `WallRound *addWallRound(const Vector2 &coord, float radiusCoef = 50, bool orient = false)` #h(1em) Добавить в конец ломаной cферическую стену c началом в предыдущей добавленной точке и концом в `point`. Если это первая точка, то добавляется только `point`.
-- `Wall *changeWallType(Wall *wall)` #h(1em) Изменяет тип стены `wall`.
+- `Wall *changeWallType(Wall *wall)` #h(1em) Изменяет тип стены `wall` по кругу: плоская, сферическая, эллиптическая, кривая Безье. Поверхность и доля отражения сохраняются.
+- `Wall *replaceWall(Wall *wall, Wall *replacement)` #h(1em) Заменяет стену `wall` (комнаты или препятствия) стеной `replacement` с теми же концами и удаляет `wall`. Лучи, начинавшиеся на `wall`, переносятся на новую стену. Используется при смене типа и при загрузке стен эллипсов и кривых Безье из JSON.
+- `Obstacle *addObstacle(const vector<Vector2> &coords, bool closed)` #h(1em) Добавить препятствие из прямых стен с вершинами `coords`, замкнутое, если `closed`. Отдельное зеркало --- незамкнутое препятствие из двух вершин.
+- `const vector<Obstacle *> &getObstacles()`
 - `void movePoint(Point &p, const Vector2 &coord)` #h(1em) Переместить точку `p` на заданные координаты.
 - `void draw()` #h(1em) Отрисовывать все объекты эксперимента на экране приложения.
 - `json toJson()` #h(1em) Возвращает JSON-объект.
-- `void addRay(const Vector2 &point, bool inverted = false)` #h(1em) Добавляет объект луча в ближайшую точку к `point`, которая находится на какой-либо стене, если она находится в зоне досягаемости мыши.
+- `void addRay(const Vector2 &point, bool inverted = false)` #h(1em) Добавляет луч в ближайшую точку к `point`, которая находится на какой-либо стене, если она находится в зоне досягаемости мыши, и выбирает его.
+- `void removeRay(RayStart *removed)` #h(1em) Удалить луч. Если он был выбран, выбирается последний из оставшихся.
+- `void selectRay(RayStart *selected)`
+- `RayFan *addFan(const Vector2 &point, bool inverted = false, float fromAngle = 10 * DEG2RAD, float toAngle = 170 * DEG2RAD, int count = 1000)` #h(1em) Добавляет веер из `count` лучей в ближайшую к `point` точку стены, если она в зоне досягаемости мыши. Возвращает веер или `nullptr`, если стены рядом нет.
+- `void removeFan(RayFan *removed)` #h(1em) Удалить веер.
 - `vector<Wall *> &getWalls()`
+- `const Tracer<float> &getTracer()`
+- `void update()` #h(1em) Обновляет снимок геометрии `tracer` и перетрассирует лучи. Вызывается после любого изменения стен, точек или целей. Новый снимок сравнивается с прежним (`Tracer::difference`), и перестраиваются только лучи, сегменты которых проходят через габариты измененных стен и целей (`RayTree::crosses`, `RayFan::crosses`). Если изменился набор стен, перестраиваются все лучи. Перестроение идет в нескольких потоках (`retrace`).
+- `unsigned long getVersion()` #h(1em) Счетчик изменений комнаты, цели и луча. Позволяет длительным расчетам определить, что комната изменилась.
+- `void markChanged()` #h(1em) Увеличивает счетчик изменений. Вызывается из `update()`, `clear()` и при перестроении луча.
+- `unsigned long getShapeVersion()` #h(1em) Счетчик изменений стен и цели. Увеличивается в `update()` и `clear()`, но не при перемещении или повороте луча.
 - `void clear()` #h(1em) Очистка комнаты.
 
 *Примечание*: статические поля класса `Room` инициализируются в `main.cpp`, например:
@@ -191,38 +346,45 @@ public:
 
 == `Ray.h`
 
-=== Класс `RaySegment`
+=== Класс `RayTree`
+
+Дерево луча. Луч, попавший на светоделитель, разделяется на отраженную ветвь с энергией, умноженной на `reflectance`, и прошедшую ветвь, которая продолжает направление луча с энергией, умноженной на $1 - $ `reflectance`. Прошедшая сквозь стену замкнутой комнаты ветвь выходит наружу и дальше не прослеживается. На диффузной стене ветвь обрывается: рассеянный свет уходит во все стороны и учитывается оценкой попадания, картами и излучательностью. Без светоделителей дерево вырождается в цепочку сегментов.
+
+Дерево строится в ширину: узлы выдаются пулом (`Pool`) в порядке уровней, и очередью обхода служит сам пул. Ветви, энергия которых меньше `minimalEnergy`, не продолжаются, а когда число узлов достигает бюджета `budget`, отбрасываются самые глубокие уровни. Пул сохраняет память между перестроениями, поэтому при движении луча узлы не выделяются в куче по одному. В открытой комнате с двумя светоделителями дерево из $2.3 dot 10^6$ узлов строится примерно за 0.35 с.
 
-Класс сегмента луча.
+*Вложенные классы*:
+
+- `struct Node` #h(1em) Сегмент луча: начало `start`, единичное направление `direction`, стена `fromWall`, от которой отразился луч (или `-1`), флаг столкновения `hasHit`, флаг выхода сквозь стену замкнутой комнаты `escaped`, точка `hitPoint` и стена `hitWall` столкновения (`-1` у цели), индекс цели `hitAim`, в которую попал сегмент (или `-1`), число переотражений `depth`, доля энергии `energy` и ветви `reflected`, `transmitted` (или `nullptr`).
 
 *Конструкторы/деструктор*:
 
-- `RaySegment(const Vector2 &start, const Vector2 &end, int depth == 1)` #h(1em) Конструктор сегмента луча с заданными началом и концом и аргументом числа переотражений (чтобы остановиться, если число переотражений превысило ограничение).
-- `~RaySegment()` #h(1em) рекурсивно вызывает деструктор для `next`.
+- `RayTree(long budget = 1 << 20, float minimalEnergy = 1e-3f)` #h(1em) Создает пустое дерево с бюджетом узлов `budget` и порогом энергии `minimalEnergy`.
 
 *Поля*:
 
 private:
 
-- `Vector2 start` #h(1em) Точка начала.
-- `Vector2 end` #h(1em) Точка конца.
-- `bool hasHit` #h(1em) Было ли столкновение со стеной.
-- `Vector2 hitPoint` #h(1em) Точка столкновения (если есть).
-- `Wall *hitWall` #h(1em) Стена, с которой произошло столкновение.
-- `RaySegment *next` #h(1em) Следующий сегмент луча.
-- `int depth` #h(1em) Число переторажений.
+- `Pool<Node> nodes` #h(1em) Узлы в порядке обхода в ширину.
+- `long budget` #h(1em) Наибольшее число узлов.
+- `float minimalEnergy` #h(1em) Энергия, ниже которой ветви не продолжаются.
+- `bool truncated` #h(1em) Были ли ветви отброшены из-за бюджета.
 
 *Методы*:
 
 private:
 
-- `Vector2 intersectionWithWallLine(WallLine *wall)` #h(1em) Вычисляет пересечение луча с WallLine, если пересечения нет, возвращает `{NAN, NAN}`.
-- `Vector2 intersectionWithWallRound(WallRound *wall)` #h(1em) Вычисляет пересечение луча с WallRound, если пересечения нет, возвращает `{NAN, NAN}`.
+- `Node *add(const Vector2 &start, const Vector2 &direction, int fromWall, int depth, float energy)` #h(1em) Берет из пула новый узел или возвращает `nullptr`, если энергия меньше порога или бюджет исчерпан.
 
 public:
 
-- `void updateParameters(Room *room)` #h(1em) Обновляет параметры луча, в процессе пересчета рекурсивно вызывает кострукторы `RaySegment`.
-- `void draw() const` #h(1em) Отрисывовывает сегмент луча в окне приложения.
+- `void build(Room *room, const Vector2 &start, const Vector2 &direction, int fromWall, int depth)` #h(1em) Строит дерево луча при помощи `Room::getTracer()`, ветви прослеживаются не более чем на `depth` отражений.
+- `const Node *getRoot() const` #h(1em) Первый сегмент луча (или `nullptr`).
+- `size_t size() const` #h(1em) Число узлов.
+- `bool isTruncated() const`
+- `float getAimEnergy(int aim) const` #h(1em) Доля энергии луча, попавшая в цель с индексом `aim`. Луч, попавший в цель, в ней заканчивается, поэтому доли по всем целям в сумме не больше 1.
+- `bool crosses(const vector<Tracer<float>::Box> &boxes) const` #h(1em) Проходит ли какой-либо сегмент через один из прямоугольников `boxes`, расширенных на 1 во все стороны. Сегмент, не встретивший стен, считается бесконечным.
+- `void clear()`
+- `void draw() const` #h(1em) Отрисовывает все сегменты, ослабленные сегменты --- прозрачнее.
 
 === Класс `RayStart`
 
@@ -236,7 +398,6 @@ public:
 *Конструкторы/деструктор*:
 
 - `RayStart(const Vector2 &point, Wall *wall, float angle, bool inverted = false)` #h(1em) Конструктор луча.
-- `~RayStart()` #h(1em) Удаляет все элементы луча.
 
 *Поля*:
 
@@ -246,7 +407,7 @@ private:
 - `float angle` #h(1em) Угол в градусах $alpha in [1 degree, 179 degree]$ относительно родительской стены.
 - `Wall *wall` #h(1em) Родительская стена.
 - `float t` #h(1em) Параметр $t in [0, 1]$, задающий положение точки начала луча на родительской стене.
-- `RaySegment *ray` #h(1em) Следующий сегмент луча.
+- `RayTree tree` #h(1em) Сегменты луча.
 - `bool inverted` #h(1em) Использовать ли инвертированный вектор нормали к стене (например, чтобы луч был направлен не внутрь комнаты, а из нее).
 
 *Методы*:
@@ -256,15 +417,97 @@ public:
 - `float getAngle()`
 - `Vector2 getStart()`
 - `Wall *getWall()`
+- `float getT()`
+- `bool isInverted()`
+- `const RayTree &getTree()`
+- `Vector2 getDirection(float angle)` #h(1em) Направление луча, выходящего из начала под углом `angle` к стене.
 - `void setAngle(float angle)`
-- `void setWall(Wall *wall)`
+- `void setT(float t)` #h(1em) Перемещает начало луча в точку стены с параметром $t in (0, 1)$. На концах стены выбрасывает `CantStartInCorner`.
+- `void setWall(Wall *wall)` #h(1em) Переносит луч на другую стену. Сегменты перестраиваются при обновлении комнаты.
 - `void inverseT()` #h(1em) Инвертирует параметр $t$.
 - `void inverseDirection()` #h(1em) Инвертирует направление луча (внутрь комнаты или из неё).
-- `void updateRaySegments()` #h(1em) Обновляет параметры сегментов луча.
-- `void updateParams()` #h(1em) Обновляет параметры.
+- `void updateRaySegments()` #h(1em) Перестраивает дерево луча (не более `Room::maximumRayDepth` отражений).
+- `void updateParams()` #h(1em) Обновляет параметры и отмечает изменение комнаты.
+- `void retrace()` #h(1em) Пересчитывает начало луча по параметру $t$ и перестраивает дерево по текущему снимку комнаты, не отмечая ее изменение. Лучи разных начал можно перестраивать одновременно в нескольких потоках.
 - `json toJson()` #h(1em) Возвращает JSON-объект.
 - `void draw()` #h(1em) Отрисовывает луч в окне приложения.
 
+=== Класс `RayFan`
+
+Веер лучей: `count` лучей из одной точки стены под углами, равномерно распределенными от `fromAngle` до `toAngle`. Лучи трассируются пакетами по `Tracer::packetSize` (`Tracer::tracePacket`). После каждого отражения лучи упорядочиваются по стене, от которой отразились, и пакет составляется из соседних лучей одной стены, поэтому пакет, лучи которого попали на разные стены, распадается на несколько. Лучи веера не ветвятся: светоделитель для них --- зеркало с долей отражения `reflectance`. Луч обрывается в цели, на диффузной стене, после `Room::maximumRayDepth` отражений или когда его энергия становится меньше $10^(-3)$.
+
+В адаптивном режиме углы выбираются по дифференциалам лучей (`Tracer::Differential`): для луча под углом $alpha$ находится наибольшая по пути скорость $v$ смещения точек отражения при изменении угла (в пикселях на радиан), и следующий луч берется с шагом $tau \/ v$, где $tau$ --- допустимое расстояние `tolerance` между соседними лучами. Если у следующего луча скорость больше чем вдвое превышает допустимую для шага, шаг уменьшается. Так лучи сгущаются там, где семейство расходится, и разреживаются там, где оно сходится или проходит мало стен. Расстояние не ограничивается для отрезков, уходящих в бесконечность, и на границах, где соседние лучи попадают на разные стены. Число лучей не превышает `maximumCount`.
+
+*Вложенные классы*:
+
+- `struct Segment { Vector2 start; Vector2 end; float energy; bool hasHit; }` #h(1em) Отрезок пути одного из лучей. `energy` --- доля энергии луча на отрезке, `hasHit` --- закончился ли отрезок на стене или в цели; иначе отрезок уходит в бесконечность, и `end` --- точка для рисования.
+- `InvalidCount: public std::exception` #h(1em) Исключение, выбрасывается, когда число лучей не от 1 до `maximumCount`.
+- `InvalidTolerance: public std::exception` #h(1em) Исключение, выбрасывается, когда точность не от `minimalTolerance` до `maximumTolerance`.
+
+*Конструкторы/деструктор*:
+
+- `RayFan(const Vector2 &point, Wall *wall, float fromAngle, float toAngle, int count, bool inverted = false)` #h(1em) Конструктор веера. Выбрасывает `RayStart::CantStartInCorner`, `RayStart::InvalidAngle` и `InvalidCount`.
+
+*Поля*:
+
+public:
+
+- `static const int maximumCount` #h(1em) Наибольшее число лучей (10000).
+- `static constexpr float minimalTolerance`, `static constexpr float maximumTolerance` #h(1em) Пределы точности адаптивного выбора углов (0.5 и 100 пикселей).
+
+private:
+
+- `Vector2 start` #h(1em) Точка начала лучей.
+- `Wall *wall` #h(1em) Родительская стена.
+- `float t` #h(1em) Параметр точки начала на стене.
+- `float fromAngle`, `float toAngle` #h(1em) Углы крайних лучей относительно стены $in [1 degree, 179 degree]$.
+- `int count` #h(1em) Число лучей при равномерном выборе углов.
+- `bool inverted` #h(1em) Использовать ли инвертированный вектор нормали к стене.
+- `bool adaptive` #h(1em) Выбираются ли углы лучей адаптивно.
+- `float tolerance` #h(1em) Допустимое расстояние между соседними лучами в адаптивном режиме (по умолчанию 5 пикселей).
+- `vector<float> angles` #h(1em) Углы лучей при последнем перестроении.
+- `vector<Segment> segments` #h(1em) Отрезки всех лучей.
+- `Caustic caustic` #h(1em) Каустики семейства лучей веера.
+- `bool causticShown` #h(1em) Строятся ли каустики при перестроении веера.
+
+*Методы*:
+
+public:
+
+- `Vector2 getStart()`
+- `Wall *getWall()`
+- `float getT()`
+- `float getFromAngle()`
+- `float getToAngle()`
+- `int getCount()`
+- `bool isInverted()`
+- `bool isAdaptive()`
+- `float getTolerance()`
+- `const vector<float> &getAngles()`
+- `const vector<Segment> &getSegments()`
+- `const Caustic &getCaustic()`
+- `bool isCausticShown()`
+- `void setCausticShown(bool shown)` #h(1em) Включает или выключает построение каустик и перестраивает веер.
+- `Vector2 getDirection(float angle)` #h(1em) Направление луча под углом `angle` к стене.
+- `void setAngles(float fromAngle, float toAngle)`
+- `void setCount(int count)`
+- `void setAdaptive(bool adaptive)` #h(1em) Включает или выключает адаптивный выбор углов и перестраивает веер.
+- `void setTolerance(float tolerance)` #h(1em) Задает допустимое расстояние между соседними лучами и перестраивает веер. Выбрасывает `InvalidTolerance`.
+- `void setT(float t)` #h(1em) Перемещает начало веера в точку стены с параметром $t in (0, 1)$.
+- `void setWall(Wall *wall)` #h(1em) Переносит веер на другую стену. Лучи перестраиваются при обновлении комнаты.
+- `void inverseT()`
+- `void inverseDirection()`
+- `void updateParams()` #h(1em) Отмечает изменение комнаты и перестраивает лучи.
+- `void retrace()` #h(1em) Перестраивает лучи по текущему снимку комнаты, не отмечая ее изменение, как `RayStart::retrace`.
+- `bool crosses(const vector<Tracer<float>::Box> &boxes) const` #h(1em) Проходит ли какой-либо отрезок веера или путь луча каустик через один из прямоугольников `boxes`.
+- `json toJson()` #h(1em) Возвращает JSON-объект.
+
+private:
+
+- `float spread(const Tracer<float> &tracer, int startWall, float angle)` #h(1em) Наибольшая скорость смещения точек отражения луча под углом `angle` при изменении угла, в пикселях на радиан. Дифференциал луча переносится через отражения `Tracer::reflectDifferential`.
+- `void chooseAngles(const Tracer<float> &tracer, int startWall)` #h(1em) Заполняет `angles`: равномерно `count` углов или адаптивно с шагом, при котором соседние лучи расходятся не больше чем на `tolerance`.
+- `void draw()` #h(1em) Отрисовывает веер и его каустики. Лучи тем прозрачнее, чем их больше и чем меньше их энергия.
+
 === Класс `AimArea`
 
 Класс целевой зоны попадания луча (круг).
@@ -287,7 +530,7 @@ public:
 - `Vector2 getCenter()`
 - `float getRadius()`
 - `void setCenter(const Vector2 &center)`
-- `bool intersectsWithRay(const Vector2 &rayStart, const Vector2 &rayEnd, Vector2 &intersectionPoint)` #h(1em) Возвращает `true` и изменяет `intersectionPoint`, если луч от `rayStart` до `rayEnd` попадает в зону. Иначе --- возвращает `false`.
+- `bool intersectsWithRay(const Vector2 &origin, const Vector2 &direction, float &distance)` #h(1em) Возвращает `true` и изменяет `distance`, если луч из `origin` в направлении `direction` попадает в зону. Иначе --- возвращает `false`.
 - `bool containsPoint(const Vector2 &point)` #h(1em) Проверка, находится ли точка внутри области.
 - `json toJson()` #h(1em) Возвращает JSON-объект.
 - `void draw()` #h(1em) Отрисовывает зону в окне приложения.
@@ -298,6 +541,669 @@ public:
   #image("src/room_graph.jpg", width: 25em)
 ]
 
+== `Geometry.h`
+
+Шаблонные функции геометрии, параметризованные скалярным типом `T` (`float`, `double` или `long double`).
+
+- `struct Vec2<T>` #h(1em) Двумерный вектор, преобразуется из `Vector2` и обратно методом `toVector2()`.
+- `T dot(a, b)`, `T cross(a, b)`, `T length(v)`, `Vec2<T> normalize(v)` #h(1em) Операции над векторами.
+- `T lineIntersection(origin, dir, a, b)` #h(1em) Расстояние вдоль луча до отрезка `[a, b]` или бесконечность.
+- `bool circleIntersection(origin, dir, center, radius, t1, t2)` #h(1em) Корни пересечения луча с окружностью.
+- `Vec2<T> inverseDirection(dir)` #h(1em) Покомпонентно обратный вектор направления, нулевые компоненты заменяются положительной бесконечностью.
+- `T boxDistance(origin, inverse, low, high, maxDistance)` #h(1em) Расстояние вдоль луча до входа в прямоугольник `[low, high]` (0, если начало луча внутри) или бесконечность, если луч не входит в него ближе `maxDistance`. Используется для габаритов кривых Безье и узлов иерархии габаритов.
+- `Vec2<T> reflect(dir, normal)` #h(1em) Отражение направления относительно нормали.
+- `bool arcContains(diff, middle, cosHalfSpan)` #h(1em) Лежит ли направление `diff` от центра внутри дуги. Не использует тригонометрию и корни.
+- `T arcParameter(diff, middle, span)` #h(1em) Параметр $t in [0, 1]$ для направления внутри дуги.
+- `bool ellipseIntersection(origin, dir, center, axis, a, b, t1, t2)` #h(1em) Корни пересечения луча с эллипсом с полуосью `a` вдоль `axis` и `b` поперек. В координатах, где эллипс становится единичной окружностью, уравнение остается квадратным.
+- `Vec2<T> bezierPoint(p, degree, t)`, `Vec2<T> bezierTangent(p, degree, t)`, `Vec2<T> bezierSecond(p, degree, t)` #h(1em) Точка, касательная и вторая производная кривой Безье степени 2 или 3.
+- `void bezierPart(p, degree, t0, t1, q)` #h(1em) Контрольные точки части кривой на промежутке $[t_0, t_1]$ (алгоритм де Кастельжо).
+- `T bezierClip(p, degree, origin, dir, minDistance, accept, parameter)` #h(1em) Ближайшее пересечение луча с кривой Безье дальше `minDistance`, принятое функцией `accept(t, point)`, методом отсечения Безье. Выпуклая оболочка расстояний контрольных точек до прямой луча сужает промежуток параметра, при слабом сужении промежуток делится пополам. Если расстояния меняют знак один раз, корень на промежутке единственный и уточняется методом Ньютона. Части позади начала луча и дальше найденного пересечения отбрасываются.
+
+== `Tracer.h`
+
+=== Шаблон класса `Tracer<T>`
+
+Трассировщик лучей по снимку геометрии комнаты. Снимок хранит стены в виде простых структур, поэтому не требует виртуальных вызовов и может одновременно использоваться из нескольких потоков. Шаблон инстанцируется в `Tracer.cpp` для `float` (интерактивная отрисовка), `double` и `long double` (длительные расчеты).
+
+Стены контура комнаты идут в снимке первыми, за ними --- стены препятствий в порядке `Room::getObstacles()`. Стены препятствий отражают свет с обеих сторон, как стены незамкнутой комнаты.
+
+*Вложенные классы*:
+
+- `struct Hit` #h(1em) Результат поиска столкновения: индекс стены `wall`, расстояние `distance`, точка `point`, параметр точки на кривой Безье `parameter`, флаг попадания в цель `aim` и индекс цели `target` (`-1`, если луч попал в стену).
+- `struct Box` #h(1em) Габаритный прямоугольник `[low, high]`.
+- `struct Differential` #h(1em) Производные начала `origin` и направления `dir` луча по параметру семейства лучей, например по углу выхода из общего начала.
+
+*Поля*:
+
+public:
+
+- `static constexpr float unboundedLength` #h(1em) Длина, до которой рисуется путь луча, не встретившего стен (10000). Используется деревом и веером лучей и каустиками.
+
+*Методы*:
+
+public:
+
+- `void update(Room *room)` #h(1em) Обновляет снимок геометрии комнаты.
+- `int indexOf(Wall *wall) const` #h(1em) Индекс стены в снимке или `-1`.
+- `void findNear(const Vec2<T> &point, T radius, vector<int> &found) const` #h(1em) Индексы стен препятствий, габарит которых ближе `radius` к точке `point`.
+- `Wall *getWall(int index) const`
+- `size_t wallsCount() const`
+- `bool isConvex() const` #h(1em) Выпуклая ли комната в снимке.
+- `void ignoreAim()` #h(1em) Цели перестают задерживать лучи (в расчетах, где они только принимают свет).
+- `size_t aimsCount() const` #h(1em) Число целей в снимке. Луч проверяется со всеми целями, и ближайшая задерживает его.
+- `bool difference(const Tracer &previous, vector<Box> &changed) const` #h(1em) Габариты стен, форма или поверхность которых отличается от снимка `previous` той же комнаты, и кругов появившихся, исчезнувших или сдвинутых целей --- до и после изменения. Возвращает `false`, если изменился набор стен или замкнутость комнаты.
+
+*Примечание*: в снимке четыре вида стен: прямые, дуги, эллиптические дуги и кривые Безье. Пересечение с эллипсом находится аналитически, с кривой Безье --- отсечением Безье (`bezierClip`) после проверки габаритного прямоугольника. Выпуклая кривая Безье, выгнутая внутрь комнаты, не может снова попасть под отразившийся от нее луч, и такая проверка пропускается.
+
+*Примечание*: при обновлении снимка замкнутая комната триангулируется отсечением ушей. Кривые стены заменяются хордами: выпуклая наружу кривая лежит вне многоугольника хорд, и луч, вышедший через хорду, пересекается с самой кривой. Вогнутая кривая заходит внутрь многоугольника, поэтому она привязывается ко всем треугольникам, которые пересекает ее габаритный прямоугольник, и проверяется при проходе через них. Расстояние до такой кривой запоминается на весь обход. Если хорды пересекают другие стены, триангуляция не строится.
+
+*Примечание*: для стен препятствий строится иерархия габаритных прямоугольников: стены делятся пополам по центрам габаритов вдоль более длинной стороны, в листе не больше двух стен. Узлы обходятся в глубину, из двух потомков первым --- тот, в который луч входит раньше, а узлы дальше уже найденного пересечения пропускаются. У комнаты больше чем из восьми стен такая же иерархия строится для стен контура.
+- `bool trace(const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit) const` #h(1em) Ищет ближайшее столкновение луча, исключая стену `fromWall`, от которой он отразился. Точка столкновения проецируется на стену. Если луч отразился точно в углу и уходит наружу, он отражается от соседней стены. В выпуклой комнате стена, через которую выходит луч, находится бинарным поиском по вершинам за $O(log n)$. В остальных замкнутых комнатах луч проходит по соседним треугольникам триангуляции, пока не достигнет стены, поэтому время отражения пропорционально числу пересеченных треугольников. Луч, выходящий из стены препятствия или не со стены, ищет стену большой комнаты по иерархии габаритов. В комнатах не более чем из восьми стен и в случае, если ни один из быстрых способов не сработал, проверяются все стены. Редактор ограничивает комнату `Room::maximumPoints` (9) точками, поэтому быстрые способы для стен контура включаются только у замкнутой комнаты из девяти стен, а иерархия препятствий --- при любом их числе. Быстрые способы сверяются с `traceScan` программой `tests/TracerCheck.cpp` (`ctest`). Затем по иерархии габаритов ищутся препятствия, которые ближе найденной стены комнаты. Полный перебор специализирован шаблоном по видам стен, присутствующих в комнате: в комнате из одних прямых или одних дуг он не содержит ветвлений по виду стены, эллипсы и кривые Безье перебираются отдельным списком. Вариант перебора выбирается при обновлении снимка.
+- `bool traceScan(const Vec2<T> &origin, const Vec2<T> &dir, int fromWall, Hit &hit) const` #h(1em) То же, что `trace`, но перебором всех стен контура и препятствий, без бинарного поиска, триангуляции и иерархий габаритов. Эталон для проверки быстрых способов.
+- `void tracePacket(const Packet &packet, Hit hits[], bool found[]) const` #h(1em) Ищет столкновения до `packetSize` (8) лучей пакета `Packet { int count; Vec2<T> origin[packetSize]; Vec2<T> dir[packetSize]; int fromWall[packetSize]; }`, `found[k]` --- было ли столкновение у луча `k`. Лучи вместе перебирают стены и обходят иерархии габаритов: узел пропускается, только если в него не входит ни один луч, а потомки упорядочиваются по направлению первого луча. Данные лучей хранятся по отдельным массивам координат, и прямые стены проверяются циклом по лучам без ветвлений, который компилятор векторизует. Кривые стены проверяются для каждого луча по отдельности. Результат тот же, что у `trace`, кроме выбора стены при попадании точно в вершину. Выгоднее всего, когда лучи пакета начинаются на одной стене и имеют близкие направления.
+- `Vec2<T> getNormal(int wall, const Vec2<T> &point, T parameter = 0) const` #h(1em) Нормаль стены в точке `point`, у кривой Безье --- в точке с параметром `parameter`.
+- `T getParameter(int wall, const Vec2<T> &point, T parameter = 0) const` #h(1em) Параметр точки стены в параметризации `Wall::getPointByT`: у прямой --- проекция, у дуги --- угол от середины дуги, деленный на ее угловую длину, у эллипса --- угол $phi$ точки $c + a cos phi + b sin phi$, параметр $1 - phi / pi$, у кривой Безье --- `parameter` из `Hit`.
+- `T getReflectance(int wall) const` #h(1em) Доля отраженного света стены.
+- `T getTransmittance(int wall) const` #h(1em) Доля света, проходящего сквозь светоделитель (0 у остальных стен).
+- `bool isDiffuse(int wall) const` #h(1em) Рассеивает ли стена свет по закону Ламберта.
+- `bool isClosed() const` #h(1em) Замкнута ли комната в снимке.
+- `bool isBoundary(int wall) const` #h(1em) Лежит ли стена на контуре замкнутой комнаты. Луч, прошедший сквозь такую стену, покидает комнату, а сквозь препятствие --- остается в ней.
+- `bool scatter(const Hit &hit, Vec2<T> &dir, T u, T v, T &energy) const` #h(1em) Продолжение одного пути после столкновения при случайных `u`, `v` из $[0, 1)$: светоделитель отражает луч с вероятностью, равной доле отражения (при `u` меньше нее), и иначе пропускает его, не меняя энергию, остальные стены отражают луч и умножают энергию на долю отражения. Так оценки `HitEstimator` и `Heatmap` остаются несмещенными. Зеркальная стена и светоделитель отражают зеркально, диффузная --- по закону Ламберта: луч уходит в ту сторону стены, с которой пришел, и синус угла к нормали равен $2v - 1$, то есть плотность направлений пропорциональна косинусу угла. Рассеяние одного луча проверяется в `tests/TracerCheck.cpp`. Возвращает `false`, если луч прошел сквозь стену контура замкнутой комнаты и покинул ее.
+- `Vec2<T> reflect(const Hit &hit, const Vec2<T> &dir) const` #h(1em) Направление луча после отражения.
+- `Differential reflectDifferential(const Hit &hit, const Vec2<T> &dir, const Differential &differential) const` #h(1em) Производные отраженного луча, начинающегося в точке `hit`, по производным падающего луча. Смещение точки луча на расстоянии `hit.distance` дополняется сдвигом вдоль луча, чтобы точка осталась на стене, а производная нормали находится по кривизне стены: у прямой она равна нулю, у дуги --- смещению точки, деленному на радиус, у эллипса и кривой Безье --- из производной градиента или касательной. Поэтому перенос точен для стен всех видов.
+- `static bool crosses(const Vec2<T> &origin, const Vec2<T> &dir, T length, const vector<Box> &boxes)` #h(1em) Проходит ли отрезок луча длиной `length` через один из прямоугольников, расширенных на единицу.
+
+== `Heatmap.h`
+
+=== Класс `Heatmap`
+
+Карта освещенности комнаты. Лучи выпускаются из начала луча комнаты, и в каждой ячейке сетки накапливается суммарная длина прошедших через нее отрезков, умноженная на энергию луча. Энергия умножается на долю отражения стены при каждом отражении. Луч веера с энергией меньше 0.1 продолжается с вероятностью, равной отношению энергии к 0.1, и тогда его энергия становится равной 0.1 (русская рулетка), поэтому слабые лучи не тратят время, а карта остается несмещенной. Решение рулетки определяется хешем номеров луча и отражения и не зависит от числа потоков. Одна траектория прослеживается без рулетки, пока энергия не упадет ниже $10^(-6)$. Сетка покрывает габаритный прямоугольник стен. Расчет ведется в `double` при помощи `Tracer<double>` и распределяется по потокам: у каждого потока своя сетка, сетки складываются при обновлении изображения. Отрезок добавляется в сетку обходом по столбцам вдоль оси, по которой он длиннее, так что в каждом столбце он проходит не более чем через две ячейки.
+
+Расчет идет порциями: `step()` трассирует лучи в течение заданного времени и обновляет одну полосу изображения, поэтому карта уточняется по кадрам, не останавливая редактор. Лучи веера берутся в порядке последовательности ван дер Корпута, так что уже первые порции равномерно покрывают все углы. Если версия комнаты (`Room::getVersion()`) изменилась, расчет начинается заново, а если луч удален --- карта очищается.
+
+*Вложенные классы*:
+
+- `class NoRayStart` #h(1em) Исключение, выбрасывается, если в комнате нет луча.
+
+*Конструкторы/деструктор*:
+
+- `Heatmap(int width = 1024, int height = 1024)` #h(1em) Создает пустую карту с сеткой `width` на `height` ячеек.
+- `~Heatmap()` #h(1em) Освобождает текстуру. Должен вызываться до `CloseWindow()`.
+
+*Поля*:
+
+private:
+
+- `int width`, `int height` #h(1em) Размеры сетки.
+- `Rectangle bounds` #h(1em) Область комнаты, покрываемая сеткой.
+- `vector<float> density` #h(1em) Накопленная длина лучей в ячейках.
+- `vector<vector<float>> grids` #h(1em) Сетки потоков.
+- `Room *room` #h(1em) Комната, для которой идет расчет (`nullptr`, если расчета нет).
+- `unsigned long roomVersion` #h(1em) Версия комнаты на момент начала расчета.
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты.
+- `long targetBounces` #h(1em) Требуемое число отражений.
+- `long totalBounces` #h(1em) Число отражений, учтенных в карте.
+- `static constexpr int refreshRows` #h(1em) Число строк изображения, обновляемых за одну порцию.
+- `vector<Color> palette` #h(1em) Таблица цветов логарифмической шкалы.
+- `vector<Color> pixels` #h(1em) Изображение карты.
+- `Texture2D texture` #h(1em) Текстура для отображения поверх комнаты.
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, long bounces, bool fan = true, int depth = 100)` #h(1em) Начинает расчет карты по `bounces` отражениям. Если `fan == true`, из начала луча выпускается веер из `bounces / depth` лучей по всем углам от стены, каждый прослеживается на `depth` отражений. Иначе рассчитывается одна траектория под углом начала луча (в одном потоке).
+- `void step(double budget)` #h(1em) Продолжает расчет в течение `budget` миллисекунд.
+- `void compute(Room *room, long bounces, bool fan = true, int depth = 100)` #h(1em) Рассчитывает карту целиком.
+- `bool isActive()` #h(1em) Идет ли (или завершен) расчет.
+- `bool isReady()` #h(1em) Есть ли в карте хотя бы одно отражение.
+- `bool isDone()` #h(1em) Завершен ли расчет.
+- `long getBounces()`
+- `float getProgress()` #h(1em) Доля выполненной работы.
+- `void clear()` #h(1em) Останавливает расчет и очищает карту.
+- `void draw()` #h(1em) Отрисовывает карту поверх области комнаты.
+- `void exportImage(const char *path)` #h(1em) Сохраняет карту в PNG.
+
+== `Illumination.h`
+
+=== Класс `Illumination`
+
+Освещение комнаты точечным источником, помещенным в любую точку внутри нее. Если все стены прямые, освещенные после $k$ отражений области строятся точно по дереву пучков (`BeamTracer`): многоугольник видимости источника, затем области за каждым освещенным участком стены, видимые из зеркального изображения источника, и так далее до заданного числа отражений. Число пучков растет с порядком экспоненциально, поэтому оно ограничено.
+
+Если в комнате есть дуги, освещенные области оцениваются веером из $2^13$ лучей, которые прослеживаются `Tracer<double>` в нескольких потоках.
+
+Области отмечаются на сетке, покрывающей комнату. Ячейки внутри комнаты, не освещенные ни одним порядком, образуют темные области, которые рисуются темно-синим. Считаются их число и доля площади комнаты. Ячейки внутри замкнутых препятствий, как и вне комнаты, отмечаются `outside` и в площадь не входят: внутренность определяется правилом четности по контуру комнаты и контурам замкнутых препятствий. Текстура сетки загружается при первой отрисовке после расчета, поэтому расчет не требует графического контекста и проверяется программой `tests/IlluminationCheck.cpp` (`ctest`) на комнате с колонной. Области изменяются, если изменились стены (`Room::getShapeVersion()`).
+
+*Вложенные классы*:
+
+- `struct Region` #h(1em) Освещенная область: порядок отражения `order` и выпуклый многоугольник `polygon`.
+- `class NotClosed` #h(1em) Исключение, выбрасывается, если комната не замкнута.
+- `class OutsideRoom` #h(1em) Исключение, выбрасывается, если источник вне комнаты или внутри замкнутого препятствия.
+
+*Конструкторы/деструктор*:
+
+- `Illumination(int width = 512, int height = 512)` #h(1em) Создает пустое освещение с сеткой `width` на `height` ячеек.
+- `~Illumination()` #h(1em) Освобождает текстуру. Должен вызываться до `CloseWindow()`.
+
+*Поля*:
+
+public:
+
+- `static constexpr unsigned char dark`, `static constexpr unsigned char outside` #h(1em) Значения неосвещенной ячейки и ячейки вне комнаты.
+
+private:
+
+- `Vector2 source` #h(1em) Положение источника.
+- `int orders` #h(1em) Наибольшее число отражений.
+- `bool exact` #h(1em) Построены ли области точно.
+- `vector<Region> regions` #h(1em) Освещенные области.
+- `vector<unsigned char> cells` #h(1em) Наименьший порядок освещения ячеек сетки.
+- `float darkFraction`, `int darkRegions` #h(1em) Доля площади комнаты в тени и число темных областей.
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, Vector2 source, int orders = 3)` #h(1em) Помещает источник в точку `source` и строит освещенные области для числа отражений от 0 до `orders`.
+- `bool update()` #h(1em) Перестраивает области, если изменились стены. Возвращает `true`, если области были перестроены.
+- `bool isActive()`, `bool isExact()`, `Vector2 getSource()`
+- `const vector<Region> &getRegions()`
+- `unsigned char getCell(int x, int y)` #h(1em) Наименьший порядок освещения ячейки, `dark` или `outside`.
+- `float getDarkFraction()`, `int getDarkRegions()`
+- `void clear()` #h(1em) Убирает источник.
+- `void draw()` #h(1em) Отрисовывает освещенные и темные области и источник.
+
+== `BeamTracer.h`
+
+=== Класс `BeamTracer`
+
+Трассировка пучков в комнате из прямых стен. Пучок --- изображение источника в стенах и окно (участок стены), через которое от изображения проходит свет или звук. Участки стен, видимые из изображения в пределах окна, находятся угловым заметанием за $O(n log n)$: концы стен сортируются по углу, а стены, которые пересекает текущее направление, хранятся в упорядоченном по расстоянию множестве. Стены между изображением и окном отсекаются прямой окна, стены вне угла окна отбрасываются до сортировки. Каждый видимый участок становится окном пучка следующего порядка, так строится дерево пучков. Снимок стен можно использовать из нескольких потоков. Дуги заменяются хордами. Стены препятствий входят в снимок после стен комнаты в том же порядке, что и в `Tracer`, поэтому отбрасывают тени и отражают пучки с обеих сторон.
+
+*Вложенные классы*:
+
+- `struct Beam` #h(1em) Пучок: изображение `source`, стена отражения `wall` (`-1` у самого источника), концы окна `a`, `b` и число отражений `order`.
+- `struct Piece` #h(1em) Участок стены `wall`, видимый в пределах пучка: концы `start`, `end` и соответствующие точки окна `windowStart`, `windowEnd`.
+
+*Методы*:
+
+public:
+
+- `void update(Room *room)` #h(1em) Обновляет снимок стен комнаты.
+- `size_t wallsCount()`, `bool hasArcs()`
+- `const Vec2<double> &getStart(int wall)`, `const Vec2<double> &getEnd(int wall)` #h(1em) Концы стены в снимке.
+- `Beam root(const Vec2<double> &source)` #h(1em) Пучок самого источника.
+- `vector<Piece> sweep(const Beam &beam)` #h(1em) Участки стен, видимые в пределах пучка, в порядке обхода против часовой стрелки.
+- `Beam reflect(const Beam &beam, const Piece &piece)` #h(1em) Пучок, отраженный от участка `piece`.
+- `vector<Vec2<double>> region(const Piece &piece, const Beam &beam)` #h(1em) Выпуклая область, освещенная через участок.
+- `bool contains(const Piece &piece, const Beam &beam, const Vec2<double> &point)` #h(1em) Лежит ли точка в этой области.
+
+== `Echogram.h`
+
+=== Класс `Echogram`
+
+Эхограмма (импульсный отклик) методом мнимых источников. Комната рассматривается как план помещения, стены --- как звукоотражающие перегородки. Изображения источника перебираются по дереву пучков `BeamTracer`, поэтому учитываются только изображения, видимые через свое окно, и для каждого пути до центра цели запоминаются время прихода и амплитуда. Дерево строится в ширину, пока пучков не хватит на все потоки, затем потоки обходят поддеревья в глубину. Пучки, окна которых дальше, чем звук проходит за заданное время, не продолжаются. Работает только для комнат из прямых стен.
+
+*Вложенные классы*:
+
+- `struct Arrival` #h(1em) Приход: время `time` в секундах, амплитуда `amplitude` (относительно амплитуды в 1 м от источника), число отражений `order` и изображение источника `image`.
+- `class NoAim` #h(1em) Исключение, выбрасывается, если в комнате нет цели.
+- `class HasArcs` #h(1em) Исключение, выбрасывается, если в комнате есть дуги.
+
+*Поля*:
+
+public:
+
+- `static constexpr double speedOfSound` #h(1em) Скорость звука, 343 м/с.
+- `static constexpr double metersPerPixel` #h(1em) Масштаб плана, 1 см в пикселе.
+
+*Методы*:
+
+public:
+
+- `void compute(Room *room, Vector2 source, int orders = 20, double duration = 0.5, double reflection = 0.9)` #h(1em) Рассчитывает приходы от источника `source` в центр цели не более чем с `orders` отражениями и не позже `duration` секунд. Амплитуда обратно пропорциональна длине пути и умножается на `reflection` при каждом отражении.
+- `const vector<Arrival> &getArrivals()` #h(1em) Приходы в порядке времени.
+- `long getBeams()` #h(1em) Число рассмотренных пучков.
+- `void exportCsv(const char *path)` #h(1em) Сохраняет эхограмму в CSV (`time_s,amplitude,order`).
+
+== `Radiosity.h`
+
+=== Класс `Radiosity`
+
+Излучательность (radiosity) в плоской комнате с диффузными стенами. Стены делятся на участки (патчи) длиной не больше `patchLength`, но не более 4096 патчей. Между каждой парой патчей считается плоский форм-фактор по правилу перекрещенных нитей: $F_(i j) = ((|a_i a_j| + |b_i b_j|) - (|a_i b_j| + |b_i a_j|)) / (2 L_i)$, умноженный на долю видимых пар точек патчей. Источник света точечный, мощности 1. Диффузные стены рассеивают долю `reflectance` падающего света, зеркальные стены и светоделители в этой модели свет только принимают. Излучательность находится итерациями Гаусса-Зейделя $B_i = rho_i (E_i + sum_j F_(i j) B_j)$.
+
+Стены препятствий тоже делятся на патчи: у замкнутого препятствия нормали направлены наружу, а его контур обходится навстречу контуру комнаты, чтобы комната лежала по одну сторону от всех патчей, как требует правило нитей. Незамкнутое препятствие получает патчи на каждую сторону стены с противоположными нормалями. Источник внутри замкнутого препятствия считается вне комнаты.
+
+Форм-факторы считаются в нескольких потоках построчно. Строка сначала заполняется без учета препятствий функцией `unoccludedRow`: цикл по отдельным массивам координат патчей, в котором условия видимости умножаются на форм-фактор вместо ветвления, и пары патчей, не обращенных друг к другу, получают ноль. GCC векторизует этот цикл при `-O3` (сборка `Release`, тип сборки CMake по умолчанию) с `-fno-math-errno`, который `CMakeLists.txt` задает для `Radiosity.cpp`: без него `sqrt` считается изменяющим память. В комнате из прямых стен видимость проверяется по многоугольникам видимости точек патча (`BeamTracer`), в комнате с дугами --- лучами `Tracer<double>`. Расчет повторяется при изменении стен (`Room::getShapeVersion()`), в том числе их поверхности.
+
+*Вложенные классы*:
+
+- `struct Patch` #h(1em) Патч: стена `wall`, концы `a`, `b`, нормаль внутрь комнаты `normal`, точки проверки видимости `samples`, длина `length`, доля рассеянного света `reflectance`, освещенность прямым светом `emitted`, полная освещенность `irradiance` и излучательность `radiosity`.
+- `class NotClosed` #h(1em) Исключение, выбрасывается, если комната не замкнута.
+- `class OutsideRoom` #h(1em) Исключение, выбрасывается, если источник вне комнаты или внутри замкнутого препятствия.
+
+*Конструкторы/деструктор*:
+
+- `Radiosity(double patchLength = 8)` #h(1em) Создает пустой расчет с наибольшей длиной патча `patchLength`.
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, Vector2 source)` #h(1em) Помещает источник в точку `source` и рассчитывает освещенность стен и цели.
+- `bool update()` #h(1em) Пересчитывает, если изменились стены. Возвращает `true`, если расчет выполнен заново.
+- `bool isActive()`, `const vector<Patch> &getPatches()`, `int getIterations()`
+- `double getAimDirect()`, `double getAimTotal()` #h(1em) Освещенность центра цели прямым светом и полная.
+- `void clear()`
+- `void draw()` #h(1em) Отрисовывает освещенность вдоль стен и в центре цели в логарифмической шкале на три порядка. Патч рисуется со стороны своей нормали, так что стороны препятствия видны по отдельности.
+
+== `Caustic.h`
+
+=== Класс `Caustic`
+
+Каустики семейства лучей, выходящих из одной точки под углами от `fromAngle` до `toAngle`. Каждый луч несет производные начала и направления по углу (`Tracer::Differential`), которые переносятся через отражения (`Tracer::reflectDifferential`). Точка огибающей отрезка луча с началом $p$ и направлением $r$ находится аналитически: $p + r t$ при $t = -(p' times r) / (r' times r)$, где смещение луча поперек направления равно нулю. Точка считается, если она лежит на самом отрезке. На диффузной стене луч обрывается: после рассеяния огибающей нет.
+
+Углы выбираются адаптивно. Сначала лучи идут по равномерной сетке из 129 углов, затем промежутки делятся пополам в ширину, пока точки огибающих соседних лучей с одинаковой последовательностью стен дальше 2 пикселей друг от друга или пока ищется граница, где огибающая обрывается, но не мельче $10^(-4)$ радиана и не больше `maximumSamples` лучей. Соседние точки с одинаковой последовательностью стен соединяются в кривые. Фокусы --- точки возврата кривых: в них точка огибающей останавливается и меняет направление движения вдоль луча. Для вогнутого сферического зеркала точка возврата после одного отражения совпадает с изображением источника по формуле зеркала.
+
+*Вложенные классы*:
+
+- `struct Curve { vector<Vector2> points; int bounces; float energy; }` #h(1em) Кривая каустики после `bounces` отражений и доля энергии образующих ее лучей.
+- `struct Focus { Vector2 point; int bounces; }` #h(1em) Фокус.
+- `struct Leg` #h(1em) Отрезок пути луча: стена, от которой он отразился, направление, точка огибающей, лежит ли она на отрезке, и доля энергии.
+- `struct Sample` #h(1em) Луч семейства: угол и отрезки пути.
+
+*Поля*:
+
+public:
+
+- `static const int maximumBounces` #h(1em) Наибольшее число отражений (4).
+- `static const int maximumSamples` #h(1em) Наибольшее число лучей (4096).
+
+private:
+
+- `vector<Curve> curves`
+- `vector<Focus> foci`
+- `size_t samplesCount` #h(1em) Число прослеженных лучей.
+- `vector<Vector2> pathPoints`, `vector<int> pathStarts` #h(1em) Пути лучей для проверки, затронуло ли изменение комнаты каустику.
+
+*Методы*:
+
+private:
+
+- `Sample trace(const Tracer<float> &tracer, const Vec2<float> &origin, int fromWall, const Vec2<float> &normal, float angle)` #h(1em) Трассирует луч семейства не более чем на `maximumBounces` отражений. Светоделители отражают лучи, как зеркала.
+- `static bool needsSplit(const Sample &a, const Sample &b)` #h(1em) Нужно ли добавить луч между соседними лучами.
+- `void connect(const vector<Sample> &samples)` #h(1em) Соединяет точки огибающих в кривые и ищет фокусы.
+
+public:
+
+- `void build(const Tracer<float> &tracer, const Vector2 &origin, int fromWall, const Vector2 &normal, float fromAngle, float toAngle)` #h(1em) Строит каустики лучей из точки `origin` на стене `fromWall`. Луч под углом `angle` к стене имеет направление нормали `normal`, повернутой на `angle - PI / 2`.
+- `void clear()`
+- `const vector<Curve> &getCurves() const`
+- `const vector<Focus> &getFoci() const`
+- `size_t getSamplesCount() const`
+- `bool crosses(const vector<Tracer<float>::Box> &boxes) const` #h(1em) Проходит ли путь одного из лучей через прямоугольники `boxes`.
+- `void draw()` #h(1em) Отрисовывает кривые каустик (прозрачность по доле энергии) и фокусы.
+
+== `ReachMap.h`
+
+=== Класс `ReachMap`
+
+Карта достижимости цели. По горизонтали откладывается параметр $t$ точки начала луча на его стене, по вертикали --- угол запуска от $179 degree$ (сверху) до $1 degree$ (снизу). В каждой ячейке хранится число отражений, после которого луч попадает в цель, или промах. Цвет ячейки меняется от желтого (попадание без отражений) к синему (`depth` отражений), промахи --- темно-серые. Карта строится для выбранного луча и выбранной цели комнаты, попадание в другую цель считается промахом: она поглощает луч, как и в дереве лучей. Зеркальные стены отражают луч, а светоделители и диффузные стены продолжают его через `Tracer::scatter` со случайными числами из хеша номеров запуска и отражения, поэтому ячейка с такими стенами на пути показывает один случайный путь, а карта не зависит от порядка обхода плиток.
+
+Карта делится на плитки $16 times 16$ ячеек, которые потоки берут по очереди. Плитки обходятся в порядке обратной записи кода Мортона, поэтому уже первые порции равномерно покрывают всю карту. Расчет идет порциями, как у `Heatmap`, и начинается заново, если изменились стены или цель (`Room::getShapeVersion()`), стена начала луча или его направление. Положение и угол луча на карту не влияют, поэтому при их изменении она сохраняется.
+
+Маршруты лучей ячеек (индексы стен, от которых луч отразился до попадания в цель или промаха) собираются в префиксное дерево `Itineraries`: поток записывает маршруты плитки в свою порцию и добавляет ее в дерево один раз на плитку. Если стен в снимке больше `Itineraries::maximumWalls`, маршруты не собираются.
+
+*Вложенные классы*:
+
+- `class NoRayStart` #h(1em) Исключение, выбрасывается, если в комнате нет луча.
+
+*Конструкторы/деструктор*:
+
+- `ReachMap(int width = 1024, int height = 1024)` #h(1em) Создает пустую карту из `width` значений $t$ и `height` значений угла.
+- `~ReachMap()` #h(1em) Освобождает текстуру. Должен вызываться до `CloseWindow()`.
+
+*Поля*:
+
+public:
+
+- `static constexpr unsigned char miss` #h(1em) Значение ячейки при промахе.
+
+private:
+
+- `vector<unsigned char> reach` #h(1em) Число отражений до цели для ячеек.
+- `Itineraries itineraries` #h(1em) Маршруты лучей ячеек.
+- `bool indexed` #h(1em) Собираются ли маршруты.
+- `vector<int> tiles` #h(1em) Порядок обхода плиток.
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты.
+- `vector<Vec2<double>> origins`, `vector<Vec2<double>> normals` #h(1em) Точки стены и нормали внутрь комнаты для каждого значения $t$.
+- `vector<Color> palette` #h(1em) Цвета по числу отражений.
+- `Texture2D texture`
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, int depth = Room::maximumRayDepth)` #h(1em) Начинает расчет карты для луча комнаты, лучи прослеживаются не более чем на `depth` отражений.
+- `void step(double budget)` #h(1em) Продолжает расчет в течение `budget` миллисекунд.
+- `void compute(Room *room, int depth = Room::maximumRayDepth)` #h(1em) Рассчитывает карту целиком.
+- `bool isActive()`, `bool isDone()`, `float getProgress()`
+- `unsigned char getReach(int column, int row)` #h(1em) Число отражений до цели для ячейки или `miss`.
+- `const Itineraries &getItineraries()` #h(1em) Маршруты лучей ячеек.
+- `long getLaunch(int column, int row)` #h(1em) Номер запуска ячейки в маршрутах: `row * width + column`.
+- `float getT(int column)`, `float getAngle(int row)` #h(1em) Параметры луча для центра ячейки (угол в радианах).
+- `bool pick(Rectangle area, Vector2 point, float &t, float &angle)` #h(1em) Параметры луча в точке `point` карты, нарисованной в прямоугольнике `area`. Возвращает `false`, если точка вне карты.
+- `long pickLaunch(Rectangle area, Vector2 point)` #h(1em) Номер запуска ячейки в точке `point` карты или -1, если точка вне карты.
+- `void clear()` #h(1em) Останавливает расчет и очищает карту.
+- `void draw(Rectangle area)` #h(1em) Отрисовывает карту в прямоугольнике `area` с отметкой текущего луча.
+
+== `Itineraries.h`
+
+=== Класс `Itineraries`
+
+Маршруты лучей перебора --- последовательности индексов стен, от которых луч отражался, --- в префиксном дереве. Узел дерева соответствует префиксу маршрута (корень `root` --- пустому) и хранит одну 16-битную стену, ссылки на родителя, первое продолжение и следующее продолжение того же родителя и число запусков, маршрут которых начинается с префикса. Поэтому память растет с числом разных префиксов, а не с числом лучей: у карты достижимости $1024 times 1024$ в стадионе 9.7 млн отражений дают 141 тыс. узлов (2.8 МБ). Для каждого запуска хранится только узел его полного маршрута, сам маршрут восстанавливается по ссылкам на родителей.
+
+Поток перебора записывает маршруты своей порции в `Batch` (стена на отражение) и добавляет их в общее дерево сразу всей порцией под мьютексом, поэтому блокировка берется один раз на порцию. Найденное продолжение переносится в начало списка продолжений: соседние запуски обычно идут по одному маршруту. Запросы к дереву не должны идти одновременно с добавлением.
+
+*Вложенные классы*:
+
+- `struct Node` #h(1em) Узел дерева: родитель `parent`, первое продолжение `child`, следующее продолжение того же родителя `sibling` (-1, если их нет), число запусков `launches`, маршрут которых начинается с префикса, число запусков `ends`, маршрут которых равен префиксу, и последняя стена префикса `wall`.
+- `class Batch` #h(1em) Маршруты порции одного потока: `void begin(long launch)` начинает маршрут запуска `launch`, `void add(int wall)` добавляет к нему отражение от стены `wall`.
+
+*Поля*:
+
+public:
+
+- `static const int maximumWalls` #h(1em) Наибольшее число стен (65536).
+- `static const int root` #h(1em) Узел пустого маршрута.
+
+private:
+
+- `vector<Node> nodes` #h(1em) Узлы дерева.
+- `vector<int> leaves` #h(1em) Узел полного маршрута каждого запуска (-1, если маршрута нет).
+- `std::mutex treeMutex` #h(1em) Защита дерева при добавлении порций.
+
+*Методы*:
+
+public:
+
+- `void reset(long launches)` #h(1em) Пустое дерево для `launches` запусков.
+- `void insert(Batch &batch)` #h(1em) Добавляет маршруты порции в дерево и очищает порцию. Порции разных потоков можно добавлять одновременно.
+- `size_t size() const` #h(1em) Число узлов.
+- `const Node &getNode(int node) const`
+- `vector<int> getChildren(int node) const` #h(1em) Продолжения префикса. Продолжения корня и их продолжения группируют запуски по первым стенам маршрута.
+- `int find(const vector<int> &prefix) const` #h(1em) Узел маршрута, начинающегося со стен `prefix`, или -1.
+- `bool isTraced(long launch) const` #h(1em) Есть ли маршрут у запуска.
+- `int getLeaf(long launch) const` #h(1em) Узел полного маршрута запуска.
+- `vector<int> getItinerary(long launch) const` #h(1em) Стены маршрута запуска.
+- `vector<long> select(const vector<int> &prefix) const` #h(1em) Запуски, маршрут которых начинается со стен `prefix` (например, `{3, 7}` --- лучи, отразившиеся сначала от стены 3, затем от стены 7), по возрастанию. Поддерево префикса отмечается обходом в глубину, затем просматриваются узлы запусков.
+- `void clear()`
+
+private:
+
+- `int childOf(int node, int wall)` #h(1em) Продолжение префикса `node` стеной `wall`. Создается, если его нет.
+
+== `Pool.h`
+
+=== Шаблон класса `Pool<T, blockSize = 4096>`
+
+Пул объектов одного типа. Память выделяется блоками по `blockSize` объектов, блоки не перемещаются, поэтому указатели на объекты остаются верными до очистки. Объекты не освобождаются по одному: `clear()` сбрасывает пул целиком, а блоки сохраняются и используются повторно.
+
+*Методы*:
+
+public:
+
+- `T *allocate()` #h(1em) Новый объект в конце пула.
+- `T &operator[](size_t index)` #h(1em) Объект с номером `index` в порядке выдачи.
+- `size_t size() const`, `size_t capacity() const`
+- `void clear()`
+
+== `Parallel.h`
+
+Выполнение пронумерованных задач в нескольких потоках порциями по времени для расчетов, которые продолжают траектории между кадрами (`Lyapunov`, `PhaseSpace`), и для независимых задач, которые идут одним проходом (`PeriodicOrbits`, `ReachMap`, веер `Heatmap`).
+
+- `double now()` #h(1em) Текущее время в миллисекундах.
+- `int hardwareThreads()` #h(1em) Число потоков расчета (не меньше 1). По нему выбирают число потоков все многопоточные расчеты.
+- `long runPasses(long next, long end, long period, double deadline, Run run)` #h(1em) Выполняет задачи с номерами из $[$`next`, `end`$)$ до момента `deadline` и возвращает номер первой невыполненной задачи. Задачи `i` и `i + period` продолжают одну траекторию, поэтому они идут проходами по `period` задач: внутри прохода потоки берут задачи из общего атомарного счетчика и вызывают `run(task, thread)`, а следующий проход начинается, только когда завершены все задачи предыдущего. Номер потока `thread` меньше `hardwareThreads()` и позволяет вести данные каждого потока без синхронизации. Независимые задачи выполняются одним проходом при `period`, равном `end`.
+
+== `Sampling.h`
+
+Последовательности с низким расхождением для квазислучайного перебора параметров луча. В отличие от случайных точек они равномерно заполняют область при любом числе взятых членов.
+
+- `double radicalInverse(uint64_t i, unsigned base = 2)` #h(1em) Обратная запись номера `i` в системе счисления `base`: последовательность ван дер Корпута, при `base` = 2, 3 --- координаты последовательности Халтона.
+- `uint32_t sobol(uint32_t i, int dimension)` #h(1em) Координата `dimension` (0 или 1) `i`-й точки двумерной последовательности Соболя в виде 32-битной двоичной дроби.
+- `double toUnit(uint32_t x)` #h(1em) Перевод двоичной дроби в число из $[0, 1)$.
+- `uint32_t reverseBits(uint32_t x)`
+- `uint32_t owenScramble(uint32_t x, uint32_t seed)` #h(1em) Скремблирование Оуэна на основе хеша: последовательность остается равномерной, а разные `seed` дают независимые серии.
+- `uint32_t hashBits(uint32_t x)` #h(1em) Перемешивающий хеш 32-битного числа.
+- `bool russianRoulette(double &energy, double threshold, double u)` #h(1em) Русская рулетка: если `energy` меньше `threshold`, путь продолжается при `u < energy / threshold` с энергией `threshold`, иначе обрывается (возвращается `false`). Математическое ожидание энергии сохраняется.
+- `double studentQuantile(int freedom)` #h(1em) Квантиль уровня 0.975 распределения Стьюдента с `freedom` степенями свободы для 95% доверительного интервала по независимым сериям (`HitEstimator`, `Lyapunov`).
+
+== `HitEstimator.h`
+
+=== Класс `HitEstimator`
+
+Оценка доли энергии луча, доходящей до цели, при запуске со стены начала луча из случайной точки $t$ и под случайным углом $alpha in [1 degree, 179 degree]$. Энергия луча умножается на долю отражения каждой стены, при идеальных зеркалах оценка равна вероятности попадания. Луч с энергией меньше 0.1 обрывается русской рулеткой (`russianRoulette`), поэтому оценка остается несмещенной, а на слабые лучи не тратится время. Точки $(t, alpha)$ берутся из случайной последовательности, последовательности Халтона или Соболя. Квазислучайные последовательности в каждой из независимых серий случайно сдвигаются (Халтон) или перемешиваются по Оуэну (Соболь), поэтому оценки серий независимы и несмещены. Доверительный интервал строится по разбросу оценок серий с квантилем распределения Стьюдента. Серии распределяются по потокам. Лучи запускаются со стены выбранного луча комнаты; если целей несколько, попаданием считается только попадание в выбранную цель (`Room::getAimIndex()`), остальные цели поглощают луч.
+
+*Вложенные классы*:
+
+- `enum Sampling { SAMPLING_RANDOM, SAMPLING_HALTON, SAMPLING_SOBOL }` #h(1em) Способ выбора параметров луча.
+- `struct Result` #h(1em) Оценка доли энергии `energy`, полуширина 95% доверительного интервала `halfWidth`, число прослеженных лучей `traces` и отражений `bounces`.
+- `class NoAim` #h(1em) Исключение, выбрасывается, если в комнате нет цели.
+- `class NoRayStart` #h(1em) Исключение, выбрасывается, если в комнате нет луча.
+
+*Конструкторы/деструктор*:
+
+- `HitEstimator(Room *room)` #h(1em) Делает снимок геометрии комнаты.
+
+*Поля*:
+
+private:
+
+- `Room *room`
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты.
+
+*Методы*:
+
+public:
+
+- `Result estimate(Sampling sampling, long samples, int replicates = 16, int depth = Room::maximumRayDepth, unsigned seed = 1, bool roulette = true)` #h(1em) Оценивает долю энергии по `replicates` сериям из `samples` лучей, каждый луч прослеживается не более чем на `depth` отражений. Если `roulette == false`, лучи обрываются только по числу отражений.
+
+== `Lyapunov.h`
+
+=== Класс `Lyapunov`
+
+Оценка старшего показателя Ляпунова бильярда в замкнутой комнате --- средней скорости, с которой экспоненциально расходятся близкие траектории. Вместе с каждой траекторией по отражениям переносится касательный вектор: производные начала и направления луча `Tracer::Differential`, которые `Tracer::reflectDifferential` переносит точно для стен всех видов. Длина вектора складывается из смещения поперек луча и поворота луча, умноженного на диагональ габарита комнаты. Каждые `renormalizationPeriod` (8) отражений вектор нормируется, а логарифм его длины прибавляется к сумме, поэтому вектор не переполняется и за $10^8$ отражений. Показатель траектории --- сумма логарифмов, деленная на число отражений (и на длину пути для показателя на единицу длины).
+
+Начальные условия берутся из перемешанной по Оуэну последовательности Соболя равномерно по длине контура и синусу угла к нормали, то есть по инвариантной мере бильярда. Все стены считаются зеркалами, цели лучей не задерживают (`Tracer::ignoreAim`). Траектория, покинувшая комнату через стык стен или касательный вектор которой выродился, считается потерянной и в оценку не входит. Оценка --- среднее показателей траекторий, 95% доверительный интервал строится по их разбросу с квантилем распределения Стьюдента. В интегрируемых комнатах (прямоугольник) показатель стремится к нулю как $ln n \/ n$, в хаотических (стадион Бунимовича) оценки всех траекторий сходятся к одному значению.
+
+Расчет идет порциями, как у карты освещенности. Задача `k` продолжает траекторию `k % n` на `chunkBounces` (4096) отражений. Задачи выполняются проходами по $n$ (`runPasses`): внутри прохода потоки разбирают задачи через атомарный счетчик, а следующий проход начинается после завершения предыдущего, поэтому одну траекторию не продолжают два потока сразу, траектории продвигаются вровень, а результат не зависит от числа потоков и деления на порции. При каждом удвоении числа отражений текущая оценка сохраняется в истории, по которой видно, сошлась ли она. Если версия стен (`Room::getShapeVersion()`) изменилась, расчет начинается заново, а если комната перестала быть замкнутой --- прекращается.
+
+*Вложенные классы*:
+
+- `struct Result` #h(1em) Показатель на одно отражение `exponent`, полуширина 95% доверительного интервала `halfWidth`, показатель на единицу длины пути `lengthExponent`, число отражений всех траекторий `bounces`, число траекторий в оценке `trajectories` и потерянных траекторий `lost`.
+- `struct Checkpoint { long bounces; double exponent; double halfWidth; }` #h(1em) Оценка после `bounces` отражений.
+- `class NotClosed` #h(1em) Исключение, выбрасывается, если комната не замкнута.
+
+*Поля*:
+
+private:
+
+- `static const int renormalizationPeriod` #h(1em) Число отражений между нормировками касательного вектора (8).
+- `static constexpr long chunkBounces` #h(1em) Число отражений траектории за одну задачу (4096).
+- `Room *room` #h(1em) Комната, для которой идет расчет (`nullptr`, если расчета нет).
+- `unsigned long roomShape` #h(1em) Версия стен на момент начала расчета.
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты без целей.
+- `double scale` #h(1em) Диагональ габарита комнаты, уравнивающая в длине вектора смещение и поворот луча.
+- `vector<Trajectory> trajectories` #h(1em) Траектории: начало и направление луча, стена, от которой он отразился, касательный вектор, число отражений, длина пути, сумма логарифмов длин вектора и признак потери.
+- `long targetBounces`, `long perTrajectory` #h(1em) Требуемое число отражений всех траекторий и одной траектории.
+- `long tasksCount`, `long nextTask` #h(1em) Число задач и номер следующей.
+- `long totalBounces` #h(1em) Число отражений всех траекторий.
+- `vector<Checkpoint> history` #h(1em) История оценок.
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, long bounces, int trajectories = 64)` #h(1em) Начинает расчет по `bounces` отражениям, поровну между `trajectories` траекториями. Выбрасывает `NotClosed`.
+- `void step(double budget)` #h(1em) Продолжает расчет в течение `budget` миллисекунд.
+- `void compute(Room *room, long bounces, int trajectories = 64)` #h(1em) Рассчитывает показатель целиком.
+- `bool isActive()` #h(1em) Идет ли (или завершен) расчет.
+- `bool isDone()` #h(1em) Завершен ли расчет.
+- `float getProgress()` #h(1em) Доля выполненных задач.
+- `Result getResult() const` #h(1em) Текущая оценка.
+- `const vector<Checkpoint> &getHistory()`
+- `void clear()` #h(1em) Останавливает расчет.
+
+private:
+
+- `void restart()` #h(1em) Выбирает начальные условия и начинает расчет по текущему состоянию комнаты. Направление внутрь комнаты определяется трассировкой: луч, выпущенный наружу замкнутой комнаты, ни во что не попадает.
+- `double norm(const Trajectory &trajectory) const` #h(1em) Длина касательного вектора траектории. Сдвиг начала вдоль луча переводит траекторию саму в себя и не учитывается.
+- `long advance(Trajectory &trajectory, long count) const` #h(1em) Продолжает траекторию на `count` отражений. Возвращает число сделанных отражений.
+
+== `PeriodicOrbits.h`
+
+=== Класс `PeriodicOrbits`
+
+Поиск периодических орбит бильярда --- путей света, которые через `period` отражений возвращаются в ту же точку стены с тем же направлением. Все стены считаются зеркалами, цели лучей не задерживают (`Tracer::ignoreAim`). Состояние после отражения задается стеной, стороной ее нормали, параметром `t` точки на стене и углом луча к стене.
+
+Сначала потоки грубо перебирают запуски со всех стен с обеих сторон: `sweepColumns` (64) значений `t` на каждой стене и `sweepRows` (128) углов. Каждый запуск прослеживается на `maximumPeriod` (50) отражений. Если луч вернулся на стену запуска, расхождение точки (деленное на диагональ габарита стен) и направления с запуском меньше `seedTolerance` (0.2), а запуск --- первая точка обхода (стены с меньшим индексом и точки раньше по той же стене на пути не встречаются), запуск становится затравкой для периода, равного числу отражений. У каждого потока для каждого периода хранится не больше `seedsPerPeriod` (32) лучших затравок, по одной на последовательность стен, поэтому семейство нейтральных орбит не вытесняет остальные. После перебора списки потоков объединяются так же.
+
+Затравка уточняется методом Ньютона по отображению отражения с многократной стрельбой. Неизвестные --- сдвиги всех `period` состояний вдоль стены и их углы, невязки отрезка `i` --- расхождение точки попадания с точкой состояния `i + 1` вдоль касательной стены и угол между отраженным лучом и направлением состояния `i + 1`. Точки и нормали состояний берутся из `Wall::getPointByT` и `Wall::getNormal`, производные по `t` --- конечными разностями, а производные отрезка по сдвигу и углу переносятся через отражение `Tracer::reflectDifferential`. Каждый отрезок содержит одно отражение, поэтому система обусловлена хорошо и для неустойчивых орбит с периодом 50, у которых одиночная стрельба теряет точность экспоненциально с числом отражений. Система решается методом Гаусса с выбором ведущего элемента, столбцы без ведущего элемента (у семейств орбит матрица вырождена) дают нулевой шаг. Если невязки не уменьшились, шаг уменьшается вдвое. Метод сошелся, если невязки точек меньше `positionTolerance` ($10^(-3)$ пикселя), а углов --- `angleTolerance` ($10^(-6)$).
+
+Устойчивость орбиты определяется следом матрицы монодромии --- произведения матриц производных отображения отражения по сдвигу точки вдоль стены и повороту луча вдоль орбиты: при $|"tr"| < 2$ орбита устойчива, при $|"tr"| = 2$ нейтральна, иначе неустойчива. Орбита, которая обходит меньший цикл несколько раз, отбрасывается. Орбита с теми же точками (с точностью `mergeTolerance`, 0.5 пикселя) или нейтральная орбита с той же последовательностью стен (с точностью до сдвига и обращения, одно семейство) повторно не добавляется. Орбиты добавляются в порядке затравок, поэтому результат не зависит от числа потоков.
+
+Расчет идет порциями, как у карты освещенности: сначала задачи перебора (столбец `t` одной стороны одной стены), затем затравки. Если версия стен (`Room::getShapeVersion()`) изменилась, поиск начинается заново.
+
+*Вложенные классы*:
+
+- `enum Stability { STABILITY_STABLE, STABILITY_NEUTRAL, STABILITY_UNSTABLE }` #h(1em) Устойчивость орбиты.
+- `struct Orbit` #h(1em) Точки отражений в порядке обхода `points`, индексы стен в снимке `walls`, след матрицы монодромии `trace` и устойчивость `stability`.
+- `class NoWalls` #h(1em) Исключение, выбрасывается, если в комнате нет стен.
+
+*Поля*:
+
+public:
+
+- `static constexpr int maximumPeriod` #h(1em) Наибольший период (50).
+
+private:
+
+- `static const int sweepColumns`, `static const int sweepRows` #h(1em) Число значений `t` на стене и углов при переборе (64 и 128).
+- `static const int seedsPerPeriod` #h(1em) Наибольшее число затравок периода (32).
+- `static constexpr double seedTolerance` #h(1em) Наибольшее расхождение затравки (0.2).
+- `static const int maximumIterations` #h(1em) Наибольшее число шагов метода Ньютона (30).
+- `static constexpr double positionTolerance`, `static constexpr double angleTolerance` #h(1em) Допустимые невязки точки и направления.
+- `static constexpr double mergeTolerance` #h(1em) Расстояние между точками совпадающих орбит.
+- `Room *room` #h(1em) Комната, для которой идет расчет (`nullptr`, если расчета нет).
+- `unsigned long roomShape` #h(1em) Версия стен на момент начала расчета.
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты без целей.
+- `double scale` #h(1em) Диагональ габарита стен.
+- `long sweepTasks` #h(1em) Число задач перебора.
+- `vector<vector<vector<Seed>>> candidates` #h(1em) Лучшие затравки каждого потока по периодам. Затравка --- период, расхождение, свертка последовательности стен и запуск.
+- `vector<Seed> seeds` #h(1em) Затравки по возрастанию периода.
+- `vector<char> found`, `vector<Orbit> results` #h(1em) Сошелся ли метод Ньютона для затравки и найденная орбита.
+- `long nextTask` #h(1em) Номер следующей задачи: сначала перебора, затем затравок.
+- `vector<vector<Orbit>> orbits` #h(1em) Найденные орбиты по периодам.
+- `int shownPeriod` #h(1em) Период показываемых орбит (0 --- все).
+- `int selected` #h(1em) Выделенная орбита показываемого периода (или -1).
+
+*Методы*:
+
+public:
+
+- `void start(Room *room)` #h(1em) Начинает поиск. Выбрасывает `NoWalls`.
+- `void step(double budget)` #h(1em) Продолжает поиск в течение `budget` миллисекунд.
+- `void compute(Room *room)` #h(1em) Находит орбиты целиком.
+- `bool isActive()` #h(1em) Идет ли (или завершен) поиск.
+- `bool isDone()` #h(1em) Завершен ли поиск.
+- `float getProgress()` #h(1em) Доля выполненной работы: перебор и уточнение затравок считаются половинами.
+- `const vector<Orbit> &getOrbits(int period)` #h(1em) Орбиты периода `period` (от 1 до `maximumPeriod`).
+- `int getOrbitsCount()` #h(1em) Число найденных орбит всех периодов.
+- `int getShownPeriod()`, `void setShownPeriod(int period)` #h(1em) Период показываемых орбит. При смене периода выделение снимается.
+- `int getSelected()`, `void setSelected(int index)` #h(1em) Выделенная орбита.
+- `void clear()` #h(1em) Останавливает поиск и удаляет орбиты.
+- `void draw()` #h(1em) Рисует орбиты показываемого периода замкнутыми ломаными: устойчивые --- зеленым, нейтральные --- синим, неустойчивые --- оранжевым. Выделенная орбита рисуется толще, остальные --- бледнее.
+
+private:
+
+- `void restart()` #h(1em) Начинает поиск по текущему состоянию комнаты.
+- `void sweepColumn(long task, vector<vector<Seed>> &best) const` #h(1em) Перебирает углы запуска одного столбца `t` и добавляет затравки в `best`.
+- `static void keep(const Seed &seed, vector<Seed> &best)` #h(1em) Добавляет затравку к лучшим затравкам периода: по одной на последовательность стен, не больше `seedsPerPeriod`.
+- `static bool less(const Seed &a, const Seed &b)` #h(1em) Лучше ли затравка `a`. При равном расхождении сравниваются запуски, чтобы порядок не зависел от потоков.
+- `bool evaluate(const State &state, Frame &frame) const` #h(1em) Точка, направление и их производные по длине стены для состояния. Возвращает `false`, если состояние вне стены.
+- `bool refine(const Seed &seed, Orbit &orbit) const` #h(1em) Уточняет затравку методом Ньютона и определяет устойчивость. Возвращает `false`, если метод не сошелся или орбита --- кратный обход меньшей.
+- `double residuals(const vector<State> &states, vector<double> &residual, vector<double> *jacobian, vector<Frame> &frames) const` #h(1em) Невязки отрезков и, если `jacobian` не `nullptr`, матрица производных. Возвращает сумму квадратов невязок (угловые умножаются на `scale`) или бесконечность, если луч попал не на ту стену.
+- `void merge(const Orbit &orbit)` #h(1em) Добавляет орбиту, если ее еще нет среди найденных.
+
+== `PhaseSpace.h`
+
+=== Класс `PhaseSpace`
+
+Фазовое пространство бильярда в координатах Биркгофа (сечение Пуанкаре по отражениям). По горизонтали --- длина дуги границы от начала первой стены (сначала стены контура, затем стены препятствий, как в снимке `Tracer`), по вертикали --- синус угла отраженного луча к нормали со знаком (положительный --- в сторону роста длины дуги). Каждое отражение добавляется в ячейку гистограммы `width` $times$ `height` (256 $times$ 256), и из нее строится изображение плотности с логарифмической шкалой, как у карты освещенности. У хаотической комнаты (стадион) плотность равномерна, у интегрируемой (прямоугольник) траектории лежат на отдельных горизонталях, а у смешанной видны острова устойчивости.
+
+Длина дуги считается по вписанным ломаным стен: у прямой стены один отрезок, у кривой --- `curvePieces` (32). Параметр `t` точки отражения дает `Tracer::getParameter` в double без поиска ближайшей точки: у прямой стены --- проекция точки, у дуги и эллипса --- угол направления от центра, отображенный на диапазон углов стены, у кривой Безье --- параметр из трассировки (`Tracer::Hit::parameter`).
+
+Траектории начинаются на стенах контура по инвариантной мере бильярда: равномерно по длине контура и синусу угла (последовательность Соболя с перемешиванием Оуэна, как у `Lyapunov`). Все стены считаются зеркалами, цели лучей не задерживают (`Tracer::ignoreAim`). Задача --- продолжение одной траектории на `chunkBounces` (4096) отражений. Задачи выполняются проходами, как у `Lyapunov` (`runPasses`), поэтому одну траекторию не продолжают два потока сразу, а траектории продвигаются вровень.
+
+У каждого потока своя гистограмма из 16-битных счетчиков. Счетчик ячейки не больше числа отражений с последнего переноса, поэтому поток переносит гистограмму в общую (64-битную, под мьютексом) перед задачей, которая могла бы привести к переполнению, а остальное переносится в конце порции. Память --- 512 КБ общей гистограммы и 128 КБ на поток --- не зависит от числа отражений, поэтому расчет по $10^9$ отражениям помещается в ту же память. Расчет идет порциями и начинается заново, если изменилась версия стен (`Room::getShapeVersion()`).
+
+*Вложенные классы*:
+
+- `class NotClosed` #h(1em) Исключение, выбрасывается, если комната не замкнута.
+
+*Конструкторы/деструктор*:
+
+- `PhaseSpace()` #h(1em) Строит таблицу цветов: от белого фона к темно-синему.
+- `~PhaseSpace()` #h(1em) Освобождает текстуру.
+
+*Поля*:
+
+public:
+
+- `static const int width`, `static const int height` #h(1em) Число ячеек по длине дуги и по синусу угла (256).
+
+private:
+
+- `static constexpr long chunkBounces` #h(1em) Число отражений траектории за задачу (4096).
+- `static const int curvePieces` #h(1em) Число отрезков ломаной кривой стены (32).
+- `Room *room` #h(1em) Комната, для которой идет расчет (`nullptr`, если расчета нет).
+- `unsigned long roomShape` #h(1em) Версия стен на момент начала расчета.
+- `Tracer<double> tracer` #h(1em) Снимок геометрии комнаты без целей.
+- `vector<int> pieceStarts`, `vector<double> arcLengths`, `vector<Vec2<double>> pieceDirs` #h(1em) Ломаные стен: начало ломаной каждой стены, длина дуги от начала границы для каждой вершины и направление каждого отрезка.
+- `double perimeter` #h(1em) Длина всей границы.
+- `vector<Trajectory> trajectories` #h(1em) Траектории: начало и направление луча, стена, с которой он выходит, число отражений и признак потери (траектория ушла через стык стен).
+- `long targetBounces`, `long perTrajectory` #h(1em) Требуемое число отражений всех траекторий и одной траектории.
+- `long tasksCount`, `long nextTask` #h(1em) Число задач и номер следующей задачи.
+- `long totalBounces` #h(1em) Число отражений, учтенных в гистограмме.
+- `bool finished` #h(1em) Завершен ли расчет.
+- `vector<uint64_t> density` #h(1em) Общая гистограмма.
+- `vector<vector<uint16_t>> histograms` #h(1em) Гистограммы потоков.
+- `std::mutex densityMutex` #h(1em) Защита общей гистограммы.
+- `vector<Color> palette`, `vector<Color> pixels`, `Texture2D texture`, `bool hasTexture` #h(1em) Таблица цветов, изображение и его текстура.
+
+*Методы*:
+
+public:
+
+- `void start(Room *room, long bounces, int trajectories = 256)` #h(1em) Начинает расчет по `bounces` отражениям, поровну между `trajectories` траекториями. Выбрасывает `NotClosed`.
+- `void step(double budget)` #h(1em) Продолжает расчет в течение `budget` миллисекунд и обновляет изображение.
+- `void compute(Room *room, long bounces, int trajectories = 256)` #h(1em) Рассчитывает гистограмму целиком.
+- `bool isActive()` #h(1em) Идет ли (или завершен) расчет.
+- `bool isDone()` #h(1em) Завершен ли расчет.
+- `long getBounces()` #h(1em) Число учтенных отражений.
+- `float getProgress()` #h(1em) Доля выполненных задач.
+- `uint64_t getDensity(int column, int row) const` #h(1em) Число отражений в ячейке: `column` --- по длине дуги, `row` --- по синусу угла сверху вниз от 1 до -1.
+- `void clear()` #h(1em) Останавливает расчет и удаляет гистограмму.
+- `void draw(Rectangle area)` #h(1em) Рисует изображение в области `area` с вертикальными линиями на стыках стен и горизонтальной линией нулевого угла.
+
+private:
+
+- `void restart()` #h(1em) Строит ломаные стен, выбирает начальные условия и начинает расчет по текущему состоянию комнаты.
+- `long advance(Trajectory &trajectory, long count, vector<uint16_t> &histogram) const` #h(1em) Продолжает траекторию на `count` отражений и добавляет их в `histogram`. Возвращает число сделанных отражений.
+- `int cellOf(const Tracer<double>::Hit &hit, const Vec2<double> &dir) const` #h(1em) Ячейка гистограммы для отражения в точке `hit` с направлением отраженного луча `dir`.
+- `void flush(vector<uint16_t> &histogram)` #h(1em) Переносит гистограмму потока в общую и обнуляет ее.
+- `void updatePixels()` #h(1em) Переносит гистограмму в изображение.
+
 == `MyUI.h`
 
 === Класс `Button`
@@ -324,7 +1230,7 @@ public:
 
 *Вложенные классы*:
 
-`enum UIMode { UI_NORMAL, UI_ADD_LINE, UI_ADD_ROUND, UI_ADD_RAY, UI_ADD_AIM, UI_EDIT_LINE, UI_EDIT_ROUND, UI_EDIT_RAY, UI_IMPORT, UI_EXPORT, UI_CLEAR };` #h(1em) Режим интерфейса. Переключается пользователем нажатием соответствующих кнопок в меню.
+`enum UIMode { UI_NORMAL, UI_ADD_LINE, UI_ADD_ROUND, UI_ADD_RAY, UI_ADD_AIM, UI_EDIT_LINE, UI_EDIT_ROUND, UI_EDIT_RAY, UI_IMPORT, UI_EXPORT, UI_CLEAR, UI_HEATMAP, UI_EXPORT_HEATMAP, UI_ADD_LIGHT, UI_CLEAR_LIGHT, UI_EXPORT_ECHOGRAM, UI_RADIOSITY, UI_ADD_FAN, UI_LYAPUNOV, UI_ORBITS, UI_PHASE_SPACE };` #h(1em) Режим интерфейса. Переключается пользователем нажатием соответствующих кнопок в меню.
 
 *Конструкторы/деструктор*:
 
@@ -346,6 +1252,7 @@ private:
 - `Rectangle panel` #h(1em) Размеры правой панели.
 - `Wall *wall` #h(1em) Стена, которая в данный момент редактируется в правой панели. Если нет --- `nullptr`.
 - `RayStart *rayStart` #h(1em) Луч, который редактируется в правой панели в данный момент. Если нет --- `nullptr`.
+- `RayFan *fan` #h(1em) Веер лучей, который редактируется в правой панели в данный момент. Если нет --- `nullptr`.
 - `Vector2 hintPosition` #h(1em) Положение подсказки.
 - `Rectangle hintBar` #h(1em) Размеры подсказки.
 - `Button importButton` #h(1em) кнопка открытия диалогового окна выбора файла и др. кнопки, при нажатии на которых режим `mode` переключается на соответствующий.
@@ -356,6 +1263,15 @@ private:
 - `Button addRayButton`
 - `Button addAimButton`
 - `Button clearButton`
+- `Button heatmapButton` #h(1em) Расчет карты освещенности (повторное нажатие скрывает карту).
+- `Button exportHeatmapButton` #h(1em) Сохранение карты освещенности в PNG.
+- `Button addLightButton` #h(1em) Размещение точечного источника света (повторное нажатие убирает источник).
+- `Button echogramButton` #h(1em) Расчет эхограммы от источника света до цели и сохранение ее в CSV.
+- `Button radiosityButton` #h(1em) Расчет излучательности диффузных стен от источника света (повторное нажатие скрывает ее).
+- `Button addFanButton` #h(1em) Добавление веера лучей.
+- `Button lyapunovButton` #h(1em) Расчет показателя Ляпунова по $10^8$ отражениям в замкнутой комнате (повторное нажатие останавливает расчет). Во время расчета в подсказке показываются текущая оценка и доля выполненной работы, по завершении --- оценка, доверительный интервал и изменение оценки за последнее удвоение числа отражений.
+- `Button orbitsButton` #h(1em) Поиск периодических орбит с периодом до 50 (повторное нажатие скрывает их). Во время поиска в подсказке показывается доля выполненной работы, по завершении --- число найденных орбит.
+- `Button phaseSpaceButton` #h(1em) Расчет фазового пространства по $10^9$ отражениям в замкнутой комнате (повторное нажатие скрывает его). Изображение показывается в правой панели.
 - `MyUI::UIMode mode` #h(1em) Режим редактирования, в котором находится интерфейс.
 
 public:
@@ -377,10 +1293,12 @@ public:
 - `Rectangle getCanvas()`
 - `void saveFile(Room *room)` #h(1em) Вызывает диалоговое окно сохранения файла.
 - `Room *openFIle(Room *room)` #h(1em) Вызывает диалоговое окно открытия файла. Возвращает импортированный экземпляр эксперимента.
+- `void saveHeatmap(Heatmap *heatmap)` #h(1em) Сохраняет карту освещенности в выбранный в диалоговом окне файл (с расширением `.png`).
+- `void saveEchogram(Echogram *echogram)` #h(1em) Сохраняет эхограмму в выбранный в диалоговом окне файл (с расширением `.csv`).
 - `void showHint(const char *message)` #h(1em) Вызывает подсказку с сообщением `message`.
-- `void showPanel(Wall *wall, RayStart *rayStart)` #h(1em) Открывает в правой панели редактирование объекта: если `wall != nullptr` открывает `wall`, иначе, если `rayStart != nullptr`, открывает `rayStart`.
-- `void drawPanel()` #h(1em) Отрисовывает правую панель.
-- `void handleButtons(bool isClosed)` #h(1em) Обрабатывает нажатие кнопок в меню. Если `isClosed == true`, то комната замкнута, добавлять стены нельзя.
+- `void showPanel(Wall *wall, RayStart *rayStart, RayFan *fan = nullptr)` #h(1em) Открывает в правой панели редактирование объекта: если `wall != nullptr` открывает `wall`, иначе, если `rayStart != nullptr`, открывает `rayStart`, иначе --- `fan`.
+- `void drawPanel(ReachMap *reachMap, PeriodicOrbits *orbits, PhaseSpace *phaseSpace)` #h(1em) Отрисовывает правую панель. В панели стены кнопка типа перебирает плоское, сферическое, эллиптическое зеркало и кривую Безье. У сферического зеркала есть ползунок кривизны и кнопка выпуклости, у эллиптического --- ползунок сжатия (отношения полуосей) и кнопка выпуклости, у кривой Безье --- ползунки изгиба (высоты контрольных точек) и кнопка степени. Кнопка поверхности перебирает зеркальную, диффузную поверхность и светоделитель (светоделитель с долей отражения 1 получает долю 0.5), есть ползунок доли отражения. В панели луча есть кнопка оценки доли энергии, доходящей до цели (`HitEstimator`, последовательность Соболя, 16 серий по 4096 лучей) и карта достижимости цели `reachMap`. Карта начинает рассчитываться при открытии панели, если в комнате есть цель. Клик по карте переносит луч в выбранную точку стены и поворачивает его на выбранный угол. Когда курсор над картой, над ней показываются первые шесть стен маршрута луча ячейки и число лучей карты с точно таким же маршрутом (`Itineraries::Node::ends`). Под картой --- кнопка удаления луча и доли энергии луча, дошедшие до каждой из первых шести целей (`RayTree::getAimEnergy`). В панели веера --- ползунки углов крайних лучей и числа лучей (в адаптивном режиме --- точности, рядом показывается число выбранных лучей), кнопки адаптивного выбора углов, изменения направления, каустик и удаления веера и координаты первых шести найденных фокусов. Если ничего не выбрано и идет поиск периодических орбит `orbits`, в панели --- ползунок периода, число найденных орбит и список орбит выбранного периода с устойчивостью и следом матрицы монодромии. Выбранная в списке орбита выделяется на поле. Если ничего не выбрано и идет расчет фазового пространства `phaseSpace`, в панели (вместо орбит) --- число учтенных отражений с долей выполненной работы и изображение фазового пространства.
+- `void handleButtons(bool isClosed, bool hasHeatmap, bool hasLight, bool hasRadiosity, bool hasLyapunov, bool hasOrbits, bool hasPhaseSpace)` #h(1em) Обрабатывает нажатие кнопок в меню. Если `isClosed == true`, то комната замкнута, добавлять стены нельзя, но можно поместить источник света, рассчитать показатель Ляпунова и фазовое пространство. Если `hasHeatmap`, `hasLight`, `hasRadiosity`, `hasLyapunov`, `hasOrbits` или `hasPhaseSpace` равны `true`, кнопка карты освещенности, источника света, излучательности, показателя Ляпунова, периодических орбит или фазового пространства выделяется как активная.
 
 == `FileDialog.h`
 
@@ -475,7 +1393,11 @@ public:
           if (ui.fileDialog.isActive()) {
               GuiLock();
           }
-          ui.handleButtons(room->isClosed());
+          ui.handleButtons(
+              room->isClosed(), heatmap->isActive(), illumination->isActive(),
+              radiosity->isActive(), lyapunov->isActive(), orbits->isActive(),
+              phaseSpace->isActive()
+          );
           // Область для рисования
           BeginScissorMode(
               ui.getCanvas().x, ui.getCanvas().y, ui.getCanvas().width,
@@ -487,11 +1409,15 @@ public:
           }
           // Аналогично --- рисование дуг, добавление цели и луча
           // --snip--
+          heatmap->draw();
+          illumination->draw();
+          orbits->draw();
           room->draw();
+          radiosity->draw();
           EndScissorMode();
 
           // Если в нужном режиме кликнули на объект, отобразить его через ui.showPanel(...)
-          ui.drawPanel();
+          ui.drawPanel(reachMap, orbits, phaseSpace);
 
           GuiUnlock();
           ui.fileDialog.update();
@@ -5,8 +5,16 @@
 #include "raygui.h"
 #undef RAYGUI_IMPLEMENTATION
 
+#include "Echogram.h"
+#include "Heatmap.h"
+#include "Illumination.h"
+#include "Lyapunov.h"
+#include "PeriodicOrbits.h"
+#include "PhaseSpace.h"
 #include "MyUI.h"
+#include "Radiosity.h"
 #include "Ray.h"
+#include "ReachMap.h"
 #include "Room.h"
 
 const int Room::minimalDistance = 20;
@@ -14,10 +22,71 @@ const int Room::maximumPoints = 9;
 const int Room::minimumPoints = 4;
 const int Room::maximumRayDepth = 10;
 
+const long heatmapBounces = 10000000; // Число отражений для карты освещенности
+const double heatmapBudget = 8; // Время расчета карты за кадр, мс
+const double reachMapBudget = 4; // Время расчета карты достижимости за кадр
+const long lyapunovBounces = 100000000; // Число отражений для показателя
+const double lyapunovBudget = 8; // Ляпунова и время его расчета за кадр, мс
+const double orbitsBudget = 8;   // Время поиска периодических орбит за кадр
+const long phaseSpaceBounces = 1000000000; // Число отражений для фазового
+const double phaseSpaceBudget = 8; // пространства и время расчета за кадр, мс
+
+// Подсказка с числом и площадью неосвещенных областей
+static void showDarkRegions(MyUI &ui, Illumination *illumination) {
+    if (illumination->getDarkRegions() == 0) {
+        ui.showHint("Вся комната освещена");
+    } else {
+        ui.showHint(TextFormat(
+            "Темных областей: %d, %.1f%% площади комнаты",
+            illumination->getDarkRegions(),
+            illumination->getDarkFraction() * 100
+        ));
+    }
+}
+
+// Подсказка с показателем Ляпунова и его изменением за последнее удвоение
+// числа отражений
+static void showLyapunov(MyUI &ui, Lyapunov *lyapunov) {
+    Lyapunov::Result result = lyapunov->getResult();
+    const vector<Lyapunov::Checkpoint> &history = lyapunov->getHistory();
+    double change = 0;
+    if (history.size() > 1) {
+        change = history.back().exponent - history[history.size() - 2].exponent;
+    }
+    ui.showHint(TextFormat(
+        "Показатель Ляпунова: %.4f ± %.4f на отражение, изменение %.1e",
+        result.exponent, result.halfWidth, change
+    ));
+}
+
+// Подсказка с освещенностью цели
+static void showRadiosity(MyUI &ui, Radiosity *radiosity) {
+    if (radiosity->getAimTotal() <= 0) {
+        ui.showHint(TextFormat(
+            "Излучательность: %d патчей, %d итераций",
+            (int)radiosity->getPatches().size(), radiosity->getIterations()
+        ));
+    } else {
+        ui.showHint(TextFormat(
+            "Освещенность цели: %.3g, рассеянный свет %.0f%%",
+            radiosity->getAimTotal(),
+            (1 - radiosity->getAimDirect() / radiosity->getAimTotal()) * 100
+        ));
+    }
+}
+
 int main() {
     MyUI ui =
         MyUI("assets/fonts/AdwaitaSans-Regular.ttf", "assets/iconset.rgi");
     Room *room = new Room();
+    Heatmap *heatmap = new Heatmap();
+    ReachMap *reachMap = new ReachMap();
+    Illumination *illumination = new Illumination();
+    Echogram *echogram = new Echogram();
+    Radiosity *radiosity = new Radiosity();
+    Lyapunov *lyapunov = new Lyapunov();
+    PeriodicOrbits *orbits = new PeriodicOrbits();
+    PhaseSpace *phaseSpace = new PhaseSpace();
 
     while (!WindowShouldClose()) {
         ui.updateSize();
@@ -34,6 +103,24 @@ int main() {
                 // Открытие файла
                 case MyUI::UI_IMPORT: {
                     room = ui.openFIle(room);
+                    heatmap->clear();
+                    reachMap->clear();
+                    illumination->clear();
+                    radiosity->clear();
+                    lyapunov->clear();
+                    orbits->clear();
+                    phaseSpace->clear();
+                    break;
+                }
+                // Сохранение карты освещенности
+                case MyUI::UI_EXPORT_HEATMAP: {
+                    ui.saveHeatmap(heatmap);
+                    break;
+                }
+                // Расчет и сохранение эхограммы
+                case MyUI::UI_EXPORT_ECHOGRAM: {
+                    echogram->compute(room, illumination->getSource());
+                    ui.saveEchogram(echogram);
                     break;
                 }
                 default: break;
@@ -47,9 +134,165 @@ int main() {
         // Очистка экрана
         if (ui.getMode() == MyUI::UI_CLEAR) {
             room->clear();
+            heatmap->clear();
+            reachMap->clear();
+            illumination->clear();
+            radiosity->clear();
+            lyapunov->clear();
+            orbits->clear();
+            phaseSpace->clear();
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Расчет карты освещенности (повторное нажатие скрывает карту)
+        if (ui.getMode() == MyUI::UI_HEATMAP) {
+            if (heatmap->isActive()) {
+                heatmap->clear();
+            } else {
+                try {
+                    heatmap->start(room, heatmapBounces);
+                } catch (std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Карта уточняется порциями в каждом кадре и пересчитывается заново
+        // при изменении комнаты, цели или луча
+        if (heatmap->isActive()) {
+            bool wasDone = heatmap->isDone();
+            heatmap->step(heatmapBudget);
+            if (heatmap->isActive() && !heatmap->isDone()) {
+                ui.showHint(TextFormat(
+                    "Расчет карты освещенности: %.0f%%",
+                    heatmap->getProgress() * 100
+                ));
+            } else if (heatmap->isDone() && !wasDone) {
+                ui.showHint(TextFormat(
+                    "Карта освещенности: %ld отражений", heatmap->getBounces()
+                ));
+            }
+        }
+
+        // Расчет показателя Ляпунова (повторное нажатие останавливает его)
+        if (ui.getMode() == MyUI::UI_LYAPUNOV) {
+            if (lyapunov->isActive()) {
+                lyapunov->clear();
+            } else {
+                try {
+                    lyapunov->start(room, lyapunovBounces);
+                } catch (std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Траектории продолжаются порциями в каждом кадре, расчет начинается
+        // заново при изменении стен
+        if (lyapunov->isActive()) {
+            bool wasDone = lyapunov->isDone();
+            lyapunov->step(lyapunovBudget);
+            if (lyapunov->isActive() && !lyapunov->isDone()) {
+                Lyapunov::Result result = lyapunov->getResult();
+                ui.showHint(TextFormat(
+                    "Показатель Ляпунова: %.4f ± %.4f (%.0f%%)",
+                    result.exponent, result.halfWidth,
+                    lyapunov->getProgress() * 100
+                ));
+            } else if (lyapunov->isDone() && !wasDone) {
+                showLyapunov(ui, lyapunov);
+            }
+        }
+
+        // Поиск периодических орбит (повторное нажатие скрывает их)
+        if (ui.getMode() == MyUI::UI_ORBITS) {
+            if (orbits->isActive()) {
+                orbits->clear();
+            } else {
+                try {
+                    orbits->start(room);
+                } catch (std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Орбиты ищутся порциями в каждом кадре и заново при изменении стен
+        if (orbits->isActive()) {
+            bool wasDone = orbits->isDone();
+            orbits->step(orbitsBudget);
+            if (orbits->isActive() && !orbits->isDone()) {
+                ui.showHint(TextFormat(
+                    "Поиск периодических орбит: %.0f%%",
+                    orbits->getProgress() * 100
+                ));
+            } else if (orbits->isDone() && !wasDone) {
+                ui.showHint(TextFormat(
+                    "Найдено периодических орбит: %d", orbits->getOrbitsCount()
+                ));
+            }
+        }
+
+        // Расчет фазового пространства (повторное нажатие скрывает его)
+        if (ui.getMode() == MyUI::UI_PHASE_SPACE) {
+            if (phaseSpace->isActive()) {
+                phaseSpace->clear();
+            } else {
+                try {
+                    phaseSpace->start(room, phaseSpaceBounces);
+                } catch (std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
             ui.setMode(MyUI::UI_NORMAL);
         }
 
+        // Отражения накапливаются порциями в каждом кадре, расчет начинается
+        // заново при изменении стен. Изображение показывается в правой панели
+        phaseSpace->step(phaseSpaceBudget);
+
+        // Удаление источника света
+        if (ui.getMode() == MyUI::UI_CLEAR_LIGHT) {
+            illumination->clear();
+            radiosity->clear();
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Расчет излучательности от источника света (повторное нажатие
+        // скрывает ее)
+        if (ui.getMode() == MyUI::UI_RADIOSITY) {
+            if (radiosity->isActive()) {
+                radiosity->clear();
+            } else {
+                try {
+                    radiosity->start(room, illumination->getSource());
+                    showRadiosity(ui, radiosity);
+                } catch (std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+            ui.setMode(MyUI::UI_NORMAL);
+        }
+
+        // Освещенные области и излучательность пересчитываются при изменении
+        // стен
+        try {
+            if (illumination->update()) {
+                showDarkRegions(ui, illumination);
+            }
+            if (radiosity->update()) {
+                showRadiosity(ui, radiosity);
+            }
+        } catch (std::exception &e) {
+            ui.showHint(e.what());
+        }
+
+        // Карта достижимости рассчитывается после открытия панели луча
+        reachMap->step(reachMapBudget);
+
         BeginDrawing();
 
         // Фон
@@ -63,7 +306,11 @@ int main() {
             GuiLock();
         }
 
-        ui.handleButtons(room->isClosed());
+        ui.handleButtons(
+            room->isClosed(), heatmap->isActive(), illumination->isActive(),
+            radiosity->isActive(), lyapunov->isActive(), orbits->isActive(),
+            phaseSpace->isActive()
+        );
 
         // Область для рисования
         BeginScissorMode(
@@ -115,7 +362,12 @@ int main() {
         if (ui.getMode() == MyUI::UI_ADD_AIM) {
             if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
                 CheckCollisionPointRec(GetMousePosition(), ui.getCanvas())) {
-                room->addAim(GetMousePosition());
+                AimArea *target = room->closestAim(GetMousePosition());
+                if (target) {
+                    room->removeAim(target);
+                } else {
+                    room->addAim(GetMousePosition());
+                }
             }
         }
 
@@ -133,7 +385,42 @@ int main() {
             }
         }
 
+        // Добавление веера лучей
+        if (ui.getMode() == MyUI::UI_ADD_FAN) {
+            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+                CheckCollisionPointRec(GetMousePosition(), ui.getCanvas())) {
+                try {
+                    RayFan *fan = room->addFan(GetMousePosition());
+                    if (fan) {
+                        ui.showPanel(nullptr, nullptr, fan);
+                    }
+                } catch (const std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+        }
+
+        // Размещение источника света
+        if (ui.getMode() == MyUI::UI_ADD_LIGHT) {
+            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+                CheckCollisionPointRec(GetMousePosition(), ui.getCanvas())) {
+                try {
+                    illumination->start(room, GetMousePosition());
+                    showDarkRegions(ui, illumination);
+                    if (radiosity->isActive()) {
+                        radiosity->start(room, GetMousePosition());
+                    }
+                } catch (const std::exception &e) {
+                    ui.showHint(e.what());
+                }
+            }
+        }
+
+        heatmap->draw();
+        illumination->draw();
+        orbits->draw();
         room->draw();
+        radiosity->draw();
         EndScissorMode();
 
         // Правая панель
@@ -143,7 +430,8 @@ int main() {
             if (CheckCollisionPointRec(GetMousePosition(), ui.getCanvas())) {
                 Wall *closest = room->closestWall(GetMousePosition());
                 RayStart *ray = room->closestRay(GetMousePosition());
-                if (ray) {
+                RayFan *fan = room->closestFan(GetMousePosition());
+                if (ray || fan) {
                     SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
                 } else if (closest) {
                     SetMouseCursor(MOUSE_CURSOR_POINTING_HAND);
@@ -151,12 +439,23 @@ int main() {
                     SetMouseCursor(MOUSE_CURSOR_DEFAULT);
                 }
                 if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                    AimArea *target = room->closestAim(GetMousePosition());
                     if (ray) {
+                        room->selectRay(ray);
                         ui.setMode(MyUI::UI_EDIT_RAY);
                         ui.showPanel(nullptr, ray);
+                    } else if (fan) {
+                        ui.setMode(MyUI::UI_EDIT_RAY);
+                        ui.showPanel(nullptr, nullptr, fan);
                     } else if (closest) {
                         ui.setMode(MyUI::UI_EDIT_ROUND);
                         ui.showPanel(closest, nullptr);
+                    } else if (target) {
+                        // Выбранная цель служит приемником эхограммы и
+                        // излучательности
+                        room->selectAim(target);
+                        ui.setMode(MyUI::UI_NORMAL);
+                        ui.showPanel(nullptr, nullptr);
                     } else {
                         ui.setMode(MyUI::UI_NORMAL);
                         ui.showPanel(nullptr, nullptr);
@@ -164,7 +463,7 @@ int main() {
                 }
             }
         }
-        ui.drawPanel();
+        ui.drawPanel(reachMap, orbits, phaseSpace);
 
         GuiUnlock();
         ui.fileDialog.update();
@@ -172,6 +471,14 @@ int main() {
         EndDrawing();
     }
 
+    delete heatmap;
+    delete reachMap;
+    delete illumination;
+    delete echogram;
+    delete radiosity;
+    delete lyapunov;
+    delete orbits;
+    delete phaseSpace;
     CloseWindow();
     delete room;
     return 0;
@@ -0,0 +1,68 @@
+// Проверка освещения в комнате с препятствием: квадратная комната 400 на
+// 400 с колонной 100 на 100 и источником слева от колонны. Без отражений
+// тень колонны --- трапеция между лучами, касающимися ее передних углов,
+// без самой колонны, а внутренность колонны не входит в площадь комнаты.
+// Затем проверяется, что источник внутри колонны не принимается. Код
+// возврата --- число непройденных проверок
+
+#include <cmath>
+#include <cstdio>
+
+#include "raylib.h"
+
+#include "Illumination.h"
+#include "Room.h"
+
+const int Room::minimalDistance = 1;
+const int Room::maximumPoints = 1000;
+const int Room::minimumPoints = 4;
+const int Room::maximumRayDepth = 10;
+
+int main() {
+    int failed = 0;
+
+    Room room;
+    room.addWallLine(Vector2{100, 100});
+    room.addWallLine(Vector2{500, 100});
+    room.addWallLine(Vector2{500, 500});
+    room.addWallLine(Vector2{100, 500});
+    room.addWallLine(Vector2{100, 100});
+    room.addObstacle({{250, 250}, {350, 250}, {350, 350}, {250, 350}}, true);
+
+    // Тень от x = 250 до x = 500 шириной от 100 до 350 минус колонна,
+    // площадь комнаты без колонны 150000
+    const double expected = (225.0 * 250 - 100 * 100) / (400 * 400 - 100 * 100);
+
+    Illumination illumination;
+    illumination.start(&room, Vector2{150, 300}, 0);
+    double fraction = illumination.getDarkFraction();
+    int regions = illumination.getDarkRegions();
+    std::printf(
+        "доля тени %.4f (ожидается %.4f), темных областей %d\n", fraction,
+        expected, regions
+    );
+    if (std::fabs(fraction - expected) > 0.01 || regions != 1) {
+        ++failed;
+    }
+
+    // Центр колонны вне комнаты
+    if (illumination.getCell(255, 255) != Illumination::outside) {
+        std::printf("центр колонны отмечен как часть комнаты\n");
+        ++failed;
+    }
+
+    bool rejected = false;
+    try {
+        illumination.start(&room, Vector2{300, 300}, 0);
+    } catch (const Illumination::OutsideRoom &) {
+        rejected = true;
+    }
+    std::printf(
+        "источник внутри колонны %s\n", rejected ? "отклонен" : "принят"
+    );
+    if (!rejected) {
+        ++failed;
+    }
+
+    return failed;
+}
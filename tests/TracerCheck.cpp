@@ -0,0 +1,245 @@
+// Проверка быстрых путей трассировщика (бинарного поиска в выпуклой
+// комнате, обхода триангуляции и иерархий габаритов) по полному перебору
+// стен. В редакторе комната содержит не больше Room::maximumPoints точек,
+// и быстрые пути включаются только у замкнутой комнаты из девяти стен,
+// поэтому здесь строятся комнаты из десятков стен и сотен препятствий.
+// Лучи и комнаты задаются генератором с постоянным зерном, результат
+// воспроизводим. Затем проверяется, что диффузная стена рассеивает один и
+// тот же падающий луч по закону Ламберта, а зеркальная отражает его в одном
+// направлении. Код возврата --- число непройденных проверок
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "raylib.h"
+
+#include "Room.h"
+#include "Tracer.h"
+
+using std::vector;
+
+const int Room::minimalDistance = 1;
+const int Room::maximumPoints = 1000;
+const int Room::minimumPoints = 4;
+const int Room::maximumRayDepth = 10;
+
+static const int launches = 2000; // Лучей на комнату
+static const int bounces = 40;    // Отражений каждого луча
+
+// Многоугольник из count вершин вокруг (400, 400): у звезды вершины
+// чередуются на двух радиусах. Каждая третья стена звезды с arcs ---
+// дуга, выгнутая попеременно наружу и внутрь
+static void polygon(Room &room, int count, bool star, bool arcs) {
+    for (int i = 0; i <= count; ++i) {
+        float angle = 2 * PI * (i % count) / count;
+        float radius = star && i % 2 ? 250 : 350;
+        Vector2 point = {
+            400 + radius * std::cos(angle), 400 + radius * std::sin(angle)
+        };
+        if (arcs && i > 0 && i % 3 == 0) {
+            room.addWallRound(point, 0.1f, i % 6 == 0);
+        } else {
+            room.addWallLine(point);
+        }
+    }
+}
+
+// Квадратные препятствия и отдельные зеркала в узлах сетки внутри комнаты
+static void obstacles(Room &room, int rows) {
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < rows; ++column) {
+            float x = 200 + 400.0f * column / rows;
+            float y = 200 + 400.0f * row / rows;
+            if ((row + column) % 2) {
+                room.addObstacle({{x, y}, {x + 8, y + 5}}, false);
+            } else {
+                room.addObstacle(
+                    {{x, y}, {x + 6, y}, {x + 6, y + 6}, {x, y + 6}}, true
+                );
+            }
+        }
+    }
+}
+
+// Лежит ли точка point ближе tolerance к концу стены wall. Точка берется на
+// луче, а не спроецированной на стену, иначе неверно найденная стена
+// проецировала бы ее в свою вершину
+template <typename T>
+static bool nearVertex(
+    const Tracer<T> &tracer, int wall, const Vec2<T> &point, T tolerance
+) {
+    Vec2<T> start(tracer.getWall(wall)->getStart()->getCoord());
+    Vec2<T> end(tracer.getWall(wall)->getEnd()->getCoord());
+    return length(point - start) < tolerance || length(point - end) < tolerance;
+}
+
+// Число лучей, у которых trace() и traceScan() нашли разные стены. Луч,
+// прошедший у самой вершины, может попасть в любую из стен около нее (у
+// float --- в пределах десятых долей пикселя), и такие попадания
+// расхождением не считаются
+template <typename T>
+static int check(Room &room, std::mt19937 &generator, long &total) {
+    Tracer<T> tracer(&room);
+    std::uniform_real_distribution<double> unit(0, 1);
+    const T tolerance = std::is_same<T, float>::value ? 0.1 : 1e-4;
+    int mismatches = 0;
+
+    for (int launch = 0; launch < launches; ++launch) {
+        // Луч начинается внутри комнаты не на стене, а дальше отражается от
+        // стен только внутрь
+        double radius = 200 * std::sqrt(unit(generator));
+        double angle = 2 * PI * unit(generator);
+        Vec2<T> origin(
+            400 + radius * std::cos(angle), 400 + radius * std::sin(angle)
+        );
+        angle = 2 * PI * unit(generator);
+        Vec2<T> dir(std::cos(angle), std::sin(angle));
+        int fromWall = -1;
+
+        for (int bounce = 0; bounce < bounces; ++bounce) {
+            typename Tracer<T>::Hit hit, expected;
+            bool found = tracer.trace(origin, dir, fromWall, hit);
+            bool scanned = tracer.traceScan(origin, dir, fromWall, expected);
+            ++total;
+            if (found != scanned ||
+                (found && hit.wall != expected.wall &&
+                 !nearVertex(
+                     tracer, hit.wall, origin + dir * hit.distance, tolerance
+                 ) &&
+                 !nearVertex(
+                     tracer, expected.wall, origin + dir * expected.distance,
+                     tolerance
+                 ))) {
+                ++mismatches;
+                break;
+            }
+            if (!found || hit.aim) {
+                break;
+            }
+            dir = tracer.reflect(hit, dir);
+            origin = hit.point;
+            fromWall = hit.wall;
+        }
+    }
+    return mismatches;
+}
+
+// Рассеяние одного луча стеной вида surface: samples раз вызывается scatter
+// со случайным v. Рассеянный луч должен уходить внутрь квадратной комнаты и
+// снова попадать в стену, у диффузной стены синус угла к нормали
+// распределен равномерно (доля лучей в каждой из bins полос синуса
+// отличается от 1 / bins не больше чем на 10%), у зеркальной все лучи
+// совпадают. Возвращает число различных полос синуса или -1 при ошибке
+static int spread(Wall::Surface surface, std::mt19937 &generator) {
+    const int samples = 20000;
+    const int bins = 8;
+    Room room;
+    for (Vector2 point : vector<Vector2>{
+             {200, 200}, {600, 200}, {600, 600}, {200, 600}, {200, 200}
+         }) {
+        room.addWallLine(point);
+    }
+    room.getWalls()[0]->setSurface(surface);
+    Tracer<double> tracer(&room);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    Vec2<double> origin(400, 400);
+    Vec2<double> incoming = normalize(Vec2<double>(0.3, -1));
+    Tracer<double>::Hit hit, next;
+    if (!tracer.trace(origin, incoming, -1, hit) || hit.wall != 0) {
+        return -1;
+    }
+    Vec2<double> normal = tracer.getNormal(hit.wall, hit.point);
+    if (dot(normal, incoming) > 0) {
+        normal = -normal;
+    }
+
+    vector<int> counts(bins, 0);
+    for (int i = 0; i < samples; ++i) {
+        Vec2<double> dir = incoming;
+        double energy = 1;
+        if (!tracer.scatter(hit, dir, 0.5, unit(generator), energy) ||
+            std::fabs(length(dir) - 1) > 1e-9 || dot(dir, normal) <= 0 ||
+            !tracer.trace(hit.point, dir, hit.wall, next)) {
+            return -1;
+        }
+        double sine = cross(normal, dir);
+        ++counts[std::min(bins - 1, (int)((sine + 1) / 2 * bins))];
+    }
+
+    int used = 0;
+    for (int count : counts) {
+        if (count > 0) {
+            ++used;
+        }
+        if (surface == Wall::SURFACE_DIFFUSE &&
+            std::abs(count - samples / bins) > samples / bins / 10) {
+            return -1;
+        }
+    }
+    return used;
+}
+
+int main() {
+    std::mt19937 generator(2024);
+    int failed = 0;
+
+    for (int kind = 0; kind < 5; ++kind) {
+        Room room;
+        const char *name;
+        if (kind == 0) {
+            name = "выпуклый 48-угольник";
+            polygon(room, 48, false, false);
+        } else if (kind == 1) {
+            name = "звезда из 48 стен";
+            polygon(room, 48, true, false);
+        } else if (kind == 2) {
+            name = "звезда из 48 стен с дугами";
+            polygon(room, 48, true, true);
+        } else if (kind == 3) {
+            name = "незамкнутая ломаная из 47 стен";
+            for (int i = 0; i < 48; ++i) {
+                float angle = 1.9f * PI * i / 47;
+                float radius = i % 2 ? 250 : 350;
+                room.addWallLine(Vector2{
+                    400 + radius * std::cos(angle),
+                    400 + radius * std::sin(angle)
+                });
+            }
+        } else {
+            name = "48-угольник с 400 препятствиями";
+            polygon(room, 48, false, false);
+            obstacles(room, 20);
+        }
+
+        long totalFloat = 0, totalDouble = 0;
+        int mismatches = check<float>(room, generator, totalFloat) +
+                         check<double>(room, generator, totalDouble);
+        std::printf(
+            "%s: %ld отражений, лучей с расхождениями: %d\n", name,
+            totalFloat + totalDouble, mismatches
+        );
+        if (mismatches > 0) {
+            ++failed;
+        }
+    }
+
+    int diffuseBins = spread(Wall::SURFACE_DIFFUSE, generator);
+    int mirrorBins = spread(Wall::SURFACE_MIRROR, generator);
+    std::printf(
+        "рассеяние луча: полос синуса у диффузной стены %d из 8, у "
+        "зеркальной %d\n",
+        diffuseBins, mirrorBins
+    );
+    if (diffuseBins != 8) {
+        ++failed;
+    }
+    if (mirrorBins != 1) {
+        ++failed;
+    }
+    return failed;
+}